@@ -0,0 +1,147 @@
+#include "Batch_Fit.h"
+
+// Everything needed to build one network of the batch
+struct Network_Spec {
+  std::string                                      graph;
+  std::vector<std::pair<std::string, std::string>> nodes; // id, type
+  std::set<std::string>                            seen_nodes;
+  std::vector<int>                                 edges; // Index into batch edge list
+
+  void add_node(const std::string& id, const std::string& type)
+  {
+    if (seen_nodes.insert(id).second) {
+      nodes.emplace_back(id, type);
+    }
+  }
+};
+
+NetworkFits fit_network_batch(const std::vector<std::string>& edge_graphs,
+                              const std::vector<std::string>& edges_from,
+                              const std::vector<std::string>& edges_to,
+                              const std::vector<std::string>& node_graphs,
+                              const std::vector<std::string>& node_ids,
+                              const std::vector<std::string>& node_types,
+                              const std::string&              default_node_type,
+                              const int&                      desired_num_blocks,
+                              const int&                      num_mcmc_steps,
+                              const int&                      num_final_sweeps,
+                              const int&                      num_checks_per_block,
+                              const double&                   sigma,
+                              const double&                   eps,
+                              const int&                      seed,
+                              const int&                      num_threads)
+{
+  PROFILE_FUNCTION(model);
+  const int num_edges = edge_graphs.size();
+  const int num_nodes = node_graphs.size();
+
+  if (int(edges_from.size()) != num_edges || int(edges_to.size()) != num_edges) {
+    LOGIC_ERROR("Edge graph ids, from ids, and to ids must all be the same length.");
+  }
+  if (int(node_ids.size()) != num_nodes || int(node_types.size()) != num_nodes) {
+    LOGIC_ERROR("Node graph ids, node ids, and node types must all be the same length.");
+  }
+
+  // Split the batch up into its networks, keeping order of first appearance
+  std::vector<Network_Spec>  networks;
+  std::map<std::string, int> graph_to_index;
+  auto                       get_network = [&](const std::string& graph) -> Network_Spec& {
+    const auto graph_it = graph_to_index.find(graph);
+    if (graph_it != graph_to_index.end()) {
+      return networks[graph_it->second];
+    }
+    graph_to_index.emplace(graph, networks.size());
+    networks.emplace_back();
+    networks.back().graph = graph;
+    return networks.back();
+  };
+
+  // Networks are ordered by first appearance in the edge list
+  for (const auto& graph : edge_graphs) {
+    get_network(graph);
+  }
+
+  // Explicitly typed nodes go in first so they win over the default type
+  for (int i = 0; i < num_nodes; i++) {
+    get_network(node_graphs[i]).add_node(node_ids[i], node_types[i]);
+  }
+
+  for (int i = 0; i < num_edges; i++) {
+    Network_Spec& network = get_network(edge_graphs[i]);
+    network.add_node(edges_from[i], default_node_type);
+    network.add_node(edges_to[i], default_node_type);
+    network.edges.push_back(i);
+  }
+
+  const int num_networks = networks.size();
+
+  // Draw every network's seed up front so results don't depend on which thread
+  // picks up which network
+  Sampler          seed_sampler(seed);
+  std::vector<int> network_seeds;
+  network_seeds.reserve(num_networks);
+  for (int i = 0; i < num_networks; i++) {
+    network_seeds.push_back(seed_sampler.generator());
+  }
+
+  // Start the biggest networks first so one large straggler doesn't hold up
+  // the end of the batch
+  std::vector<int> fit_order(num_networks);
+  for (int i = 0; i < num_networks; i++) {
+    fit_order[i] = i;
+  }
+  std::stable_sort(fit_order.begin(), fit_order.end(), [&](const int a, const int b) {
+    return networks[a].edges.size() > networks[b].edges.size();
+  });
+
+  NetworkFits fits(num_networks);
+
+  parallel_for(num_networks, num_threads, [&](const int task) {
+    const int           i       = fit_order[task];
+    const Network_Spec& network = networks[i];
+    Network_Fit&        fit     = fits[i];
+
+    try {
+      SBM model(network_seeds[i]);
+
+      for (const auto& node : network.nodes) {
+        model.add_node(node.first, node.second);
+      }
+      for (const int& edge : network.edges) {
+        model.add_edge(edges_from[edge], edges_to[edge]);
+      }
+
+      model.collapse_blocks(0,
+                            num_mcmc_steps,
+                            desired_num_blocks,
+                            num_checks_per_block,
+                            sigma,
+                            eps,
+                            false);
+
+      if (num_final_sweeps > 0) {
+        model.mcmc_sweep(0, num_final_sweeps, eps, false, false);
+      }
+
+      const LevelPtr data_nodes = model.get_level(0);
+
+      fit.graph      = network.graph;
+      fit.num_nodes  = data_nodes->size();
+      fit.num_edges  = network.edges.size();
+      fit.num_blocks = model.get_level(1)->size();
+      fit.entropy    = model.get_entropy(0);
+      fit.node_ids.reserve(fit.num_nodes);
+      fit.blocks.reserve(fit.num_nodes);
+
+      for (const auto& node : *data_nodes) {
+        fit.node_ids.push_back(node.first);
+        fit.blocks.push_back(node.second->parent->id);
+      }
+    }
+    catch (const std::exception& error) {
+      LOGIC_ERROR("Failed to fit graph " + network.graph + ": " + error.what());
+    }
+  });
+
+  return fits;
+}
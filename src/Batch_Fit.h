@@ -0,0 +1,42 @@
+#ifndef __BATCH_FIT_INCLUDED__
+#define __BATCH_FIT_INCLUDED__
+// Fits many small, unrelated networks in a single call. Every network gets its
+// own short-lived model so nothing but the compact results outlives its fit.
+
+#include "SBM.h"
+
+struct Network_Fit {
+  std::string              graph;          // Id of the network
+  int                      num_nodes  = 0; // Number of data nodes in network
+  int                      num_edges  = 0; // Number of edges in network
+  int                      num_blocks = 0; // Number of blocks in final partition
+  double                   entropy    = 0; // Exact entropy of final partition
+  std::vector<std::string> node_ids;       // Data node ids ...
+  std::vector<std::string> blocks;         // ... and the block they ended up in
+};
+
+using NetworkFits = std::vector<Network_Fit>;
+
+// Networks are given as one long edge list with a graph id per edge. Nodes
+// (and their types) can optionally be given the same way, any node only seen
+// in the edges gets default_node_type. Each network is collapsed down to
+// desired_num_blocks with collapse_blocks, then optionally run for
+// num_final_sweeps MCMC sweeps. Networks are fit largest first across
+// num_threads threads and results come back in order of first appearance.
+NetworkFits fit_network_batch(const std::vector<std::string>& edge_graphs,
+                              const std::vector<std::string>& edges_from,
+                              const std::vector<std::string>& edges_to,
+                              const std::vector<std::string>& node_graphs,
+                              const std::vector<std::string>& node_ids,
+                              const std::vector<std::string>& node_types,
+                              const std::string&              default_node_type,
+                              const int&                      desired_num_blocks,
+                              const int&                      num_mcmc_steps,
+                              const int&                      num_final_sweeps,
+                              const int&                      num_checks_per_block,
+                              const double&                   sigma,
+                              const double&                   eps,
+                              const int&                      seed,
+                              const int&                      num_threads = 1);
+
+#endif
@@ -2,6 +2,7 @@
 
 void Block_Consensus::initialize(const LevelPtr& node_map)
 {
+  PROFILE_FUNCTION(consensus);
 
   for (auto node_a_it = node_map->begin();
        node_a_it != node_map->end();
@@ -21,6 +22,8 @@ void Block_Consensus::initialize(const LevelPtr& node_map)
 
 void Block_Consensus::update_pair_tracking_map(const PairSet& updated_pairs)
 {
+  PROFILE_FUNCTION(consensus);
+
   for (auto& pair : concensus_pairs) {
 
     // Check if this pair was updated on last sweep
@@ -44,6 +47,8 @@ void Block_Consensus::update_changed_pairs(const std::string& node_id,
                                            const NodeSet&     new_connections,
                                            PairSet&           pair_moves)
 {
+  PROFILE_FUNCTION(consensus);
+
   // Loop through all the nodes in the previous group node changes
   for (const auto& lost_pair : old_connections) {
     pair_moves.insert(make_pair_key(node_id, lost_pair->id));
@@ -2,6 +2,7 @@
 #define __BLOCK_CONSENSUS_INCLUDED__
 
 #include "Node.h"
+#include "memory_accounting.h"
 
 struct Pair_Status {
   bool connected;
@@ -18,6 +19,16 @@ class Block_Consensus {
   // Holds the pairs of nodes to connection status and counts
   std::map<std::string, Pair_Status> concensus_pairs;
 
+  // Bytes held by the pair map, including the pair key strings
+  std::size_t memory_bytes() const
+  {
+    std::size_t bytes = sizeof(Block_Consensus);
+    for (const auto& pair : concensus_pairs) {
+      bytes += sizeof(pair) + TREE_NODE_OVERHEAD + string_heap_bytes(pair.first);
+    }
+    return bytes;
+  }
+
   // Initialies containers when needed
   void initialize(const LevelPtr& node_map);
 
@@ -0,0 +1,181 @@
+#include "Fit_Job.h"
+
+Fit_Job::Fit_Job(SBM&& job_model, const int& num_steps)
+    : model(std::move(job_model))
+    , control(std::make_shared<Fit_Control>())
+    , start_time(std::chrono::steady_clock::now())
+    , num_steps(num_steps)
+    , sweeps(num_steps)
+{
+  model.fit_control = control;
+}
+
+Fit_Job::~Fit_Job()
+{
+  cancel();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+template <typename Work>
+void Fit_Job::launch(const Work& work)
+{
+  worker = std::thread([this, work]() {
+    // Errors need to come back as plain exceptions, not R ones
+    Worker_Scope worker_scope;
+
+    Job_Status  end_status = Job_Status::finished;
+    std::string end_error;
+    try {
+      work();
+      if (control->stop_requested) {
+        end_status = Job_Status::cancelled;
+      }
+    }
+    catch (const std::exception& e) {
+      end_status = Job_Status::failed;
+      end_error  = e.what();
+    }
+    catch (...) {
+      end_status = Job_Status::failed;
+      end_error  = "Unknown error";
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    status   = end_status;
+    error    = end_error;
+    end_time = std::chrono::steady_clock::now();
+  });
+}
+
+std::shared_ptr<Fit_Job> Fit_Job::start_sweeps(const SBM&    model,
+                                               const int&    level,
+                                               const int&    num_sweeps,
+                                               const double& eps,
+                                               const bool&   variable_num_blocks,
+                                               const bool&   track_pairs,
+                                               const int&    seed)
+{
+  std::shared_ptr<Fit_Job> job(new Fit_Job(model.clone(seed), num_sweeps));
+  Fit_Job*                 self = job.get();
+
+  job->launch([self, level, num_sweeps, eps, variable_num_blocks, track_pairs]() {
+    const std::vector<std::string> node_ids = self->model.get_sweep_node_ids(level);
+
+    // Gathered the same way mcmc_sweep() gathers them but a sweep at a time
+    // so progress can be checked on as it goes
+    const auto add_sweep = [self, &node_ids](const Sweep_Record& record) {
+      self->sweeps.sweep_entropy_delta.push_back(record.entropy_delta);
+      self->sweeps.sweep_num_nodes_moved.push_back(record.nodes_moved.size());
+      for (const int& node_index : record.nodes_moved) {
+        self->sweeps.nodes_moved.push_back(node_ids[node_index]);
+      }
+
+      std::lock_guard<std::mutex> guard(self->lock);
+      self->trace.push_back(record.entropy_delta);
+      return true;
+    };
+
+    self->model.mcmc_sweep_stream(level,
+                                  num_sweeps,
+                                  eps,
+                                  variable_num_blocks,
+                                  add_sweep,
+                                  0,
+                                  track_pairs ? &self->sweeps.block_consensus : nullptr);
+  });
+
+  return job;
+}
+
+std::shared_ptr<Fit_Job> Fit_Job::start_collapse_run(const SBM&              model,
+                                                     const int&              node_level,
+                                                     const int&              num_mcmc_steps,
+                                                     const int&              num_checks_per_block,
+                                                     const double&           sigma,
+                                                     const double&           eps,
+                                                     const std::vector<int>& block_nums,
+                                                     const int&              seed)
+{
+  std::shared_ptr<Fit_Job> job(new Fit_Job(model.clone(seed), block_nums.size()));
+  Fit_Job*                 self = job.get();
+
+  job->launch([self, node_level, num_mcmc_steps, num_checks_per_block, sigma, eps, block_nums]() {
+    // Same as collapse_run() but reporting each target as it's reached
+    for (const int& target_num : block_nums) {
+      Merge_Step step = self->model.collapse_blocks(node_level,
+                                                    num_mcmc_steps,
+                                                    target_num,
+                                                    num_checks_per_block,
+                                                    sigma,
+                                                    eps,
+                                                    false)[0];
+
+      // A target cut short by cancelling isn't a result
+      if (self->model.stop_requested()) {
+        break;
+      }
+
+      step.entropy = self->model.get_entropy(node_level);
+      self->collapse_steps.push_back(step);
+      std::lock_guard<std::mutex> guard(self->lock);
+      self->trace.push_back(step.entropy);
+    }
+    self->model.keep_best_collapse(self->collapse_steps);
+  });
+
+  return job;
+}
+
+Job_Progress Fit_Job::progress(const int& first_step) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  const auto elapsed_to = status == Job_Status::running ? std::chrono::steady_clock::now() : end_time;
+  const int  first      = std::min(std::max(first_step, 0), int(trace.size()));
+
+  Job_Progress snapshot;
+  snapshot.status     = status;
+  snapshot.steps_done = trace.size();
+  snapshot.num_steps  = num_steps;
+  snapshot.num_blocks = control->num_blocks;
+  snapshot.seconds    = std::chrono::duration<double>(elapsed_to - start_time).count();
+  snapshot.trace.assign(trace.begin() + first, trace.end());
+  snapshot.error = error;
+  return snapshot;
+}
+
+bool Fit_Job::done() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return status != Job_Status::running;
+}
+
+void Fit_Job::wait()
+{
+  if (worker.joinable()) {
+    worker.join();
+  }
+  if (status == Job_Status::failed) {
+    LOGIC_ERROR("Fit job failed: " + error);
+  }
+}
+
+const MCMC_Sweeps& Fit_Job::sweep_results()
+{
+  wait();
+  return sweeps;
+}
+
+const CollapseResults& Fit_Job::collapse_results()
+{
+  wait();
+  return collapse_steps;
+}
+
+State_Dump Fit_Job::final_state()
+{
+  wait();
+  return model.get_state();
+}
@@ -0,0 +1,101 @@
+#ifndef __FIT_JOB_INCLUDED__
+#define __FIT_JOB_INCLUDED__
+// Runs long fits on a background thread so the caller can carry on, check in
+// on progress, or stop them early. Each job works on its own copy of the model
+// so the original can be used (or other jobs started from it) while it runs.
+
+#include "SBM.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+enum class Job_Status {
+  running,
+  finished,  // Ran to completion
+  cancelled, // Stopped early on request. Results cover the work done.
+  failed     // Threw an error, see Job_Progress::error
+};
+
+struct Job_Progress {
+  Job_Status          status;
+  int                 steps_done;  // Sweeps or collapse targets finished
+  int                 num_steps;   // Sweeps or collapse targets asked for
+  int                 num_blocks;  // Blocks left after the latest merge step (collapse jobs)
+  double              seconds;     // Time since the job started
+  std::vector<double> trace;       // Entropy change of each sweep or final entropy of each collapse target, from first_step
+  std::string         error;
+};
+
+class Fit_Job {
+  public:
+  // Run mcmc_sweep() on a copy of model
+  static std::shared_ptr<Fit_Job> start_sweeps(const SBM&    model,
+                                               const int&    level,
+                                               const int&    num_sweeps,
+                                               const double& eps,
+                                               const bool&   variable_num_blocks,
+                                               const bool&   track_pairs,
+                                               const int&    seed);
+
+  // Run collapse_run() on a copy of model
+  static std::shared_ptr<Fit_Job> start_collapse_run(const SBM&              model,
+                                                     const int&              node_level,
+                                                     const int&              num_mcmc_steps,
+                                                     const int&              num_checks_per_block,
+                                                     const double&           sigma,
+                                                     const double&           eps,
+                                                     const std::vector<int>& block_nums,
+                                                     const int&              seed);
+
+  // Stops the job and waits for it
+  ~Fit_Job();
+
+  Fit_Job(const Fit_Job&) = delete;
+  Fit_Job& operator=(const Fit_Job&) = delete;
+
+  // Snapshot of how the job is going. Only trace entries from first_step on
+  // are returned so pollers can just pick up what's new.
+  Job_Progress progress(const int& first_step = 0) const;
+
+  bool done() const;
+
+  // Ask the job to stop at its next sweep or merge step
+  void cancel() { control->stop_requested = true; }
+
+  // Wait for the job to stop. Rethrows the job's error if it failed.
+  void wait();
+
+  // Results of a finished (or cancelled) job, and the state it left the model
+  // in. Both wait for the job first.
+  const MCMC_Sweeps&     sweep_results();
+  const CollapseResults& collapse_results();
+  State_Dump             final_state();
+
+  private:
+  explicit Fit_Job(SBM&& job_model, const int& num_steps);
+
+  // Runs work on the job's thread, catching anything it throws
+  template <typename Work>
+  void launch(const Work& work);
+
+  SBM                                   model;
+  std::shared_ptr<Fit_Control>          control;
+  std::chrono::steady_clock::time_point start_time;
+  std::chrono::steady_clock::time_point end_time;
+  std::thread                           worker;
+
+  // Shared with the job's thread
+  mutable std::mutex  lock;
+  Job_Status          status = Job_Status::running;
+  int                 num_steps;
+  std::vector<double> trace;
+  std::string         error;
+
+  // Only touched by the job's thread until it finishes
+  MCMC_Sweeps     sweeps;
+  CollapseResults collapse_steps;
+};
+
+#endif
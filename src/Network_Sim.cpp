@@ -0,0 +1,411 @@
+#include "Network_Sim.h"
+#include "profiling/Instrument.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+// =============================================================================
+// Build the alias table. Every slot holds the chance of keeping its own index
+// and the index to use otherwise.
+// =============================================================================
+Alias_Sampler::Alias_Sampler(const std::vector<double>& weights)
+    : probs(weights.size(), 1.0)
+    , aliases(weights.size())
+{
+  const int n = weights.size();
+  if (n == 0) {
+    LOGIC_ERROR("Can't sample from an empty set of weights.");
+  }
+
+  double total = 0;
+  for (const double& weight : weights) {
+    if (weight < 0) {
+      LOGIC_ERROR("Sampling weights can't be negative.");
+    }
+    total += weight;
+  }
+  if (total <= 0) {
+    LOGIC_ERROR("Sampling weights need to have a positive sum.");
+  }
+
+  // Scale so the average slot is 1 and split into slots that are under and over
+  std::vector<int> small, large;
+  for (int i = 0; i < n; i++) {
+    aliases[i] = i;
+    probs[i]   = weights[i] * n / total;
+    (probs[i] < 1 ? small : large).push_back(i);
+  }
+
+  // Top up each under-full slot from an over-full one
+  while (!small.empty() && !large.empty()) {
+    const int under = small.back();
+    const int over  = large.back();
+    small.pop_back();
+
+    aliases[under] = over;
+    probs[over] -= 1 - probs[under];
+
+    if (probs[over] < 1) {
+      large.pop_back();
+      small.push_back(over);
+    }
+  }
+
+  // Anything left over is full up to rounding error
+  for (const int& i : small) probs[i] = 1;
+  for (const int& i : large) probs[i] = 1;
+}
+
+int Alias_Sampler::draw(std::mt19937& generator) const
+{
+  std::uniform_int_distribution<int> slot_dist(0, probs.size() - 1);
+  std::uniform_real_distribution<>   unif(0.0, 1.0);
+
+  const int slot = slot_dist(generator);
+  return unif(generator) < probs[slot] ? slot : aliases[slot];
+}
+
+// =============================================================================
+// Equal sized planted blocks. Within block edges are shared evenly between the
+// blocks and between block edges evenly between every pair of blocks.
+// =============================================================================
+Sim_Spec planted_partition_spec(const int&    num_nodes,
+                                const int&    num_blocks,
+                                const double& mean_degree,
+                                const double& within_block_frac,
+                                const double& degree_exponent,
+                                const int&    seed)
+{
+  if (num_blocks < 1 || num_nodes < num_blocks) {
+    LOGIC_ERROR("Need at least one block and at least as many nodes as blocks.");
+  }
+  if (within_block_frac < 0 || within_block_frac > 1) {
+    LOGIC_ERROR("Share of edges within blocks needs to be between 0 and 1.");
+  }
+  if (degree_exponent != 0 && degree_exponent <= 1) {
+    LOGIC_ERROR("Degree exponent needs to be above 1, or 0 for equal weights.");
+  }
+
+  Sim_Spec spec;
+
+  spec.node_blocks.reserve(num_nodes);
+  for (int i = 0; i < num_nodes; i++) {
+    spec.node_blocks.push_back(i % num_blocks);
+  }
+
+  if (degree_exponent > 0) {
+    std::mt19937                     generator(seed);
+    std::uniform_real_distribution<> unif(0.0, 1.0);
+    spec.node_weights.reserve(num_nodes);
+    for (int i = 0; i < num_nodes; i++) {
+      spec.node_weights.push_back(std::pow(1.0 - unif(generator), -1.0 / (degree_exponent - 1)));
+    }
+  }
+
+  const double num_edges     = num_nodes * mean_degree / 2;
+  const int    num_off_pairs = num_blocks * (num_blocks - 1) / 2;
+  const double within_edges  = num_off_pairs > 0 ? num_edges * within_block_frac : num_edges;
+
+  for (int a = 0; a < num_blocks; a++) {
+    spec.block_pairs.emplace_back(a, a, within_edges / num_blocks);
+    for (int b = a + 1; b < num_blocks; b++) {
+      spec.block_pairs.emplace_back(a, b, (num_edges - within_edges) / num_off_pairs);
+    }
+  }
+
+  return spec;
+}
+
+// =============================================================================
+// Draw the edges of every block pair, placing their ends by node weight
+// =============================================================================
+Sim_Network simulate_network(const Sim_Spec& spec, const int& seed)
+{
+  PROFILE_FUNCTION(model);
+  const int num_nodes = spec.node_blocks.size();
+
+  if (!spec.node_weights.empty() && int(spec.node_weights.size()) != num_nodes) {
+    LOGIC_ERROR("Need a weight for every node or none at all.");
+  }
+  if (!spec.node_ids.empty() && int(spec.node_ids.size()) != num_nodes) {
+    LOGIC_ERROR("Need an id for every node or none at all.");
+  }
+  if (!spec.node_types.empty() && int(spec.node_types.size()) != num_nodes) {
+    LOGIC_ERROR("Need a type for every node or none at all.");
+  }
+
+  Sim_Network network;
+  network.node_blocks = spec.node_blocks;
+  network.node_ids    = spec.node_ids;
+  network.node_types  = spec.node_types;
+  if (network.node_ids.empty()) {
+    network.node_ids.reserve(num_nodes);
+    for (int i = 0; i < num_nodes; i++) {
+      network.node_ids.push_back("n" + std::to_string(i));
+    }
+  }
+  if (network.node_types.empty()) {
+    network.node_types.assign(num_nodes, "a");
+  }
+
+  // Gather the members of every block and a sampler over their weights
+  std::vector<std::vector<int>> block_members;
+  for (int i = 0; i < num_nodes; i++) {
+    const int block = spec.node_blocks[i];
+    if (block < 0) {
+      LOGIC_ERROR("Block indices can't be negative.");
+    }
+    if (block >= int(block_members.size())) block_members.resize(block + 1);
+    block_members[block].push_back(i);
+  }
+
+  // Also count how many members of each block can be drawn at all
+  std::vector<Alias_Sampler> block_samplers;
+  std::vector<int>           num_drawable(block_members.size(), 0);
+  block_samplers.reserve(block_members.size());
+  for (std::size_t block = 0; block < block_members.size(); block++) {
+    const auto&         members = block_members[block];
+    std::vector<double> member_weights;
+    member_weights.reserve(members.size());
+    for (const int& member : members) {
+      member_weights.push_back(spec.node_weights.empty() ? 1.0 : spec.node_weights[member]);
+      if (member_weights.back() > 0) num_drawable[block]++;
+    }
+
+    // Blocks of unconnected nodes have no weight so fall back to equal weights.
+    // Empty blocks get a placeholder that is never drawn from.
+    if (num_drawable[block] == 0) {
+      member_weights.assign(members.size(), 1.0);
+      num_drawable[block] = members.size();
+    }
+    block_samplers.emplace_back(members.empty() ? std::vector<double> { 1.0 } : member_weights);
+  }
+
+  std::mt19937 generator(seed);
+
+  // Reserve for the expected total up front so the edge vectors grow once
+  double expected_total = 0;
+  for (const auto& pair : spec.block_pairs) {
+    expected_total += pair.expected_edges;
+  }
+  network.edges_from.reserve(expected_total * 1.01 + 16);
+  network.edges_to.reserve(expected_total * 1.01 + 16);
+
+  const int num_blocks = block_members.size();
+  for (const auto& pair : spec.block_pairs) {
+    if (pair.block_a < 0 || pair.block_b < 0 || pair.block_a >= num_blocks || pair.block_b >= num_blocks) {
+      RANGE_ERROR("Block pair refers to a block with no nodes.");
+    }
+    if (pair.expected_edges <= 0) continue;
+
+    const auto& members_a = block_members[pair.block_a];
+    const auto& members_b = block_members[pair.block_b];
+    if (members_a.empty() || members_b.empty()) {
+      RANGE_ERROR("Block pair refers to a block with no nodes.");
+    }
+
+    // A block with a single drawable node can't hold any edges without self edges
+    const bool same_block = pair.block_a == pair.block_b;
+    if (same_block && num_drawable[pair.block_a] == 1 && !spec.allow_self_edges) continue;
+
+    long num_pair_edges = 0;
+    if (spec.exact_edge_counts) {
+      num_pair_edges = std::lround(pair.expected_edges);
+    }
+    else {
+      std::poisson_distribution<long> count_dist(pair.expected_edges);
+      num_pair_edges = count_dist(generator);
+    }
+
+    const Alias_Sampler& sampler_a = block_samplers[pair.block_a];
+    const Alias_Sampler& sampler_b = block_samplers[pair.block_b];
+
+    for (long e = 0; e < num_pair_edges; e++) {
+      const int node_a = members_a[sampler_a.draw(generator)];
+      int       node_b = members_b[sampler_b.draw(generator)];
+      while (same_block && node_b == node_a && !spec.allow_self_edges) {
+        node_b = members_b[sampler_b.draw(generator)];
+      }
+      network.edges_from.push_back(node_a);
+      network.edges_to.push_back(node_b);
+    }
+  }
+
+  return network;
+}
+
+Sim_Network simulate_block_network(const std::vector<std::string>& node_ids,
+                                   const std::vector<std::string>& node_types,
+                                   const std::vector<int>&         node_blocks,
+                                   const std::vector<double>&      node_weights,
+                                   const std::vector<int>&         pair_blocks_a,
+                                   const std::vector<int>&         pair_blocks_b,
+                                   const std::vector<double>&      pair_expected_edges,
+                                   const bool&                     exact_edge_counts,
+                                   const bool&                     allow_self_edges,
+                                   const int&                      seed)
+{
+  const int num_pairs = pair_blocks_a.size();
+  if (int(pair_blocks_b.size()) != num_pairs || int(pair_expected_edges.size()) != num_pairs) {
+    LOGIC_ERROR("Every block pair needs two blocks and an expected number of edges.");
+  }
+
+  Sim_Spec spec;
+  spec.node_ids          = node_ids;
+  spec.node_types        = node_types;
+  spec.node_blocks       = node_blocks;
+  spec.node_weights      = node_weights;
+  spec.exact_edge_counts = exact_edge_counts;
+  spec.allow_self_edges  = allow_self_edges;
+
+  spec.block_pairs.reserve(num_pairs);
+  for (int i = 0; i < num_pairs; i++) {
+    spec.block_pairs.emplace_back(pair_blocks_a[i], pair_blocks_b[i], pair_expected_edges[i]);
+  }
+
+  return simulate_network(spec, seed);
+}
+
+// =============================================================================
+// Binary edge files
+// =============================================================================
+namespace {
+const char          EDGE_FILE_MARKER[8] = { 'S', 'B', 'M', 'E', 'D', 'G', 'E', 'S' };
+const std::uint32_t EDGE_FILE_VERSION   = 1;
+const std::uint32_t EDGE_FILE_HAS_TYPES = 1; // Flag for a node type section after the blocks
+
+template <typename T>
+void write_value(std::ofstream& file, const T& value)
+{
+  file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T read_value(std::ifstream& file)
+{
+  T value;
+  file.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return value;
+}
+} // namespace
+
+void write_edge_file(const Sim_Network& network, const std::string& path)
+{
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    LOGIC_ERROR("Could not open " + path + " for writing.");
+  }
+
+  file.write(EDGE_FILE_MARKER, sizeof(EDGE_FILE_MARKER));
+  write_value<std::uint32_t>(file, EDGE_FILE_VERSION);
+  write_value<std::uint32_t>(file, EDGE_FILE_HAS_TYPES);
+  write_value<std::uint64_t>(file, network.num_nodes());
+  write_value<std::uint64_t>(file, network.num_edges());
+
+  const std::vector<std::int32_t> blocks(network.node_blocks.begin(), network.node_blocks.end());
+  file.write(reinterpret_cast<const char*>(blocks.data()), blocks.size() * sizeof(std::int32_t));
+
+  // Types are few so are written once each and referred to by number
+  std::unordered_map<std::string, std::uint32_t> type_numbers;
+  std::vector<std::string>                       types;
+  std::vector<std::uint32_t>                     node_types;
+  node_types.reserve(network.num_nodes());
+  for (int i = 0; i < network.num_nodes(); i++) {
+    const std::string& type     = network.node_types.empty() ? "a" : network.node_types[i];
+    const auto         inserted = type_numbers.emplace(type, types.size());
+    if (inserted.second) types.push_back(type);
+    node_types.push_back(inserted.first->second);
+  }
+  write_value<std::uint32_t>(file, types.size());
+  for (const auto& type : types) {
+    write_value<std::uint32_t>(file, type.size());
+    file.write(type.data(), type.size());
+  }
+  file.write(reinterpret_cast<const char*>(node_types.data()), node_types.size() * sizeof(std::uint32_t));
+
+  // Edge ends interleaved so a reader can stream edges in order
+  std::vector<std::uint32_t> ends;
+  ends.reserve(2 * network.num_edges());
+  for (int i = 0; i < network.num_edges(); i++) {
+    ends.push_back(network.edges_from[i]);
+    ends.push_back(network.edges_to[i]);
+  }
+  file.write(reinterpret_cast<const char*>(ends.data()), ends.size() * sizeof(std::uint32_t));
+
+  if (!file) {
+    LOGIC_ERROR("Failed writing edges to " + path + ".");
+  }
+}
+
+Sim_Network read_edge_file(const std::string& path)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    LOGIC_ERROR("Could not open " + path + " for reading.");
+  }
+
+  char marker[sizeof(EDGE_FILE_MARKER)];
+  file.read(marker, sizeof(marker));
+  if (!file || std::memcmp(marker, EDGE_FILE_MARKER, sizeof(marker)) != 0) {
+    LOGIC_ERROR(path + " is not an sbmR edge file.");
+  }
+  if (read_value<std::uint32_t>(file) != EDGE_FILE_VERSION) {
+    LOGIC_ERROR(path + " was written by an unsupported version.");
+  }
+  const std::uint32_t flags = read_value<std::uint32_t>(file);
+
+  const std::uint64_t num_nodes = read_value<std::uint64_t>(file);
+  const std::uint64_t num_edges = read_value<std::uint64_t>(file);
+
+  std::vector<std::int32_t> blocks(num_nodes);
+  file.read(reinterpret_cast<char*>(blocks.data()), num_nodes * sizeof(std::int32_t));
+
+  // Files from before types were kept have every node of type "a"
+  std::vector<std::string>   types { "a" };
+  std::vector<std::uint32_t> node_types(num_nodes, 0);
+  if (flags & EDGE_FILE_HAS_TYPES) {
+    types.resize(read_value<std::uint32_t>(file));
+    for (auto& type : types) {
+      type.resize(read_value<std::uint32_t>(file));
+      if (!file) break;
+      file.read(&type[0], type.size());
+    }
+    file.read(reinterpret_cast<char*>(node_types.data()), num_nodes * sizeof(std::uint32_t));
+  }
+
+  std::vector<std::uint32_t> ends(2 * num_edges);
+  file.read(reinterpret_cast<char*>(ends.data()), ends.size() * sizeof(std::uint32_t));
+
+  if (!file) {
+    LOGIC_ERROR(path + " ended early.");
+  }
+
+  Sim_Network network;
+  network.node_blocks.assign(blocks.begin(), blocks.end());
+  network.node_ids.reserve(num_nodes);
+  network.node_types.reserve(num_nodes);
+  for (std::uint64_t i = 0; i < num_nodes; i++) {
+    if (node_types[i] >= types.size()) {
+      RANGE_ERROR(path + " has a node of a type that doesn't exist.");
+    }
+    network.node_ids.push_back("n" + std::to_string(i));
+    network.node_types.push_back(types[node_types[i]]);
+  }
+
+  network.edges_from.reserve(num_edges);
+  network.edges_to.reserve(num_edges);
+  for (std::uint64_t i = 0; i < num_edges; i++) {
+    const std::uint32_t from = ends[2 * i];
+    const std::uint32_t to   = ends[2 * i + 1];
+    if (from >= num_nodes || to >= num_nodes) {
+      RANGE_ERROR(path + " has an edge to a node that doesn't exist.");
+    }
+    network.edges_from.push_back(from);
+    network.edges_to.push_back(to);
+  }
+
+  return network;
+}
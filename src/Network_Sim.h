@@ -0,0 +1,107 @@
+#ifndef __NETWORK_SIM_INCLUDED__
+#define __NETWORK_SIM_INCLUDED__
+// Samples networks from a degree-corrected stochastic block model in time
+// proportional to the number of edges drawn. Rather than visiting every pair
+// of nodes, the number of edges between each pair of blocks is drawn once and
+// each edge's ends are then placed on nodes of those blocks in proportion to
+// the nodes' weights, so networks of millions of nodes are cheap as long as
+// they're sparse.
+
+#include "Node.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+// Expected number of edges between two blocks (or within one if they match)
+struct Block_Pair_Rate {
+  int    block_a;
+  int    block_b;
+  double expected_edges;
+  Block_Pair_Rate(const int a, const int b, const double expected)
+      : block_a(a)
+      , block_b(b)
+      , expected_edges(expected)
+  {
+  }
+};
+
+// Everything needed to sample a network. Nodes are referred to by index.
+struct Sim_Spec {
+  std::vector<int>             node_blocks;  // Block of every node, from 0
+  std::vector<double>          node_weights; // Relative share of its block's edge ends each node gets. Empty means equal.
+  std::vector<Block_Pair_Rate> block_pairs;  // Pairs of blocks that can share edges
+  std::vector<std::string>     node_ids;     // Empty means nodes are named n0, n1, ...
+  std::vector<std::string>     node_types;   // Empty means every node is of type "a"
+  bool                         exact_edge_counts = false; // Place the expected counts (rounded) rather than Poisson draws
+  bool                         allow_self_edges  = false;
+};
+
+// A sampled network. Edges are given as indices into the node vectors.
+struct Sim_Network {
+  std::vector<std::string> node_ids;
+  std::vector<std::string> node_types;
+  std::vector<int>         node_blocks;
+  std::vector<int>         edges_from;
+  std::vector<int>         edges_to;
+
+  int num_nodes() const { return node_blocks.size(); }
+  int num_edges() const { return edges_from.size(); }
+};
+
+// Walker's alias method: O(1) draws from a fixed discrete distribution after
+// O(n) setup
+class Alias_Sampler {
+  public:
+  explicit Alias_Sampler(const std::vector<double>& weights);
+
+  int draw(std::mt19937& generator) const;
+
+  int size() const { return probs.size(); }
+
+  private:
+  std::vector<double> probs;
+  std::vector<int>    aliases;
+};
+
+// Equal sized blocks with a set share of edges inside blocks. Node weights
+// follow a power law with exponent degree_exponent (values around 2 to 3 give
+// the heavy tailed degrees of real networks) or are all equal if
+// degree_exponent is 0.
+Sim_Spec planted_partition_spec(const int&    num_nodes,
+                                const int&    num_blocks,
+                                const double& mean_degree,
+                                const double& within_block_frac,
+                                const double& degree_exponent,
+                                const int&    seed);
+
+// Draw a network from a spec
+Sim_Network simulate_network(const Sim_Spec& spec, const int& seed);
+
+// Draw a network from a spec given as plain vectors, as it comes from R. Block
+// pairs are given by their two blocks and expected number of edges.
+Sim_Network simulate_block_network(const std::vector<std::string>& node_ids,
+                                   const std::vector<std::string>& node_types,
+                                   const std::vector<int>&         node_blocks,
+                                   const std::vector<double>&      node_weights,
+                                   const std::vector<int>&         pair_blocks_a,
+                                   const std::vector<int>&         pair_blocks_b,
+                                   const std::vector<double>&      pair_expected_edges,
+                                   const bool&                     exact_edge_counts,
+                                   const bool&                     allow_self_edges,
+                                   const int&                      seed);
+
+// Write a sampled network to a compact binary file: an 8 byte "SBMEDGES"
+// marker, a 32 bit version and flags, 64 bit node and edge counts, the 32 bit
+// block of every node, the node types, and then the 32 bit from and to node
+// index of every edge, all in the machine's byte order. Types are a 32 bit
+// count and each type as a 32 bit length and bytes, then the 32 bit number of
+// every node's type in that list. Flag 1 marks that the types are there;
+// files written before types were kept lack it. Node ids aren't kept.
+void write_edge_file(const Sim_Network& network, const std::string& path);
+
+// Read a network written by write_edge_file(). Nodes are named n0, n1, ...
+// and are all of type "a" if the file has no types.
+Sim_Network read_edge_file(const std::string& path);
+
+#endif
@@ -1,5 +1,6 @@
 #include "Node.h"
 
+#include <algorithm>
 #include <iostream>
 
 // =============================================================================
@@ -11,11 +12,11 @@ inline NodePtr Node::this_ptr()
 }
 
 // =============================================================================
-// Add edge to another node
+// Add edge to another node, or count edges at once
 // =============================================================================
-inline void Node::add_edge(const NodePtr& node)
+inline void Node::add_edge(const NodePtr& node, const int& count)
 {
-  //PROFILE_FUNCTION();
+  //PROFILE_FUNCTION(model);
 
   // propigate new edge upwards to all parents
   NodePtr current_node  = this_ptr();
@@ -23,8 +24,8 @@ inline void Node::add_edge(const NodePtr& node)
 
   while (current_node) {
     // Add node to base edges
-    (current_node->edges).push_back(node);
-    current_node->degree++;
+    current_node->insert_edge(node, count);
+    current_node->degree += count;
     current_node = current_node->parent;
     current_level++;
   }
@@ -35,10 +36,10 @@ inline void Node::add_edge(const NodePtr& node)
 // =============================================================================
 void Node::update_edges_from_node(const NodePtr& node, const bool& remove)
 {
-  // PROFILE_FUNCTION();
+  // PROFILE_FUNCTION(model);
 
   // Grab list of nodes from node being removed or added we are updating
-  const auto changed_node_edges = node->edges;
+  const NodeVec& changed_node_edges = node->edges;
 
   // Keep track of which node in the hierarchy is being updated.
   // Starts with this node
@@ -47,26 +48,12 @@ void Node::update_edges_from_node(const NodePtr& node, const bool& remove)
   // While we still have a node to continue to in the hierarchy...
   while (node_being_updated) {
     // Loop through all the edges that are being updated...
-    // Grab reference to the current nodes edges list
-    NodeList& curr_edges = node_being_updated->edges;
-
     for (const auto& edge_to_update : changed_node_edges) {
       if (remove) {
-        // Scan through this nodes edges untill we find the first instance
-        // of the connected node we want to remove
-        auto last_place = curr_edges.end();
-        for (auto con_it = curr_edges.begin();
-             con_it != last_place;
-             con_it++) {
-          if (*con_it == edge_to_update) {
-            curr_edges.erase(con_it);
-            break;
-          }
-        }
+        node_being_updated->erase_edge(edge_to_update);
       }
       else {
-        // Just add this edge to nodes edges
-        curr_edges.push_back(edge_to_update);
+        node_being_updated->insert_edge(edge_to_update);
       }
     }
 
@@ -78,12 +65,103 @@ void Node::update_edges_from_node(const NodePtr& node, const bool& remove)
   }
 }
 
+// =============================================================================
+// Find the index of the edge segment holding neighbors of a given type. Returns
+// the number of segments if the node has no segment for the type yet. Nodes
+// only ever see a handful of types so a linear scan beats anything fancier.
+// =============================================================================
+inline int find_edge_segment(const std::vector<std::string>& edge_types,
+                             const std::string&              node_type)
+{
+  const int num_segments = edge_types.size();
+  for (int i = 0; i < num_segments; i++) {
+    if (edge_types[i] == node_type) return i;
+  }
+  return num_segments;
+}
+
+// =============================================================================
+// Place copies of a neighbor at the end of its type's segment of the edges
+// vector. A new type gets a new segment at the back. Room is made by moving the
+// first few neighbors of every later segment to that segment's end, so the cost
+// depends on the number of types rather than the node's degree.
+// =============================================================================
+void Node::insert_edge(const NodePtr& node, const int& count)
+{
+  const int segment = find_edge_segment(edge_types, node->type);
+
+  if (segment == int(edge_types.size())) {
+    edge_types.push_back(node->type);
+    edge_type_ends.push_back(edges.size());
+  }
+
+  edges.resize(edges.size() + count);
+
+  // Shift later segments along by count, back to front, into the free space
+  for (int later = edge_type_ends.size() - 1; later > segment; later--) {
+    const auto segment_start = edges.begin() + edge_type_ends[later - 1];
+    const auto segment_end   = edges.begin() + edge_type_ends[later];
+
+    if (segment_end - segment_start >= count) {
+      std::move(segment_start, segment_start + count, segment_end);
+    }
+    else {
+      std::move_backward(segment_start, segment_end, segment_end + count);
+    }
+    edge_type_ends[later] += count;
+  }
+
+  const auto insert_at = edges.begin() + edge_type_ends[segment];
+  std::fill(insert_at, insert_at + count, node);
+  edge_type_ends[segment] += count;
+}
+
+// =============================================================================
+// Remove the first instance of a neighbor from the edges vector. Only the
+// neighbor's type segment is scanned. The gap is filled from the end of the
+// segment, and that gap from the end of the next, so nothing is shifted.
+// =============================================================================
+void Node::erase_edge(const NodePtr& node)
+{
+  const int segment = find_edge_segment(edge_types, node->type);
+  if (segment == int(edge_types.size())) return;
+
+  const auto segment_start = edges.begin() + (segment == 0 ? 0 : edge_type_ends[segment - 1]);
+  const auto segment_end   = edges.begin() + edge_type_ends[segment];
+  auto       gap           = std::find(segment_start, segment_end, node);
+  if (gap == segment_end) return;
+
+  const int num_segments = edge_types.size();
+  for (int later = segment; later < num_segments; later++) {
+    const auto last_in_segment = edges.begin() + (--edge_type_ends[later]);
+    if (gap != last_in_segment) {
+      *gap = std::move(*last_in_segment);
+    }
+    gap = last_in_segment;
+  }
+
+  edges.pop_back();
+}
+
+// =============================================================================
+// Range of the edges vector holding neighbors of a given type. Empty if the
+// node has no neighbors of that type.
+// =============================================================================
+EdgeRange Node::edges_of_type(const std::string& node_type) const
+{
+  const int segment = find_edge_segment(edge_types, node_type);
+  if (segment == int(edge_types.size())) return EdgeRange(edges.end(), edges.end());
+
+  return EdgeRange(edges.begin() + (segment == 0 ? 0 : edge_type_ends[segment - 1]),
+                   edges.begin() + edge_type_ends[segment]);
+}
+
 // =============================================================================
 // Set current node parent/cluster
 // =============================================================================
 void Node::set_parent(NodePtr parent_node_ptr)
 {
-  //PROFILE_FUNCTION();
+  //PROFILE_FUNCTION(model);
 
   if (level != parent_node_ptr->level - 1) {
     LOGIC_ERROR("Parent node must be one level above child");
@@ -113,7 +191,7 @@ void Node::set_parent(NodePtr parent_node_ptr)
 // =============================================================================
 inline void Node::add_child(const NodePtr& new_child_node)
 {
-  //PROFILE_FUNCTION();
+  //PROFILE_FUNCTION(model);
   // Add new child node to the set of children. An unordered set is used because
   // repeat children can't happen.
   (this_ptr()->children).insert(new_child_node);
@@ -156,23 +234,20 @@ inline NodePtr Node::get_parent_at_level(const int& level_of_parent)
 
 // =============================================================================
 // Get all nodes connected to Node at a given level with specified type
-// We return a vector because we need random access to elements in this array
-// and that isn't provided to us with the list format.
 // =============================================================================
 NodeVec Node::get_edges_of_type(const std::string& node_type, const int& desired_level) const
 {
+  // Only the segment of edges to the requested type needs visiting
+  const EdgeRange type_edges = edges_of_type(node_type);
+
   // Vector to return containing parents at desired level for edges
   NodeVec level_cons;
+  level_cons.reserve(type_edges.second - type_edges.first);
 
-  // Conservatively assume all edges will be taken
-  level_cons.reserve(edges.size());
-
-  // Go through every child node's edges list, find parent at
-  // desired level and place in connected nodes vector
-  for (const auto& edge : edges) {
-    if (edge->type == node_type) {
-      level_cons.push_back(edge->get_parent_at_level(desired_level));
-    }
+  // Find parent at desired level for each edge and place in connected nodes
+  // vector
+  for (auto edge_it = type_edges.first; edge_it != type_edges.second; edge_it++) {
+    level_cons.push_back((*edge_it)->get_parent_at_level(desired_level));
   }
 
   return level_cons;
@@ -201,9 +276,9 @@ NodeEdgeMap Node::gather_edges_to_level(const int& level) const
 // =============================================================================
 // Static method to connect two nodes to each other with edge
 // =============================================================================
-void Node::connect_nodes(const NodePtr& node1_ptr, const NodePtr& node2_ptr)
+void Node::connect_nodes(const NodePtr& node1_ptr, const NodePtr& node2_ptr, const int& count)
 {
-  //PROFILE_FUNCTION();
-  node1_ptr->add_edge(node2_ptr);
-  node2_ptr->add_edge(node1_ptr);
+  //PROFILE_FUNCTION(model);
+  node1_ptr->add_edge(node2_ptr, count);
+  node2_ptr->add_edge(node1_ptr, count);
 }
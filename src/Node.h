@@ -14,16 +14,26 @@
 #define OUT_MSG std::cout
 #else
 #include <Rcpp.h>
-// Eases the process of wrapping functions to get errors forwarded to R
-#define LOGIC_ERROR(msg)         \
-  const std::string e_msg = msg; \
+// Eases the process of wrapping functions to get errors forwarded to R. Worker
+// threads can't touch the R API so they throw plain std exceptions instead,
+// which get rethrown on the main thread, and drop their warnings.
+#define LOGIC_ERROR(msg)                  \
+  const std::string e_msg = msg;          \
+  if (in_worker_thread()) {               \
+    throw std::logic_error(e_msg);        \
+  }                                       \
   throw Rcpp::exception(e_msg.c_str(), false)
-#define RANGE_ERROR(msg)         \
-  const std::string e_msg = msg; \
+#define RANGE_ERROR(msg)                  \
+  const std::string e_msg = msg;          \
+  if (in_worker_thread()) {               \
+    throw std::range_error(e_msg);        \
+  }                                       \
   throw Rcpp::exception(e_msg.c_str(), false)
-#define WARN_ABOUT(msg)          \
-  const std::string w_msg = msg; \
-  Rcpp::warning(w_msg.c_str())
+#define WARN_ABOUT(msg)                   \
+  const std::string w_msg = msg;          \
+  if (!in_worker_thread()) {              \
+    Rcpp::warning(w_msg.c_str());         \
+  }
 
 #define OUT_MSG Rcpp::Rcout
 #endif
@@ -37,9 +47,18 @@
 #include <memory>
 #include <queue>
 #include <set>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
+// Is the current thread one of our worker threads (see parallel_helpers.h)?
+// Used by the error macros above.
+inline bool& in_worker_thread()
+{
+  static thread_local bool is_worker = false;
+  return is_worker;
+}
+
 // =============================================================================
 // What this file declares
 // =============================================================================
@@ -54,6 +73,7 @@ using NodeEdgeMap = std::map<NodePtr, int>;
 using NodeLevel   = std::map<std::string, NodePtr>;
 using LevelPtr    = std::shared_ptr<NodeLevel>;
 using LevelMap    = std::map<int, LevelPtr>;
+using EdgeRange   = std::pair<NodeVec::const_iterator, NodeVec::const_iterator>;
 
 //=================================
 // Main node class declaration
@@ -69,6 +89,7 @@ class Node : public std::enable_shared_from_this<Node> {
       , type("a")
       , level(level)
       , degree(0)
+      , type_id(0)
   {
   }
 
@@ -78,6 +99,7 @@ class Node : public std::enable_shared_from_this<Node> {
       , type(type)
       , level(level)
       , degree(0)
+      , type_id(0)
   {
   }
 
@@ -87,6 +109,7 @@ class Node : public std::enable_shared_from_this<Node> {
       , type(std::to_string(type))
       , level(level)
       , degree(0)
+      , type_id(0)
   {
   }
 
@@ -95,10 +118,17 @@ class Node : public std::enable_shared_from_this<Node> {
   std::string id;       // Unique integer id for node
   std::string type;     // What type of node is this?
   int         level;    // What level does this node sit at (0 = data, 1 = cluster, 2 = super-clusters, ...)
-  NodeList    edges;    // Nodes that are connected to this node
+  NodeVec     edges;    // Nodes that are connected to this node, grouped by their type
   NodePtr     parent;   // What node contains this node (aka its cluster)
   NodeSet     children; // Nodes that are contained within node (if node is cluster)
   int         degree;   // How many edges/ edges does this node have?
+  int         type_id;  // Integer index of type within the model it belongs to
+
+  // The edges vector is kept as one contiguous segment per neighbor type so
+  // type restricted lookups don't need to filter. Segment i holds neighbors of
+  // type edge_types[i] and ends at index edge_type_ends[i].
+  std::vector<std::string> edge_types;
+  std::vector<int>         edge_type_ends;
 
   // Methods
   // =========================================================================
@@ -106,12 +136,15 @@ class Node : public std::enable_shared_from_this<Node> {
   void        set_parent(NodePtr new_parent);                                                  // Set current node parent/cluster
   void        add_child(const NodePtr& new_child);                                             // Add a node to the children vector
   void        remove_child(const NodePtr& child);                                              // Remove a child node
-  void        add_edge(const NodePtr& node);                                                   // Add edge to another node
+  void        add_edge(const NodePtr& node, const int& count = 1);                             // Add edge(s) to another node
   void        update_edges_from_node(const NodePtr& node, const bool& remove);                 // Add or remove edges from nodes edge list
+  void        insert_edge(const NodePtr& node, const int& count = 1);                          // Place copies of a neighbor at the end of its type's segment
+  void        erase_edge(const NodePtr& node);                                                 // Remove first instance of a neighbor from its type's segment
+  EdgeRange   edges_of_type(const std::string& node_type) const;                               // Range of edges to neighbors of a given type
   NodePtr     get_parent_at_level(const int& level);                                           // Get parent of node at a given level
   NodeVec     get_edges_of_type(const std::string& node_type, const int& desired_level) const; // Get all nodes connected to Node at a given level
   NodeEdgeMap gather_edges_to_level(const int& level) const;                                   // Get a map keyed by node with value of number of edges for all of a nodes edges to a level
-  static void connect_nodes(const NodePtr& node_a, const NodePtr& node_b);                     // Static method to connect two nodes to each other with edge
+  static void connect_nodes(const NodePtr& node_a, const NodePtr& node_b, const int& count = 1); // Static method to connect two nodes to each other with edge(s)
 };
 
 #endif
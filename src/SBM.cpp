@@ -1,12 +1,17 @@
 #include "SBM.h"
 
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+#include <sstream>
+
 // =============================================================================
 // Grab reference to a desired level map. If level doesn't exist yet, it will be
 // created
 // =============================================================================
 LevelPtr SBM::get_level(const int& level)
 {
-  PROFILE_FUNCTION();
+  PROFILE_FUNCTION(model);
   // Grab level for block node
   LevelMap::iterator block_level = nodes.find(level);
 
@@ -27,7 +32,7 @@ LevelPtr SBM::get_level(const int& level)
 // Const version that doesn't append level
 LevelPtr SBM::get_level(const int& level) const
 {
-  PROFILE_FUNCTION();
+  PROFILE_FUNCTION(model);
   try {
     return nodes.at(level);
   }
@@ -42,7 +47,7 @@ LevelPtr SBM::get_level(const int& level) const
 NodePtr SBM::get_node_by_id(const std::string& id,
                             const int          level) const
 {
-  PROFILE_FUNCTION();
+  PROFILE_FUNCTION(model);
   try {
     // Attempt to find node on the 'node level' of the Network
     return nodes.at(level)->at(id);
@@ -60,22 +65,34 @@ NodePtr SBM::add_node(const std::string& id,
                       const std::string& type,
                       const int          level)
 {
-  PROFILE_FUNCTION();
+  PROFILE_FUNCTION(model);
   // Grab level
   LevelPtr node_level = get_level(level);
 
   // Check if we need to make the id or not
-  std::string node_id = id == "new block"
-      ? type + "-" + std::to_string(level) + "_" + std::to_string(node_level->size())
-      : id;
+  std::string node_id = id;
+  if (id == "new block") {
+    // Blocks are removed as they empty out so the level's size can land on an
+    // id that's still taken. Move on to the next free one.
+    int id_num = node_level->size();
+    do {
+      node_id = type + "-" + std::to_string(level) + "_" + std::to_string(id_num++);
+    } while (node_level->count(node_id) > 0);
+  }
 
   // Create node
   NodePtr new_node = std::make_shared<Node>(node_id, level, type);
+  new_node->type_id = get_type_id(type);
 
   (*node_level)[node_id] = new_node;
 
-  // Add this node to node counting map
-  node_type_counts[type][level]++;
+  // Add this node to node counting maps
+  update_type_counts(new_node, 1);
+
+  // Data nodes start off in their own component
+  if (level == 0) {
+    component_links[new_node] = new_node;
+  }
 
   return new_node;
 };
@@ -85,13 +102,15 @@ NodePtr SBM::add_node(const std::string& id,
 // =============================================================================
 NodePtr SBM::create_block_node(const std::string& type, const int level)
 {
-  PROFILE_FUNCTION();
+  PROFILE_FUNCTION(model);
 
   // Make sure requested level is not 0
   if (level == 0) {
     LOGIC_ERROR("Can't create block node at first level");
   }
 
+  stats.blocks_created++;
+
   // Initialize new node
   return add_node("new block", type, level);
 };
@@ -101,7 +120,7 @@ NodePtr SBM::create_block_node(const std::string& type, const int level)
 // =============================================================================
 NodeVec SBM::get_nodes_of_type_at_level(const std::string& type, const int& level) const
 {
-  PROFILE_FUNCTION();
+  PROFILE_FUNCTION(model);
 
   // Grab desired level reference
   LevelPtr node_level = nodes.at(level);
@@ -138,7 +157,16 @@ NodeVec SBM::get_nodes_of_type_at_level(const std::string& type, const int& leve
 // =============================================================================
 void SBM::add_edge(const std::string& id_a, const std::string& id_b)
 {
-  PROFILE_FUNCTION();
+  add_edges(id_a, id_b, 1);
+}
+
+// =============================================================================
+// Add a number of edges between a pair of nodes. Nodes are looked up, checked,
+// and have their edge lists grown once rather than once per edge.
+// =============================================================================
+void SBM::add_edges(const std::string& id_a, const std::string& id_b, const int& num_edges)
+{
+  PROFILE_FUNCTION(model);
   const NodePtr node_a = get_node_by_id(id_a);
   const NodePtr node_b = get_node_by_id(id_b);
 
@@ -146,49 +174,270 @@ void SBM::add_edge(const std::string& id_a, const std::string& id_b)
   // add this edge as a possible pair.
   // If the user has specified allowed edges explicitely, make sure that this edge follows protocol
   if (specified_allowed_edges) {
-    const bool a_to_b_bad = !(edge_type_pairs.at(node_a->type).count(node_b->type));
-    const bool b_to_a_bad = !(edge_type_pairs.at(node_b->type).count(node_a->type));
-
-    if (a_to_b_bad | b_to_a_bad) {
+    if (!types_compatible(node_a->type_id, node_b->type_id)) {
       LOGIC_ERROR("Edge of " + id_a + " - " + id_b + " does not fit allowed specified edge_types type combos.");
     }
   }
-  else {
-    add_edge_type(edge_type_pairs, node_a->type, node_b->type);
+  else if (!types_compatible(node_a->type_id, node_b->type_id)) {
+    allow_edge_type(node_a->type, node_b->type);
   }
 
-  Node::connect_nodes(node_a, node_b);   // Connect nodes to eachother
-  edges.push_back(Edge(node_a, node_b)); // Add edge to edge tracking list
+  // Connect nodes to eachother and add the edges to edge tracking list
+  Node::connect_nodes(node_a, node_b, num_edges);
+  edges.insert(edges.end(), num_edges, Edge(node_a, node_b));
+
+  // Join the two node's components
+  component_links[get_component_root(node_a)] = get_component_root(node_b);
 };
 
+// =============================================================================
+// Find the representative node of a data node's connected component
+// =============================================================================
+NodePtr SBM::get_component_root(const NodePtr& node)
+{
+  NodePtr current_node = node;
+
+  while (true) {
+    NodePtr& link = component_links.at(current_node);
+    if (link == current_node) {
+      return current_node;
+    }
+
+    // Point at grandparent as we go to keep trees shallow (path halving)
+    link         = component_links.at(link);
+    current_node = link;
+  }
+}
+
+// =============================================================================
+// Group data nodes by their connected component. Components are ordered by
+// size, largest first, with ties broken by the ids of the nodes inside them.
+// =============================================================================
+std::vector<NodeVec> SBM::get_components()
+{
+  PROFILE_FUNCTION(model);
+
+  std::vector<NodeVec>   components;
+  std::map<NodePtr, int> root_to_component;
+
+  // Level map is sorted by id so components are built in a stable order
+  for (const auto& node : *get_level(0)) {
+    const NodePtr root    = get_component_root(node.second);
+    const auto    root_it = root_to_component.emplace(root, components.size());
+
+    if (root_it.second) {
+      components.emplace_back();
+    }
+    components[root_it.first->second].push_back(node.second);
+  }
+
+  std::stable_sort(components.begin(), components.end(), [](const NodeVec& a, const NodeVec& b) {
+    return a.size() > b.size();
+  });
+
+  return components;
+}
+
+// =============================================================================
+// Build a fresh model from a subset of data nodes and the edges between them.
+// The new model shares no nodes with this one so it can be fit on its own.
+// =============================================================================
+SBM SBM::build_submodel(const NodeVec&           data_nodes,
+                        const std::vector<Edge>& sub_edges,
+                        const int&               seed) const
+{
+  SBM submodel(seed);
+
+  // Keep the same edge type rules and edge model as the full model
+  submodel.inherit_edge_types(*this);
+  submodel.degree_corrected = degree_corrected;
+
+  for (const auto& node : data_nodes) {
+    submodel.add_node(node->id, node->type);
+  }
+
+  for (const auto& edge : sub_edges) {
+    submodel.add_edge(edge.node_a->id, edge.node_b->id);
+  }
+
+  return submodel;
+}
+
+// =============================================================================
+// Copy the whole model, blocks and all, into a fresh model sharing no nodes
+// with this one
+// =============================================================================
+SBM SBM::clone(const int& seed) const
+{
+  NodeVec data_nodes;
+  for (const auto& node : *get_level(0)) {
+    data_nodes.push_back(node.second);
+  }
+
+  SBM copy = build_submodel(data_nodes, std::vector<Edge>(edges.begin(), edges.end()), seed);
+
+  const State_Dump state = get_state();
+  copy.set_state(state.id, state.parent, state.level, state.type);
+
+  return copy;
+}
+
 // Vectorized version of add edge types for when a whole set is passed at once
 void SBM::add_edge_types(const std::vector<std::string>& from_types, const std::vector<std::string>& to_types)
 {
   // Clear old allowed pairs (if they exist)
   edge_type_pairs.clear();
+  for (auto& type_row : type_compatibility) {
+    std::fill(type_row.begin(), type_row.end(), 0);
+  }
 
   // Add pairs to network map of allowed pairs
   const int num_pairs = from_types.size();
   for (int i = 0; i < num_pairs; i++) {
-    add_edge_type(edge_type_pairs, from_types[i], to_types[i]);
+    allow_edge_type(from_types[i], to_types[i]);
   }
+  recount_neighbor_types();
 
   // Let object know that we're working with specified types now.
   specified_allowed_edges = true;
 }
 
+// =============================================================================
+// Get the integer index of a node type. New types get the next free index and
+// a row and column in the type structures.
+// =============================================================================
+int SBM::get_type_id(const std::string& type)
+{
+  const auto type_it = type_ids.find(type);
+  if (type_it != type_ids.end()) {
+    return type_it->second;
+  }
+
+  const int type_id   = type_ids.size();
+  const int num_words = type_id / 64 + 1;
+  type_ids.emplace(type, type_id);
+
+  type_compatibility.emplace_back(num_words, 0);
+  for (auto& type_row : type_compatibility) {
+    type_row.resize(num_words, 0);
+  }
+
+  for (auto& level_counts : type_counts_by_level) {
+    level_counts.push_back(0);
+  }
+  for (auto& level_counts : neighbor_counts_by_level) {
+    level_counts.push_back(0);
+  }
+
+  return type_id;
+}
+
+// =============================================================================
+// Allow edges between two types in both the string pair map and the bitmask
+// =============================================================================
+void SBM::allow_edge_type(const std::string& type_a, const std::string& type_b)
+{
+  const int id_a = get_type_id(type_a);
+  const int id_b = get_type_id(type_b);
+
+  add_edge_type(edge_type_pairs, type_a, type_b);
+
+  if (types_compatible(id_a, id_b)) {
+    return;
+  }
+
+  type_compatibility[id_a][id_b / 64] |= uint64_t(1) << (id_b % 64);
+  type_compatibility[id_b][id_a / 64] |= uint64_t(1) << (id_a % 64);
+
+  // Nodes of one type are now possible neighbors of the other
+  const int num_levels = type_counts_by_level.size();
+  for (int level = 0; level < num_levels; level++) {
+    neighbor_counts_by_level[level][id_a] += type_counts_by_level[level][id_b];
+    if (id_a != id_b) {
+      neighbor_counts_by_level[level][id_b] += type_counts_by_level[level][id_a];
+    }
+  }
+}
+
+// =============================================================================
+// Copy another model's allowed edge types. Type ids are per model so the pairs
+// get registered by name.
+// =============================================================================
+void SBM::inherit_edge_types(const SBM& source)
+{
+  for (const auto& type_pairs : source.edge_type_pairs) {
+    for (const auto& to_type : type_pairs.second) {
+      allow_edge_type(type_pairs.first, to_type);
+    }
+  }
+  specified_allowed_edges = source.specified_allowed_edges;
+}
+
+// =============================================================================
+// Keep the node type counts in sync as nodes are added or removed
+// =============================================================================
+void SBM::update_type_counts(const NodePtr& node, const int& change)
+{
+  const int level   = node->level;
+  const int type_id = node->type_id;
+
+  node_type_counts[node->type][level] += change;
+
+  const int num_types = type_ids.size();
+  while (int(type_counts_by_level.size()) <= level) {
+    type_counts_by_level.emplace_back(num_types, 0);
+    neighbor_counts_by_level.emplace_back(num_types, 0);
+  }
+
+  type_counts_by_level[level][type_id] += change;
+
+  // Every type this node can connect to gains or loses a possible neighbor
+  std::vector<int>& level_neighbor_counts = neighbor_counts_by_level[level];
+  for (int other_type = 0; other_type < num_types; other_type++) {
+    if (types_compatible(type_id, other_type)) {
+      level_neighbor_counts[other_type] += change;
+    }
+  }
+}
+
+// =============================================================================
+// Rebuild the neighbor counts from scratch from the type counts
+// =============================================================================
+void SBM::recount_neighbor_types()
+{
+  const int num_levels = type_counts_by_level.size();
+  const int num_types  = type_ids.size();
+
+  for (int level = 0; level < num_levels; level++) {
+    std::vector<int>& level_neighbor_counts = neighbor_counts_by_level[level];
+    std::fill(level_neighbor_counts.begin(), level_neighbor_counts.end(), 0);
+
+    for (int type_a = 0; type_a < num_types; type_a++) {
+      for (int type_b = 0; type_b < num_types; type_b++) {
+        if (types_compatible(type_a, type_b)) {
+          level_neighbor_counts[type_a] += type_counts_by_level[level][type_b];
+        }
+      }
+    }
+  }
+}
+
 // =============================================================================
 // Adds a desired number of blocks and randomly assigns them for a given level
 // num_blocks = -1 means every node gets their own block
 // =============================================================================
 void SBM::initialize_blocks(const int level, const int num_blocks)
 {
-  PROFILE_FUNCTION();
+  PROFILE_FUNCTION(model);
 
   const int block_level = level + 1;
 
   // Clear all previous nodes in block level out
-  get_level(block_level)->clear();
+  const LevelPtr old_blocks = get_level(block_level);
+  for (const auto& old_block : *old_blocks) {
+    update_type_counts(old_block.second, -1);
+  }
+  old_blocks->clear();
 
   // Grab all the nodes for the desired level
   LevelPtr node_level = nodes.at(level);
@@ -244,7 +493,9 @@ void SBM::initialize_blocks(const int level, const int num_blocks)
 // =============================================================================
 NodeVec SBM::clean_empty_blocks()
 {
-  PROFILE_FUNCTION();
+  PROFILE_FUNCTION(model);
+  Stats_Timer cleanup_timer(stats.cleanup_ns);
+
   int num_levels    = nodes.size();
   int total_deleted = 0;
 
@@ -275,7 +526,7 @@ NodeVec SBM::clean_empty_blocks()
         blocks_to_delete.push(block.second->id);
 
         // Remove nodes contribution to node counts map
-        node_type_counts[block.second->type][level]--;
+        update_type_counts(block.second, -1);
       }
     }
 
@@ -291,6 +542,8 @@ NodeVec SBM::clean_empty_blocks()
     }
   }
 
+  stats.blocks_removed += total_deleted;
+
   return blocks_removed;
 }
 
@@ -299,7 +552,7 @@ NodeVec SBM::clean_empty_blocks()
 // =============================================================================
 State_Dump SBM::get_state() const
 {
-  PROFILE_FUNCTION();
+  PROFILE_FUNCTION(state_io);
   // Initialize the return struct
   State_Dump state;
 
@@ -342,7 +595,7 @@ void SBM::set_state(const std::vector<std::string>& id,
                     const std::vector<int>&         level,
                     const std::vector<std::string>& type)
 {
-  PROFILE_FUNCTION();
+  PROFILE_FUNCTION(state_io);
 
   const int n = id.size();
 
@@ -401,6 +654,95 @@ BlockEdgeCounts SBM::get_block_edge_counts(const int& level) const
   return block_counts;
 }
 
+// =============================================================================
+// Describe the model's blocks at a level as a network simulation spec. Nodes
+// keep their blocks, ids and types, are weighted by their degree, and every
+// connected pair of blocks expects the number of edges it currently has.
+// =============================================================================
+Sim_Spec SBM::block_sim_spec(const int& level) const
+{
+  PROFILE_FUNCTION(model);
+
+  if (level < 1 || nodes.count(level) == 0) {
+    RANGE_ERROR("Model has no blocks at level " + std::to_string(level));
+  }
+
+  const LevelPtr data_nodes = nodes.at(0);
+
+  Sim_Spec spec;
+  spec.node_blocks.reserve(data_nodes->size());
+  spec.node_weights.reserve(data_nodes->size());
+  spec.node_ids.reserve(data_nodes->size());
+  spec.node_types.reserve(data_nodes->size());
+
+  std::map<NodePtr, int> block_indices;
+  for (const auto& node : *data_nodes) {
+    const NodePtr block       = node.second->get_parent_at_level(level);
+    const int     block_index = block_indices.emplace(block, block_indices.size()).first->second;
+
+    spec.node_blocks.push_back(block_index);
+    spec.node_weights.push_back(node.second->degree);
+    spec.node_ids.push_back(node.second->id);
+    spec.node_types.push_back(node.second->type);
+  }
+
+  // Count edges per unordered pair of block indices
+  std::map<std::pair<int, int>, int> pair_counts;
+  for (const auto& edge : edges) {
+    const int block_a = block_indices.at(edge.node_a->get_parent_at_level(level));
+    const int block_b = block_indices.at(edge.node_b->get_parent_at_level(level));
+    pair_counts[std::minmax(block_a, block_b)]++;
+
+    // Only simulate self edges if the data has them
+    if (edge.node_a == edge.node_b) spec.allow_self_edges = true;
+  }
+
+  spec.block_pairs.reserve(pair_counts.size());
+  for (const auto& pair : pair_counts) {
+    spec.block_pairs.emplace_back(pair.first.first, pair.first.second, pair.second);
+  }
+
+  return spec;
+}
+
+Sim_Network SBM::simulate_from_blocks(const int& level, const int& seed, const bool& exact_edge_counts) const
+{
+  Sim_Spec spec          = block_sim_spec(level);
+  spec.exact_edge_counts = exact_edge_counts;
+  return simulate_network(spec, seed);
+}
+
+// =============================================================================
+// Fill the model with a simulated network, optionally placing nodes in their
+// simulated blocks at level 1
+// =============================================================================
+void SBM::add_sim_network(const Sim_Network& network, const bool& plant_blocks)
+{
+  PROFILE_FUNCTION(model);
+  const int num_nodes = network.num_nodes();
+
+  NodeVec new_nodes;
+  new_nodes.reserve(num_nodes);
+  for (int i = 0; i < num_nodes; i++) {
+    new_nodes.push_back(add_node(network.node_ids[i], network.node_types[i]));
+  }
+
+  for (int i = 0; i < network.num_edges(); i++) {
+    add_edge(new_nodes[network.edges_from[i]]->id, new_nodes[network.edges_to[i]]->id);
+  }
+
+  if (plant_blocks) {
+    // Blocks only hold one type of node so mixed simulated blocks get split
+    std::map<std::pair<int, std::string>, NodePtr> planted_blocks;
+    for (int i = 0; i < num_nodes; i++) {
+      const NodePtr& node = new_nodes[i];
+      NodePtr&       block = planted_blocks[std::make_pair(network.node_blocks[i], node->type)];
+      if (!block) block = create_block_node(node->type, 1);
+      node->set_parent(block);
+    }
+  }
+}
+
 NodeEdgeMap SBM::get_node_to_block_edge_counts(const std::string& id,
                                                const int&         node_level,
                                                const int&         connections_level) const
@@ -409,6 +751,56 @@ NodeEdgeMap SBM::get_node_to_block_edge_counts(const std::string& id,
   return get_node_by_id(id, node_level)->gather_edges_to_level(connections_level);
 }
 
+// =============================================================================
+// Work out how the node types of the network connect. Bipartite networks have
+// two types that only ever connect to each other.
+// =============================================================================
+Network_Structure SBM::get_structure() const
+{
+  if (node_type_counts.size() == 1) {
+    return Network_Structure::unipartite;
+  }
+
+  if (node_type_counts.size() == 2 && edge_type_pairs.size() == 2) {
+    bool only_cross_type = true;
+    for (const auto& type_pairs : edge_type_pairs) {
+      only_cross_type &= type_pairs.second.size() == 1 && type_pairs.second.count(type_pairs.first) == 0;
+    }
+    if (only_cross_type) {
+      return Network_Structure::bipartite;
+    }
+  }
+
+  return Network_Structure::polypartite;
+}
+
+// =============================================================================
+// Count the blocks a node could be moved to and the blocks that its neighbors
+// could be in. These come straight from the cached per type counts, only
+// unipartite networks can skip them.
+// =============================================================================
+template <typename Structure>
+Move_Block_Counts SBM::count_move_blocks(const NodePtr& node, const int& block_level) const
+{
+  Move_Block_Counts counts;
+
+  if (Structure::single_type) {
+    counts.candidates         = get_level(block_level)->size();
+    counts.possible_neighbors = counts.candidates;
+    return counts;
+  }
+
+  // No blocks have ever been added at this level
+  if (block_level >= int(type_counts_by_level.size())) {
+    return counts;
+  }
+
+  counts.candidates         = type_counts_by_level[block_level][node->type_id];
+  counts.possible_neighbors = neighbor_counts_by_level[block_level][node->type_id];
+
+  return counts;
+}
+
 // =============================================================================
 // Propose a potential block move for a node.
 // =============================================================================
@@ -416,12 +808,40 @@ NodePtr SBM::propose_move(const NodePtr& node,
                           const double&  eps,
                           Sampler&       random) const
 {
-  PROFILE_FUNCTION();
+  return propose_structured_move<Polypartite_Network>(
+      node, eps, random, count_move_blocks<Polypartite_Network>(node, node->level + 1).candidates);
+}
+
+template <typename Structure>
+NodePtr SBM::propose_structured_move(const NodePtr& node,
+                                     const double&  eps,
+                                     Sampler&       random,
+                                     const int&     num_candidates) const
+{
+  PROFILE_FUNCTION(proposal);
 
   const int block_level = node->level + 1;
 
-  // Grab a list of all the blocks that the node could join
-  const NodeVec potential_blocks = get_nodes_of_type_at_level(node->type, block_level);
+  // Draws uniformly from every block the node could join. The list of potential
+  // blocks is only gathered if it is actually needed.
+  const auto random_block = [&]() -> NodePtr {
+    if (Structure::single_type) {
+      const LevelPtr blocks   = get_level(block_level);
+      auto           block_it = blocks->begin();
+      std::advance(block_it, random.get_rand_int(blocks->size() - 1));
+      return block_it->second;
+    }
+    return random.sample(get_nodes_of_type_at_level(node->type, block_level));
+  };
+
+  // Without any neighbors to go off of a random block is all we can offer.
+  // Happens for isolated nodes, which get their own connected component, and
+  // when merging blocks whose members are all unconnected. Nodes with edges
+  // never get here so their proposals draw exactly as they always have.
+  if (node->edges.empty()) {
+    stats.random_block_proposals++;
+    return random_block();
+  }
 
   // Sample a random neighbor of node
   const NodePtr rand_neighbor = random.sample(node->edges)->get_parent_at_level(node->level);
@@ -430,12 +850,32 @@ NodePtr SBM::propose_move(const NodePtr& node,
   const int neighbor_block_degree = rand_neighbor->parent->degree;
 
   // Decide if we are going to choose a random block for our node
-  const double ergo_amnt            = eps * potential_blocks.size();
+  const double ergo_amnt            = eps * num_candidates;
   const double prob_of_random_block = ergo_amnt / (neighbor_block_degree + ergo_amnt);
 
   // Decide where we will get new block from and draw from potential candidates
-  return random.draw_unif() < prob_of_random_block ? random.sample(potential_blocks)
-                                                   : random.sample(rand_neighbor->get_edges_of_type(node->type, block_level));
+  if (random.draw_unif() < prob_of_random_block) {
+    stats.random_block_proposals++;
+    return random_block();
+  }
+
+  stats.neighbor_proposals++;
+
+  // When every neighbor of the neighbor is of the node's type they can be
+  // sampled straight from its edge list
+  if (Structure::neighbors_share_type) {
+    return random.sample(rand_neighbor->edges)->get_parent_at_level(block_level);
+  }
+
+  // Otherwise draw from the neighbor's segment of edges to the node's type.
+  // Only the drawn edge needs walking up to the block level.
+  const EdgeRange type_edges = rand_neighbor->edges_of_type(node->type);
+  const int       num_edges  = type_edges.second - type_edges.first;
+  if (num_edges == 0) {
+    LOGIC_ERROR("Neighbor " + rand_neighbor->id + " has no edges to nodes of type " + node->type);
+  }
+
+  return (*(type_edges.first + random.get_rand_int(num_edges - 1)))->get_parent_at_level(block_level);
 }
 
 // =============================================================================
@@ -445,7 +885,19 @@ Proposal_Res SBM::make_proposal_decision(const NodePtr& node,
                                          const NodePtr& new_block,
                                          const double&  eps)
 {
-  PROFILE_FUNCTION();
+  const int n_possible_neighbors = count_move_blocks<Polypartite_Network>(node, new_block->level).possible_neighbors;
+
+  return degree_corrected ? make_model_proposal_decision<Degree_Corrected>(node, new_block, eps, n_possible_neighbors)
+                          : make_model_proposal_decision<Non_Degree_Corrected>(node, new_block, eps, n_possible_neighbors);
+}
+
+template <typename Entropy_Model>
+Proposal_Res SBM::make_model_proposal_decision(const NodePtr& node,
+                                               const NodePtr& new_block,
+                                               const double&  eps,
+                                               const int&     n_possible_neighbors)
+{
+  PROFILE_FUNCTION(proposal);
 
   const NodePtr old_block = node->parent; // Reference to old block that would be swapped for new_block
   // Make sure we're actually doing something
@@ -467,6 +919,7 @@ Proposal_Res SBM::make_proposal_decision(const NodePtr& node,
   // Gather the node to edge counts together to one main map
   int node_to_old_block = 0;
   int node_to_new_block = 0;
+  int num_internal      = 0; // Half-edges with both ends in node (self-loops or edges inside a block node)
 
   for (const auto& edge : old_block->edges) {
     move_edge_counts[edge->get_parent_at_level(block_level)].old_to_neighbor++;
@@ -477,6 +930,12 @@ Proposal_Res SBM::make_proposal_decision(const NodePtr& node,
   }
 
   for (const auto& edge : node->edges) {
+    // Internal edges move with the node so they aren't edges to the old block
+    if (edge->get_parent_at_level(node->level) == node) {
+      num_internal++;
+      continue;
+    }
+
     const NodePtr edge_block = edge->get_parent_at_level(block_level);
 
     if (edge_block == old_block) {
@@ -489,13 +948,9 @@ Proposal_Res SBM::make_proposal_decision(const NodePtr& node,
     move_edge_counts[edge_block].node_to_neighbor++;
   }
 
-  // How many possible neighbor blocks are there?
-  // Loop over all the possible neighbor node types for this node and add up.
-  int n_possible_neighbors = 0;
-
-  const auto possible_neighbor_types = edge_type_pairs.at(node->type);
-  for (const auto& neighbor_type : possible_neighbor_types) {
-    n_possible_neighbors += node_type_counts[neighbor_type][block_level];
+  // Internal edges end up in the new block even if nothing else connects to it
+  if (num_internal > 0) {
+    move_edge_counts[new_block];
   }
 
   // These are constants for edge connections that are used in entropy calc
@@ -505,6 +960,13 @@ Proposal_Res SBM::make_proposal_decision(const NodePtr& node,
   const int pre_new_degree        = new_block->degree;
   const int post_new_degree       = pre_new_degree + node_degree;
 
+  // Block weights used by the entropy terms (degree or size depending on model)
+  const double node_weight     = Entropy_Model::member_weight(node_degree);
+  const double pre_old_weight  = Entropy_Model::block_weight(old_block);
+  const double post_old_weight = pre_old_weight - node_weight;
+  const double pre_new_weight  = Entropy_Model::block_weight(new_block);
+  const double post_new_weight = pre_new_weight + node_weight;
+
   // These will get summed into as we loop over all the neighbor blocks
   double entropy_delta  = 0;
   double pre_move_prob  = 0;
@@ -522,22 +984,26 @@ Proposal_Res SBM::make_proposal_decision(const NodePtr& node,
     int    post_new_to_neighbor = pre.new_to_neighbor;
     double scalar               = 1; // If we are double counting this pair we will need to downweight it
 
-    // This will stay the same unless the neighbor is one of the old or new blocks
-    int post_neighbor_degree = pre_neighbor_degree;
+    // These will stay the same unless the neighbor is one of the old or new blocks
+    int          post_neighbor_degree = pre_neighbor_degree;
+    const double pre_neighbor_weight  = Entropy_Model::block_weight(neighbor);
+    double       post_neighbor_weight = pre_neighbor_weight;
 
     const bool neighbor_is_old = neighbor == old_block;
     const bool neighbor_is_new = neighbor == new_block;
 
     if (neighbor_is_old) {
-      post_old_to_neighbor -= 2 * (node_to_old_block);
+      post_old_to_neighbor -= 2 * (node_to_old_block) + num_internal;
       post_new_to_neighbor += node_to_old_new_delta;
       post_neighbor_degree = post_old_degree;
+      post_neighbor_weight = post_old_weight;
       scalar               = 2;
     }
     else if (neighbor_is_new) {
       post_old_to_neighbor += node_to_old_new_delta;
-      post_new_to_neighbor += 2 * node_to_new_block;
+      post_new_to_neighbor += 2 * node_to_new_block + num_internal;
       post_neighbor_degree = post_new_degree;
+      post_neighbor_weight = post_new_weight;
       scalar               = 2;
     }
     else {
@@ -546,24 +1012,26 @@ Proposal_Res SBM::make_proposal_decision(const NodePtr& node,
     }
 
     // First calculate old group's entropy contributions pre and post move
-    const double pre_old_entropy  = partial_entropy(pre.old_to_neighbor, pre_neighbor_degree, pre_old_degree);
-    const double post_old_entropy = partial_entropy(post_old_to_neighbor, post_neighbor_degree, post_old_degree);
+    const double pre_old_entropy  = partial_entropy(pre.old_to_neighbor, pre_neighbor_weight, pre_old_weight);
+    const double post_old_entropy = partial_entropy(post_old_to_neighbor, post_neighbor_weight, post_old_weight);
 
     // Then do the same for the new group
-    const double pre_new_entropy  = partial_entropy(pre.new_to_neighbor, pre_neighbor_degree, pre_new_degree);
-    const double post_new_entropy = partial_entropy(post_new_to_neighbor, post_neighbor_degree, post_new_degree);
+    const double pre_new_entropy  = partial_entropy(pre.new_to_neighbor, pre_neighbor_weight, pre_new_weight);
+    const double post_new_entropy = partial_entropy(post_new_to_neighbor, post_neighbor_weight, post_new_weight);
 
     // Add this neighbors contribution to the overall delta
     entropy_delta += (pre_old_entropy + pre_new_entropy - post_old_entropy - post_new_entropy) / scalar;
 
     // Before moving calculating probability ratio components for neighbor we
-    // first check if node being moved has any connections to this neighbor
-    if (pre.node_to_neighbor != 0) {
-      const double prop_edges_to_neighbor = pre.node_to_neighbor / node_degree;
-      const double eps_B                  = eps * n_possible_neighbors;
-
-      pre_move_prob += prop_edges_to_neighbor * (pre.new_to_neighbor + eps) / (pre_neighbor_degree + eps_B);
-      post_move_prob += prop_edges_to_neighbor * (post_old_to_neighbor + eps) / (post_neighbor_degree + eps_B);
+    // first check if node being moved has any connections to this neighbor.
+    // Internal edges lead back to whichever block the node is in.
+    const int pre_node_to_neighbor  = pre.node_to_neighbor + (neighbor_is_old ? num_internal : 0);
+    const int post_node_to_neighbor = pre.node_to_neighbor + (neighbor_is_new ? num_internal : 0);
+    if (pre_node_to_neighbor != 0 || post_node_to_neighbor != 0) {
+      const double eps_B = eps * n_possible_neighbors;
+
+      pre_move_prob += (pre_node_to_neighbor / node_degree) * (pre.new_to_neighbor + eps) / (pre_neighbor_degree + eps_B);
+      post_move_prob += (post_node_to_neighbor / node_degree) * (post_old_to_neighbor + eps) / (post_neighbor_degree + eps_B);
     }
   } // End main neighbor loop
 
@@ -572,147 +1040,1403 @@ Proposal_Res SBM::make_proposal_decision(const NodePtr& node,
 }
 
 // =============================================================================
-// Runs efficient MCMC sweep algorithm on desired node level
+// Make a decision on the proposed new block for node using the nested entropy.
+// Moving a node doesn't just change the block pairs at the level above it: the
+// old and new blocks change degree, and so do their ancestors up until the old
+// and new ancestor chains meet, changing the entropy of every level in between.
+// The node's edges are walked up the hierarchy once to get its edge counts to
+// every level, rather than once per level.
 // =============================================================================
-MCMC_Sweeps SBM::mcmc_sweep(const int&    level,
-                            const int&    num_sweeps,
-                            const double& eps,
-                            const bool&   variable_num_blocks,
-                            const bool&   track_pairs,
-                            const bool&   verbose)
-{
-  PROFILE_FUNCTION();
 
-  const int block_level = level + 1;
+// Counts of half-edges from the old block, new block, and the node being moved
+// to a single neighbor block.
+struct Nested_Move_Cons {
+  int old_to_neighbor  = 0;
+  int new_to_neighbor  = 0;
+  int node_to_neighbor = 0;
+};
+using NestedMoveMap = std::map<NodePtr, Nested_Move_Cons>;
 
-  // Initialize structure that contains the returned values for this/these sweeps
-  MCMC_Sweeps results(num_sweeps);
+// Gathers the edge counts of the old and new blocks and the node being moved
+// together. The node counts exclude half-edges internal to the node.
+inline NestedMoveMap gather_move_cons(const NodePtr&     old_block,
+                                      const NodePtr&     new_block,
+                                      const NodeEdgeMap& node_cons)
+{
+  const int     block_level = old_block->level;
+  NestedMoveMap move_cons;
 
-  // Initialize pair tracking map if needed
-  if (track_pairs) {
-    results.block_consensus.initialize(get_level(level));
+  for (const auto& edge : old_block->edges) {
+    move_cons[edge->get_parent_at_level(block_level)].old_to_neighbor++;
   }
-
-  // Check if we have any blocks ready in the network...
-  const bool no_blocks_present = get_level(block_level)->size() == 0;
-
-  if (no_blocks_present) {
-    initialize_blocks(level);
-
-    if (verbose) {
-      WARN_ABOUT("No blocks present. Initializing one block per node.");
-    }
+  for (const auto& edge : new_block->edges) {
+    move_cons[edge->get_parent_at_level(block_level)].new_to_neighbor++;
   }
-
-  if (verbose) {
-    OUT_MSG << "sweep_num,"
-            << "node,"
-            << "current_block,"
-            << "proposed_block,"
-            << "entropy_delta,"
-            << "prob_of_accept,"
-            << "move_accepted" << std::endl;
+  for (const auto& node_con : node_cons) {
+    move_cons[node_con.first].node_to_neighbor += node_con.second;
   }
 
-  // Initialize a vector of nodes that will be passed through for a sweep.
-  // Grab level map
-  const LevelPtr node_map  = get_level(level);
-  NodeVec        nodes_to_sweep;
-  nodes_to_sweep.reserve(node_map->size());
-  for (const auto& node : *node_map) {
-    nodes_to_sweep.push_back(node.second);
-  }
+  // Make sure the old and new blocks are always present
+  move_cons[old_block];
+  move_cons[new_block];
 
-  for (int i = 0; i < num_sweeps; i++) {
-    // Book keeper variables for this sweeps stats
-    int    num_nodes_moved = 0;
-    double entropy_delta   = 0;
-    
-    // Shuffle order order of nodes to be run through for sweep
-    std::shuffle(nodes_to_sweep.begin(), nodes_to_sweep.end(), sampler.generator);
+  return move_cons;
+}
 
-    // Setup container to track what pairs need to be updated for sweep
-    std::set<std::string> pair_moves;
+// Change in the edge entropy summation (sum of e_rs*ln(e_rs/w_r*w_s)) at the
+// level of the old and new blocks when the node's half-edges, and weight_moved
+// of block weight, move from one to the other. num_internal of those half-edges
+// have both ends in the node.
+template <typename Entropy_Model>
+inline double move_edge_entropy_delta(const NestedMoveMap& move_cons,
+                                      const NodePtr&       old_block,
+                                      const NodePtr&       new_block,
+                                      const double&        weight_moved,
+                                      const int&           num_internal)
+{
+  const double pre_old_weight  = Entropy_Model::block_weight(old_block);
+  const double post_old_weight = pre_old_weight - weight_moved;
+  const double pre_new_weight  = Entropy_Model::block_weight(new_block);
+  const double post_new_weight = pre_new_weight + weight_moved;
 
-    // Loop through each node
-    for (const NodePtr& curr_node : nodes_to_sweep) {
-      // Check if we're running sweep with variable block numbers. If we are, we
-      // need to make sure we don't have any extra unoccupied blocks floating around,
-      // then we need to add a new block as a potential for the node to enter
-      if (variable_num_blocks) {
-        clean_empty_blocks();
-        create_block_node(curr_node->type, block_level);
-      }
+  const Nested_Move_Cons& old_cons = move_cons.at(old_block);
+  const Nested_Move_Cons& new_cons = move_cons.at(new_block);
 
-      // Get a move proposal
-      const NodePtr proposed_new_block = propose_move(curr_node, eps, sampler);
+  double delta = 0;
 
-      // If the proposed block is the nodes current block, we don't need to waste
-      // time checking because decision will always result in same state.
-      if ((curr_node->parent)->id == proposed_new_block->id) {
-        continue;
-      }
+  for (const auto& move_edges : move_cons) {
+    const NodePtr& neighbor = move_edges.first;
+    if (neighbor == old_block || neighbor == new_block) {
+      continue;
+    }
+    const Nested_Move_Cons& pre             = move_edges.second;
+    const double            neighbor_weight = Entropy_Model::block_weight(neighbor);
 
-      if (verbose) {
-        OUT_MSG << i
-                << "," << curr_node->id
-                << "," << (curr_node->parent)->id
-                << "," << proposed_new_block->id
-                << ",";
-      }
-      // Calculate acceptance probability based on posterior changes
-      Proposal_Res proposal_results = make_proposal_decision(curr_node, proposed_new_block, eps);
+    delta += partial_entropy(pre.old_to_neighbor - pre.node_to_neighbor, post_old_weight, neighbor_weight)
+        - partial_entropy(pre.old_to_neighbor, pre_old_weight, neighbor_weight)
+        + partial_entropy(pre.new_to_neighbor + pre.node_to_neighbor, post_new_weight, neighbor_weight)
+        - partial_entropy(pre.new_to_neighbor, pre_new_weight, neighbor_weight);
+  }
 
-      // Make movement decision
-      const bool move_accepted = proposal_results.prob_of_accept > sampler.draw_unif();
+  // Pairs made up of just the old and new blocks. Self-pairs are counted in
+  // half-edges and so get downweighted.
+  const int post_old_to_old = old_cons.old_to_neighbor - 2 * old_cons.node_to_neighbor - num_internal;
+  const int post_new_to_new = new_cons.new_to_neighbor + 2 * new_cons.node_to_neighbor + num_internal;
+  const int post_old_to_new = old_cons.new_to_neighbor - new_cons.node_to_neighbor + old_cons.node_to_neighbor;
+
+  delta += partial_entropy(post_old_to_new, post_old_weight, post_new_weight)
+      - partial_entropy(old_cons.new_to_neighbor, pre_old_weight, pre_new_weight);
+  delta += (partial_entropy(post_old_to_old, post_old_weight, post_old_weight)
+            - partial_entropy(old_cons.old_to_neighbor, pre_old_weight, pre_old_weight))
+      / 2;
+  delta += (partial_entropy(post_new_to_new, post_new_weight, post_new_weight)
+            - partial_entropy(new_cons.new_to_neighbor, pre_new_weight, pre_new_weight))
+      / 2;
+
+  return delta;
+}
 
+Proposal_Res SBM::make_nested_proposal_decision(const NodePtr& node,
+                                                const NodePtr& new_block,
+                                                const double&  eps,
+                                                const int&     top_level)
+{
+  const int n_possible_neighbors = count_move_blocks<Polypartite_Network>(node, new_block->level).possible_neighbors;
 
-      if (verbose) {
-        OUT_MSG << proposal_results.entropy_delta << "," << proposal_results.prob_of_accept << ","
-                << move_accepted << std::endl;
-      }
+  return degree_corrected
+      ? make_model_nested_proposal_decision<Degree_Corrected>(node, new_block, eps, top_level, n_possible_neighbors)
+      : make_model_nested_proposal_decision<Non_Degree_Corrected>(node, new_block, eps, top_level, n_possible_neighbors);
+}
+
+template <typename Entropy_Model>
+Proposal_Res SBM::make_model_nested_proposal_decision(const NodePtr& node,
+                                                      const NodePtr& new_block,
+                                                      const double&  eps,
+                                                      const int&     top_level,
+                                                      const int&     n_possible_neighbors)
+{
+  PROFILE_FUNCTION(proposal);
+
+  const NodePtr old_block = node->parent;
+  if (old_block == new_block) {
+    return Proposal_Res(0.0, 0.0);
+  }
+
+  const int    node_level  = node->level;
+  const int    num_above   = top_level - node_level; // Levels from the node's blocks up to top_level
+  const double node_degree = node->degree;
+
+  // Ancestors of the node before and after the move for each level above it
+  NodeVec old_chain { old_block };
+  NodeVec new_chain { new_block };
+  for (int i = 1; i < num_above; i++) {
+    old_chain.push_back(old_chain[i - 1]->parent);
+    new_chain.push_back(new_chain[i - 1]->parent);
+  }
+
+  // Walk each of the node's edges up the hierarchy once, counting the node's
+  // edges to every level above it along the way
+  std::vector<NodeEdgeMap> node_cons(num_above);
+  int                      num_internal = 0;
+  for (const auto& edge : node->edges) {
+    NodePtr ancestor = edge;
+    while (ancestor->level < node_level) {
+      ancestor = ancestor->parent;
+    }
+
+    if (ancestor == node) {
+      num_internal++;
+      continue;
+    }
+
+    for (int i = 0; i < num_above; i++) {
+      ancestor = ancestor->parent;
+      node_cons[i][ancestor]++;
+    }
+  }
+
+  // Level the proposal takes place on is always changed
+  // The node is a member of its own block but only a descendant of the blocks
+  // above that, so it may carry a different weight with it there
+  const double member_weight     = Entropy_Model::member_weight(node_degree);
+  const double descendant_weight = Entropy_Model::edge_weight(node_degree);
+
+  const NestedMoveMap move_cons     = gather_move_cons(old_block, new_block, node_cons[0]);
+  double              entropy_delta = -move_edge_entropy_delta<Entropy_Model>(move_cons, old_block, new_block, member_weight, num_internal);
+
+  for (int i = 1; i < num_above; i++) {
+    const NodePtr& old_ancestor = old_chain[i - 1];
+    const NodePtr& new_ancestor = new_chain[i - 1];
+
+    // Once the chains meet nothing further up changes
+    if (old_ancestor == new_ancestor) {
+      break;
+    }
+
+    // The node's old and new ancestors at this level change degree...
+    const double pre_old_degree = old_ancestor->degree;
+    const double pre_new_degree = new_ancestor->degree;
+    entropy_delta += Entropy_Model::degree_term(pre_old_degree) + Entropy_Model::degree_term(pre_new_degree)
+        - Entropy_Model::degree_term(pre_old_degree - node_degree) - Entropy_Model::degree_term(pre_new_degree + node_degree);
+
+    // ...and if their blocks differ the node's edges move between those too
+    if (old_chain[i] != new_chain[i]) {
+      entropy_delta -= move_edge_entropy_delta<Entropy_Model>(gather_move_cons(old_chain[i], new_chain[i], node_cons[i]),
+                                                              old_chain[i],
+                                                              new_chain[i],
+                                                              descendant_weight,
+                                                              num_internal);
+    }
+  }
+
+  // Probabilities of proposing this move and its reverse, as in
+  // make_proposal_decision. Edges internal to the node lead back to the node's
+  // own block.
+  const double eps_B = eps * n_possible_neighbors;
+
+  const Nested_Move_Cons& old_cons        = move_cons.at(old_block);
+  const Nested_Move_Cons& new_cons        = move_cons.at(new_block);
+  const double            post_old_degree = old_block->degree - node_degree;
+  const double            post_new_degree = new_block->degree + node_degree;
+  const int               post_old_to_new = old_cons.new_to_neighbor - new_cons.node_to_neighbor + old_cons.node_to_neighbor;
+
+  double pre_move_prob  = num_internal * (old_cons.new_to_neighbor + eps) / (old_block->degree + eps_B);
+  double post_move_prob = num_internal * (post_old_to_new + eps) / (post_new_degree + eps_B);
+
+  for (const auto& move_edges : move_cons) {
+    const NodePtr&          neighbor = move_edges.first;
+    const Nested_Move_Cons& pre      = move_edges.second;
+
+    if (pre.node_to_neighbor == 0) {
+      continue;
+    }
+
+    int    post_old_to_neighbor = pre.old_to_neighbor - pre.node_to_neighbor;
+    double post_neighbor_degree = neighbor->degree;
+
+    if (neighbor == old_block) {
+      post_old_to_neighbor = pre.old_to_neighbor - 2 * pre.node_to_neighbor - num_internal;
+      post_neighbor_degree = post_old_degree;
+    }
+    else if (neighbor == new_block) {
+      post_old_to_neighbor = post_old_to_new;
+      post_neighbor_degree = post_new_degree;
+    }
+
+    pre_move_prob += pre.node_to_neighbor * (pre.new_to_neighbor + eps) / (neighbor->degree + eps_B);
+    post_move_prob += pre.node_to_neighbor * (post_old_to_neighbor + eps) / (post_neighbor_degree + eps_B);
+  }
+
+  return Proposal_Res(entropy_delta, exp(-entropy_delta) * (post_move_prob / pre_move_prob));
+}
+
+// =============================================================================
+// Score every block of the right type for a batch of nodes that aren't in the
+// model yet. Follows the same maths as make_proposal_decision: placing a node in
+// block r only changes the entropy terms of block pairs involving r (the degree
+// changes of the node's neighbor blocks are shared by every candidate), so each
+// candidate just needs r's block-to-block edge counts.
+// =============================================================================
+BlockAssignments SBM::assign_new_nodes(const std::vector<std::string>& node_ids,
+                                       const std::vector<std::string>& node_types,
+                                       const std::vector<std::string>& edges_from,
+                                       const std::vector<std::string>& edges_to,
+                                       const int&                      level,
+                                       const int&                      num_threads) const
+{
+  return degree_corrected
+      ? model_assign_new_nodes<Degree_Corrected>(node_ids, node_types, edges_from, edges_to, level, num_threads)
+      : model_assign_new_nodes<Non_Degree_Corrected>(node_ids, node_types, edges_from, edges_to, level, num_threads);
+}
+
+template <typename Entropy_Model>
+BlockAssignments SBM::model_assign_new_nodes(const std::vector<std::string>& node_ids,
+                                             const std::vector<std::string>& node_types,
+                                             const std::vector<std::string>& edges_from,
+                                             const std::vector<std::string>& edges_to,
+                                             const int&                      level,
+                                             const int&                      num_threads) const
+{
+  PROFILE_FUNCTION(proposal);
+
+  const int block_level = level + 1;
+  const int num_new     = node_ids.size();
+  const int num_edges   = edges_from.size();
+
+  if (node_types.size() != node_ids.size()) {
+    LOGIC_ERROR("Need a type for every new node.");
+  }
+  if (edges_to.size() != edges_from.size()) {
+    LOGIC_ERROR("Edge from and to vectors must be the same length.");
+  }
+
+  const LevelPtr blocks     = get_level(block_level);
+  const int      num_blocks = blocks->size();
+
+  if (num_blocks == 0) {
+    LOGIC_ERROR("Network has not had block structure initialized.");
+  }
+
+  // Snapshot the block level into flat vectors so the scoring threads never
+  // have to touch the node pointer structure
+  std::map<NodePtr, int>                  block_index;
+  NodeVec                                 block_nodes;
+  std::vector<double>                     block_weight;
+  std::map<std::string, std::vector<int>> blocks_of_type;
+  block_nodes.reserve(num_blocks);
+  block_weight.reserve(num_blocks);
+
+  for (const auto& block : *blocks) {
+    blocks_of_type[block.second->type].push_back(block_nodes.size());
+    block_index.emplace(block.second, block_nodes.size());
+    block_nodes.push_back(block.second);
+    block_weight.push_back(Entropy_Model::block_weight(block.second));
+  }
+
+  // Half-edge counts from each block to its neighbor blocks, sorted by neighbor
+  // index. (Edges within a block are seen from both ends and so counted twice.)
+  using Block_Counts = std::vector<std::pair<int, int>>;
+  std::vector<Block_Counts> block_cons(num_blocks);
+
+  for (int r = 0; r < num_blocks; r++) {
+    std::map<int, int> counts;
+    for (const auto& edge : block_nodes[r]->edges) {
+      counts[block_index.at(edge->get_parent_at_level(block_level))]++;
+    }
+    block_cons[r].assign(counts.begin(), counts.end());
+  }
+
+  // Count up each new node's edges to the blocks of its neighbors
+  std::map<std::string, int> new_node_index;
+  for (int i = 0; i < num_new; i++) {
+    if (!new_node_index.emplace(node_ids[i], i).second) {
+      LOGIC_ERROR("Node " + node_ids[i] + " appears in batch more than once.");
+    }
+    if (blocks_of_type.count(node_types[i]) == 0) {
+      LOGIC_ERROR("No blocks of type " + node_types[i] + " for node " + node_ids[i] + " to join.");
+    }
+  }
+
+  std::vector<std::map<int, int>> new_node_counts(num_new);
+  for (int i = 0; i < num_edges; i++) {
+    const auto new_node_loc = new_node_index.find(edges_from[i]);
+    if (new_node_loc == new_node_index.end()) {
+      LOGIC_ERROR("Edge " + edges_from[i] + " - " + edges_to[i] + " does not start at a node in the batch.");
+    }
+
+    const NodePtr neighbor = get_node_by_id(edges_to[i], level);
+    new_node_counts[new_node_loc->second][block_index.at(neighbor->get_parent_at_level(block_level))]++;
+  }
+
+  BlockAssignments assignments(num_new);
+
+  parallel_for(num_new, num_threads, [&](const int n) {
+    const std::vector<int>& candidates = blocks_of_type.at(node_types[n]);
+    const Block_Counts      node_cons(new_node_counts[n].begin(), new_node_counts[n].end());
+
+    double node_degree = 0;
+    for (const auto& node_con : node_cons) {
+      node_degree += node_con.second;
+    }
+
+    std::vector<double> candidate_deltas;
+    candidate_deltas.reserve(candidates.size());
+
+    for (const int r : candidates) {
+      // Edges from new node to the candidate block itself
+      const auto node_to_r_it = std::lower_bound(node_cons.begin(), node_cons.end(), std::make_pair(r, 0));
+      const int  node_to_r    = (node_to_r_it != node_cons.end() && node_to_r_it->first == r) ? node_to_r_it->second : 0;
+
+      // Weight of candidate with the node's edges counted from the neighbor
+      // side only (pre) and then with the node inside of it (post)
+      const double pre_r_weight  = block_weight[r] + Entropy_Model::edge_weight(node_to_r);
+      const double post_r_weight = pre_r_weight + Entropy_Model::member_weight(node_degree);
+
+      double edge_entropy_delta = 0;
+
+      auto add_pair_contribution = [&](const int s, const int r_to_s, const int node_to_s) {
+        if (s == r) {
+          // Self-pairs are seen in half-edges so get downweighted
+          edge_entropy_delta += (partial_entropy(r_to_s + 2 * node_to_s, post_r_weight, post_r_weight)
+                                 - partial_entropy(r_to_s, pre_r_weight, pre_r_weight))
+              / 2;
+        }
+        else {
+          const double s_weight = block_weight[s] + Entropy_Model::edge_weight(node_to_s);
+          edge_entropy_delta += partial_entropy(r_to_s + node_to_s, post_r_weight, s_weight)
+              - partial_entropy(r_to_s, pre_r_weight, s_weight);
+        }
+      };
+
+      // Walk the union of the candidate's and the new node's neighbor blocks
+      auto r_it    = block_cons[r].begin();
+      auto node_it = node_cons.begin();
+      while (r_it != block_cons[r].end() || node_it != node_cons.end()) {
+        const bool r_done    = r_it == block_cons[r].end();
+        const bool node_done = node_it == node_cons.end();
+
+        if (node_done || (!r_done && r_it->first < node_it->first)) {
+          add_pair_contribution(r_it->first, r_it->second, 0);
+          r_it++;
+        }
+        else if (r_done || node_it->first < r_it->first) {
+          add_pair_contribution(node_it->first, 0, node_it->second);
+          node_it++;
+        }
+        else {
+          add_pair_contribution(r_it->first, r_it->second, node_it->second);
+          r_it++;
+          node_it++;
+        }
+      }
+
+      // Entropy is the negative of the edge entropy sum
+      candidate_deltas.push_back(-edge_entropy_delta);
+    }
+
+    // Lowest entropy is best. Probabilities are proportional to exp(-delta)
+    const int    best_index = std::min_element(candidate_deltas.begin(), candidate_deltas.end()) - candidate_deltas.begin();
+    const double best_delta = candidate_deltas[best_index];
+
+    double normalizer = 0;
+    for (const double& delta : candidate_deltas) {
+      normalizer += std::exp(best_delta - delta);
+    }
+
+    Block_Assignment& assignment = assignments[n];
+    assignment.id                = node_ids[n];
+    assignment.best_block        = block_nodes[candidates[best_index]]->id;
+    assignment.entropy_delta     = best_delta;
+    assignment.prob              = 1 / normalizer;
+  });
+
+  return assignments;
+}
+
+// =============================================================================
+// Give a single node the chance to move blocks. Any accepted move is recorded
+// in the sweep results. Returns if the node was moved or not.
+// =============================================================================
+bool SBM::attempt_move(const NodePtr& curr_node,
+                       const double&  eps,
+                       const bool&    variable_num_blocks,
+                       const bool&    track_pairs,
+                       const bool&    verbose,
+                       const int&     sweep_num,
+                       Sweep_Res&     sweep_results,
+                       const int&     nested_top_level)
+{
+  return (this->*get_move_attempter())(curr_node,
+                                       eps,
+                                       variable_num_blocks,
+                                       track_pairs,
+                                       verbose,
+                                       sweep_num,
+                                       sweep_results,
+                                       nested_top_level);
+}
+
+// Sweeps look this up once and then call the specialisation for every node
+SBM::Move_Attempter SBM::get_move_attempter() const
+{
+  switch (get_structure()) {
+  case Network_Structure::unipartite:
+    return &SBM::attempt_structured_move<Unipartite_Network>;
+  case Network_Structure::bipartite:
+    return &SBM::attempt_structured_move<Bipartite_Network>;
+  default:
+    return &SBM::attempt_structured_move<Polypartite_Network>;
+  }
+}
+
+template <typename Structure>
+bool SBM::attempt_structured_move(const NodePtr& curr_node,
+                                  const double&  eps,
+                                  const bool&    variable_num_blocks,
+                                  const bool&    track_pairs,
+                                  const bool&    verbose,
+                                  const int&     sweep_num,
+                                  Sweep_Res&     sweep_results,
+                                  const int&     nested_top_level)
+{
+  const int     block_level = curr_node->level + 1;
+  const NodePtr old_block   = curr_node->parent;
+
+  // With variable block numbers the node gets a fresh block as a potential to
+  // enter. Blocks only ever empty out through a move, so removing the fresh
+  // block if it goes unused and the old block if the move empties it keeps
+  // the level free of empty blocks without scanning it.
+  NodePtr fresh_block;
+  if (variable_num_blocks) {
+    fresh_block = create_block_node(curr_node->type, block_level);
+  }
+
+  // Phases are timed off one clock read at each boundary
+  stats.proposals++;
+  int64_t phase_start = profile_now_ns();
+
+  // Both the proposal and the decision need to know how many blocks there are
+  // to move to and to connect to
+  const Move_Block_Counts block_counts = count_move_blocks<Structure>(curr_node, block_level);
+
+  // Get a move proposal
+  const NodePtr proposed_new_block = propose_structured_move<Structure>(curr_node, eps, sampler, block_counts.candidates);
+
+  int64_t phase_end = profile_now_ns();
+  stats.propose_ns += phase_end - phase_start;
+  phase_start = phase_end;
+
+  // If the proposed block is the nodes current block, we don't need to waste
+  // time checking because decision will always result in same state.
+  if ((curr_node->parent)->id == proposed_new_block->id) {
+    stats.proposals_unchanged++;
+    if (fresh_block) {
+      remove_block_if_empty(fresh_block);
+    }
+    return false;
+  }
+
+  if (verbose) {
+    OUT_MSG << sweep_num
+            << "," << curr_node->id
+            << "," << (curr_node->parent)->id
+            << "," << proposed_new_block->id
+            << ",";
+  }
+  // Calculate acceptance probability based on posterior changes. Nested sweeps
+  // score against all the levels up to the top of the hierarchy.
+  const int&   n_possible_neighbors = block_counts.possible_neighbors;
+  Proposal_Res proposal_results     = nested_top_level < 0
+      ? (degree_corrected
+             ? make_model_proposal_decision<Degree_Corrected>(curr_node, proposed_new_block, eps, n_possible_neighbors)
+             : make_model_proposal_decision<Non_Degree_Corrected>(curr_node, proposed_new_block, eps, n_possible_neighbors))
+      : (degree_corrected
+             ? make_model_nested_proposal_decision<Degree_Corrected>(curr_node, proposed_new_block, eps, nested_top_level, n_possible_neighbors)
+             : make_model_nested_proposal_decision<Non_Degree_Corrected>(curr_node, proposed_new_block, eps, nested_top_level, n_possible_neighbors));
+
+  // Make movement decision
+  const bool move_accepted = proposal_results.prob_of_accept > sampler.draw_unif();
+
+  if (verbose) {
+    OUT_MSG << proposal_results.entropy_delta << "," << proposal_results.prob_of_accept << ","
+            << move_accepted << std::endl;
+  }
+
+  if (proposal_trace) {
+    proposal_trace->record(sweep_num,
+                           curr_node->id,
+                           (curr_node->parent)->id,
+                           proposed_new_block->id,
+                           proposal_results.entropy_delta,
+                           proposal_results.prob_of_accept,
+                           move_accepted);
+  }
+
+  phase_end = profile_now_ns();
+  stats.evaluate_ns += phase_end - phase_start;
+  phase_start = phase_end;
+
+  // Is the move accepted?
+  if (move_accepted) {
+    stats.proposals_accepted++;
+
+    // Move the node
+    curr_node->set_parent(proposed_new_block);
+
+    if (move_log) {
+      static const std::string no_parent = "none";
+      move_log->record(sweep_num,
+                       curr_node->id,
+                       proposed_new_block->id,
+                       proposed_new_block->parent ? proposed_new_block->parent->id : no_parent);
+    }
+
+    // Update results
+    sweep_results.nodes_moved.push_back(curr_node->id);
+    sweep_results.entropy_delta += proposal_results.entropy_delta;
+
+    if (track_pairs) {
+      Block_Consensus::update_changed_pairs(curr_node->id,
+                                            old_block->children,
+                                            proposed_new_block->children,
+                                            sweep_results.pair_moves);
+    }
+
+    stats.apply_ns += profile_now_ns() - phase_start;
+  } // End accepted if statement
+  else {
+    stats.proposals_rejected++;
+  }
+
+  if (variable_num_blocks) {
+    remove_block_if_empty(fresh_block);
+    remove_block_if_empty(old_block);
+  }
+
+  return move_accepted;
+}
+
+void SBM::remove_block_if_empty(NodePtr block)
+{
+  while (block && block->level > 0 && block->children.size() == 0) {
+    const NodePtr parent = block->parent;
+    if (parent) {
+      parent->remove_child(block);
+    }
+    update_type_counts(block, -1);
+    get_level(block->level)->erase(block->id);
+    stats.blocks_removed++;
+    block = parent;
+  }
+}
+
+void SBM::clear_empty_blocks_for_sweep(const bool& variable_num_blocks)
+{
+  // Moves only clean up the blocks they empty, so start from a level with none
+  if (variable_num_blocks) {
+    clean_empty_blocks();
+  }
+}
+
+// =============================================================================
+// Runs efficient MCMC sweep algorithm on desired node level
+// =============================================================================
+MCMC_Sweeps SBM::mcmc_sweep(const int&    level,
+                            const int&    num_sweeps,
+                            const double& eps,
+                            const bool&   variable_num_blocks,
+                            const bool&   track_pairs,
+                            const bool&   verbose)
+{
+  PROFILE_FUNCTION(proposal);
+
+  const int block_level = level + 1;
+
+  // Initialize structure that contains the returned values for this/these sweeps
+  MCMC_Sweeps results(num_sweeps);
+
+  // Initialize pair tracking map if needed
+  if (track_pairs) {
+    results.block_consensus.initialize(get_level(level));
+  }
+
+  // Check if we have any blocks ready in the network...
+  const bool no_blocks_present = get_level(block_level)->size() == 0;
+
+  if (no_blocks_present) {
+    initialize_blocks(level);
+
+    if (verbose) {
+      WARN_ABOUT("No blocks present. Initializing one block per node.");
+    }
+  }
+
+  if (verbose) {
+    OUT_MSG << "sweep_num,"
+            << "node,"
+            << "current_block,"
+            << "proposed_block,"
+            << "entropy_delta,"
+            << "prob_of_accept,"
+            << "move_accepted" << std::endl;
+  }
+
+  // Initialize a vector of nodes that will be passed through for a sweep.
+  // Grab level map
+  const LevelPtr node_map  = get_level(level);
+  NodeVec        nodes_to_sweep;
+  nodes_to_sweep.reserve(node_map->size());
+  for (const auto& node : *node_map) {
+    nodes_to_sweep.push_back(node.second);
+  }
+
+  // The network's structure doesn't change during the sweeps
+  const Move_Attempter attempt = get_move_attempter();
+
+  clear_empty_blocks_for_sweep(variable_num_blocks);
+
+  for (int i = 0; i < num_sweeps && !stop_requested(); i++) {
+    // Book keeper for this sweeps stats
+    Sweep_Res sweep_results;
+
+    // Shuffle order order of nodes to be run through for sweep
+    std::shuffle(nodes_to_sweep.begin(), nodes_to_sweep.end(), sampler.generator);
+
+    // Loop through each node
+    for (const NodePtr& curr_node : nodes_to_sweep) {
+      (this->*attempt)(curr_node, eps, variable_num_blocks, track_pairs, verbose, i, sweep_results, -1);
+    } // End current sweep
+
+    // Update results for this sweep
+    results.sweep_num_nodes_moved.push_back(sweep_results.nodes_moved.size());
+    results.sweep_entropy_delta.push_back(sweep_results.entropy_delta);
+    results.nodes_moved.splice(results.nodes_moved.end(), sweep_results.nodes_moved);
+
+    // Update the concensus pairs map with results if needed.
+    if (track_pairs) {
+      results.block_consensus.update_pair_tracking_map(sweep_results.pair_moves);
+    }
+  } // End multi-sweep loop
+
+  last_sweep_memory = results.memory_report();
+
+  return results;
+}
+
+// =============================================================================
+// Streams MCMC sweeps to a callback one sweep at a time. Nodes are visited in
+// the same order mcmc_sweep() would for a given random seed but only the
+// current sweep's moves are ever held.
+// =============================================================================
+int SBM::mcmc_sweep_stream(const int&            level,
+                           const int&            num_sweeps,
+                           const double&         eps,
+                           const bool&           variable_num_blocks,
+                           const Sweep_Callback& on_sweep,
+                           const int&            first_sweep,
+                           Block_Consensus*      pair_counts)
+{
+  PROFILE_FUNCTION(proposal);
+
+  // Streams carried on over several calls keep counting into the same pairs
+  const bool track_pairs = pair_counts != nullptr;
+  if (track_pairs && pair_counts->concensus_pairs.empty()) {
+    pair_counts->initialize(get_level(level));
+  }
+
+  if (get_level(level + 1)->size() == 0) {
+    initialize_blocks(level);
+  }
+
+  // Nodes are referred to by their place in the level so records don't need
+  // to carry ids around
+  const LevelPtr node_map = get_level(level);
+  NodeVec        level_nodes;
+  level_nodes.reserve(node_map->size());
+  for (const auto& node : *node_map) {
+    level_nodes.push_back(node.second);
+  }
+
+  // Shuffling indices gives the same order as shuffling the nodes themselves.
+  // New streams start from the level's order as mcmc_sweep() does.
+  const bool carries_on = first_sweep == stream_next_sweep && level == stream_sweep_level
+      && stream_sweep_order.size() == level_nodes.size();
+  if (!carries_on) {
+    stream_sweep_order.resize(level_nodes.size());
+    std::iota(stream_sweep_order.begin(), stream_sweep_order.end(), 0);
+    stream_sweep_level = level;
+  }
+  std::vector<int>& sweep_order = stream_sweep_order;
+
+  const Move_Attempter attempt = get_move_attempter();
+
+  clear_empty_blocks_for_sweep(variable_num_blocks);
+
+  Sweep_Res    sweep_results;
+  Sweep_Record record;
+
+  for (int i = 0; i < num_sweeps; i++) {
+    if (stop_requested()) {
+      return i;
+    }
+    record.sweep      = first_sweep + i;
+    stream_next_sweep = record.sweep + 1;
+    record.nodes_moved.clear();
+    sweep_results.nodes_moved.clear();
+    sweep_results.pair_moves.clear();
+    sweep_results.entropy_delta = 0;
+
+    std::shuffle(sweep_order.begin(), sweep_order.end(), sampler.generator);
+
+    for (const int& node_index : sweep_order) {
+      if ((this->*attempt)(level_nodes[node_index], eps, variable_num_blocks, track_pairs, false, record.sweep, sweep_results, -1)) {
+        record.nodes_moved.push_back(node_index);
+      }
+    }
+    record.entropy_delta = sweep_results.entropy_delta;
+
+    if (track_pairs) {
+      pair_counts->update_pair_tracking_map(sweep_results.pair_moves);
+    }
+
+    if (!on_sweep(record)) {
+      return i + 1;
+    }
+  }
+
+  return num_sweeps;
+}
+
+Sweep_Chunk SBM::mcmc_sweep_chunk(const int&    level,
+                                  const int&    num_sweeps,
+                                  const double& eps,
+                                  const bool&   variable_num_blocks,
+                                  const int&    first_sweep)
+{
+  Sweep_Chunk chunk;
+  chunk.sweep.reserve(num_sweeps);
+  chunk.entropy_delta.reserve(num_sweeps);
+  chunk.num_nodes_moved.reserve(num_sweeps);
+
+  const auto add_to_chunk = [&chunk](const Sweep_Record& record) {
+    chunk.sweep.push_back(record.sweep);
+    chunk.entropy_delta.push_back(record.entropy_delta);
+    chunk.num_nodes_moved.push_back(record.nodes_moved.size());
+    chunk.move_sweep.insert(chunk.move_sweep.end(), record.nodes_moved.size(), record.sweep);
+    chunk.move_node.insert(chunk.move_node.end(), record.nodes_moved.begin(), record.nodes_moved.end());
+    return true;
+  };
+
+  mcmc_sweep_stream(level, num_sweeps, eps, variable_num_blocks, add_to_chunk, first_sweep);
+
+  return chunk;
+}
+
+std::vector<std::string> SBM::get_sweep_node_ids(const int& level) const
+{
+  const LevelPtr           node_map = get_level(level);
+  std::vector<std::string> ids;
+  ids.reserve(node_map->size());
+  for (const auto& node : *node_map) {
+    ids.push_back(node.first);
+  }
+  return ids;
+}
+
+// =============================================================================
+// Runs MCMC sweeps with the chain checkpointed to a file as it goes so a long
+// run that gets killed can be carried on with resume_sweeps(). Nodes are
+// visited in the same order mcmc_sweep() would visit them for a given random
+// seed.
+// =============================================================================
+MCMC_Sweeps SBM::mcmc_sweep_checkpointed(const int&         level,
+                                         const int&         num_sweeps,
+                                         const double&      eps,
+                                         const bool&        variable_num_blocks,
+                                         const bool&        track_pairs,
+                                         const std::string& checkpoint_path,
+                                         const int&         every_sweeps,
+                                         const double&      every_seconds)
+{
+  PROFILE_FUNCTION(proposal);
+
+  Checkpoint_Writer writer(checkpoint_path);
+
+  if (get_level(level + 1)->size() == 0) {
+    initialize_blocks(level);
+  }
+
+  Chain_Checkpoint chain;
+  chain.level               = level;
+  chain.num_sweeps          = num_sweeps;
+  chain.eps                 = eps;
+  chain.variable_num_blocks = variable_num_blocks;
+  chain.track_pairs         = track_pairs;
+  chain.degree_corrected    = degree_corrected;
+
+  chain.sweep_order.resize(get_level(level)->size());
+  std::iota(chain.sweep_order.begin(), chain.sweep_order.end(), 0);
+
+  std::shared_ptr<Chain_Checkpoint::Edge_List> edge_list = std::make_shared<Chain_Checkpoint::Edge_List>();
+  edge_list->from.reserve(edges.size());
+  edge_list->to.reserve(edges.size());
+  for (const auto& edge : edges) {
+    edge_list->from.push_back(edge.node_a->id);
+    edge_list->to.push_back(edge.node_b->id);
+  }
+  chain.edges = edge_list;
+
+  MCMC_Sweeps results(num_sweeps);
+  if (track_pairs) {
+    results.block_consensus.initialize(get_level(level));
+  }
+
+  run_checkpointed_chain(chain, results, writer, every_sweeps, every_seconds);
+
+  return results;
+}
+
+// =============================================================================
+// Put the model back in the state a checkpointed chain was in when it was last
+// saved and carry on with the rest of its sweeps
+// =============================================================================
+MCMC_Sweeps SBM::resume_sweeps(const std::string& checkpoint_path,
+                               const int&         every_sweeps,
+                               const double&      every_seconds)
+{
+  PROFILE_FUNCTION(proposal);
+
+  // Proposals made between the last checkpoint and the chain stopping are
+  // already in the first run's trace, and would be traced again here
+  if (proposal_trace) {
+    LOGIC_ERROR("Resumed chains can't be traced as they'd repeat proposals. Stop the proposal trace first.");
+  }
+
+  Chain_Checkpoint chain = read_checkpoint(checkpoint_path);
+
+  // Resuming on another network would run but be meaningless
+  const Chain_Checkpoint::Edge_List& chain_edges = *chain.edges;
+  bool same_network = chain_edges.from.size() == edges.size();
+  auto edge_it      = edges.begin();
+  for (std::size_t i = 0; same_network && i < chain_edges.from.size(); i++, edge_it++) {
+    same_network = edge_it->node_a->id == chain_edges.from[i] && edge_it->node_b->id == chain_edges.to[i];
+  }
+  if (!same_network || int(get_level(chain.level)->size()) != int(chain.sweep_order.size())) {
+    LOGIC_ERROR("Checkpoint " + checkpoint_path + " was taken from a different network.");
+  }
+
+  // Moves scored under the other model would make a different chain
+  if (chain.degree_corrected != degree_corrected) {
+    LOGIC_ERROR("Checkpoint " + checkpoint_path + " was taken with degree correction "
+                + (chain.degree_corrected ? "on" : "off") + ", the model has it "
+                + (degree_corrected ? "on." : "off."));
+  }
+
+  Checkpoint_Writer writer(checkpoint_path);
+
+  set_state(chain.state_id, chain.state_parent, chain.state_level, chain.state_type);
+
+  // A move log started ahead of resuming starts from the restored state
+  if (move_log) {
+    move_log->record_state(chain.state_id, chain.state_parent, chain.state_level, chain.state_type);
+  }
+
+  chain.state_id.clear();
+  chain.state_parent.clear();
+  chain.state_level.clear();
+  chain.state_type.clear();
+
+  std::istringstream sampler_state(chain.sampler_state);
+  sampler_state >> sampler.generator;
+  if (!sampler_state) {
+    LOGIC_ERROR("Checkpoint " + checkpoint_path + " has a corrupt random generator state.");
+  }
+
+  MCMC_Sweeps results(chain.num_sweeps);
+  results.sweep_entropy_delta   = std::move(chain.sweep_entropy_delta);
+  results.sweep_num_nodes_moved = std::move(chain.sweep_num_nodes_moved);
+  if (chain.track_pairs) {
+    chain.get_pair_counts(results.block_consensus);
+    chain.set_pair_counts(Block_Consensus());
+  }
+
+  run_checkpointed_chain(chain, results, writer, every_sweeps, every_seconds);
+
+  return results;
+}
+
+void SBM::run_checkpointed_chain(Chain_Checkpoint&  chain,
+                                 MCMC_Sweeps&       results,
+                                 Checkpoint_Writer& writer,
+                                 const int&         every_sweeps,
+                                 const double&      every_seconds)
+{
+  const LevelPtr node_map = get_level(chain.level);
+  NodeVec        level_nodes;
+  level_nodes.reserve(node_map->size());
+  for (const auto& node : *node_map) {
+    level_nodes.push_back(node.second);
+  }
+
+  const Move_Attempter attempt = get_move_attempter();
+
+  clear_empty_blocks_for_sweep(chain.variable_num_blocks);
+
+  using Clock                          = std::chrono::steady_clock;
+  Clock::time_point last_checkpoint    = Clock::now();
+  int               sweeps_since_saved = 0;
+
+  // Copying the chain's state is all the sweeps wait for, the writer thread
+  // takes care of the rest
+  const auto save_checkpoint = [&]() {
+    Chain_Checkpoint snapshot = chain;
+
+    State_Dump state       = get_state();
+    snapshot.state_id      = std::move(state.id);
+    snapshot.state_parent  = std::move(state.parent);
+    snapshot.state_level   = std::move(state.level);
+    snapshot.state_type    = std::move(state.type);
+
+    std::ostringstream sampler_state;
+    sampler_state << sampler.generator;
+    snapshot.sampler_state = sampler_state.str();
+
+    snapshot.sweep_entropy_delta   = results.sweep_entropy_delta;
+    snapshot.sweep_num_nodes_moved = results.sweep_num_nodes_moved;
+    if (chain.track_pairs) {
+      snapshot.set_pair_counts(results.block_consensus);
+    }
+
+    writer.submit(std::move(snapshot));
+    last_checkpoint    = Clock::now();
+    sweeps_since_saved = 0;
+  };
+
+  while (chain.sweeps_done < chain.num_sweeps && !stop_requested()) {
+    Sweep_Res sweep_results;
+
+    std::shuffle(chain.sweep_order.begin(), chain.sweep_order.end(), sampler.generator);
+
+    for (const int& node_index : chain.sweep_order) {
+      (this->*attempt)(level_nodes[node_index],
+                       chain.eps,
+                       chain.variable_num_blocks,
+                       chain.track_pairs,
+                       false,
+                       chain.sweeps_done,
+                       sweep_results,
+                       -1);
+    }
+
+    results.sweep_num_nodes_moved.push_back(sweep_results.nodes_moved.size());
+    results.sweep_entropy_delta.push_back(sweep_results.entropy_delta);
+    results.nodes_moved.splice(results.nodes_moved.end(), sweep_results.nodes_moved);
 
-      // Is the move accepted?
-      if (move_accepted) {
-        const NodePtr old_block = curr_node->parent;
+    if (chain.track_pairs) {
+      results.block_consensus.update_pair_tracking_map(sweep_results.pair_moves);
+    }
+
+    chain.sweeps_done++;
+    sweeps_since_saved++;
+
+    const bool sweeps_due = every_sweeps > 0 && sweeps_since_saved >= every_sweeps;
+    const bool time_due   = every_seconds > 0
+        && std::chrono::duration<double>(Clock::now() - last_checkpoint).count() >= every_seconds;
+    if (sweeps_due || time_due) {
+      save_checkpoint();
+    }
+  }
 
-        // Move the node
-        curr_node->set_parent(proposed_new_block);
+  // Always leave a checkpoint of where the chain stopped
+  if (sweeps_since_saved > 0 || chain.sweeps_done == 0) {
+    save_checkpoint();
+  }
+
+  writer.close();
+  last_sweep_memory = results.memory_report();
+}
+
+// =============================================================================
+// Runs MCMC sweeps over just the neighborhood of a set of seed nodes. Useful
+// after adding nodes or edges to an already fit model as only the part of the
+// network near the change needs to re-equilibriate. Whenever a node moves its
+// neighbors get added to the set swept from the next sweep on.
+// =============================================================================
+MCMC_Sweeps SBM::mcmc_sweep_local(const std::vector<std::string>& seed_ids,
+                                  const int&                      hop_radius,
+                                  const int&                      level,
+                                  const int&                      num_sweeps,
+                                  const double&                   eps,
+                                  const bool&                     variable_num_blocks)
+{
+  PROFILE_FUNCTION(proposal);
+
+  check_no_move_log("Local sweeps");
+
+  if (nodes.count(level + 1) == 0 || get_level(level + 1)->size() == 0) {
+    LOGIC_ERROR("Network has not had block structure initialized.");
+  }
+
+  // Nodes get swept in the order they were reached from the seeds so results
+  // are reproducible for a given random seed
+  NodeSet reached_nodes;
+  NodeVec nodes_to_sweep;
+
+  // Adds node to the sweep set if it hasn't been reached already
+  auto reach_node = [&](const NodePtr& node) {
+    if (reached_nodes.insert(node).second) {
+      nodes_to_sweep.push_back(node);
+    }
+  };
+
+  // Adds all the neighbors of a node at the sweep level to the sweep set
+  auto reach_neighbors = [&](const NodePtr& node) {
+    for (const auto& edge : node->edges) {
+      reach_node(edge->get_parent_at_level(level));
+    }
+  };
+
+  for (const auto& seed_id : seed_ids) {
+    reach_node(get_node_by_id(seed_id, level));
+  }
+
+  // Breadth first expansion out to the hop radius
+  int hop_start = 0;
+  for (int hop = 0; hop < hop_radius; hop++) {
+    const int hop_end = nodes_to_sweep.size();
+    for (int i = hop_start; i < hop_end; i++) {
+      reach_neighbors(nodes_to_sweep[i]);
+    }
+    hop_start = hop_end;
+  }
+
+  MCMC_Sweeps          results(num_sweeps);
+  const Move_Attempter attempt = get_move_attempter();
+
+  // Moves remove the blocks they empty. Blocks left empty by earlier work
+  // elsewhere are left alone, as finding them means scanning the whole network.
+  for (int i = 0; i < num_sweeps; i++) {
+    Sweep_Res sweep_results;
+
+    std::shuffle(nodes_to_sweep.begin(), nodes_to_sweep.end(), sampler.generator);
+
+    // Can't add to the sweep set while looping through it so take a copy
+    const NodeVec sweep_order = nodes_to_sweep;
+    for (const NodePtr& curr_node : sweep_order) {
+      if ((this->*attempt)(curr_node, eps, variable_num_blocks, false, false, i, sweep_results, -1)) {
+        // Let the move propagate to the node's neighborhood on the next sweep
+        reach_neighbors(curr_node);
+      }
+    }
+
+    results.sweep_num_nodes_moved.push_back(sweep_results.nodes_moved.size());
+    results.sweep_entropy_delta.push_back(sweep_results.entropy_delta);
+    results.nodes_moved.splice(results.nodes_moved.end(), sweep_results.nodes_moved);
+  }
+
+  last_sweep_memory = results.memory_report();
+
+  return results;
+}
+
+// =============================================================================
+// Runs MCMC sweeps over the whole block hierarchy. Every sweep goes through the
+// levels from the data nodes up, giving each node a chance to move between the
+// blocks directly above it. Moves are scored against the nested entropy so a
+// single run fits all levels together rather than each level on its own.
+// =============================================================================
+MCMC_Sweeps SBM::mcmc_sweep_nested(const int&    num_sweeps,
+                                   const double& eps)
+{
+  PROFILE_FUNCTION(proposal);
+
+  check_no_move_log("Nested sweeps");
+
+  const int top_level = get_top_level();
+
+  if (top_level < 1) {
+    LOGIC_ERROR("Network has not had block structure initialized.");
+  }
+
+  // Every node below the top needs a block to be moved out of
+  for (int level = 0; level < top_level; level++) {
+    for (const auto& node : *get_level(level)) {
+      if (!node.second->parent) {
+        LOGIC_ERROR("Node " + node.first + " has no parent. Nested sweeps need a complete block hierarchy.");
+      }
+    }
+  }
 
-        // Update results
-        results.nodes_moved.push_back(curr_node->id);
-        num_nodes_moved++;
-        entropy_delta += proposal_results.entropy_delta;
+  MCMC_Sweeps          results(num_sweeps);
+  const Move_Attempter attempt = get_move_attempter();
 
-        if (track_pairs) {
-          Block_Consensus::update_changed_pairs(curr_node->id,
-                                                old_block->children,
-                                                proposed_new_block->children,
-                                                pair_moves);
+  for (int i = 0; i < num_sweeps; i++) {
+    Sweep_Res sweep_results;
+
+    for (int level = 0; level < top_level; level++) {
+      // Blocks may have been emptied and removed by the level below so gather
+      // the level's nodes fresh
+      const LevelPtr node_map = get_level(level);
+      NodeVec        nodes_to_sweep;
+      nodes_to_sweep.reserve(node_map->size());
+      for (const auto& node : *node_map) {
+        // Nodes without edges have nothing to propose a move from
+        if (node.second->degree > 0) {
+          nodes_to_sweep.push_back(node.second);
         }
-      } // End accepted if statement
-    }   // End current sweep
+      }
 
-    // Update results for this sweep
-    results.sweep_num_nodes_moved.push_back(num_nodes_moved);
-    results.sweep_entropy_delta.push_back(entropy_delta);
+      std::shuffle(nodes_to_sweep.begin(), nodes_to_sweep.end(), sampler.generator);
 
-    // Update the concensus pairs map with results if needed.
-    if (track_pairs) {
-      results.block_consensus.update_pair_tracking_map(pair_moves);
+      for (const NodePtr& curr_node : nodes_to_sweep) {
+        (this->*attempt)(curr_node, eps, false, false, false, i, sweep_results, top_level);
+      }
+
+      // Emptied blocks can't be swept at the next level up
+      clean_empty_blocks();
     }
-  } // End multi-sweep loop
+
+    results.sweep_num_nodes_moved.push_back(sweep_results.nodes_moved.size());
+    results.sweep_entropy_delta.push_back(sweep_results.entropy_delta);
+    results.nodes_moved.splice(results.nodes_moved.end(), sweep_results.nodes_moved);
+  }
+
+  last_sweep_memory = results.memory_report();
 
   return results;
 }
 
 // =============================================================================
-// Compute microcononical entropy of current model state
-// Note that this is currently only the degree corrected entropy
+// Choose the edge model used to score partitions
+// =============================================================================
+void SBM::set_degree_corrected(const bool& is_degree_corrected)
+{
+  degree_corrected = is_degree_corrected;
+}
+
+// =============================================================================
+// Walk the model adding up the bytes used by each structure. Block edge lists
+// hold a pointer for every data-level edge end under the block so they grow
+// with the number of levels, not just the number of blocks.
+// =============================================================================
+Memory_Report SBM::memory_report() const
+{
+  Memory_Report report;
+
+  for (const auto& level : nodes) {
+    Memory_Entry node_objects("nodes", level.first);
+    Memory_Entry edge_lists("edge_lists", level.first);
+    Memory_Entry children("children", level.first);
+    Memory_Entry level_index("level_index", level.first);
+
+    for (const auto& level_entry : *level.second) {
+      const Node& node = *level_entry.second;
+
+      node_objects.count++;
+      node_objects.bytes += sizeof(Node) + SHARED_BLOCK_OVERHEAD
+          + string_heap_bytes(node.id) + string_heap_bytes(node.type);
+
+      edge_lists.count += node.edges.size();
+      edge_lists.bytes += vector_heap_bytes(node.edges)
+          + vector_heap_bytes(node.edge_types)
+          + vector_heap_bytes(node.edge_type_ends);
+
+      children.count += node.children.size();
+      children.bytes += node.children.size() * (sizeof(NodePtr) + TREE_NODE_OVERHEAD);
+
+      level_index.count++;
+      level_index.bytes += sizeof(NodeLevel::value_type) + TREE_NODE_OVERHEAD
+          + string_heap_bytes(level_entry.first);
+    }
+
+    report.push_back(node_objects);
+    report.push_back(edge_lists);
+    report.push_back(children);
+    report.push_back(level_index);
+  }
+
+  Memory_Entry edge_list("edges", -1);
+  for (const auto& edge : edges) {
+    edge_list.count++;
+    edge_list.bytes += sizeof(Edge) + LIST_NODE_OVERHEAD + string_heap_bytes(edge.pair_id);
+  }
+  report.push_back(edge_list);
+
+  Memory_Entry components("component_links", -1);
+  components.count = component_links.size();
+  components.bytes = component_links.size() * (sizeof(std::pair<NodePtr, NodePtr>) + TREE_NODE_OVERHEAD);
+  report.push_back(components);
+
+  // Everything kept to look up node types and their allowed connections
+  Memory_Entry type_tables("type_tables", -1);
+  for (const auto& type_counts : node_type_counts) {
+    type_tables.count++;
+    type_tables.bytes += sizeof(type_counts) + TREE_NODE_OVERHEAD + string_heap_bytes(type_counts.first)
+        + type_counts.second.size() * (sizeof(std::pair<int, int>) + TREE_NODE_OVERHEAD);
+  }
+  for (const auto& type_pairs : edge_type_pairs) {
+    type_tables.bytes += sizeof(type_pairs) + TREE_NODE_OVERHEAD + string_heap_bytes(type_pairs.first);
+    for (const auto& pair_type : type_pairs.second) {
+      type_tables.bytes += sizeof(pair_type) + TREE_NODE_OVERHEAD + string_heap_bytes(pair_type);
+    }
+  }
+  for (const auto& type_id : type_ids) {
+    type_tables.bytes += sizeof(type_id) + TREE_NODE_OVERHEAD + string_heap_bytes(type_id.first);
+  }
+  type_tables.bytes += vector_heap_bytes(type_compatibility);
+  for (const auto& row : type_compatibility) type_tables.bytes += vector_heap_bytes(row);
+  type_tables.bytes += vector_heap_bytes(type_counts_by_level) + vector_heap_bytes(neighbor_counts_by_level);
+  for (const auto& row : type_counts_by_level) type_tables.bytes += vector_heap_bytes(row);
+  for (const auto& row : neighbor_counts_by_level) type_tables.bytes += vector_heap_bytes(row);
+  report.push_back(type_tables);
+
+  // What a get_state() copy of the model would take, worked out without making one
+  Memory_Entry state_dump("state_dump", -1);
+  state_dump.bytes = sizeof(State_Dump);
+  for (const auto& level : nodes) {
+    for (const auto& level_entry : *level.second) {
+      const Node& node = *level_entry.second;
+      state_dump.count++;
+      state_dump.bytes += 3 * sizeof(std::string) + sizeof(int)
+          + string_heap_bytes(node.id) + string_heap_bytes(node.type)
+          + (node.parent ? string_heap_bytes(node.parent->id) : 0);
+    }
+  }
+  report.push_back(state_dump);
+
+  // Results of the last sweep run have already been handed off but their size
+  // is what the run needed on top of the model
+  report.insert(report.end(), last_sweep_memory.begin(), last_sweep_memory.end());
+
+  return report;
+}
+
+// =============================================================================
+// Counters of work done fitting the model so far
+// =============================================================================
+Engine_Stats SBM::get_stats() const
+{
+  return stats;
+}
+
+void SBM::reset_stats()
+{
+  stats = Engine_Stats();
+}
+
+// =============================================================================
+// Write counters to a JSON metrics file. Written to a temporary file first and
+// then moved into place so anything scraping the file never sees half of it.
+// =============================================================================
+void SBM::write_stats(const std::string& output_path) const
+{
+  const std::string temp_path = output_path + ".tmp";
+  {
+    std::ofstream metrics_file(temp_path);
+    if (!metrics_file) {
+      RANGE_ERROR("Could not open " + temp_path + " to write stats to.");
+    }
+    metrics_file << stats.to_json() << std::endl;
+  }
+
+  if (std::rename(temp_path.c_str(), output_path.c_str()) != 0) {
+    RANGE_ERROR("Could not move stats into " + output_path + ".");
+  }
+}
+
+// =============================================================================
+// Turn profiling on for a set of categories, writing to a trace file
+// =============================================================================
+void SBM::start_profiling(const std::string& output_path, const std::string& categories)
+{
+  Instrumentor::Get().BeginSession("SBM", output_path, categories);
+}
+
+// =============================================================================
+// Turn profiling off and close out the trace file
+// =============================================================================
+void SBM::stop_profiling()
+{
+  Instrumentor::Get().EndSession();
+}
+
+// =============================================================================
+// Send move proposals to a binary trace file
+// =============================================================================
+void SBM::start_proposal_trace(const std::string& output_path)
+{
+  stop_proposal_trace();
+  proposal_trace.open(output_path);
+}
+
+// =============================================================================
+// Close out the proposal trace file, if one is open
+// =============================================================================
+double SBM::stop_proposal_trace()
+{
+  if (!proposal_trace) {
+    return 0;
+  }
+
+  // Let go of the trace before closing so a failed write doesn't leave it open
+  const std::unique_ptr<Proposal_Trace> trace = proposal_trace.release();
+  trace->close();
+
+  return trace->size();
+}
+
+// =============================================================================
+// Start logging accepted moves, beginning with the partition they're made from
+// =============================================================================
+void SBM::start_move_log(const std::string& output_path)
+{
+  stop_move_log();
+  move_log.open(output_path);
+
+  const State_Dump state = get_state();
+  move_log->record_state(state.id, state.parent, state.level, state.type);
+}
+
+// =============================================================================
+// Only plain sweeps are logged, so anything else that moves nodes would leave
+// the log out of step with the model
+// =============================================================================
+void SBM::check_no_move_log(const std::string& action) const
+{
+  if (move_log) {
+    LOGIC_ERROR(action + " can't be run while a move log is open. Stop the log first.");
+  }
+}
+
+// =============================================================================
+// Close out the move log file, if one is open
+// =============================================================================
+double SBM::stop_move_log()
+{
+  if (!move_log) {
+    return 0;
+  }
+
+  const std::unique_ptr<Move_Log> log = move_log.release();
+  log->close();
+
+  return log->size();
+}
+
+// =============================================================================
+// Compute microcononical entropy of current model state under the chosen edge
+// model
 // =============================================================================
 double SBM::get_entropy(const int level) const
 {
-  PROFILE_FUNCTION();
+  return degree_corrected ? get_model_entropy<Degree_Corrected>(level)
+                          : get_model_entropy<Non_Degree_Corrected>(level);
+}
+
+template <typename Entropy_Model>
+double SBM::get_model_entropy(const int& level) const
+{
+  PROFILE_FUNCTION(entropy);
   //============================================================================
   // First, calc the number of total edges and build a degree->num nodes map
 
@@ -740,14 +2464,14 @@ double SBM::get_entropy(const int level) const
   // Calculate first component (sum of node degree counts portion)
   double degree_summation = 0.0;
   for (const auto& degree_count : n_nodes_w_degree) {
-    // Using std's built in lgamma here: lgamma(x + 1) = log(x!)
-    degree_summation += degree_count.second * lgamma(degree_count.first + 1);
+    // For the degree corrected model this is lgamma(x + 1) = log(x!)
+    degree_summation += degree_count.second * Entropy_Model::degree_term(degree_count.first);
   }
 
   //============================================================================
-  // Last, we calculate the summation of e_rs*ln(e_rs/e_r*e_s)/2 where e_rs is
-  // number of edges between blocks r and s and e_r is the total number of
-  // edges for block r.
+  // Last, we calculate the summation of e_rs*ln(e_rs/w_r*w_s)/2 where e_rs is
+  // number of edges between blocks r and s and w_r is the weight of block r:
+  // its total number of edges or, without degree correction, its size.
 
   // Grab all block nodes
   const LevelPtr block_level = get_level(level + 1);
@@ -771,19 +2495,54 @@ double SBM::get_entropy(const int level) const
       // number of times as compared to the others which are getting seen
       // half as much as we would expect due to non-duplicating pairs
       edge_entropy += partial_entropy(block_edge.second * 2,
-                                      block_r->degree,
-                                      block_s->degree)
+                                      Entropy_Model::block_weight(block_r),
+                                      Entropy_Model::block_weight(block_s))
           / 2;
     }
     else {
       edge_entropy += partial_entropy(block_edge.second,
-                                      block_r->degree,
-                                      block_s->degree);
+                                      Entropy_Model::block_weight(block_r),
+                                      Entropy_Model::block_weight(block_s));
     }
   }
 
   // Add three components together to return
-  return -1 * (n_total_edges + degree_summation + edge_entropy);
+  return -1 * (Entropy_Model::edge_count_term(n_total_edges) + degree_summation + edge_entropy);
+}
+
+// =============================================================================
+// Find the highest level of the model with nodes in it
+// =============================================================================
+int SBM::get_top_level() const
+{
+  for (auto level_it = nodes.rbegin(); level_it != nodes.rend(); level_it++) {
+    if (level_it->second->size() > 0) {
+      return level_it->first;
+    }
+  }
+  return -1;
+}
+
+// =============================================================================
+// Compute the nested entropy of the whole block hierarchy. Each level's
+// partition is treated as a model of the network of blocks below it so the
+// total description length is the sum of the entropies of every level.
+// =============================================================================
+double SBM::get_nested_entropy() const
+{
+  PROFILE_FUNCTION(entropy);
+  const int top_level = get_top_level();
+
+  if (top_level < 1) {
+    LOGIC_ERROR("Network has not had block structure initialized.");
+  }
+
+  double nested_entropy = 0;
+  for (int level = 0; level < top_level; level++) {
+    nested_entropy += get_entropy(level);
+  }
+
+  return nested_entropy;
 }
 
 // =============================================================================
@@ -792,7 +2551,7 @@ double SBM::get_entropy(const int level) const
 // =============================================================================
 void SBM::merge_blocks(const NodePtr& absorbing_block, const NodePtr& absorbed_block)
 {
-  PROFILE_FUNCTION();
+  PROFILE_FUNCTION(merge);
   // Place all the members of block b under block a
   const NodeSet children_to_move = absorbed_block->children;
   for (const NodePtr& child_node : children_to_move) {
@@ -804,9 +2563,10 @@ void SBM::merge_blocks(const NodePtr& absorbing_block, const NodePtr& absorbed_b
   while (current_node) {
     // Delete the now absorbed block from level map
     get_level(current_node->level)->erase(current_node->id);
+    stats.blocks_removed++;
 
     // Remove nodes contribution to node counts map
-    node_type_counts[current_node->type][current_node->level]--;
+    update_type_counts(current_node, -1);
 
     current_node = current_node->parent;
   }
@@ -820,7 +2580,34 @@ Merge_Step SBM::agglomerative_merge(const int&    block_level,
                                     const int&    num_checks_per_block,
                                     const double& eps)
 {
-  PROFILE_FUNCTION();
+  return degree_corrected
+      ? structured_agglomerative_merge<Degree_Corrected>(block_level, num_merges_to_make, num_checks_per_block, eps)
+      : structured_agglomerative_merge<Non_Degree_Corrected>(block_level, num_merges_to_make, num_checks_per_block, eps);
+}
+
+template <typename Entropy_Model>
+Merge_Step SBM::structured_agglomerative_merge(const int&    block_level,
+                                               const int&    num_merges_to_make,
+                                               const int&    num_checks_per_block,
+                                               const double& eps)
+{
+  switch (get_structure()) {
+  case Network_Structure::unipartite:
+    return model_agglomerative_merge<Entropy_Model, Unipartite_Network>(block_level, num_merges_to_make, num_checks_per_block, eps);
+  case Network_Structure::bipartite:
+    return model_agglomerative_merge<Entropy_Model, Bipartite_Network>(block_level, num_merges_to_make, num_checks_per_block, eps);
+  default:
+    return model_agglomerative_merge<Entropy_Model, Polypartite_Network>(block_level, num_merges_to_make, num_checks_per_block, eps);
+  }
+}
+
+template <typename Entropy_Model, typename Structure>
+Merge_Step SBM::model_agglomerative_merge(const int&    block_level,
+                                          const int&    num_merges_to_make,
+                                          const int&    num_checks_per_block,
+                                          const double& eps)
+{
+  PROFILE_FUNCTION(merge);
   // Quick check to make sure reasonable request
   if (num_merges_to_make <= 0) {
     LOGIC_ERROR("Zero merges requested.");
@@ -855,8 +2642,10 @@ Merge_Step SBM::agglomerative_merge(const int&    block_level,
 
     NodeVec metablocks_to_search;
 
+    const int num_metablocks = count_move_blocks<Structure>(block.second, meta_level).candidates;
+
     // No point in running M checks if there are < M blocks left.
-    const bool less_blocks_than_checks = node_type_counts[block.second->type][meta_level] <= num_checks_per_block;
+    const bool less_blocks_than_checks = num_metablocks <= num_checks_per_block;
     if (less_blocks_than_checks) {
       // Get a list of all the potential metablocks for block
       metablocks_to_search = get_nodes_of_type_at_level(block.second->type, meta_level);
@@ -866,7 +2655,7 @@ Merge_Step SBM::agglomerative_merge(const int&    block_level,
       // Otherwise, we should sample a given number of blocks to check
       for (int i = 0; i < num_checks_per_block; i++) {
         // Sample a metablock from potentials
-        metablocks_to_search.push_back(propose_move(block.second, eps, sampler));
+        metablocks_to_search.push_back(propose_structured_move<Structure>(block.second, eps, sampler, num_metablocks));
       }
     }
 
@@ -885,6 +2674,7 @@ Merge_Step SBM::agglomerative_merge(const int&    block_level,
       const bool unchecked_pair = checked_pairs.insert(make_pair_key(merge_block->id, block.second->id)).second;
 
       if (unchecked_pair) {
+        stats.merge_candidates_scored++;
 
         const NodePtr& block_a = merge_block;
         const NodePtr& block_b = block.second;
@@ -912,9 +2702,9 @@ Merge_Step SBM::agglomerative_merge(const int&    block_level,
           }
         }
 
-        const double e_a  = block_a->degree; // Degree of a before merge
-        const double e_b  = block_b->degree; // Degree of b before merge
-        const double e_ab = e_a + e_b;       // Degree of merged group
+        const double e_a  = Entropy_Model::block_weight(block_a); // Weight of a before merge
+        const double e_b  = Entropy_Model::block_weight(block_b); // Weight of b before merge
+        const double e_ab = e_a + e_b;                            // Weight of merged group
 
         double entropy_delta = 0;
         for (const auto& edge_counts : pair_counts_to_neighbor) {
@@ -922,7 +2712,7 @@ Merge_Step SBM::agglomerative_merge(const int&    block_level,
 
           const double e_a_s = edge_counts.second.first;
           const double e_b_s = edge_counts.second.second;
-          const double e_s   = block_s->degree;
+          const double e_s   = Entropy_Model::block_weight(block_s);
 
           entropy_delta += partial_entropy(e_a_s, e_a, e_s) + partial_entropy(e_b_s, e_b, e_s);
 
@@ -994,7 +2784,10 @@ CollapseResults SBM::collapse_blocks(const int&    node_level,
                                      const double& eps,
                                      const bool&   report_all_steps)
 {
-  PROFILE_FUNCTION();
+  PROFILE_FUNCTION(merge);
+
+  check_no_move_log("Collapsing blocks");
+
   const int block_level = node_level + 1;
 
   // Start by giving every node at the desired level its own block and every
@@ -1023,7 +2816,7 @@ CollapseResults SBM::collapse_blocks(const int&    node_level,
   // Counter to calculate the total entropy delta of this collapse run. Only used when not reporting all results
   double total_entropy_delta = 0;
 
-  while (curr_num_blocks > desired_num_blocks) {
+  while (curr_num_blocks > desired_num_blocks && !stop_requested()) {
     // Decide how many merges we should do. Make sure we don't overstep the goal
     // number of blocks and we need to remove at least 1 block
     const int num_merges = std::max(
@@ -1060,6 +2853,9 @@ CollapseResults SBM::collapse_blocks(const int&    node_level,
 
     // Update current number of blocks
     curr_num_blocks = block_level_ptr->size();
+    if (fit_control) {
+      fit_control->num_blocks = curr_num_blocks;
+    }
 
     if (report_all_steps) {
       // Dump state into step results
@@ -1095,6 +2891,389 @@ CollapseResults SBM::collapse_blocks(const int&    node_level,
   return step_results;
 }
 
+// =============================================================================
+// Run collapse_blocks on every connected component of the network on its own.
+// Blocks never gain anything from spanning components in the degree corrected
+// entropy, and the entropy of the whole network is just the sum of its
+// components' entropies, so the separate fits can be stitched back together.
+// Components are fit in parallel with the largest handed out first.
+// =============================================================================
+CollapseResults SBM::collapse_components(const int&    num_mcmc_steps,
+                                         const int&    desired_num_blocks,
+                                         const int&    num_checks_per_block,
+                                         const double& sigma,
+                                         const double& eps,
+                                         const int&    num_threads)
+{
+  check_no_move_log("Collapsing components");
+
+  return CollapseResults { collapse_each_component(num_mcmc_steps,
+                                                   desired_num_blocks,
+                                                   0,
+                                                   num_checks_per_block,
+                                                   sigma,
+                                                   eps,
+                                                   num_threads) };
+}
+
+Merge_Step SBM::collapse_each_component(const int&    num_mcmc_steps,
+                                        const int&    desired_num_blocks,
+                                        const double& block_ratio,
+                                        const int&    num_checks_per_block,
+                                        const double& sigma,
+                                        const double& eps,
+                                        const int&    num_threads)
+{
+  PROFILE_FUNCTION(merge);
+
+  const std::vector<NodeVec> components     = get_components();
+  const int                  num_components = components.size();
+
+  // Bucket the edges by the component they fall in
+  std::map<NodePtr, int> node_to_component;
+  for (int i = 0; i < num_components; i++) {
+    for (const auto& node : components[i]) {
+      node_to_component[node] = i;
+    }
+  }
+
+  std::vector<std::vector<Edge>> component_edges(num_components);
+  for (const auto& edge : edges) {
+    component_edges[node_to_component.at(edge.node_a)].push_back(edge);
+  }
+
+  // Draw a seed for every component up front so each component's fit doesn't
+  // depend on the order the threads happen to pick them up in
+  std::vector<int> component_seeds;
+  component_seeds.reserve(num_components);
+  for (int i = 0; i < num_components; i++) {
+    component_seeds.push_back(sampler.generator());
+  }
+
+  std::vector<Merge_Step>   component_results(num_components);
+  std::vector<Engine_Stats> component_stats(num_components);
+
+  parallel_for(num_components, num_threads, [&](const int i) {
+    SBM component_model = build_submodel(components[i], component_edges[i], component_seeds[i]);
+
+    // Either every component shares a block count or gets one in proportion to its size
+    const int component_num_blocks = block_ratio > 0
+        ? std::max(desired_num_blocks, int(std::ceil(components[i].size() / block_ratio)))
+        : desired_num_blocks;
+
+    component_results[i] = component_model.collapse_blocks(0,
+                                                           num_mcmc_steps,
+                                                           component_num_blocks,
+                                                           num_checks_per_block,
+                                                           sigma,
+                                                           eps,
+                                                           false)[0];
+
+    // Use the component's exact final entropy rather than the running total of
+    // merge deltas so the sum over components is the true network entropy
+    component_results[i].entropy = component_model.get_entropy(0);
+    component_stats[i]           = component_model.stats;
+  });
+
+  for (const auto& component_stat : component_stats) {
+    stats += component_stat;
+  }
+
+  // Stitch the component partitions together into one state. Block ids get a
+  // component prefix so they stay unique across components.
+  std::vector<std::string> id;
+  std::vector<std::string> parent;
+  std::vector<int>         level;
+  std::vector<std::string> type;
+
+  Merge_Step combined_results;
+  combined_results.entropy    = 0;
+  combined_results.num_blocks = 0;
+
+  for (int i = 0; i < num_components; i++) {
+    const Merge_Step& component_result = component_results[i];
+    const State_Dump& component_state  = component_result.state;
+    const std::string block_prefix     = "comp" + std::to_string(i) + "_";
+    const int         num_entries      = component_state.id.size();
+
+    for (int j = 0; j < num_entries; j++) {
+      if (component_state.level[j] != 0) {
+        continue;
+      }
+      id.push_back(component_state.id[j]);
+      parent.push_back(block_prefix + component_state.parent[j]);
+      level.push_back(0);
+      type.push_back(component_state.type[j]);
+    }
+
+    combined_results.entropy_delta += component_result.entropy_delta;
+    combined_results.entropy += component_result.entropy;
+    combined_results.num_blocks += component_result.num_blocks;
+  }
+
+  set_state(id, parent, level, type);
+  combined_results.state = get_state();
+
+  return combined_results;
+}
+
+// =============================================================================
+// Run MCMC sweeps over every connected component on its own. As long as no
+// block spans components a component's moves never change the entropy of
+// another, so sweeping them separately is the same as sweeping the network
+// restricted to each in turn and the entropy changes add up. Components are
+// swept in parallel with the largest handed out first.
+// =============================================================================
+MCMC_Sweeps SBM::mcmc_sweep_components(const int&    num_sweeps,
+                                       const double& eps,
+                                       const bool&   variable_num_blocks,
+                                       const int&    num_threads)
+{
+  PROFILE_FUNCTION(proposal);
+
+  check_no_move_log("Component sweeps");
+
+  if (nodes.count(1) == 0 || get_level(1)->size() == 0) {
+    LOGIC_ERROR("Network has not had block structure initialized.");
+  }
+
+  const std::vector<NodeVec> components     = get_components();
+  const int                  num_components = components.size();
+
+  // Bucket the edges by the component they fall in, checking along the way
+  // that every block sits within a single component
+  std::map<NodePtr, int> node_to_component;
+  std::map<NodePtr, int> block_to_component;
+  for (int i = 0; i < num_components; i++) {
+    for (const auto& node : components[i]) {
+      if (!node->parent) {
+        LOGIC_ERROR("Node " + node->id + " has no block to be swept from.");
+      }
+      node_to_component[node] = i;
+
+      const auto block_component = block_to_component.emplace(node->parent, i);
+      if (block_component.first->second != i) {
+        LOGIC_ERROR("Block " + node->parent->id + " spans more than one connected component. "
+                    + "Sweeping components separately needs blocks fit within components, "
+                    + "such as by collapse_components().");
+      }
+    }
+  }
+
+  std::vector<std::vector<Edge>> component_edges(num_components);
+  for (const auto& edge : edges) {
+    component_edges[node_to_component.at(edge.node_a)].push_back(edge);
+  }
+
+  // Seeds are drawn up front so results don't depend on the thread count
+  std::vector<int> component_seeds;
+  component_seeds.reserve(num_components);
+  for (int i = 0; i < num_components; i++) {
+    component_seeds.push_back(sampler.generator());
+  }
+
+  std::vector<MCMC_Sweeps>  component_results(num_components, MCMC_Sweeps(0));
+  std::vector<State_Dump>   component_states(num_components);
+  std::vector<Engine_Stats> component_stats(num_components);
+
+  parallel_for(num_components, num_threads, [&](const int i) {
+    SBM component_model = build_submodel(components[i], component_edges[i], component_seeds[i]);
+
+    // Start the component from its blocks in the full model
+    const int                num_nodes = components[i].size();
+    std::vector<std::string> id, parent, type;
+    std::vector<int>         level(num_nodes, 0);
+    for (const auto& node : components[i]) {
+      id.push_back(node->id);
+      parent.push_back(node->parent->id);
+      type.push_back(node->type);
+    }
+    component_model.set_state(id, parent, level, type);
+
+    component_results[i] = component_model.mcmc_sweep(0, num_sweeps, eps, variable_num_blocks, false, false);
+    component_states[i]  = component_model.get_state();
+    component_stats[i]   = component_model.stats;
+  });
+
+  for (const auto& component_stat : component_stats) {
+    stats += component_stat;
+  }
+
+  // Move the nodes to their component's new blocks. Blocks the component
+  // already had keep their ids and new ones get a fresh block in this model.
+  for (int i = 0; i < num_components; i++) {
+    std::map<std::string, NodePtr> component_blocks;
+    for (const auto& node : components[i]) {
+      component_blocks.emplace(node->parent->id, node->parent);
+    }
+
+    const State_Dump& component_state = component_states[i];
+    const int         num_entries     = component_state.id.size();
+    for (int j = 0; j < num_entries; j++) {
+      if (component_state.level[j] != 0) {
+        continue;
+      }
+
+      auto block_it = component_blocks.find(component_state.parent[j]);
+      if (block_it == component_blocks.end()) {
+        block_it = component_blocks.emplace(component_state.parent[j],
+                                            create_block_node(component_state.type[j], 1))
+                       .first;
+      }
+
+      const NodePtr node = get_node_by_id(component_state.id[j], 0);
+      if (node->parent != block_it->second) {
+        node->set_parent(block_it->second);
+      }
+    }
+  }
+  clean_empty_blocks();
+
+  // Sum the sweeps over components. Moved nodes stay grouped by sweep.
+  MCMC_Sweeps results(num_sweeps);
+  results.sweep_entropy_delta.assign(num_sweeps, 0);
+  results.sweep_num_nodes_moved.assign(num_sweeps, 0);
+  for (int sweep = 0; sweep < num_sweeps; sweep++) {
+    for (auto& component_result : component_results) {
+      const int num_moved = component_result.sweep_num_nodes_moved[sweep];
+      results.sweep_entropy_delta[sweep] += component_result.sweep_entropy_delta[sweep];
+      results.sweep_num_nodes_moved[sweep] += num_moved;
+
+      auto moved_end = component_result.nodes_moved.begin();
+      std::advance(moved_end, num_moved);
+      results.nodes_moved.splice(results.nodes_moved.end(),
+                                 component_result.nodes_moved,
+                                 component_result.nodes_moved.begin(),
+                                 moved_end);
+    }
+  }
+
+  last_sweep_memory = results.memory_report();
+
+  return results;
+}
+
+// =============================================================================
+// Build a full block hierarchy by collapsing one level at a time: nodes are
+// collapsed into blocks, those blocks are collapsed into super-blocks, and so on
+// until every connected component is down to a single block of each type, so
+// a network with three components ends with at least three top blocks. Each
+// level is fit with its own model whose data nodes are the blocks of the level
+// below, connected by that level's block-to-block edge counts, so edges only
+// ever get projected up a single level. The components of every level are fit
+// in parallel.
+// =============================================================================
+CollapseResults SBM::collapse_hierarchy(const int&    num_mcmc_steps,
+                                        const double& block_ratio,
+                                        const int&    num_checks_per_block,
+                                        const double& sigma,
+                                        const double& eps,
+                                        const int&    num_threads)
+{
+  PROFILE_FUNCTION(merge);
+
+  check_no_move_log("Collapsing a hierarchy");
+
+  if (block_ratio <= 1) {
+    LOGIC_ERROR("Block ratio must be greater than one for levels to shrink.");
+  }
+
+  NodeVec data_nodes;
+  for (const auto& node : *get_level(0)) {
+    data_nodes.push_back(node.second);
+  }
+
+  // The hierarchy is built from a clean slate with nothing above the data
+  // nodes. The old blocks are only cleared once the first level has merged so
+  // a network that can't be collapsed keeps them.
+  const auto clear_hierarchy = [&]() {
+    for (auto level_it = nodes.upper_bound(0); level_it != nodes.end();) {
+      level_it = nodes.erase(level_it);
+    }
+    for (auto& type_counts : node_type_counts) {
+      type_counts.second.erase(type_counts.second.upper_bound(0), type_counts.second.end());
+    }
+    type_counts_by_level.resize(1);
+    neighbor_counts_by_level.resize(1);
+
+    for (const auto& node : data_nodes) {
+      node->parent = nullptr;
+    }
+  };
+
+  const int num_types = node_type_counts.size();
+
+  // The first level's model is just a copy of the data
+  SBM level_model = build_submodel(data_nodes,
+                                   std::vector<Edge>(edges.begin(), edges.end()),
+                                   sampler.generator());
+
+  CollapseResults level_results;
+
+  for (int level = 0;; level++) {
+    const int num_nodes = level_model.get_level(0)->size();
+
+    if (num_nodes <= num_types) {
+      break;
+    }
+
+    Merge_Step level_step = level_model.collapse_each_component(num_mcmc_steps,
+                                                                1,
+                                                                block_ratio,
+                                                                num_checks_per_block,
+                                                                sigma,
+                                                                eps,
+                                                                num_threads);
+    stats += level_model.stats;
+
+    // Nothing more can be merged so the hierarchy stops here
+    if (level_step.num_blocks >= num_nodes) {
+      break;
+    }
+
+    if (level == 0) {
+      clear_hierarchy();
+    }
+
+    // Copy the level's blocks into the hierarchy under the usual block naming
+    const LevelPtr             nodes_at_level = get_level(level);
+    std::map<NodePtr, NodePtr> level_to_block;
+    for (const auto& level_node : *level_model.get_level(0)) {
+      const NodePtr& level_block = level_node.second->parent;
+
+      auto block_it = level_to_block.find(level_block);
+      if (block_it == level_to_block.end()) {
+        block_it = level_to_block.emplace(level_block, create_block_node(level_block->type, level + 1)).first;
+      }
+
+      nodes_at_level->at(level_node.first)->set_parent(block_it->second);
+    }
+
+    level_step.state = get_state();
+    level_results.push_back(level_step);
+
+    // The next level's data nodes are this level's blocks. Their edges come
+    // straight from the block edge counts of the level just fit.
+    SBM next_model(sampler.generator());
+    next_model.inherit_edge_types(*this);
+    next_model.degree_corrected = degree_corrected;
+
+    for (const auto& block : level_to_block) {
+      next_model.add_node(block.second->id, block.second->type);
+    }
+
+    for (const auto& block_edge : level_model.get_block_edge_counts(1)) {
+      next_model.add_edges(level_to_block.at(block_edge.first.node_a)->id,
+                           level_to_block.at(block_edge.first.node_b)->id,
+                           block_edge.second);
+    }
+
+    level_model = std::move(next_model);
+  }
+
+  return level_results;
+}
+
 // =============================================================================
 // Repeat the collapse_blocks method with a ranging number of desired blocks to
 // collapse to and report just the final result for all
@@ -1106,8 +3285,13 @@ CollapseResults SBM::collapse_run(const int&              node_level,
                                   const double&           eps,
                                   const std::vector<int>& block_nums)
 {
+  check_no_move_log("Collapse runs");
+
   CollapseResults run_results;
   for (const int& target_num : block_nums) {
+    if (stop_requested()) {
+      break;
+    }
     run_results.push_back(collapse_blocks(node_level,
                                           num_mcmc_steps,
                                           target_num,
@@ -1115,6 +3299,22 @@ CollapseResults SBM::collapse_run(const int&              node_level,
                                           sigma,
                                           eps,
                                           false)[0]);
+
+    // The model is still in the state just reached
+    run_results.back().entropy = get_entropy(node_level);
   }
+
+  keep_best_collapse(run_results);
   return run_results;
 }
+
+void SBM::keep_best_collapse(const CollapseResults& run_results)
+{
+  if (run_results.empty()) return;
+
+  const Merge_Step& best = *std::min_element(
+      run_results.begin(), run_results.end(), [](const Merge_Step& a, const Merge_Step& b) {
+        return a.entropy < b.entropy;
+      });
+  set_state(best.state.id, best.state.parent, best.state.level, best.state.type);
+}
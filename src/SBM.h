@@ -3,10 +3,22 @@
 
 #include "Block_Consensus.h"
 #include "Edge.h"
+#include "chain_checkpoint.h"
+#include "Network_Sim.h"
 #include "Node.h"
 #include "Sampler.h"
+#include "engine_stats.h"
+#include "entropy_models.h"
+#include "memory_accounting.h"
+#include "move_log.h"
+#include "network_structures.h"
+#include "parallel_helpers.h"
+#include "proposal_trace.h"
 #include "sbm_helpers.h"
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <math.h>
 
 // =============================================================================
@@ -31,6 +43,13 @@ struct State_Dump {
       , type(t)
   {
   }
+
+  // Bytes held by the dump's vectors and strings
+  std::size_t memory_bytes() const
+  {
+    return sizeof(State_Dump) + vector_heap_bytes(id) + vector_heap_bytes(parent)
+        + vector_heap_bytes(level) + vector_heap_bytes(type);
+  }
 };
 
 struct Merge_Step {
@@ -76,11 +95,99 @@ struct MCMC_Sweeps {
     sweep_entropy_delta.reserve(n);
     sweep_num_nodes_moved.reserve(n);
   }
+
+  // Bytes held by the per-sweep results and, separately, by the pair consensus
+  Memory_Report memory_report() const
+  {
+    Memory_Entry sweep_results("sweep_results", -1);
+    sweep_results.count = sweep_entropy_delta.size();
+    sweep_results.bytes = sizeof(MCMC_Sweeps) - sizeof(Block_Consensus)
+        + vector_heap_bytes(sweep_entropy_delta) + vector_heap_bytes(sweep_num_nodes_moved);
+    for (const auto& node_id : nodes_moved) {
+      sweep_results.bytes += sizeof(node_id) + LIST_NODE_OVERHEAD + string_heap_bytes(node_id);
+    }
+
+    Memory_Entry pair_consensus("pair_consensus", -1);
+    pair_consensus.count = block_consensus.concensus_pairs.size();
+    pair_consensus.bytes = block_consensus.memory_bytes();
+
+    return { sweep_results, pair_consensus };
+  }
+};
+
+// Compact record of a single sweep handed to streaming consumers. Nodes are
+// given by their index in the order returned by get_sweep_node_ids().
+struct Sweep_Record {
+  int              sweep;         // Index of the sweep, counting from first_sweep
+  double           entropy_delta;
+  std::vector<int> nodes_moved;
+};
+
+// Called after every streamed sweep. Returning false stops the run.
+using Sweep_Callback = std::function<bool(const Sweep_Record&)>;
+
+// A run of streamed sweeps gathered into flat vectors for returning to R.
+// Moves are given as parallel vectors of sweep index and node index.
+struct Sweep_Chunk {
+  std::vector<int>    sweep;
+  std::vector<double> entropy_delta;
+  std::vector<int>    num_nodes_moved;
+  std::vector<int>    move_sweep;
+  std::vector<int>    move_node;
+};
+
+// Lets another thread follow a long running fit and ask it to stop. Fits stop
+// at the next sweep or merge step once stop_requested is set.
+struct Fit_Control {
+  std::atomic<bool> stop_requested;
+  std::atomic<int>  num_blocks; // Blocks left after the latest merge step
+  Fit_Control()
+      : stop_requested(false)
+      , num_blocks(0)
+  {
+  }
+};
+
+struct Block_Assignment {
+  std::string id;            // Id of the new node
+  std::string best_block;    // Id of most likely block for the node
+  double      entropy_delta; // Entropy change of placing node in best block (minus terms shared by all blocks)
+  double      prob;          // Posterior probability of best block amongst all candidates
+  Block_Assignment()
+      : entropy_delta(0)
+      , prob(0)
+  {
+  }
+};
+
+// An output file a model writes to while fitting, such as a Proposal_Trace.
+// Belongs to a single model: copies of the model start without one rather
+// than writing into the same file, and assigning a model keeps its own.
+template <typename Output>
+class Model_Output {
+  public:
+  Model_Output() = default;
+  Model_Output(const Model_Output&) {}
+  Model_Output(Model_Output&&) = default;
+  Model_Output& operator=(const Model_Output&) { return *this; }
+  Model_Output& operator=(Model_Output&&) = default;
+
+  void open(const std::string& path) { output.reset(new Output(path)); }
+
+  // Hand the output over to the caller, leaving the model without one
+  std::unique_ptr<Output> release() { return std::move(output); }
+
+  explicit operator bool() const { return bool(output); }
+  Output* operator->() const { return output.get(); }
+
+  private:
+  std::unique_ptr<Output> output;
 };
 
 // Some type definitions for cleaning up ugly syntax
-using CollapseResults = std::vector<Merge_Step>;
-using BlockEdgeCounts = std::map<Edge, int>;
+using CollapseResults  = std::vector<Merge_Step>;
+using BlockEdgeCounts  = std::map<Edge, int>;
+using BlockAssignments = std::vector<Block_Assignment>;
 
 // =============================================================================
 // Main node class declaration
@@ -101,20 +208,66 @@ class SBM {
   // Do we have an explicitely set list of allowed edges or should we build this list ourselves?
   bool specified_allowed_edges = false;
 
+  // Integer index of every node type. Nodes carry theirs as type_id.
+  std::map<std::string, int> type_ids;
+
+  // Bitmask matrix of allowed edge type pairs. Bit j of row i (packed into 64
+  // bit words) is set if nodes of type i may connect to nodes of type j.
+  std::vector<std::vector<uint64_t>> type_compatibility;
+
+  // Cached counts indexed by level then type id: number of nodes of each type
+  // and number of nodes each type could connect to. Updated as blocks are
+  // created and deleted so proposals never have to add them up.
+  std::vector<std::vector<int>> type_counts_by_level;
+  std::vector<std::vector<int>> neighbor_counts_by_level;
+
   // A random sampler generation class.
   Sampler sampler;
 
+  // Score partitions with the degree-corrected entropy (default) or the cheaper
+  // non-degree-corrected one. See entropy_models.h.
+  bool degree_corrected = true;
+
+  // Counters of the work done fitting this model. Mutable as proposals are
+  // counted from const methods.
+  mutable Engine_Stats stats;
+
+  // Footprint of the results of the last MCMC sweep run, kept for
+  // memory_report() as the results themselves are handed off to the caller
+  Memory_Report last_sweep_memory;
+
+  // Where the last streamed sweeps left off: the order they last visited the
+  // level's nodes in, by index, and the sweep number they'd carry on from
+  std::vector<int> stream_sweep_order;
+  int              stream_sweep_level = -1;
+  int              stream_next_sweep  = -1;
+
+  // Union-find forest over the data nodes. Kept up to date as edges are added
+  // so connected components are known without a separate pass over the network.
+  std::map<NodePtr, NodePtr> component_links;
+
+  // Where move proposals get recorded, if anywhere. See proposal_trace.h.
+  Model_Output<Proposal_Trace> proposal_trace;
+
+  // Where accepted sweep moves get logged, if anywhere. See move_log.h.
+  Model_Output<Move_Log> move_log;
+
+  // Set when fits on this model can be followed and stopped from elsewhere
+  std::shared_ptr<Fit_Control> fit_control;
+
   // Methods
   // =========================================================================
   // Adds a node of specified id of a type at desired level.
   SBM()
   {
+    Instrumentor::BeginSessionFromEnvironment();
   }
 
   // Sets default seed to specified value
   SBM(int sampler_seed)
       : sampler(sampler_seed)
   {
+    Instrumentor::BeginSessionFromEnvironment();
   }
 
   NodePtr add_node(const std::string& id,
@@ -123,9 +276,46 @@ class SBM {
 
   void add_edge(const std::string& id_a, const std::string& id_b); // based on their ids
 
+  // Add num_edges edges between the same pair of nodes in one go
+  void add_edges(const std::string& id_a, const std::string& id_b, const int& num_edges);
+
+  // Find the representative node of the connected component a data node is in
+  NodePtr get_component_root(const NodePtr& node);
+
+  // Group data nodes by their connected component, largest component first
+  std::vector<NodeVec> get_components();
+
+  // Build a fresh model (without blocks) from a subset of the data nodes and
+  // the edges between them
+  SBM build_submodel(const NodeVec&           data_nodes,
+                     const std::vector<Edge>& sub_edges,
+                     const int&               seed) const;
+
+  // Build an independent copy of the model's network and block state that can
+  // be fit without touching this one
+  SBM clone(const int& seed) const;
+
+  // Has whoever is following this fit asked for it to stop?
+  bool stop_requested() const { return fit_control && fit_control->stop_requested; }
+
   // Add an alowed pairing of node types for edges
   void add_edge_types(const std::vector<std::string>& from_types, const std::vector<std::string>& to_types);
 
+  // Integer index of a node type, registering it if it's new
+  int get_type_id(const std::string& type);
+
+  // Allow edges between two node types
+  void allow_edge_type(const std::string& type_a, const std::string& type_b);
+
+  // Can nodes of these two types be connected?
+  bool types_compatible(const int& type_a, const int& type_b) const
+  {
+    return (type_compatibility[type_a][type_b / 64] >> (type_b % 64)) & 1;
+  }
+
+  // Take on the allowed edge types of another model
+  void inherit_edge_types(const SBM& source);
+
   // Creates a new block node and adds it to its neccesary level
   NodePtr create_block_node(const std::string& type, const int level);
 
@@ -147,6 +337,19 @@ class SBM {
   // Gathers counts of edges between any two blocks in network
   BlockEdgeCounts get_block_edge_counts(const int& level) const;
 
+  // Describe the blocks at a level as a simulation spec (see Network_Sim.h)
+  // with nodes weighted by degree and block pairs expecting their current
+  // number of edges
+  Sim_Spec block_sim_spec(const int& level) const;
+
+  // Draw a new network from the blocks at a level, e.g. for posterior
+  // predictive checks. Exact edge counts keep every block pair's count as is.
+  Sim_Network simulate_from_blocks(const int& level, const int& seed, const bool& exact_edge_counts) const;
+
+  // Add the nodes and edges of a simulated network, optionally placing nodes
+  // in their simulated blocks at level 1
+  void add_sim_network(const Sim_Network& network, const bool& plant_blocks);
+
   // Get a node's block connections map to a desired level
   NodeEdgeMap get_node_to_block_edge_counts(const std::string& id,
                                             const int&         node_level        = 0,
@@ -164,9 +367,59 @@ class SBM {
   // Scan through levels and remove all block nodes that have no children. Returns # of blocks removed
   NodeVec clean_empty_blocks();
 
+  // Choose between the degree-corrected and non-degree-corrected edge models
+  void set_degree_corrected(const bool& is_degree_corrected);
+
+  // Record profiling scopes of the listed categories (see profiling/Instrument.h)
+  // to a Chrome trace file. Profiling is shared by every model in the process.
+  void start_profiling(const std::string& output_path, const std::string& categories);
+
+  // Stop profiling and finish writing the trace file
+  void stop_profiling();
+
+  // Record every move proposal made from now on to a binary trace file (see
+  // proposal_trace.h), closing any trace already open
+  void start_proposal_trace(const std::string& output_path);
+
+  // Finish writing the proposal trace. Returns the number of proposals in it.
+  double stop_proposal_trace();
+
+  // Log every move accepted by sweeps from now on to a binary file (see
+  // move_log.h), starting from the current partition. Closes any log already
+  // open. Only mcmc_sweep() and its streamed, checkpointed and resumed forms
+  // can run while a log is open, other sweeps and collapses throw.
+  void start_move_log(const std::string& output_path);
+
+  // Finish writing the move log. Returns the number of moves in it.
+  double stop_move_log();
+
+  // Estimated bytes used by each of the model's structures, per level for the
+  // node levels and model wide (level -1) for everything else. Includes what
+  // the results of the last MCMC sweep run held, pair consensus included.
+  Memory_Report memory_report() const;
+
+  // Counters and phase timings of work done so far, see engine_stats.h
+  Engine_Stats get_stats() const;
+
+  // Zero all the counters and timings
+  void reset_stats();
+
+  // Write the counters as a JSON object to a file, replacing its contents
+  void write_stats(const std::string& output_path) const;
+
   // Compute microcononical entropy of current model state at a level
   double get_entropy(int level) const;
 
+  // Highest level of the model that has any nodes in it
+  int get_top_level() const;
+
+  // Sum of the entropies of every level below the top level. This is the
+  // description length of the whole block hierarchy.
+  double get_nested_entropy() const;
+
+  // Work out if the network is unipartite, bipartite, or something more general
+  Network_Structure get_structure() const;
+
   // Use model state to propose a potential block move for a node.
   NodePtr propose_move(const NodePtr& node,
                        const double&  eps,
@@ -177,6 +430,22 @@ class SBM {
                                       const NodePtr& new_block,
                                       const double&  eps);
 
+  // Make a decision on the proposed new block for node, scoring the move by the
+  // change in nested entropy of every level up to top_level
+  Proposal_Res make_nested_proposal_decision(const NodePtr& node,
+                                             const NodePtr& new_block,
+                                             const double&  eps,
+                                             const int&     top_level);
+
+  // Score the blocks a batch of not-yet-added nodes would most likely belong to
+  // given their edges to existing nodes. Model state is left untouched.
+  BlockAssignments assign_new_nodes(const std::vector<std::string>& node_ids,
+                                    const std::vector<std::string>& node_types,
+                                    const std::vector<std::string>& edges_from,
+                                    const std::vector<std::string>& edges_to,
+                                    const int&                      level       = 0,
+                                    const int&                      num_threads = 1) const;
+
   // Runs efficient MCMC sweep algorithm on desired node level
   MCMC_Sweeps mcmc_sweep(const int&    level,
                          const int&    num_sweeps,
@@ -185,6 +454,82 @@ class SBM {
                          const bool&   track_pairs,
                          const bool&   verbose = false);
 
+  // Runs MCMC sweeps like mcmc_sweep() but hands each sweep's record to
+  // on_sweep as soon as it finishes rather than keeping them, so memory use
+  // doesn't grow with the number of sweeps. Returns the number of sweeps run.
+  // Node pairs sharing a block are counted into pair_counts after every sweep
+  // if it's given, as mcmc_sweep() does with track_pairs. A call whose
+  // first_sweep follows on from the last streamed sweep of the level shuffles
+  // on from that sweep's node order, so a run split over several calls makes
+  // the same moves as one call.
+  int mcmc_sweep_stream(const int&            level,
+                        const int&            num_sweeps,
+                        const double&         eps,
+                        const bool&           variable_num_blocks,
+                        const Sweep_Callback& on_sweep,
+                        const int&            first_sweep = 0,
+                        Block_Consensus*      pair_counts = nullptr);
+
+  // Streams num_sweeps sweeps into a single chunk. Callers wanting bounded
+  // memory call this repeatedly, passing on the sweep index to continue from.
+  Sweep_Chunk mcmc_sweep_chunk(const int&    level,
+                               const int&    num_sweeps,
+                               const double& eps,
+                               const bool&   variable_num_blocks,
+                               const int&    first_sweep);
+
+  // Ids of a level's nodes in the order streamed sweeps index them by
+  std::vector<std::string> get_sweep_node_ids(const int& level) const;
+
+  // Runs MCMC sweeps like mcmc_sweep() while a background thread saves the
+  // chain to checkpoint_path every every_sweeps sweeps or every_seconds
+  // seconds, whichever comes first (0 turns either off), and once more when
+  // the sweeps end. See chain_checkpoint.h.
+  MCMC_Sweeps mcmc_sweep_checkpointed(const int&         level,
+                                      const int&         num_sweeps,
+                                      const double&      eps,
+                                      const bool&        variable_num_blocks,
+                                      const bool&        track_pairs,
+                                      const std::string& checkpoint_path,
+                                      const int&         every_sweeps,
+                                      const double&      every_seconds);
+
+  // Carries on a chain from a checkpoint left by mcmc_sweep_checkpointed(),
+  // making exactly the moves it would have gone on to make, and keeps
+  // checkpointing to the same file. The model has to hold the network the
+  // chain was started on and be degree corrected only if it was. Results
+  // cover the whole chain apart from nodes_moved, which only covers the
+  // sweeps run here. Entropy changes can differ in their last bits as blocks
+  // are summed over in memory order. Throws if a proposal trace is open.
+  MCMC_Sweeps resume_sweeps(const std::string& checkpoint_path,
+                            const int&         every_sweeps,
+                            const double&      every_seconds);
+
+  // Give a single node a chance to move blocks, recording result in sweep results
+  bool attempt_move(const NodePtr& node,
+                    const double&  eps,
+                    const bool&    variable_num_blocks,
+                    const bool&    track_pairs,
+                    const bool&    verbose,
+                    const int&     sweep_num,
+                    Sweep_Res&     sweep_results,
+                    const int&     nested_top_level = -1);
+
+  // Runs MCMC sweeps over only the nodes within hop_radius of the seed nodes,
+  // growing the swept set as moves propagate. Work is in proportion to the
+  // swept set: blocks left empty elsewhere beforehand aren't cleared out.
+  MCMC_Sweeps mcmc_sweep_local(const std::vector<std::string>& seed_ids,
+                               const int&                      hop_radius,
+                               const int&                      level,
+                               const int&                      num_sweeps,
+                               const double&                   eps,
+                               const bool&                     variable_num_blocks = false);
+
+  // Runs MCMC sweeps over every level of the block hierarchy in one pass, from
+  // the data nodes up, scoring moves against the nested entropy
+  MCMC_Sweeps mcmc_sweep_nested(const int&    num_sweeps,
+                                const double& eps);
+
   // Merge two blocks, placing all nodes that were under block_b under
   // block_a and deleting from model.
   void merge_blocks(const NodePtr& block_a, const NodePtr& block_b);
@@ -205,12 +550,156 @@ class SBM {
                                   const double& eps,
                                   const bool&   report_all_steps);
 
+  // Run collapse_blocks independently on every connected component of the
+  // network, largest first, and combine them into a single model state
+  CollapseResults collapse_components(const int&    num_mcmc_steps,
+                                      const int&    desired_num_blocks,
+                                      const int&    num_checks_per_block,
+                                      const double& sigma,
+                                      const double& eps,
+                                      const int&    num_threads = 1);
+
+  // Does the work of collapse_components. If block_ratio is positive each
+  // component is collapsed to 1/block_ratio of its size (but never below
+  // desired_num_blocks) instead of to a shared number of blocks.
+  Merge_Step collapse_each_component(const int&    num_mcmc_steps,
+                                     const int&    desired_num_blocks,
+                                     const double& block_ratio,
+                                     const int&    num_checks_per_block,
+                                     const double& sigma,
+                                     const double& eps,
+                                     const int&    num_threads);
+
+  // Run MCMC sweeps over the data nodes of every connected component
+  // independently, largest first across num_threads threads. No block can
+  // span components. Sweep results are summed over components.
+  MCMC_Sweeps mcmc_sweep_components(const int&    num_sweeps,
+                                    const double& eps,
+                                    const bool&   variable_num_blocks,
+                                    const int&    num_threads = 1);
+
+  // Build a full block hierarchy by collapsing each level's blocks into the
+  // next level up until one block per type remains in each connected
+  // component. Returns the result of each level's collapse.
+  CollapseResults collapse_hierarchy(const int&    num_mcmc_steps,
+                                     const double& block_ratio,
+                                     const int&    num_checks_per_block,
+                                     const double& sigma,
+                                     const double& eps,
+                                     const int&    num_threads = 1);
+
+  // Collapse to each number of blocks in block_nums in turn. Each result's
+  // entropy is scored from scratch, as the running total kept while
+  // collapsing drifts, and the model is left in the result with the lowest.
   CollapseResults collapse_run(const int&              node_level,
                                const int&              num_mcmc_steps,
                                const int&              num_checks_per_block,
                                const double&           sigma,
                                const double&           eps,
                                const std::vector<int>& block_nums);
+
+  // Put the model in whichever of a collapse run's results has the lowest
+  // entropy. Does nothing if there are none.
+  void keep_best_collapse(const CollapseResults& run_results);
+
+  private:
+  // Add (change = 1) or remove (change = -1) a node from the type counts
+  void update_type_counts(const NodePtr& node, const int& change);
+
+  // Rebuild the cached neighbor counts, needed when allowed edge types change
+  void recount_neighbor_types();
+
+  // Throws if a move log is open, for anything that moves nodes without
+  // logging it
+  void check_no_move_log(const std::string& action) const;
+
+  // Runs a checkpointed chain from where chain says it's up to, keeping chain's
+  // position current as it goes and handing checkpoints to writer
+  void run_checkpointed_chain(Chain_Checkpoint&  chain,
+                              MCMC_Sweeps&       results,
+                              Checkpoint_Writer& writer,
+                              const int&         every_sweeps,
+                              const double&      every_seconds);
+
+  // A version of attempt_move specialised on a network structure
+  using Move_Attempter = bool (SBM::*)(const NodePtr&,
+                                       const double&,
+                                       const bool&,
+                                       const bool&,
+                                       const bool&,
+                                       const int&,
+                                       Sweep_Res&,
+                                       const int&);
+
+  // Pick the attempt_move specialisation for the network's current structure
+  Move_Attempter get_move_attempter() const;
+
+  // Remove a block left without children, along with any ancestors its
+  // removal empties
+  void remove_block_if_empty(NodePtr block);
+
+  // Sweeps of a whole level that can change the number of blocks start by
+  // clearing out any empty blocks
+  void clear_empty_blocks_for_sweep(const bool& variable_num_blocks);
+
+  // Kernels specialised on a network structure from network_structures.h
+  template <typename Structure>
+  Move_Block_Counts count_move_blocks(const NodePtr& node, const int& block_level) const;
+
+  template <typename Structure>
+  NodePtr propose_structured_move(const NodePtr& node,
+                                  const double&  eps,
+                                  Sampler&       node_chooser,
+                                  const int&     num_candidates) const;
+
+  template <typename Structure>
+  bool attempt_structured_move(const NodePtr& node,
+                               const double&  eps,
+                               const bool&    variable_num_blocks,
+                               const bool&    track_pairs,
+                               const bool&    verbose,
+                               const int&     sweep_num,
+                               Sweep_Res&     sweep_results,
+                               const int&     nested_top_level);
+
+  // Entropy kernels specialised on an edge model from entropy_models.h. The
+  // public methods above pick the right instantiation once per call.
+  template <typename Entropy_Model>
+  double get_model_entropy(const int& level) const;
+
+  template <typename Entropy_Model>
+  Proposal_Res make_model_proposal_decision(const NodePtr& node,
+                                            const NodePtr& new_block,
+                                            const double&  eps,
+                                            const int&     n_possible_neighbors);
+
+  template <typename Entropy_Model>
+  Proposal_Res make_model_nested_proposal_decision(const NodePtr& node,
+                                                   const NodePtr& new_block,
+                                                   const double&  eps,
+                                                   const int&     top_level,
+                                                   const int&     n_possible_neighbors);
+
+  template <typename Entropy_Model>
+  BlockAssignments model_assign_new_nodes(const std::vector<std::string>& node_ids,
+                                          const std::vector<std::string>& node_types,
+                                          const std::vector<std::string>& edges_from,
+                                          const std::vector<std::string>& edges_to,
+                                          const int&                      level,
+                                          const int&                      num_threads) const;
+
+  template <typename Entropy_Model, typename Structure>
+  Merge_Step model_agglomerative_merge(const int&    level_of_blocks,
+                                       const int&    n_merges,
+                                       const int&    num_checks_per_block,
+                                       const double& eps);
+
+  // Pick the merge kernel for a given entropy model and the network's structure
+  template <typename Entropy_Model>
+  Merge_Step structured_agglomerative_merge(const int&    level_of_blocks,
+                                            const int&    n_merges,
+                                            const int&    num_checks_per_block,
+                                            const double& eps);
 };
 
 #endif
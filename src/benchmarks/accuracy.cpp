@@ -0,0 +1,245 @@
+// Accuracy against time benchmark. Fits planted partition networks with each
+// of the fitting strategies at a range of effort settings and scores how well
+// the planted blocks were recovered against the CPU time spent, so changes to
+// the fitting algorithms can be judged by where they land on the
+// quality/time Pareto front rather than on speed alone. Build and run with
+// run_accuracy.sh, e.g.
+//
+//   sh src/benchmarks/run_accuracy.sh --nodes 2000 --blocks 10 --within 0.7 --out accuracy.json
+
+#include "../SBM.h"
+#include "../partition_similarity.h"
+#include "benchmark_networks.h"
+
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+struct Accuracy_Options {
+  int         num_nodes   = 1000;
+  int         num_blocks  = 8;
+  double      mean_degree = 10;
+  double      within_frac = 0.8; // Share of edges inside planted blocks
+  int         num_seeds   = 3;   // Networks fit per setting
+  std::string output_path;       // Empty means stdout
+  std::string label;
+};
+
+// One fit of one strategy
+struct Accuracy_Point {
+  std::string          strategy;
+  int                  effort; // Strategy specific, see run_strategies()
+  int                  seed;
+  double               cpu_seconds;
+  int                  num_blocks_found;
+  Partition_Similarity similarity;
+  bool                 pareto; // Filled in by mark_pareto_front()
+};
+
+double cpu_seconds()
+{
+  return double(std::clock()) / CLOCKS_PER_SEC;
+}
+
+// Score the blocks the data nodes are in at a level against the planted ones
+Accuracy_Point score_fit(const SBM&            net,
+                         const Benchmark_Spec& spec,
+                         const int&            level,
+                         const std::string&    strategy,
+                         const int&            effort,
+                         const double&         cpu_start)
+{
+  const double cpu_used = cpu_seconds() - cpu_start;
+
+  std::vector<int>         planted;
+  std::vector<std::string> found;
+  planted.reserve(spec.num_nodes);
+  found.reserve(spec.num_nodes);
+  for (int i = 0; i < spec.num_nodes; i++) {
+    planted.push_back(i % spec.num_blocks);
+    found.push_back(net.get_node_by_id("n" + std::to_string(i))->get_parent_at_level(level)->id);
+  }
+
+  const std::vector<int> found_ids = dense_labels(found);
+  return Accuracy_Point { strategy,
+                          effort,
+                          spec.seed,
+                          cpu_used,
+                          *std::max_element(found_ids.begin(), found_ids.end()) + 1,
+                          compare_partitions(planted, found_ids),
+                          false };
+}
+
+std::vector<Accuracy_Point> run_strategies(const Benchmark_Spec& spec)
+{
+  std::vector<Accuracy_Point> points;
+  const double                eps   = 0.1;
+  const double                sigma = 2;
+
+  // Sweeps from a random start with the right number of blocks. Effort is the
+  // number of sweeps, scored as the chain goes.
+  {
+    SBM          net       = build_benchmark_network(spec);
+    const double cpu_start = cpu_seconds();
+    net.initialize_blocks(0, spec.num_blocks);
+    int sweeps_done = 0;
+    for (const int& num_sweeps : { 5, 20, 50, 100 }) {
+      net.mcmc_sweep(0, num_sweeps - sweeps_done, eps, false, false);
+      sweeps_done = num_sweeps;
+      points.push_back(score_fit(net, spec, 1, "mcmc_sweep", num_sweeps, cpu_start));
+    }
+  }
+
+  // Agglomerative collapsing down to the planted number of blocks. Effort is
+  // the number of sweeps after each merge step.
+  for (const int& num_mcmc_steps : { 0, 2, 5, 10 }) {
+    SBM          net       = build_benchmark_network(spec);
+    const double cpu_start = cpu_seconds();
+    net.collapse_blocks(0, num_mcmc_steps, spec.num_blocks, 5, sigma, eps, false);
+    points.push_back(score_fit(net, spec, 1, "collapse_blocks", num_mcmc_steps, cpu_start));
+  }
+
+  // The usual workflow of a quick collapse refined by sweeps. Effort is the
+  // number of refining sweeps.
+  {
+    SBM          net       = build_benchmark_network(spec);
+    const double cpu_start = cpu_seconds();
+    net.collapse_blocks(0, 0, spec.num_blocks, 5, sigma, eps, false);
+    int sweeps_done = 0;
+    for (const int& num_sweeps : { 5, 20, 50 }) {
+      net.mcmc_sweep(0, num_sweeps - sweeps_done, eps, false, false);
+      sweeps_done = num_sweeps;
+      points.push_back(score_fit(net, spec, 1, "collapse_then_sweep", num_sweeps, cpu_start));
+    }
+  }
+
+  // A full hierarchy sized so its first level holds about the planted number
+  // of blocks. Effort is the number of sweeps after each merge step.
+  const double block_ratio = double(spec.num_nodes) / spec.num_blocks;
+  for (const int& num_mcmc_steps : { 0, 2, 5 }) {
+    SBM          net       = build_benchmark_network(spec);
+    const double cpu_start = cpu_seconds();
+    net.collapse_hierarchy(num_mcmc_steps, block_ratio, 5, sigma, eps);
+    points.push_back(score_fit(net, spec, 1, "collapse_hierarchy", num_mcmc_steps, cpu_start));
+  }
+
+  return points;
+}
+
+// A point is on the Pareto front of its network if no other fit of the same
+// network was both faster and recovered the planted blocks better
+void mark_pareto_front(std::vector<Accuracy_Point>& points)
+{
+  for (auto& point : points) {
+    point.pareto = std::none_of(points.begin(), points.end(), [&](const Accuracy_Point& other) {
+      return other.seed == point.seed
+          && other.cpu_seconds <= point.cpu_seconds
+          && other.similarity.nmi >= point.similarity.nmi
+          && (other.cpu_seconds < point.cpu_seconds || other.similarity.nmi > point.similarity.nmi);
+    });
+  }
+}
+
+std::string points_to_json(const std::vector<Accuracy_Point>& points, const Accuracy_Options& options)
+{
+  std::ostringstream json;
+  json << std::setprecision(10);
+  json << "{\"label\":\"" << options.label << "\","
+       << "\"compiler\":\"" << __VERSION__ << "\","
+       << "\"nodes\":" << options.num_nodes << ","
+       << "\"blocks\":" << options.num_blocks << ","
+       << "\"mean_degree\":" << options.mean_degree << ","
+       << "\"within_frac\":" << options.within_frac << ","
+       << "\"results\":[";
+
+  for (auto point = points.begin(); point != points.end(); point++) {
+    json << (point == points.begin() ? "" : ",")
+         << "{\"strategy\":\"" << point->strategy << "\","
+         << "\"effort\":" << point->effort << ","
+         << "\"seed\":" << point->seed << ","
+         << "\"cpu_seconds\":" << point->cpu_seconds << ","
+         << "\"blocks_found\":" << point->num_blocks_found << ","
+         << "\"nmi\":" << point->similarity.nmi << ","
+         << "\"ari\":" << point->similarity.ari << ","
+         << "\"vi\":" << point->similarity.vi << ","
+         << "\"pareto\":" << (point->pareto ? "true" : "false") << "}";
+  }
+
+  json << "]}";
+  return json.str();
+}
+
+int main(int argc, char** argv)
+{
+  Accuracy_Options options;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg       = argv[i];
+    const bool        has_value = i + 1 < argc;
+
+    if (arg == "--nodes" && has_value) {
+      options.num_nodes = std::stoi(argv[++i]);
+    }
+    else if (arg == "--blocks" && has_value) {
+      options.num_blocks = std::stoi(argv[++i]);
+    }
+    else if (arg == "--degree" && has_value) {
+      options.mean_degree = std::stod(argv[++i]);
+    }
+    else if (arg == "--within" && has_value) {
+      options.within_frac = std::stod(argv[++i]);
+    }
+    else if (arg == "--seeds" && has_value) {
+      options.num_seeds = std::stoi(argv[++i]);
+    }
+    else if (arg == "--out" && has_value) {
+      options.output_path = argv[++i];
+    }
+    else if (arg == "--label" && has_value) {
+      options.label = argv[++i];
+    }
+    else {
+      std::cerr << "Usage: accuracy [--nodes 1000] [--blocks 8] [--degree 10] [--within 0.8] "
+                << "[--seeds 3] [--out results.json] [--label name]" << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<Accuracy_Point> points;
+  for (int seed = 1; seed <= options.num_seeds; seed++) {
+    const Benchmark_Spec spec(options.num_nodes,
+                              options.num_blocks,
+                              options.mean_degree,
+                              Degree_Distribution::power_law,
+                              options.within_frac,
+                              seed);
+
+    const auto seed_points = run_strategies(spec);
+    points.insert(points.end(), seed_points.begin(), seed_points.end());
+  }
+  mark_pareto_front(points);
+
+  std::cerr << std::left << std::setw(22) << "strategy" << std::setw(8) << "effort" << std::setw(6) << "seed"
+            << std::setw(10) << "cpu (s)" << std::setw(8) << "blocks" << std::setw(8) << "nmi"
+            << std::setw(8) << "ari" << std::setw(8) << "vi" << std::endl;
+  for (const auto& point : points) {
+    std::cerr << std::setw(22) << point.strategy << std::setw(8) << point.effort << std::setw(6) << point.seed
+              << std::fixed << std::setprecision(3) << std::setw(10) << point.cpu_seconds
+              << std::setw(8) << point.num_blocks_found << std::setw(8) << point.similarity.nmi
+              << std::setw(8) << point.similarity.ari << std::setw(8) << point.similarity.vi
+              << (point.pareto ? "*" : "") << std::endl;
+  }
+  std::cerr << "* on the Pareto front of CPU time against NMI for its network" << std::endl;
+
+  const std::string json = points_to_json(points, options);
+  if (options.output_path.empty()) {
+    std::cout << json << std::endl;
+  }
+  else {
+    std::ofstream(options.output_path) << json << std::endl;
+  }
+
+  return 0;
+}
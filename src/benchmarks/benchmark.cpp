@@ -0,0 +1,277 @@
+// Microbenchmarks of the core model kernels. Build and run with
+// run_benchmarks.sh. Results are written as JSON so runs on different commits
+// can be compared, e.g.
+//
+//   sh src/benchmarks/run_benchmarks.sh --nodes 1000,10000 --out before.json
+//
+// Every kernel is timed on the same seeded networks. Kernels that change the
+// model have it put back outside of the timed region.
+
+#include "../Block_Consensus.h"
+#include "../SBM.h"
+#include "../command_line.h"
+#include "benchmark_networks.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+struct Kernel_Timing {
+  std::string         kernel;
+  Benchmark_Spec      spec;
+  int                 ops_per_sample;
+  std::vector<double> ns_per_op; // One entry per sample
+};
+
+struct Benchmark_Options {
+  std::vector<int> node_counts = { 1000, 10000 };
+  double           mean_degree = 10;
+  int              samples     = 9;
+  int              max_consensus_nodes = 1000; // Consensus holds every node pair
+  std::string      output_path;                // Empty means stdout
+  std::string      label;                      // Usually the commit being benchmarked
+  std::string      flags;                      // Compiler flags of the build
+};
+
+// Sinks results so the optimizer can't drop a kernel whose result is unused
+static double benchmark_sink = 0;
+
+// Run setup then time op, once to warm up and then for every sample
+Kernel_Timing time_kernel(const std::string&           kernel,
+                          const Benchmark_Spec&        spec,
+                          const int                    ops_per_sample,
+                          const int                    samples,
+                          const std::function<void()>& setup,
+                          const std::function<void()>& op)
+{
+  Kernel_Timing timing { kernel, spec, ops_per_sample, {} };
+
+  for (int i = 0; i <= samples; i++) {
+    setup();
+    const int64_t start = profile_now_ns();
+    op();
+    const int64_t elapsed = profile_now_ns() - start;
+    if (i > 0) timing.ns_per_op.push_back(double(elapsed) / ops_per_sample);
+  }
+
+  std::sort(timing.ns_per_op.begin(), timing.ns_per_op.end());
+  std::cerr << "  " << std::left << std::setw(24) << kernel
+            << timing.ns_per_op[timing.ns_per_op.size() / 2] << " ns/op" << std::endl;
+
+  return timing;
+}
+
+void restore_state(SBM& net, const State_Dump& state)
+{
+  net.set_state(state.id, state.parent, state.level, state.type);
+}
+
+std::vector<Kernel_Timing> benchmark_network(const Benchmark_Spec& spec, const Benchmark_Options& options)
+{
+  std::vector<Kernel_Timing> timings;
+  const int                  samples = options.samples;
+  const double               eps     = 0.1;
+  const auto                 noop    = [] {};
+
+  SBM net = build_benchmark_network(spec);
+  net.initialize_blocks(0, spec.num_blocks);
+  const State_Dump start_state = net.get_state();
+
+  NodeVec data_nodes;
+  for (const auto& node : *net.get_level(0)) {
+    data_nodes.push_back(node.second);
+  }
+  const int num_nodes = data_nodes.size();
+
+  Sampler sampler(spec.seed);
+
+  // Proposals read the model and don't change it
+  timings.push_back(time_kernel("propose_move", spec, num_nodes, samples, noop, [&] {
+    for (const auto& node : data_nodes) {
+      benchmark_sink += net.propose_move(node, eps, sampler)->degree;
+    }
+  }));
+
+  // Score moves that actually change a node's block
+  std::vector<std::pair<NodePtr, NodePtr>> proposals;
+  for (const auto& node : data_nodes) {
+    const NodePtr new_block = net.propose_move(node, eps, sampler);
+    if (new_block != node->parent) proposals.emplace_back(node, new_block);
+  }
+  timings.push_back(time_kernel("make_proposal_decision", spec, proposals.size(), samples, noop, [&] {
+    for (const auto& proposal : proposals) {
+      benchmark_sink += net.make_proposal_decision(proposal.first, proposal.second, eps).entropy_delta;
+    }
+  }));
+  proposals.clear();
+  net.clean_empty_blocks(); // Proposals can leave fresh empty blocks behind
+
+  timings.push_back(time_kernel("get_entropy", spec, 1, samples, noop, [&] {
+    benchmark_sink += net.get_entropy(0);
+  }));
+
+  timings.push_back(time_kernel("get_state", spec, 1, samples, noop, [&] {
+    benchmark_sink += net.get_state().id.size();
+  }));
+
+  timings.push_back(time_kernel("set_state", spec, 1, samples, noop, [&] {
+    restore_state(net, start_state);
+  }));
+
+  // Merge disjoint pairs of blocks, restarting from the initial blocks each sample
+  const int                                num_merges = std::max(1, spec.num_blocks / 4);
+  std::vector<std::pair<NodePtr, NodePtr>> merge_pairs;
+  timings.push_back(time_kernel(
+      "merge_blocks",
+      spec,
+      num_merges,
+      samples,
+      [&] {
+        restore_state(net, start_state);
+        merge_pairs.clear();
+        const NodeVec blocks = net.get_nodes_of_type_at_level("a", 1);
+        for (int i = 0; i < std::min(num_merges, int(blocks.size()) / 2); i++) {
+          merge_pairs.emplace_back(blocks[2 * i], blocks[2 * i + 1]);
+        }
+      },
+      [&] {
+        for (const auto& pair : merge_pairs) {
+          net.merge_blocks(pair.first, pair.second);
+        }
+      }));
+
+  // Merging leaves a level of metablocks behind that set_state() doesn't
+  // remove, so each sample gets a freshly built model
+  SBM merge_net;
+  timings.push_back(time_kernel(
+      "agglomerative_merge",
+      spec,
+      1,
+      samples,
+      [&] {
+        merge_net = build_benchmark_network(spec);
+        restore_state(merge_net, start_state);
+      },
+      [&] { benchmark_sink += merge_net.agglomerative_merge(1, 1, 5, eps).entropy_delta; }));
+  restore_state(net, start_state);
+
+  // Consensus tracking is quadratic in the number of nodes so only small
+  // networks get it
+  if (num_nodes <= options.max_consensus_nodes) {
+    Block_Consensus consensus;
+    consensus.initialize(net.get_level(0));
+
+    // Pairs a sweep moving a tenth of the nodes would touch
+    PairSet changed_pairs;
+    for (int i = 0; i < num_nodes; i += 10) {
+      for (int j = 0; j < num_nodes; j++) {
+        if (j != i) changed_pairs.insert(make_pair_key(data_nodes[i]->id, data_nodes[j]->id));
+      }
+    }
+
+    timings.push_back(time_kernel("consensus_update", spec, 1, samples, noop, [&] {
+      consensus.update_pair_tracking_map(changed_pairs);
+    }));
+  }
+
+  return timings;
+}
+
+// Median, min and max of the per op times of each kernel, plus the raw samples
+std::string timings_to_json(const std::vector<Kernel_Timing>& timings, const Benchmark_Options& options)
+{
+  std::ostringstream json;
+  json << std::setprecision(10);
+  json << "{\"label\":\"" << options.label << "\","
+       << "\"compiler\":\"" << __VERSION__ << "\","
+       << "\"flags\":\"" << options.flags << "\","
+       << "\"samples\":" << options.samples << ","
+       << "\"results\":[";
+
+  for (auto timing = timings.begin(); timing != timings.end(); timing++) {
+    const auto& ns = timing->ns_per_op;
+    json << (timing == timings.begin() ? "" : ",")
+         << "{\"kernel\":\"" << timing->kernel << "\","
+         << "\"nodes\":" << timing->spec.num_nodes << ","
+         << "\"edges\":" << timing->spec.num_edges() << ","
+         << "\"blocks\":" << timing->spec.num_blocks << ","
+         << "\"degree_distribution\":\"" << degree_distribution_name(timing->spec.degree_distribution) << "\","
+         << "\"ops_per_sample\":" << timing->ops_per_sample << ","
+         << "\"median_ns\":" << ns[ns.size() / 2] << ","
+         << "\"min_ns\":" << ns.front() << ","
+         << "\"max_ns\":" << ns.back() << ","
+         << "\"samples_ns\":[";
+    for (std::size_t i = 0; i < ns.size(); i++) {
+      json << (i == 0 ? "" : ",") << ns[i];
+    }
+    json << "]}";
+  }
+
+  json << "]}";
+  return json.str();
+}
+
+int main(int argc, char** argv)
+{
+  Benchmark_Options options;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg   = argv[i];
+    const bool        has_value = i + 1 < argc;
+
+    if (arg == "--nodes" && has_value) {
+      options.node_counts = parse_int_list(argv[++i]);
+    }
+    else if (arg == "--degree" && has_value) {
+      options.mean_degree = std::stod(argv[++i]);
+    }
+    else if (arg == "--samples" && has_value) {
+      options.samples = std::stoi(argv[++i]);
+    }
+    else if (arg == "--out" && has_value) {
+      options.output_path = argv[++i];
+    }
+    else if (arg == "--label" && has_value) {
+      options.label = argv[++i];
+    }
+    else if (arg == "--flags" && has_value) {
+      options.flags = argv[++i];
+    }
+    else {
+      std::cerr << "Usage: benchmark [--nodes 1000,10000] [--degree 10] [--samples 9] "
+                << "[--out results.json] [--label name] [--flags compiler-flags]" << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<Kernel_Timing> timings;
+
+  for (const int& num_nodes : options.node_counts) {
+    for (const auto& degree_distribution : { Degree_Distribution::poisson, Degree_Distribution::power_law }) {
+      // Blocks grow with the square root of the network size
+      const Benchmark_Spec spec(num_nodes,
+                                std::max(2, int(std::lround(std::sqrt(num_nodes)))),
+                                options.mean_degree,
+                                degree_distribution);
+
+      std::cerr << num_nodes << " nodes, " << degree_distribution_name(degree_distribution)
+                << " degrees" << std::endl;
+
+      const auto network_timings = benchmark_network(spec, options);
+      timings.insert(timings.end(), network_timings.begin(), network_timings.end());
+    }
+  }
+
+  const std::string json = timings_to_json(timings, options);
+  if (options.output_path.empty()) {
+    std::cout << json << std::endl;
+  }
+  else {
+    std::ofstream(options.output_path) << json << std::endl;
+  }
+
+  return benchmark_sink == -1; // Practically never, keeps the sink live
+}
@@ -0,0 +1,100 @@
+#ifndef __BENCHMARK_NETWORKS_INCLUDED__
+#define __BENCHMARK_NETWORKS_INCLUDED__
+// Synthetic networks for benchmarking. Sizes, block structure and the shape of
+// the degree distribution are all set explicitly so timings on different
+// commits are taken on the same graphs.
+
+#include "../Network_Sim.h"
+#include "../SBM.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+enum class Degree_Distribution {
+  poisson,  // Every node equally likely to be an edge end
+  power_law // Node weights drawn from a Pareto with tail exponent 2.5
+};
+
+inline std::string degree_distribution_name(const Degree_Distribution& dist)
+{
+  return dist == Degree_Distribution::poisson ? "poisson" : "power_law";
+}
+
+struct Benchmark_Spec {
+  int                 num_nodes;
+  int                 num_blocks;
+  double              mean_degree;
+  Degree_Distribution degree_distribution;
+  double              within_block_frac; // Share of edges placed inside a block
+  int                 seed;
+  int                 num_components; // Blocks are split between this many disconnected pieces
+
+  Benchmark_Spec(const int                  num_nodes,
+                 const int                  num_blocks,
+                 const double               mean_degree,
+                 const Degree_Distribution& degree_distribution,
+                 const double               within_block_frac = 0.8,
+                 const int                  seed              = 42,
+                 const int                  num_components    = 1)
+      : num_nodes(num_nodes)
+      , num_blocks(num_blocks)
+      , mean_degree(mean_degree)
+      , degree_distribution(degree_distribution)
+      , within_block_frac(within_block_frac)
+      , seed(seed)
+      , num_components(std::max(1, std::min(num_components, num_blocks)))
+  {
+  }
+
+  int num_edges() const { return std::lround(num_nodes * mean_degree / 2); }
+};
+
+// Build a unipartite planted partition network from a spec with the package's
+// own generator (see Network_Sim.h), so benchmarks time the graphs users get.
+// Nodes are named n<i> and planted in block i % num_blocks, and blocks sit in
+// component block % num_components. Pairs of blocks in different components
+// get no edges, their share going to the other between block pairs instead.
+inline SBM build_benchmark_network(const Benchmark_Spec& spec)
+{
+  const double degree_exponent = spec.degree_distribution == Degree_Distribution::power_law ? 2.5 : 0;
+
+  Sim_Spec sim_spec = planted_partition_spec(spec.num_nodes,
+                                             spec.num_blocks,
+                                             spec.mean_degree,
+                                             spec.within_block_frac,
+                                             degree_exponent,
+                                             spec.seed);
+  sim_spec.exact_edge_counts = true;
+
+  if (spec.num_components > 1) {
+    const auto component_of = [&](const int block) { return block % spec.num_components; };
+
+    std::vector<Block_Pair_Rate> kept_pairs;
+    double                       between_edges = 0;
+    double                       kept_between  = 0;
+    for (const auto& pair : sim_spec.block_pairs) {
+      if (pair.block_a != pair.block_b) {
+        between_edges += pair.expected_edges;
+      }
+      if (component_of(pair.block_a) == component_of(pair.block_b)) {
+        kept_pairs.push_back(pair);
+        if (pair.block_a != pair.block_b) kept_between += pair.expected_edges;
+      }
+    }
+
+    if (kept_between > 0) {
+      for (auto& pair : kept_pairs) {
+        if (pair.block_a != pair.block_b) pair.expected_edges *= between_edges / kept_between;
+      }
+    }
+    sim_spec.block_pairs = kept_pairs;
+  }
+
+  SBM net(spec.seed);
+  net.add_sim_network(simulate_network(sim_spec, spec.seed), false);
+  return net;
+}
+
+#endif
@@ -0,0 +1,19 @@
+# Run from the repo root. Arguments are passed on to the benchmark, e.g.
+# sh src/benchmarks/run_accuracy.sh --nodes 2000 --blocks 10 --within 0.7 --out accuracy.json
+# Relative output paths are relative to src/.
+cd src/
+
+OPTIMIZATION_LEVEL=-O3
+
+# Compile everything the same way as the tests but optimized
+g++ -std=c++11 ${OPTIMIZATION_LEVEL} -pthread benchmarks/accuracy.cpp \
+    -DNO_RCPP=1 \
+    Node.cpp Block_Consensus.cpp SBM.cpp Sampler.cpp Batch_Fit.cpp Network_Sim.cpp \
+    -o benchmarks/accuracy.o
+
+./benchmarks/accuracy.o \
+    --label "$(git rev-parse --short HEAD 2>/dev/null)" \
+    "$@"
+
+# Remove binaries
+rm benchmarks/accuracy.o
@@ -0,0 +1,21 @@
+# Run from the repo root. Arguments are passed on to the benchmark, e.g.
+# sh src/benchmarks/run_benchmarks.sh --nodes 1000,10000 --out results.json
+# Relative output paths are relative to src/.
+cd src/
+
+OPTIMIZATION_LEVEL=-O3
+
+# Compile everything the same way as the tests but optimized
+g++ -std=c++11 ${OPTIMIZATION_LEVEL} -pthread benchmarks/benchmark.cpp \
+    -DNO_RCPP=1 \
+    Node.cpp Block_Consensus.cpp SBM.cpp Sampler.cpp Batch_Fit.cpp Network_Sim.cpp \
+    -o benchmarks/benchmark.o
+
+# Tag results with the commit being benchmarked
+./benchmarks/benchmark.o \
+    --label "$(git rev-parse --short HEAD 2>/dev/null)" \
+    --flags "${OPTIMIZATION_LEVEL}" \
+    "$@"
+
+# Remove binaries
+rm benchmarks/benchmark.o
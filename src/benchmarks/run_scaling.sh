@@ -0,0 +1,31 @@
+# Run from the repo root. Arguments are passed on to the benchmark, e.g.
+# sh src/benchmarks/run_scaling.sh --nodes 1000,10000,100000,1000000 --threads 1,2,4,8
+# Phases are checked against benchmarks/scaling_baseline.txt and the script
+# exits with a failure if any is slower than the baseline allows. The baseline
+# stores times relative to a reference workload so it carries between
+# machines; record a new one after an intended change with
+# sh src/benchmarks/run_scaling.sh --threads 1,2,4,8 --write-baseline benchmarks/scaling_baseline.txt
+# Threaded collapses are only checked on a machine with enough cores, and
+# ones recorded on fewer cores only bound them from above, so record
+# baselines on a multi-core machine where there is one.
+# Relative paths are relative to src/.
+cd src/
+
+OPTIMIZATION_LEVEL=-O3
+
+# Compile everything the same way as the tests but optimized
+g++ -std=c++11 ${OPTIMIZATION_LEVEL} -pthread benchmarks/scaling.cpp \
+    -DNO_RCPP=1 \
+    Node.cpp Block_Consensus.cpp SBM.cpp Sampler.cpp Batch_Fit.cpp Network_Sim.cpp \
+    -o benchmarks/scaling.o
+
+./benchmarks/scaling.o \
+    --label "$(git rev-parse --short HEAD 2>/dev/null)" \
+    --baseline benchmarks/scaling_baseline.txt \
+    "$@"
+STATUS=$?
+
+# Remove binaries
+rm benchmarks/scaling.o
+
+exit $STATUS
@@ -0,0 +1,491 @@
+// End to end scaling benchmark. Times generating a network, running MCMC
+// sweeps over it and collapsing it to its planted number of blocks, for a
+// range of network sizes and thread counts, and checks the results against a
+// stored baseline. Build and run with run_scaling.sh, e.g.
+//
+//   sh src/benchmarks/run_scaling.sh --nodes 1000,10000,100000,1000000 --threads 1,2,4,8
+//
+// Collapsing goes through collapse_components(), which runs collapse_blocks()
+// on every connected component of the network with the components spread over
+// the threads. mcmc_sweep() is single threaded so is only run once per size.
+// The planted blocks are split between --components disconnected pieces so
+// there is work to spread.
+//
+// A move costs time in proportion to the degree of the blocks involved, which
+// grows with the network, so full sweeps of the largest sizes would take
+// hours. Sweeps that would make more than --max-moves moves instead sweep an
+// evenly spread sample of that many nodes once. Collapses start from every
+// node in its own block, which takes roughly quadratic time, so they are only
+// run up to --max-collapse-nodes nodes.
+//
+// Wall times are compared as ratios so one baseline serves every machine: each
+// phase against a fixed reference workload timed at the start of the run, and
+// collapses on more than one thread against the same collapse on one thread.
+// Threaded collapses are recorded on any machine but only checked where it
+// has at least as many cores as threads. Each phase is repeated --repeats
+// times (once from 100000 nodes up) and then until it has run for
+// --min-phase-ms in total, and the median run is kept, so short phases aren't
+// judged on a single noisy run. Any phase slower (or heavier on memory) than
+// its baseline by more than the tolerance is reported and the run exits with
+// a failure.
+
+#include "../SBM.h"
+#include "../command_line.h"
+#include "benchmark_networks.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <sys/resource.h>
+#include <thread>
+#include <tuple>
+
+struct Scaling_Options {
+  std::vector<int> node_counts        = { 1000, 10000, 100000, 1000000 };
+  std::vector<int> thread_counts      = { 1, 2, 4 };
+  double           mean_degree        = 10;
+  int              num_components     = 8;
+  int              num_sweeps         = 5;
+  int              max_moves          = 50000;  // Above this sweeps are sampled
+  int              max_collapse_nodes = 10000;  // Larger networks aren't collapsed
+  int              num_mcmc_steps     = 2;      // Sweeps after each collapse step
+  int              repeats            = 3;      // Median of at least this many runs is kept
+  double           min_phase_ms       = 1000;   // Short phases repeat until they've run this long
+  double           tolerance          = 0.25;
+  std::string      output_path;       // Empty means stdout
+  std::string      baseline_path;     // Compare against this baseline
+  std::string      new_baseline_path; // Write results as a new baseline here
+  std::string      label;
+
+  // Everything that changes what is measured. Baselines only compare if equal.
+  std::string settings() const
+  {
+    std::ostringstream settings;
+    settings << "degree=" << mean_degree << ",components=" << num_components
+             << ",sweeps=" << num_sweeps << ",max_moves=" << max_moves << ",mcmc_steps=" << num_mcmc_steps;
+    return settings.str();
+  }
+};
+
+struct Phase_Result {
+  std::string phase;
+  int         num_nodes;
+  int         num_threads;
+  double      wall_ms;
+  double      throughput; // Work items per second, see throughput_unit
+  std::string throughput_unit;
+  double      peak_rss_mb;
+  double      peak_growth_mb; // Peak over what was resident when the phase started
+};
+
+using Phase_Key = std::tuple<std::string, int, int>;
+
+// Peak resident memory can be reset between phases on Linux. Elsewhere the
+// process-wide peak is all there is.
+void reset_peak_rss()
+{
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  if (clear_refs) clear_refs << "5";
+}
+
+// Reads a memory field of /proc/self/status in MB, or -1 if there isn't one
+double proc_status_mb(const std::string& field)
+{
+  std::ifstream status("/proc/self/status");
+  std::string   line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, field.size(), field) == 0) {
+      return std::stod(line.substr(field.size())) / 1024;
+    }
+  }
+  return -1;
+}
+
+double peak_rss_mb()
+{
+  const double peak = proc_status_mb("VmHWM:");
+  if (peak >= 0) return peak;
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+double current_rss_mb()
+{
+  return std::max(0.0, proc_status_mb("VmRSS:"));
+}
+
+// Run setup then time op, at least repeats times and until the runs add up to
+// min_total_ms, keeping the median wall time and the highest memory peaks.
+// Models that go out of scope aren't always fully freed (blocks and their
+// children point at each other) so memory is compared on growth over the phase
+// rather than the absolute peak.
+template <typename Setup, typename Op>
+Phase_Result time_phase(const std::string& phase,
+                        const int          num_nodes,
+                        const int          num_threads,
+                        const double       work_items,
+                        const std::string& throughput_unit,
+                        const int          repeats,
+                        const double       min_total_ms,
+                        Setup              setup,
+                        Op                 op)
+{
+  Phase_Result        result { phase, num_nodes, num_threads, 0, 0, throughput_unit, 0, 0 };
+  std::vector<double> wall_times;
+  double              total_ms = 0;
+
+  while (int(wall_times.size()) < repeats || total_ms < min_total_ms) {
+    setup();
+    reset_peak_rss();
+    const double  start_rss_mb = current_rss_mb();
+    const int64_t start        = profile_now_ns();
+    op();
+    const double  wall_ms      = (profile_now_ns() - start) / 1e6;
+    const double  peak_mb      = peak_rss_mb();
+
+    wall_times.push_back(wall_ms);
+    total_ms += wall_ms;
+    result.peak_rss_mb    = std::max(result.peak_rss_mb, peak_mb);
+    result.peak_growth_mb = std::max(result.peak_growth_mb, peak_mb - start_rss_mb);
+  }
+  std::sort(wall_times.begin(), wall_times.end());
+  const std::size_t middle = wall_times.size() / 2;
+  result.wall_ms = wall_times.size() % 2 == 1 ? wall_times[middle]
+                                              : (wall_times[middle - 1] + wall_times[middle]) / 2;
+  result.throughput = work_items / (result.wall_ms / 1e3);
+
+  std::cerr << "  " << std::left << std::setw(10) << phase << std::setw(4) << num_threads
+            << std::fixed << std::setprecision(1) << result.wall_ms << " ms, "
+            << std::setprecision(0) << result.throughput << " " << throughput_unit << ", "
+            << std::setprecision(1) << result.peak_rss_mb << " MB peak (+" << result.peak_growth_mb << " MB)"
+            << std::endl;
+
+  return result;
+}
+
+// Fixed workload every other phase is measured against, so baselines carry
+// between machines of different speeds
+Phase_Result time_reference(const Scaling_Options& options)
+{
+  const Benchmark_Spec spec(1000, 32, 10, Degree_Distribution::power_law, 0.8, 42, 1);
+  SBM                  net;
+
+  std::cerr << "Reference workload" << std::endl;
+  return time_phase(
+      "reference", spec.num_nodes, 1, spec.num_nodes * 5.0, "moves/s", std::max(3, options.repeats),
+      options.min_phase_ms,
+      [&] {
+        net = build_benchmark_network(spec);
+        net.initialize_blocks(0, spec.num_blocks);
+      },
+      [&] { net.mcmc_sweep(0, 5, 0.1, false, false); });
+}
+
+std::vector<Phase_Result> run_size(const int num_nodes, const Scaling_Options& options)
+{
+  std::vector<Phase_Result> results;
+  const double              eps        = 0.1;
+  const int                 num_blocks = std::max(2, int(std::lround(std::sqrt(num_nodes))));
+  const Benchmark_Spec      spec(num_nodes,
+                            num_blocks,
+                            options.mean_degree,
+                            Degree_Distribution::power_law,
+                            0.8,
+                            42,
+                            options.num_components);
+
+  // Repeats of the large sizes take far longer than the noise they'd remove
+  const int repeats = num_nodes >= 100000 ? 1 : options.repeats;
+
+  std::cerr << num_nodes << " nodes, " << spec.num_edges() << " edges, " << num_blocks << " blocks" << std::endl;
+
+  SBM net;
+  results.push_back(time_phase(
+      "generate", num_nodes, 1, spec.num_edges(), "edges/s", repeats, options.min_phase_ms,
+      [] {},
+      [&] { net = build_benchmark_network(spec); }));
+
+  const auto setup_sweep = [&] {
+    net = build_benchmark_network(spec);
+    net.initialize_blocks(0, num_blocks);
+  };
+  if (double(num_nodes) * options.num_sweeps <= options.max_moves) {
+    results.push_back(time_phase(
+        "sweep", num_nodes, 1, double(num_nodes) * options.num_sweeps, "moves/s", repeats, options.min_phase_ms,
+        setup_sweep,
+        [&] { net.mcmc_sweep(0, options.num_sweeps, eps, false, false); }));
+  }
+  else {
+    const int                num_sampled = std::min(num_nodes, options.max_moves);
+    std::vector<std::string> sampled_ids;
+    for (int i = 0; i < num_sampled; i++) {
+      sampled_ids.push_back("n" + std::to_string(int64_t(i) * num_nodes / num_sampled));
+    }
+    results.push_back(time_phase(
+        "sweep", num_nodes, 1, num_sampled, "moves/s", repeats, options.min_phase_ms,
+        setup_sweep,
+        [&] { net.mcmc_sweep_local(sampled_ids, 0, 0, 1, eps, false); }));
+  }
+
+  if (num_nodes > options.max_collapse_nodes) {
+    std::cerr << "  collapse skipped above " << options.max_collapse_nodes << " nodes" << std::endl;
+    return results;
+  }
+
+  // Each component collapses to its share of the planted blocks
+  const int blocks_per_component = std::max(1, num_blocks / spec.num_components);
+  for (const int& num_threads : options.thread_counts) {
+    results.push_back(time_phase(
+        "collapse", num_nodes, num_threads, num_nodes, "nodes/s", repeats, options.min_phase_ms,
+        [&] { net = build_benchmark_network(spec); },
+        [&] { net.collapse_components(options.num_mcmc_steps, blocks_per_component, 5, 2, eps, num_threads); }));
+  }
+
+  return results;
+}
+
+std::string results_to_json(const std::vector<Phase_Result>& results, const Scaling_Options& options)
+{
+  std::ostringstream json;
+  json << std::setprecision(10);
+  json << "{\"label\":\"" << options.label << "\","
+       << "\"compiler\":\"" << __VERSION__ << "\","
+       << "\"settings\":\"" << options.settings() << "\","
+       << "\"host_threads\":" << std::thread::hardware_concurrency() << ","
+       << "\"results\":[";
+
+  for (auto result = results.begin(); result != results.end(); result++) {
+    json << (result == results.begin() ? "" : ",")
+         << "{\"phase\":\"" << result->phase << "\","
+         << "\"nodes\":" << result->num_nodes << ","
+         << "\"threads\":" << result->num_threads << ","
+         << "\"wall_ms\":" << result->wall_ms << ","
+         << "\"throughput\":" << result->throughput << ","
+         << "\"throughput_unit\":\"" << result->throughput_unit << "\","
+         << "\"peak_rss_mb\":" << result->peak_rss_mb << ","
+         << "\"peak_growth_mb\":" << result->peak_growth_mb << "}";
+  }
+
+  json << "]}";
+  return json.str();
+}
+
+// Wall time a phase is compared on: for collapses on more than one thread the
+// same collapse on one thread, for everything else the reference workload.
+// Returns 0 if the run has nothing to compare it to.
+double comparison_ms(const Phase_Result& result, const std::vector<Phase_Result>& results)
+{
+  const bool threaded = result.num_threads > 1;
+  for (const auto& other : results) {
+    const bool matches = threaded
+        ? other.phase == result.phase && other.num_nodes == result.num_nodes && other.num_threads == 1
+        : other.phase == "reference";
+    if (matches) return other.wall_ms;
+  }
+  return 0;
+}
+
+// Threaded phases only say anything about scaling if the machine has the cores
+bool has_cores_for(const Phase_Result& result, const unsigned int host_threads)
+{
+  return result.num_threads == 1 || unsigned(result.num_threads) <= host_threads;
+}
+
+// Baselines are plain text: a settings line, the number of cores the baseline
+// was recorded with, then one line per phase of
+//   phase nodes threads relative_time peak_growth_mb
+void write_baseline(const std::string& path, const std::vector<Phase_Result>& results, const Scaling_Options& options)
+{
+  const unsigned int host_threads = std::thread::hardware_concurrency();
+
+  std::ofstream baseline(path);
+  baseline << "# Scaling benchmark baseline, written by run_scaling.sh --write-baseline\n"
+           << "# relative_time is the phase's wall time over the reference workload's, or\n"
+           << "# for collapses on more than one thread over the same collapse on one thread.\n"
+           << "# Threaded rows recorded on fewer cores than threads (see host_threads)\n"
+           << "# only bound the threaded collapses from above.\n"
+           << "# phase nodes threads relative_time peak_growth_mb\n"
+           << "settings " << options.settings() << "\n"
+           << "host_threads " << host_threads << "\n";
+  for (const auto& result : results) {
+    const double compared_to = comparison_ms(result, results);
+    if (compared_to <= 0) continue;
+
+    baseline << result.phase << " " << result.num_nodes << " " << result.num_threads << " "
+             << result.wall_ms / compared_to << " " << result.peak_growth_mb << "\n";
+  }
+}
+
+// Returns the number of regressions found
+int compare_to_baseline(const std::vector<Phase_Result>& results, const Scaling_Options& options)
+{
+  std::ifstream baseline_file(options.baseline_path);
+  if (!baseline_file) {
+    std::cerr << "No baseline found at " << options.baseline_path << ", skipping comparison" << std::endl;
+    return 0;
+  }
+
+  std::string                                    settings;
+  std::map<Phase_Key, std::pair<double, double>> baseline;
+  std::string                                    line;
+  while (std::getline(baseline_file, line)) {
+    if (line.empty() || line[0] == '#') continue;
+
+    std::istringstream fields(line);
+    std::string        phase;
+    fields >> phase;
+    if (phase == "settings") {
+      fields >> settings;
+      continue;
+    }
+    if (phase == "host_threads") continue;
+
+    int    num_nodes, num_threads;
+    double relative_time, rss_mb;
+    fields >> num_nodes >> num_threads >> relative_time >> rss_mb;
+    baseline[Phase_Key(phase, num_nodes, num_threads)] = std::make_pair(relative_time, rss_mb);
+  }
+
+  if (settings != options.settings()) {
+    std::cerr << "Baseline was recorded with " << settings << " but this run used " << options.settings()
+              << ", skipping comparison" << std::endl;
+    return 0;
+  }
+
+  // Differences under noise_floor are left alone however large they are
+  // relatively, short phases jitter by more than the tolerance
+  std::vector<std::string> regressions;
+  const auto               check = [&](const Phase_Result& result,
+                         const std::string&  metric,
+                         const double        value,
+                         const double        baseline_value,
+                         const double        noise_floor,
+                         const std::string&  unit) {
+    if (value <= baseline_value * (1 + options.tolerance)) return;
+    if (value - baseline_value < noise_floor) return;
+
+    std::ostringstream message;
+    message << std::fixed << std::setprecision(1) << result.phase << " at " << result.num_nodes << " nodes, "
+            << result.num_threads << " threads: " << metric << " " << value << unit << " vs baseline "
+            << baseline_value << unit << " (+" << 100 * (value / baseline_value - 1) << "%)";
+    regressions.push_back(message.str());
+  };
+
+  const unsigned int host_threads = std::thread::hardware_concurrency();
+  for (const auto& result : results) {
+    const auto base = baseline.find(Phase_Key(result.phase, result.num_nodes, result.num_threads));
+    if (base == baseline.end()) continue; // Sizes not in the baseline aren't checked
+
+    // The baseline's ratio scaled back to a wall time on this machine
+    const double compared_to = comparison_ms(result, results);
+    if (result.phase != "reference" && has_cores_for(result, host_threads) && compared_to > 0) {
+      check(result, "wall time", result.wall_ms, base->second.first * compared_to, 20, " ms");
+    }
+    check(result, "peak memory growth", result.peak_growth_mb, base->second.second, 4, " MB");
+  }
+
+  if (!regressions.empty()) {
+    std::cerr << std::string(78, '=') << "\n"
+              << "PERFORMANCE REGRESSION against " << options.baseline_path
+              << " (tolerance " << 100 * options.tolerance << "%)\n";
+    for (const auto& regression : regressions) {
+      std::cerr << "  " << regression << "\n";
+    }
+    std::cerr << std::string(78, '=') << std::endl;
+  }
+  else {
+    std::cerr << "All phases within " << 100 * options.tolerance << "% of baseline" << std::endl;
+  }
+
+  return regressions.size();
+}
+
+int main(int argc, char** argv)
+{
+  Scaling_Options options;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg       = argv[i];
+    const bool        has_value = i + 1 < argc;
+
+    if (arg == "--nodes" && has_value) {
+      options.node_counts = parse_int_list(argv[++i]);
+    }
+    else if (arg == "--threads" && has_value) {
+      options.thread_counts = parse_int_list(argv[++i]);
+    }
+    else if (arg == "--degree" && has_value) {
+      options.mean_degree = std::stod(argv[++i]);
+    }
+    else if (arg == "--components" && has_value) {
+      options.num_components = std::stoi(argv[++i]);
+    }
+    else if (arg == "--sweeps" && has_value) {
+      options.num_sweeps = std::stoi(argv[++i]);
+    }
+    else if (arg == "--max-moves" && has_value) {
+      options.max_moves = std::stoi(argv[++i]);
+    }
+    else if (arg == "--max-collapse-nodes" && has_value) {
+      options.max_collapse_nodes = std::stoi(argv[++i]);
+    }
+    else if (arg == "--mcmc-steps" && has_value) {
+      options.num_mcmc_steps = std::stoi(argv[++i]);
+    }
+    else if (arg == "--repeats" && has_value) {
+      options.repeats = std::stoi(argv[++i]);
+    }
+    else if (arg == "--min-phase-ms" && has_value) {
+      options.min_phase_ms = std::stod(argv[++i]);
+    }
+    else if (arg == "--tolerance" && has_value) {
+      options.tolerance = std::stod(argv[++i]);
+    }
+    else if (arg == "--out" && has_value) {
+      options.output_path = argv[++i];
+    }
+    else if (arg == "--baseline" && has_value) {
+      options.baseline_path = argv[++i];
+    }
+    else if (arg == "--write-baseline" && has_value) {
+      options.new_baseline_path = argv[++i];
+    }
+    else if (arg == "--label" && has_value) {
+      options.label = argv[++i];
+    }
+    else {
+      std::cerr << "Usage: scaling [--nodes 1000,10000,100000,1000000] [--threads 1,2,4] [--degree 10] "
+                << "[--components 8] [--sweeps 5] [--max-moves 50000] [--max-collapse-nodes 10000] [--mcmc-steps 2] [--repeats 3] [--min-phase-ms 1000] [--tolerance 0.25] [--out results.json] "
+                << "[--baseline baseline.txt] [--write-baseline baseline.txt] [--label name]" << std::endl;
+      return 2;
+    }
+  }
+
+  std::vector<Phase_Result> results = { time_reference(options) };
+  for (const int& num_nodes : options.node_counts) {
+    const auto size_results = run_size(num_nodes, options);
+    results.insert(results.end(), size_results.begin(), size_results.end());
+  }
+
+  const std::string json = results_to_json(results, options);
+  if (options.output_path.empty()) {
+    std::cout << json << std::endl;
+  }
+  else {
+    std::ofstream(options.output_path) << json << std::endl;
+  }
+
+  if (!options.new_baseline_path.empty()) {
+    write_baseline(options.new_baseline_path, results, options);
+    std::cerr << "Wrote new baseline to " << options.new_baseline_path << std::endl;
+    return 0;
+  }
+
+  const int num_regressions = options.baseline_path.empty() ? 0 : compare_to_baseline(results, options);
+  return num_regressions > 0 ? 1 : 0;
+}
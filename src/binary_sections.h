@@ -0,0 +1,78 @@
+#ifndef __BINARY_SECTIONS_INCLUDED__
+#define __BINARY_SECTIONS_INCLUDED__
+// Pieces shared by the binary files of proposal_trace.h and move_log.h. Both
+// are a marker and version followed by sections that each start with a one
+// byte kind, and both give ids in sections of kind 1: a 32 bit count, then
+// that many ids as a 32 bit length and bytes, numbered from 0 across the
+// whole file in the order given. Numbers are in the machine's byte order.
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+template <typename T>
+void write_section_value(std::ofstream& file, const T& value)
+{
+  file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+void write_section_column(std::ofstream& file, const std::vector<T>& values)
+{
+  file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+inline void write_id_section(std::ofstream& file, const std::vector<std::string>& ids)
+{
+  write_section_value<std::uint8_t>(file, 1);
+  write_section_value<std::uint32_t>(file, ids.size());
+  for (const auto& id : ids) {
+    write_section_value<std::uint32_t>(file, id.size());
+    file.write(id.data(), id.size());
+  }
+}
+
+// Called after each section or group of sections is written. Flushing them
+// as they go keeps the file of a run that dies readable up to its last full
+// section. Returns false if anything has failed to write.
+inline bool end_sections(std::ofstream& file)
+{
+  file.flush();
+  return bool(file);
+}
+
+template <typename T>
+bool read_section_value(std::ifstream& file, T& value)
+{
+  file.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return bool(file);
+}
+
+// Read n values stored as File_Type onto the end of a column
+template <typename File_Type, typename T>
+bool read_section_column(std::ifstream& file, const std::uint32_t& n, std::vector<T>& column)
+{
+  std::vector<File_Type> values(n);
+  file.read(reinterpret_cast<char*>(values.data()), n * sizeof(File_Type));
+  column.insert(column.end(), values.begin(), values.end());
+  return bool(file);
+}
+
+// Read the n ids of an id section onto the end of ids. Returns false, leaving
+// ids as they were, if the section was cut short.
+inline bool read_id_section(std::ifstream& file, const std::uint32_t& n, std::vector<std::string>& ids)
+{
+  std::vector<std::string> new_ids(n);
+  for (auto& id : new_ids) {
+    std::uint32_t length = 0;
+    if (!read_section_value(file, length)) return false;
+    id.resize(length);
+    file.read(&id[0], length);
+  }
+  if (!file) return false;
+  ids.insert(ids.end(), new_ids.begin(), new_ids.end());
+  return true;
+}
+
+#endif
@@ -0,0 +1,20 @@
+# Run from the repo root. Builds the C interface to the engine (see sbm_c.h)
+# as a shared library in the repo root, or to the path given, e.g.
+# sh src/capi/build_capi.sh /usr/local/lib/libsbm.so
+OUTPUT_PATH="${1:-libsbm.so}"
+case "${OUTPUT_PATH}" in
+  /*) ;;
+  *) OUTPUT_PATH="$(pwd)/${OUTPUT_PATH}" ;;
+esac
+
+cd src/
+
+OPTIMIZATION_LEVEL=-O3
+
+# Only the sbm_* functions are exported so the engine's own symbols can't
+# clash with those of the program loading the library
+g++ -std=c++11 ${OPTIMIZATION_LEVEL} -pthread -fPIC -shared -fvisibility=hidden \
+    -DNO_RCPP=1 \
+    capi/sbm_c.cpp \
+    Node.cpp Block_Consensus.cpp SBM.cpp Sampler.cpp Batch_Fit.cpp Network_Sim.cpp \
+    -o "${OUTPUT_PATH}"
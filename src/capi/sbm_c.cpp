@@ -0,0 +1,439 @@
+#include "sbm_c.h"
+#include "../SBM.h"
+#include "../partition_similarity.h"
+
+#include <memory>
+#include <unordered_map>
+
+// =============================================================================
+// Handle definitions. These never leave the library so their layout can change
+// freely without breaking callers.
+// =============================================================================
+struct sbm_graph {
+  Sim_Network network;
+};
+
+struct sbm_model {
+  SBM     net;
+  NodeVec nodes; // Data nodes in graph order
+  sbm_model(const int seed)
+      : net(seed)
+  {
+  }
+};
+
+struct sbm_results {
+  // Sweeps
+  std::vector<double>  sweep_entropy_delta;
+  std::vector<int32_t> sweep_num_nodes_moved;
+
+  // Collapse steps
+  std::vector<int32_t>              step_num_blocks;
+  std::vector<double>               step_entropy;
+  std::vector<double>               step_entropy_delta;
+  std::vector<std::vector<int32_t>> step_blocks;
+
+  bool is_sweep = false;
+
+  void clear()
+  {
+    sweep_entropy_delta.clear();
+    sweep_num_nodes_moved.clear();
+    step_num_blocks.clear();
+    step_entropy.clear();
+    step_entropy_delta.clear();
+    step_blocks.clear();
+  }
+};
+
+namespace {
+thread_local std::string last_error;
+
+sbm_status fail(const sbm_status status, const std::string& message)
+{
+  last_error = message;
+  return status;
+}
+
+// Run a call, turning anything the engine throws into a status
+template <typename Call>
+sbm_status guarded(const Call& call)
+{
+  try {
+    return call();
+  }
+  catch (const std::exception& error) {
+    return fail(SBM_ENGINE_ERROR, error.what());
+  }
+  catch (...) {
+    return fail(SBM_ENGINE_ERROR, "Unknown error in the SBM engine.");
+  }
+}
+
+// Copy a vector into a caller's buffer if it fits. Null buffers are skipped.
+template <typename T>
+sbm_status copy_out(const std::vector<T>& values, T* buffer, const size_t capacity)
+{
+  if (buffer == nullptr) return SBM_OK;
+  if (capacity < values.size()) {
+    return fail(SBM_BUFFER_TOO_SMALL,
+                "Buffer holds " + std::to_string(capacity) + " values but " + std::to_string(values.size()) + " are needed.");
+  }
+  std::copy(values.begin(), values.end(), buffer);
+  return SBM_OK;
+}
+
+// Blocks of the data nodes in a state dump, in graph order
+std::vector<int32_t> state_blocks(const State_Dump& state, const NodeVec& nodes)
+{
+  std::unordered_map<std::string, std::string> node_parents;
+  for (std::size_t i = 0; i < state.id.size(); i++) {
+    if (state.level[i] == 0) node_parents[state.id[i]] = state.parent[i];
+  }
+
+  std::vector<std::string> parents;
+  parents.reserve(nodes.size());
+  for (const auto& node : nodes) {
+    parents.push_back(node_parents[node->id]);
+  }
+  return dense_labels(parents);
+}
+
+void record_steps(const CollapseResults& steps, const NodeVec& nodes, sbm_results* results)
+{
+  results->clear();
+  results->is_sweep = false;
+  for (const auto& step : steps) {
+    results->step_num_blocks.push_back(step.num_blocks);
+    results->step_entropy.push_back(step.entropy);
+    results->step_entropy_delta.push_back(step.entropy_delta);
+    results->step_blocks.push_back(state_blocks(step.state, nodes));
+  }
+}
+} // namespace
+
+// =============================================================================
+// Library info
+// =============================================================================
+int32_t sbm_api_version(void)
+{
+  return SBM_C_API_VERSION;
+}
+
+const char* sbm_last_error(void)
+{
+  return last_error.c_str();
+}
+
+// =============================================================================
+// Graphs
+// =============================================================================
+sbm_status sbm_graph_create(sbm_graph** graph)
+{
+  if (graph == nullptr) return fail(SBM_INVALID_ARGUMENT, "Need somewhere to put the graph.");
+  return guarded([&]() {
+    *graph = new sbm_graph();
+    return SBM_OK;
+  });
+}
+
+void sbm_graph_free(sbm_graph* graph)
+{
+  delete graph;
+}
+
+sbm_status sbm_graph_add_nodes(sbm_graph*         graph,
+                               size_t             num_nodes,
+                               const char* const* ids,
+                               const char* const* types)
+{
+  if (graph == nullptr || (num_nodes > 0 && ids == nullptr)) {
+    return fail(SBM_INVALID_ARGUMENT, "Need a graph and an id for every node.");
+  }
+  return guarded([&]() {
+    Sim_Network& network = graph->network;
+    network.node_ids.reserve(network.node_ids.size() + num_nodes);
+    network.node_types.reserve(network.node_types.size() + num_nodes);
+    for (size_t i = 0; i < num_nodes; i++) {
+      network.node_ids.emplace_back(ids[i]);
+      network.node_types.emplace_back(types == nullptr ? "node" : types[i]);
+    }
+    network.node_blocks.resize(network.node_ids.size(), 0);
+    return SBM_OK;
+  });
+}
+
+sbm_status sbm_graph_add_edges(sbm_graph*     graph,
+                               size_t         num_edges,
+                               const int32_t* from,
+                               const int32_t* to)
+{
+  if (graph == nullptr || (num_edges > 0 && (from == nullptr || to == nullptr))) {
+    return fail(SBM_INVALID_ARGUMENT, "Need a graph and both ends of every edge.");
+  }
+
+  const int32_t num_nodes = graph->network.num_nodes();
+  for (size_t i = 0; i < num_edges; i++) {
+    if (from[i] < 0 || to[i] < 0 || from[i] >= num_nodes || to[i] >= num_nodes) {
+      return fail(SBM_INVALID_ARGUMENT, "Edge " + std::to_string(i) + " refers to a node that hasn't been added.");
+    }
+  }
+
+  return guarded([&]() {
+    Sim_Network& network = graph->network;
+    network.edges_from.insert(network.edges_from.end(), from, from + num_edges);
+    network.edges_to.insert(network.edges_to.end(), to, to + num_edges);
+    return SBM_OK;
+  });
+}
+
+sbm_status sbm_graph_read_edge_file(sbm_graph* graph, const char* path)
+{
+  if (graph == nullptr || path == nullptr) return fail(SBM_INVALID_ARGUMENT, "Need a graph and a path.");
+  if (graph->network.num_nodes() > 0) return fail(SBM_INVALID_ARGUMENT, "Edge files can only be read into empty graphs.");
+  return guarded([&]() {
+    graph->network = read_edge_file(path);
+    return SBM_OK;
+  });
+}
+
+size_t sbm_graph_num_nodes(const sbm_graph* graph)
+{
+  return graph == nullptr ? 0 : graph->network.num_nodes();
+}
+
+size_t sbm_graph_num_edges(const sbm_graph* graph)
+{
+  return graph == nullptr ? 0 : graph->network.num_edges();
+}
+
+// =============================================================================
+// Models
+// =============================================================================
+sbm_status sbm_model_create(const sbm_graph* graph,
+                            int32_t          seed,
+                            int32_t          degree_corrected,
+                            sbm_model**      model)
+{
+  if (graph == nullptr || model == nullptr) return fail(SBM_INVALID_ARGUMENT, "Need a graph and somewhere to put the model.");
+  return guarded([&]() {
+    std::unique_ptr<sbm_model> new_model(new sbm_model(seed));
+    new_model->net.set_degree_corrected(degree_corrected != 0);
+    new_model->net.add_sim_network(graph->network, false);
+
+    const LevelPtr data_nodes = new_model->net.get_level(0);
+    if (int(data_nodes->size()) != graph->network.num_nodes()) {
+      return fail(SBM_INVALID_ARGUMENT, "Node ids need to be unique.");
+    }
+
+    new_model->nodes.reserve(data_nodes->size());
+    for (const auto& id : graph->network.node_ids) {
+      new_model->nodes.push_back(data_nodes->at(id));
+    }
+
+    *model = new_model.release();
+    return SBM_OK;
+  });
+}
+
+void sbm_model_free(sbm_model* model)
+{
+  delete model;
+}
+
+sbm_status sbm_model_initialize_blocks(sbm_model* model, int32_t num_blocks)
+{
+  if (model == nullptr) return fail(SBM_INVALID_ARGUMENT, "Need a model.");
+  return guarded([&]() {
+    model->net.initialize_blocks(0, num_blocks);
+    return SBM_OK;
+  });
+}
+
+sbm_status sbm_model_set_blocks(sbm_model* model, size_t num_nodes, const int32_t* blocks)
+{
+  if (model == nullptr || blocks == nullptr || num_nodes != model->nodes.size()) {
+    return fail(SBM_INVALID_ARGUMENT, "Need a model and a block for every node.");
+  }
+  return guarded([&]() {
+    State_Dump state;
+    state.id.reserve(num_nodes);
+    state.parent.reserve(num_nodes);
+    for (size_t i = 0; i < num_nodes; i++) {
+      const NodePtr& node = model->nodes[i];
+      state.id.push_back(node->id);
+      state.parent.push_back(node->type + "-1_set_" + std::to_string(blocks[i]));
+      state.type.push_back(node->type);
+    }
+    state.level.assign(num_nodes, 0);
+
+    model->net.set_state(state.id, state.parent, state.level, state.type);
+    return SBM_OK;
+  });
+}
+
+sbm_status sbm_model_get_blocks(const sbm_model* model,
+                                int32_t          level,
+                                int32_t*         blocks,
+                                size_t           capacity,
+                                size_t*          num_nodes)
+{
+  if (model == nullptr || level < 1) return fail(SBM_INVALID_ARGUMENT, "Need a model and a block level of 1 or more.");
+  if (num_nodes != nullptr) *num_nodes = model->nodes.size();
+  return guarded([&]() {
+    std::vector<const Node*> node_blocks;
+    node_blocks.reserve(model->nodes.size());
+    for (const auto& node : model->nodes) {
+      const Node* block = node.get();
+      for (int i = 0; i < level && block != nullptr; i++) {
+        block = block->parent.get();
+      }
+      if (block == nullptr) {
+        return fail(SBM_INVALID_ARGUMENT, "Node " + node->id + " has no block at level " + std::to_string(level) + ".");
+      }
+      node_blocks.push_back(block);
+    }
+    return copy_out(dense_labels(node_blocks), blocks, capacity);
+  });
+}
+
+sbm_status sbm_model_num_blocks(const sbm_model* model, int32_t level, size_t* num_blocks)
+{
+  if (model == nullptr || num_blocks == nullptr) return fail(SBM_INVALID_ARGUMENT, "Need a model and somewhere to put the count.");
+  const auto level_loc = model->net.nodes.find(level);
+  *num_blocks          = level_loc == model->net.nodes.end() ? 0 : level_loc->second->size();
+  return SBM_OK;
+}
+
+sbm_status sbm_model_entropy(const sbm_model* model, int32_t level, double* entropy)
+{
+  if (model == nullptr || entropy == nullptr) return fail(SBM_INVALID_ARGUMENT, "Need a model and somewhere to put the entropy.");
+  if (model->net.nodes.count(level + 1) == 0 || model->net.nodes.at(level + 1)->empty()) {
+    return fail(SBM_INVALID_ARGUMENT, "Level " + std::to_string(level) + " has no blocks.");
+  }
+  return guarded([&]() {
+    *entropy = model->net.get_entropy(level);
+    return SBM_OK;
+  });
+}
+
+// =============================================================================
+// Fitting
+// =============================================================================
+sbm_status sbm_results_create(sbm_results** results)
+{
+  if (results == nullptr) return fail(SBM_INVALID_ARGUMENT, "Need somewhere to put the results.");
+  return guarded([&]() {
+    *results = new sbm_results();
+    return SBM_OK;
+  });
+}
+
+void sbm_results_free(sbm_results* results)
+{
+  delete results;
+}
+
+sbm_status sbm_model_sweep(sbm_model*   model,
+                           int32_t      num_sweeps,
+                           double       eps,
+                           int32_t      variable_num_blocks,
+                           sbm_results* results)
+{
+  if (model == nullptr || results == nullptr || num_sweeps < 0) {
+    return fail(SBM_INVALID_ARGUMENT, "Need a model, a results handle and a number of sweeps.");
+  }
+  if (model->net.nodes.count(1) == 0 || model->net.nodes.at(1)->empty()) {
+    return fail(SBM_INVALID_ARGUMENT, "Set or initialize blocks before sweeping.");
+  }
+  return guarded([&]() {
+    const MCMC_Sweeps sweeps = model->net.mcmc_sweep(0, num_sweeps, eps, variable_num_blocks != 0, false);
+
+    results->clear();
+    results->is_sweep = true;
+    results->sweep_entropy_delta.assign(sweeps.sweep_entropy_delta.begin(), sweeps.sweep_entropy_delta.end());
+    results->sweep_num_nodes_moved.assign(sweeps.sweep_num_nodes_moved.begin(), sweeps.sweep_num_nodes_moved.end());
+    return SBM_OK;
+  });
+}
+
+sbm_status sbm_model_collapse(sbm_model*   model,
+                              int32_t      num_mcmc_steps,
+                              int32_t      desired_num_blocks,
+                              int32_t      num_checks_per_block,
+                              double       sigma,
+                              double       eps,
+                              int32_t      report_all_steps,
+                              sbm_results* results)
+{
+  if (model == nullptr || results == nullptr) return fail(SBM_INVALID_ARGUMENT, "Need a model and a results handle.");
+  return guarded([&]() {
+    record_steps(model->net.collapse_blocks(0, num_mcmc_steps, desired_num_blocks, num_checks_per_block, sigma, eps, report_all_steps != 0),
+                 model->nodes,
+                 results);
+    return SBM_OK;
+  });
+}
+
+sbm_status sbm_model_collapse_components(sbm_model*   model,
+                                         int32_t      num_mcmc_steps,
+                                         int32_t      desired_num_blocks,
+                                         int32_t      num_checks_per_block,
+                                         double       sigma,
+                                         double       eps,
+                                         int32_t      num_threads,
+                                         sbm_results* results)
+{
+  if (model == nullptr || results == nullptr) return fail(SBM_INVALID_ARGUMENT, "Need a model and a results handle.");
+  if (num_threads < 1) return fail(SBM_INVALID_ARGUMENT, "Need at least one thread.");
+  return guarded([&]() {
+    record_steps(model->net.collapse_components(num_mcmc_steps, desired_num_blocks, num_checks_per_block, sigma, eps, num_threads),
+                 model->nodes,
+                 results);
+    return SBM_OK;
+  });
+}
+
+size_t sbm_results_num_steps(const sbm_results* results)
+{
+  if (results == nullptr) return 0;
+  return results->is_sweep ? results->sweep_entropy_delta.size() : results->step_num_blocks.size();
+}
+
+sbm_status sbm_results_get_sweeps(const sbm_results* results,
+                                  double*            entropy_delta,
+                                  int32_t*           num_nodes_moved,
+                                  size_t             capacity)
+{
+  if (results == nullptr || !results->is_sweep) return fail(SBM_INVALID_ARGUMENT, "Results don't hold sweeps.");
+  const sbm_status status = copy_out(results->sweep_entropy_delta, entropy_delta, capacity);
+  if (status != SBM_OK) return status;
+  return copy_out(results->sweep_num_nodes_moved, num_nodes_moved, capacity);
+}
+
+sbm_status sbm_results_get_steps(const sbm_results* results,
+                                 int32_t*           num_blocks,
+                                 double*            entropy,
+                                 double*            entropy_delta,
+                                 size_t             capacity)
+{
+  if (results == nullptr || results->is_sweep) return fail(SBM_INVALID_ARGUMENT, "Results don't hold collapse steps.");
+  sbm_status status = copy_out(results->step_num_blocks, num_blocks, capacity);
+  if (status == SBM_OK) status = copy_out(results->step_entropy, entropy, capacity);
+  if (status == SBM_OK) status = copy_out(results->step_entropy_delta, entropy_delta, capacity);
+  return status;
+}
+
+sbm_status sbm_results_get_step_blocks(const sbm_results* results,
+                                       size_t             step,
+                                       int32_t*           blocks,
+                                       size_t             capacity,
+                                       size_t*            num_nodes)
+{
+  if (results == nullptr || results->is_sweep || step >= results->step_blocks.size()) {
+    return fail(SBM_INVALID_ARGUMENT, "Results don't hold a collapse step " + std::to_string(step) + ".");
+  }
+  const std::vector<int32_t>& step_blocks = results->step_blocks[step];
+  if (num_nodes != nullptr) *num_nodes = step_blocks.size();
+  return copy_out(step_blocks, blocks, capacity);
+}
@@ -0,0 +1,191 @@
+#ifndef __SBM_C_INCLUDED__
+#define __SBM_C_INCLUDED__
+/*
+ * C interface to the SBM engine for use from other languages and services.
+ * Build libsbm with src/capi/build_capi.sh.
+ *
+ * Everything is reached through three opaque handles:
+ *
+ *   sbm_graph    nodes and edges, loaded in bulk. Nodes are referred to by
+ *                their index in the order they were added.
+ *   sbm_model    a model fit to a graph
+ *   sbm_results  the outcome of the last sweep or collapse run into it.
+ *                Reuse one handle across calls to avoid reallocating.
+ *
+ * Data never crosses the boundary in memory owned by the other side: inputs
+ * are read from the caller's arrays during the call and outputs are copied
+ * into caller provided buffers along with their capacity. Calls that fill a
+ * buffer that's too small return SBM_BUFFER_TOO_SMALL and report the size
+ * needed, so callers can size buffers once and reuse them.
+ *
+ * Every call returns a status. On failure sbm_last_error() describes what
+ * went wrong on the calling thread. Handles are not thread safe, but
+ * different handles can be used from different threads at once.
+ *
+ * Functions are only ever added to this interface, never changed, so a
+ * program built against one version keeps working with later libraries.
+ * SBM_C_API_VERSION goes up when functions are added.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32)
+#define SBM_API __declspec(dllexport)
+#else
+#define SBM_API __attribute__((visibility("default")))
+#endif
+
+#define SBM_C_API_VERSION 1
+
+typedef struct sbm_graph   sbm_graph;
+typedef struct sbm_model   sbm_model;
+typedef struct sbm_results sbm_results;
+
+typedef enum {
+  SBM_OK               = 0,
+  SBM_INVALID_ARGUMENT = 1, /* Null handle, bad index or inconsistent sizes */
+  SBM_BUFFER_TOO_SMALL = 2, /* Output buffer can't hold the result */
+  SBM_ENGINE_ERROR     = 3  /* The engine threw, see sbm_last_error() */
+} sbm_status;
+
+/* Version of the interface the library was built with */
+SBM_API int32_t sbm_api_version(void);
+
+/* Message describing the last failed call on this thread. Valid until the
+   next failing call on the thread. */
+SBM_API const char* sbm_last_error(void);
+
+/* ---- Graphs ------------------------------------------------------------- */
+
+SBM_API sbm_status sbm_graph_create(sbm_graph** graph);
+SBM_API void       sbm_graph_free(sbm_graph* graph);
+
+/* Add num_nodes nodes with null terminated ids. Types may be null, in which
+   case every node gets type "node". */
+SBM_API sbm_status sbm_graph_add_nodes(sbm_graph*         graph,
+                                       size_t             num_nodes,
+                                       const char* const* ids,
+                                       const char* const* types);
+
+/* Add num_edges edges between nodes given by index */
+SBM_API sbm_status sbm_graph_add_edges(sbm_graph*     graph,
+                                       size_t         num_edges,
+                                       const int32_t* from,
+                                       const int32_t* to);
+
+/* Load a binary edge file written by write_edge_file() (see Network_Sim.h)
+   into an empty graph. Nodes are named n0, n1, ... */
+SBM_API sbm_status sbm_graph_read_edge_file(sbm_graph* graph, const char* path);
+
+SBM_API size_t sbm_graph_num_nodes(const sbm_graph* graph);
+SBM_API size_t sbm_graph_num_edges(const sbm_graph* graph);
+
+/* ---- Models ------------------------------------------------------------- */
+
+/* Build a model of a graph. The graph can be freed afterwards. Node ids must
+   be unique. degree_corrected picks the edge model entropy is scored with. */
+SBM_API sbm_status sbm_model_create(const sbm_graph* graph,
+                                    int32_t          seed,
+                                    int32_t          degree_corrected,
+                                    sbm_model**      model);
+SBM_API void       sbm_model_free(sbm_model* model);
+
+/* Put the graph's nodes in num_blocks random blocks per node type, or each in
+   their own block if num_blocks is -1 */
+SBM_API sbm_status sbm_model_initialize_blocks(sbm_model* model, int32_t num_blocks);
+
+/* Place every node (num_nodes of them, in graph order) in the block given by
+   an integer label. Nodes of different types never share a block, even with
+   the same label. Replaces any existing blocks. */
+SBM_API sbm_status sbm_model_set_blocks(sbm_model* model, size_t num_nodes, const int32_t* blocks);
+
+/* Copy the block of every node at a level of the hierarchy (1 is the nodes'
+   own blocks) into blocks, in graph order. Blocks are numbered from 0 in
+   order of first appearance. num_nodes is set to the number of nodes. */
+SBM_API sbm_status sbm_model_get_blocks(const sbm_model* model,
+                                        int32_t          level,
+                                        int32_t*         blocks,
+                                        size_t           capacity,
+                                        size_t*          num_nodes);
+
+/* Number of blocks at a level */
+SBM_API sbm_status sbm_model_num_blocks(const sbm_model* model, int32_t level, size_t* num_blocks);
+
+/* Entropy of the partition of a level's nodes into their blocks (0 for the
+   graph's nodes) */
+SBM_API sbm_status sbm_model_entropy(const sbm_model* model, int32_t level, double* entropy);
+
+/* ---- Fitting ------------------------------------------------------------ */
+
+SBM_API sbm_status sbm_results_create(sbm_results** results);
+SBM_API void       sbm_results_free(sbm_results* results);
+
+/* MCMC sweeps of the graph's nodes over their blocks, as mcmc_sweep() in R.
+   Blocks must have been set or initialized first. */
+SBM_API sbm_status sbm_model_sweep(sbm_model*   model,
+                                   int32_t      num_sweeps,
+                                   double       eps,
+                                   int32_t      variable_num_blocks,
+                                   sbm_results* results);
+
+/* Agglomerative merging down to desired_num_blocks, as collapse_blocks() in
+   R. report_all_steps records every merge step rather than just the last. */
+SBM_API sbm_status sbm_model_collapse(sbm_model*   model,
+                                      int32_t      num_mcmc_steps,
+                                      int32_t      desired_num_blocks,
+                                      int32_t      num_checks_per_block,
+                                      double       sigma,
+                                      double       eps,
+                                      int32_t      report_all_steps,
+                                      sbm_results* results);
+
+/* Agglomerative merging of each connected component separately, as
+   collapse_components() in R. Every component is collapsed down to
+   desired_num_blocks of its own and only the final combined step is
+   recorded. Components are spread over num_threads threads, which changes
+   how fast the collapse runs but not the results it can give. */
+SBM_API sbm_status sbm_model_collapse_components(sbm_model*   model,
+                                                 int32_t      num_mcmc_steps,
+                                                 int32_t      desired_num_blocks,
+                                                 int32_t      num_checks_per_block,
+                                                 double       sigma,
+                                                 double       eps,
+                                                 int32_t      num_threads,
+                                                 sbm_results* results);
+
+/* Number of sweeps or collapse steps held */
+SBM_API size_t sbm_results_num_steps(const sbm_results* results);
+
+/* Per sweep entropy change and number of nodes moved. Either buffer may be
+   null to skip it. */
+SBM_API sbm_status sbm_results_get_sweeps(const sbm_results* results,
+                                          double*            entropy_delta,
+                                          int32_t*           num_nodes_moved,
+                                          size_t             capacity);
+
+/* Per collapse step number of blocks, entropy and entropy change. Any buffer
+   may be null to skip it. */
+SBM_API sbm_status sbm_results_get_steps(const sbm_results* results,
+                                         int32_t*           num_blocks,
+                                         double*            entropy,
+                                         double*            entropy_delta,
+                                         size_t             capacity);
+
+/* Block of every node (in graph order, numbered as sbm_model_get_blocks())
+   after a collapse step */
+SBM_API sbm_status sbm_results_get_step_blocks(const sbm_results* results,
+                                               size_t             step,
+                                               int32_t*           blocks,
+                                               size_t             capacity,
+                                               size_t*            num_nodes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,374 @@
+#ifndef __CHAIN_CHECKPOINT_INCLUDED__
+#define __CHAIN_CHECKPOINT_INCLUDED__
+// Snapshots of a running chain of MCMC sweeps, written to disk every so often
+// so a long run that gets killed can pick up where it left off. A snapshot
+// holds everything the chain's next sweep depends on: the partition, the
+// random generator, the order nodes were last swept in, and what's been
+// gathered so far. Resuming from one carries on exactly as the chain would
+// have.
+//
+// The chain only ever copies its state into a Chain_Checkpoint. Writing that
+// out happens on a background thread, and if the chain checkpoints again
+// before the last one is written the older one is simply dropped. A write
+// that fails is reported the next time the chain checkpoints.
+//
+// The file is an 8 byte "SBMCHAIN" marker and a 32 bit version followed by
+// the fields of Chain_Checkpoint in the order they're declared. Vectors are a
+// 32 bit count then their values, strings a 32 bit length then their bytes.
+// It ends with the marker again so a cut short file is never mistaken for a
+// whole one. Numbers are in the machine's byte order. Files are written next
+// to their destination and renamed over it, so the last complete checkpoint
+// survives a crash part way through writing the next.
+
+#include "Block_Consensus.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Chain_Checkpoint {
+  // How the chain was started
+  int    level               = 0;
+  int    num_sweeps          = 0;
+  double eps                 = 0;
+  bool   variable_num_blocks = false;
+  bool   track_pairs         = false;
+  bool   degree_corrected    = false;
+
+  // Where the chain is up to
+  int                 sweeps_done = 0;
+  std::string         sampler_state; // The random generator, as written by operator<<
+  std::vector<int>    sweep_order;   // Indices into the level's nodes in the order last swept
+  std::vector<double> sweep_entropy_delta;
+  std::vector<int>    sweep_num_nodes_moved;
+
+  // Partition, as from SBM::get_state()
+  std::vector<std::string> state_id;
+  std::vector<std::string> state_parent;
+  std::vector<int>         state_level;
+  std::vector<std::string> state_type;
+
+  // Pair counts when tracking pairs
+  std::vector<std::string> pair_key;
+  std::vector<std::uint8_t> pair_connected;
+  std::vector<int>         pair_times_connected;
+
+  // The network's edges, in the order they were added, so a checkpoint can be
+  // matched up with the network it came from. They're the same for the whole
+  // chain so all its checkpoints share one copy.
+  struct Edge_List {
+    std::vector<std::string> from;
+    std::vector<std::string> to;
+  };
+  std::shared_ptr<const Edge_List> edges;
+
+  void set_pair_counts(const Block_Consensus& consensus)
+  {
+    const std::size_t n = consensus.concensus_pairs.size();
+    pair_key.clear();
+    pair_connected.clear();
+    pair_times_connected.clear();
+    pair_key.reserve(n);
+    pair_connected.reserve(n);
+    pair_times_connected.reserve(n);
+    for (const auto& pair : consensus.concensus_pairs) {
+      pair_key.push_back(pair.first);
+      pair_connected.push_back(pair.second.connected);
+      pair_times_connected.push_back(pair.second.times_connected);
+    }
+  }
+
+  void get_pair_counts(Block_Consensus& consensus) const
+  {
+    consensus.concensus_pairs.clear();
+    const std::size_t n = pair_key.size();
+    for (std::size_t i = 0; i < n; i++) {
+      Pair_Status status(pair_connected[i]);
+      status.times_connected = pair_times_connected[i];
+      consensus.concensus_pairs.emplace_hint(consensus.concensus_pairs.end(), pair_key[i], status);
+    }
+  }
+};
+
+// Helpers for write_checkpoint() and read_checkpoint()
+template <typename T>
+void write_checkpoint_value(std::ofstream& file, const T& value)
+{
+  file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+inline void write_checkpoint_string(std::ofstream& file, const std::string& value)
+{
+  write_checkpoint_value<std::uint32_t>(file, value.size());
+  file.write(value.data(), value.size());
+}
+
+template <typename T>
+void write_checkpoint_vector(std::ofstream& file, const std::vector<T>& values)
+{
+  write_checkpoint_value<std::uint32_t>(file, values.size());
+  file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+inline void write_checkpoint_vector(std::ofstream& file, const std::vector<std::string>& values)
+{
+  write_checkpoint_value<std::uint32_t>(file, values.size());
+  for (const auto& value : values) {
+    write_checkpoint_string(file, value);
+  }
+}
+
+template <typename T>
+void read_checkpoint_value(std::ifstream& file, T& value)
+{
+  file.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+inline void read_checkpoint_string(std::ifstream& file, std::string& value)
+{
+  std::uint32_t length = 0;
+  read_checkpoint_value(file, length);
+  if (!file) return;
+  value.resize(length);
+  file.read(&value[0], length);
+}
+
+template <typename T>
+void read_checkpoint_vector(std::ifstream& file, std::vector<T>& values)
+{
+  std::uint32_t n = 0;
+  read_checkpoint_value(file, n);
+  if (!file) return;
+  values.resize(n);
+  file.read(reinterpret_cast<char*>(values.data()), n * sizeof(T));
+}
+
+inline void read_checkpoint_vector(std::ifstream& file, std::vector<std::string>& values)
+{
+  std::uint32_t n = 0;
+  read_checkpoint_value(file, n);
+  if (!file) return;
+  values.resize(n);
+  for (auto& value : values) {
+    read_checkpoint_string(file, value);
+    if (!file) return;
+  }
+}
+
+// Write a checkpoint to path, replacing whatever was there only once the new
+// one is completely written. Returns false if anything failed.
+inline bool write_checkpoint(const std::string& path, const Chain_Checkpoint& checkpoint)
+{
+  const std::string partial_path = path + ".partial";
+  {
+    std::ofstream file(partial_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      return false;
+    }
+
+    file.write("SBMCHAIN", 8);
+    write_checkpoint_value<std::uint32_t>(file, 2);
+
+    write_checkpoint_value<std::int32_t>(file, checkpoint.level);
+    write_checkpoint_value<std::int32_t>(file, checkpoint.num_sweeps);
+    write_checkpoint_value<double>(file, checkpoint.eps);
+    write_checkpoint_value<std::uint8_t>(file, checkpoint.variable_num_blocks);
+    write_checkpoint_value<std::uint8_t>(file, checkpoint.track_pairs);
+    write_checkpoint_value<std::uint8_t>(file, checkpoint.degree_corrected);
+
+    write_checkpoint_value<std::int32_t>(file, checkpoint.sweeps_done);
+    write_checkpoint_string(file, checkpoint.sampler_state);
+    write_checkpoint_vector(file, checkpoint.sweep_order);
+    write_checkpoint_vector(file, checkpoint.sweep_entropy_delta);
+    write_checkpoint_vector(file, checkpoint.sweep_num_nodes_moved);
+
+    write_checkpoint_vector(file, checkpoint.state_id);
+    write_checkpoint_vector(file, checkpoint.state_parent);
+    write_checkpoint_vector(file, checkpoint.state_level);
+    write_checkpoint_vector(file, checkpoint.state_type);
+
+    write_checkpoint_vector(file, checkpoint.pair_key);
+    write_checkpoint_vector(file, checkpoint.pair_connected);
+    write_checkpoint_vector(file, checkpoint.pair_times_connected);
+
+    const Chain_Checkpoint::Edge_List no_edges;
+    const Chain_Checkpoint::Edge_List& edges = checkpoint.edges ? *checkpoint.edges : no_edges;
+    write_checkpoint_vector(file, edges.from);
+    write_checkpoint_vector(file, edges.to);
+
+    file.write("SBMCHAIN", 8);
+    file.close();
+    if (!file) {
+      std::remove(partial_path.c_str());
+      return false;
+    }
+  }
+
+  return std::rename(partial_path.c_str(), path.c_str()) == 0;
+}
+
+// Load a checkpoint written by write_checkpoint()
+inline Chain_Checkpoint read_checkpoint(const std::string& path)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    RANGE_ERROR("Could not open checkpoint " + path + ".");
+  }
+
+  char          marker[8];
+  std::uint32_t version = 0;
+  file.read(marker, 8);
+  if (!file || std::string(marker, 8) != "SBMCHAIN") {
+    LOGIC_ERROR(path + " is not a sweep checkpoint.");
+  }
+  read_checkpoint_value(file, version);
+  if (!file || version != 2) {
+    LOGIC_ERROR("Unsupported checkpoint version in " + path + ".");
+  }
+
+  Chain_Checkpoint checkpoint;
+  std::int32_t     level = 0, num_sweeps = 0, sweeps_done = 0;
+  std::uint8_t     variable_num_blocks = 0, track_pairs = 0, degree_corrected = 0;
+
+  read_checkpoint_value(file, level);
+  read_checkpoint_value(file, num_sweeps);
+  read_checkpoint_value(file, checkpoint.eps);
+  read_checkpoint_value(file, variable_num_blocks);
+  read_checkpoint_value(file, track_pairs);
+  read_checkpoint_value(file, degree_corrected);
+
+  read_checkpoint_value(file, sweeps_done);
+  read_checkpoint_string(file, checkpoint.sampler_state);
+  read_checkpoint_vector(file, checkpoint.sweep_order);
+  read_checkpoint_vector(file, checkpoint.sweep_entropy_delta);
+  read_checkpoint_vector(file, checkpoint.sweep_num_nodes_moved);
+
+  read_checkpoint_vector(file, checkpoint.state_id);
+  read_checkpoint_vector(file, checkpoint.state_parent);
+  read_checkpoint_vector(file, checkpoint.state_level);
+  read_checkpoint_vector(file, checkpoint.state_type);
+
+  read_checkpoint_vector(file, checkpoint.pair_key);
+  read_checkpoint_vector(file, checkpoint.pair_connected);
+  read_checkpoint_vector(file, checkpoint.pair_times_connected);
+
+  std::shared_ptr<Chain_Checkpoint::Edge_List> edges = std::make_shared<Chain_Checkpoint::Edge_List>();
+  read_checkpoint_vector(file, edges->from);
+  read_checkpoint_vector(file, edges->to);
+  checkpoint.edges = edges;
+
+  file.read(marker, 8);
+  if (!file || std::string(marker, 8) != "SBMCHAIN") {
+    LOGIC_ERROR("Checkpoint " + path + " is incomplete or corrupt.");
+  }
+
+  checkpoint.level               = level;
+  checkpoint.num_sweeps          = num_sweeps;
+  checkpoint.sweeps_done         = sweeps_done;
+  checkpoint.variable_num_blocks = variable_num_blocks;
+  checkpoint.track_pairs         = track_pairs;
+  checkpoint.degree_corrected    = degree_corrected;
+  return checkpoint;
+}
+
+// Writes checkpoints handed to it on a background thread. Only the latest
+// checkpoint not yet written is kept.
+class Checkpoint_Writer {
+  public:
+  // Throws straight away if nothing can be written next to path, rather than
+  // once a chain has been running for hours
+  explicit Checkpoint_Writer(const std::string& path)
+      : path(path)
+  {
+    const std::string probe_path = path + ".partial";
+    const bool        writable   = bool(std::ofstream(probe_path, std::ios::binary | std::ios::trunc));
+    std::remove(probe_path.c_str());
+    if (!writable) {
+      RANGE_ERROR("Can't write checkpoints to " + path + ".");
+    }
+
+    writer = std::thread(&Checkpoint_Writer::write_loop, this);
+  }
+
+  ~Checkpoint_Writer()
+  {
+    if (writer.joinable()) {
+      finish();
+    }
+  }
+
+  Checkpoint_Writer(const Checkpoint_Writer&) = delete;
+  Checkpoint_Writer& operator=(const Checkpoint_Writer&) = delete;
+
+  // Queue a checkpoint to be written, replacing any still waiting. Throws if
+  // an earlier checkpoint failed to write.
+  void submit(Chain_Checkpoint&& checkpoint)
+  {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (write_failed) {
+        RANGE_ERROR("Failed writing checkpoint to " + path + ".");
+      }
+      pending.reset(new Chain_Checkpoint(std::move(checkpoint)));
+    }
+    checkpoint_ready.notify_one();
+  }
+
+  // Write out the last checkpoint submitted and stop the writer
+  void close()
+  {
+    finish();
+    if (write_failed) {
+      RANGE_ERROR("Failed writing checkpoint to " + path + ".");
+    }
+  }
+
+  private:
+  std::string path;
+
+  // Shared with the writer thread
+  std::mutex                        lock;
+  std::condition_variable           checkpoint_ready;
+  std::unique_ptr<Chain_Checkpoint> pending;
+  bool                              closing      = false;
+  bool                              write_failed = false;
+  std::thread                       writer;
+
+  void finish()
+  {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      closing = true;
+    }
+    checkpoint_ready.notify_one();
+    writer.join();
+  }
+
+  void write_loop()
+  {
+    while (true) {
+      std::unique_ptr<Chain_Checkpoint> checkpoint;
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        checkpoint_ready.wait(guard, [this] { return closing || pending; });
+        if (!pending) {
+          return;
+        }
+        checkpoint = std::move(pending);
+      }
+
+      const bool written = write_checkpoint(path, *checkpoint);
+
+      std::lock_guard<std::mutex> guard(lock);
+      write_failed = write_failed || !written;
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,17 @@
+# Run from the repo root. Builds the sbm command line tool into the repo root,
+# or to the path given, e.g. sh src/cli/build_cli.sh /usr/local/bin/sbm
+OUTPUT_PATH="${1:-sbm}"
+case "${OUTPUT_PATH}" in
+  /*) ;;
+  *) OUTPUT_PATH="$(pwd)/${OUTPUT_PATH}" ;;
+esac
+
+cd src/
+
+OPTIMIZATION_LEVEL=-O3
+
+# Same sources as the tests, without any R dependencies
+g++ -std=c++11 ${OPTIMIZATION_LEVEL} -pthread cli/sbm.cpp \
+    -DNO_RCPP=1 \
+    Node.cpp Block_Consensus.cpp SBM.cpp Sampler.cpp Batch_Fit.cpp Network_Sim.cpp \
+    -o "${OUTPUT_PATH}"
@@ -0,0 +1,538 @@
+// Command line front end to the model for fitting networks without R. Reads
+// an edge file, runs one of the fitting algorithms and writes the resulting
+// states, traces and consensus counts to tab separated or binary tables (see
+// output_table.h). Build with build_cli.sh, e.g.
+//
+//   sh src/cli/build_cli.sh
+//   ./sbm collapse --edges edges.tsv --blocks 10 --mcmc-steps 5 --out-state state.tsv
+//
+// Run with no arguments for the full list of options.
+
+#include "../Network_Sim.h"
+#include "../SBM.h"
+#include "../command_line.h"
+#include "../output_table.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+struct Cli_Options {
+  std::string command;
+
+  // Input
+  std::string edges_path;
+  std::string nodes_path;
+  std::string state_path;
+  std::string default_node_type = "node";
+  int         seed              = 42;
+  bool        degree_corrected  = true;
+
+  // Algorithm settings
+  int              level                = 0;
+  int              num_mcmc_steps       = 0;
+  int              desired_num_blocks   = 1;
+  int              num_checks_per_block = 5;
+  double           sigma                = 2;
+  double           eps                  = 0.1;
+  bool             report_all_steps     = false;
+  bool             by_component         = false;
+  std::vector<int> block_nums;
+  int              num_sweeps          = 10;
+  int              initial_num_blocks  = -1;
+  bool             variable_num_blocks = true;
+  int              num_threads         = 1;
+
+  // Checkpointing of sweeps
+  std::string checkpoint_path;
+  int         checkpoint_every   = 100;
+  double      checkpoint_seconds = 600;
+  bool        resume             = false;
+
+  // Output
+  std::string format = "tsv";
+  std::string state_out_path;
+  std::string steps_out_path;
+  std::string trace_out_path;
+  std::string moves_out_path;
+  std::string consensus_out_path;
+  std::string stats_out_path;
+};
+
+const char* USAGE = R"(Usage: sbm <collapse|run|sweep> --edges PATH [options]
+
+Input
+  --edges PATH            Edges as a binary file from write_edge_file() or as text
+                          with a from and a to node id on each line, separated by
+                          tabs, commas or spaces. A first line of "from to" is
+                          skipped as a header.
+  --nodes PATH            Optional text file of node id and type per line, for
+                          polypartite networks. Header "id type" is skipped.
+  --state PATH            Start from a state written by --out-state (tsv only)
+  --node-type NAME        Type of nodes not in --nodes (node)
+  --seed N                Random seed (42)
+  --no-degree-correction  Score with the non-degree-corrected SBM
+
+collapse: agglomerative merging, like collapse_blocks() in R
+  --level N               Level of nodes to collapse (0)
+  --blocks N              Number of blocks to collapse down to (1)
+  --mcmc-steps N          MCMC sweeps after each merge step (0)
+  --checks-per-block N    Merge proposals per block (5)
+  --sigma X               Rate of collapse (2)
+  --eps X                 Ergodicity tuning parameter (0.1)
+  --all-steps             Record the state after every merge step
+  --by-component          Collapse each connected component separately, spread
+                          over --threads threads, like collapse_components().
+                          Always starts from level 0 and can't be combined
+                          with --level or --all-steps.
+
+run: several collapses to different numbers of blocks, like collapse_run()
+  --block-nums 2,4,8      Numbers of blocks to collapse to. The model is left in
+                          the result with the lowest entropy, recomputed for each.
+  plus --level, --mcmc-steps, --checks-per-block, --sigma and --eps
+
+sweep: MCMC sweeps from the current blocks, like mcmc_sweep()
+  --level N               Level of nodes to sweep (0)
+  --sweeps N              Number of sweeps (10)
+  --initial-blocks N      Start from N random blocks per type if no --state is
+                          given. -1 gives every node its own block. (-1)
+  --fixed-blocks          Don't create or remove blocks
+  --eps X                 Ergodicity tuning parameter (0.1)
+  --checkpoint PATH       Save the chain to PATH as it runs so it can be resumed
+  --checkpoint-every N    Sweeps between checkpoints, 0 for only by time (100)
+  --checkpoint-seconds X  Seconds between checkpoints, 0 for only by sweeps (600)
+  --resume                Carry on the chain saved at --checkpoint instead of
+                          starting a new one. Sweep settings come from the
+                          checkpoint.
+
+Threads
+  --threads N             Threads for --by-component collapses (1)
+
+Output
+  --format tsv|binary     Format of every output table (tsv)
+  --out-state PATH        Final model state: id, parent, level, type
+  --out-steps PATH        collapse/run: state after every step, with a step column
+  --out-trace PATH        collapse/run: step, num_blocks, entropy, entropy_delta
+                          sweep: sweep, entropy_delta, num_nodes_moved
+  --out-consensus PATH    sweep: times each pair of nodes shared a block
+  --out-moves PATH        sweep: binary log of every accepted move, from which
+                          the state after any sweep can be rebuilt (see
+                          move_log.h)
+  --out-stats PATH        Engine counters as JSON (see engine_stats.h)
+)";
+
+std::vector<std::string> split_fields(const std::string& line)
+{
+  std::vector<std::string> fields;
+  std::string              field;
+  for (const char& c : line) {
+    if (c == '\t' || c == ',' || c == ' ' || c == '\r') {
+      if (!field.empty()) fields.push_back(field);
+      field.clear();
+    }
+    else {
+      field.push_back(c);
+    }
+  }
+  if (!field.empty()) fields.push_back(field);
+  return fields;
+}
+
+// Rows of a delimited text file, minus blank lines and a matching header
+std::vector<std::vector<std::string>> read_text_table(const std::string&              path,
+                                                      const std::vector<std::string>& header)
+{
+  std::ifstream file(path);
+  if (!file) {
+    LOGIC_ERROR("Could not open " + path + " for reading.");
+  }
+
+  std::vector<std::vector<std::string>> rows;
+  std::string                           line;
+  bool                                  first_line = true;
+  while (std::getline(file, line)) {
+    std::vector<std::string> fields = split_fields(line);
+    const bool               is_header
+        = first_line && fields.size() >= header.size() && std::equal(header.begin(), header.end(), fields.begin());
+    first_line = false;
+    if (fields.empty() || is_header) continue;
+
+    if (fields.size() < header.size()) {
+      LOGIC_ERROR(path + " has a line with fewer than " + std::to_string(header.size()) + " fields: " + line);
+    }
+    rows.push_back(fields);
+  }
+
+  return rows;
+}
+
+bool is_binary_edge_file(const std::string& path)
+{
+  std::ifstream file(path, std::ios::binary);
+  char          marker[8] = {};
+  file.read(marker, sizeof(marker));
+  return file && std::memcmp(marker, "SBMEDGES", sizeof(marker)) == 0;
+}
+
+void load_network(SBM& net, const Cli_Options& options)
+{
+  if (options.edges_path.empty()) {
+    LOGIC_ERROR("Need an edge file given with --edges.");
+  }
+
+  if (is_binary_edge_file(options.edges_path)) {
+    net.add_sim_network(read_edge_file(options.edges_path), false);
+    return;
+  }
+
+  if (!options.nodes_path.empty()) {
+    for (const auto& row : read_text_table(options.nodes_path, { "id", "type" })) {
+      net.add_node(row[0], row[1]);
+    }
+  }
+
+  const LevelPtr data_nodes = net.get_level(0);
+  for (const auto& row : read_text_table(options.edges_path, { "from", "to" })) {
+    for (int i = 0; i < 2; i++) {
+      if (data_nodes->count(row[i]) == 0) net.add_node(row[i], options.default_node_type);
+    }
+    net.add_edge(row[0], row[1]);
+  }
+}
+
+void load_state(SBM& net, const std::string& path)
+{
+  State_Dump state;
+  for (const auto& row : read_text_table(path, { "id", "parent", "level", "type" })) {
+    state.id.push_back(row[0]);
+    state.parent.push_back(row[1]);
+    state.level.push_back(std::stoi(row[2]));
+    state.type.push_back(row[3]);
+  }
+  net.set_state(state.id, state.parent, state.level, state.type);
+}
+
+Output_Table state_table(const State_Dump& state)
+{
+  Output_Table table;
+  table.add_column("id", state.id)
+      .add_column("parent", state.parent)
+      .add_column("level", state.level)
+      .add_column("type", state.type);
+  return table;
+}
+
+// Every step's state stacked into one table with the step it came from
+Output_Table steps_table(const CollapseResults& steps)
+{
+  State_Dump       stacked;
+  std::vector<int> step_nums;
+  for (std::size_t i = 0; i < steps.size(); i++) {
+    const State_Dump& state = steps[i].state;
+    stacked.id.insert(stacked.id.end(), state.id.begin(), state.id.end());
+    stacked.parent.insert(stacked.parent.end(), state.parent.begin(), state.parent.end());
+    stacked.level.insert(stacked.level.end(), state.level.begin(), state.level.end());
+    stacked.type.insert(stacked.type.end(), state.type.begin(), state.type.end());
+    step_nums.insert(step_nums.end(), state.id.size(), i + 1);
+  }
+
+  Output_Table table = state_table(stacked);
+  table.add_column("step", step_nums);
+  return table;
+}
+
+Output_Table collapse_trace_table(const CollapseResults& steps)
+{
+  std::vector<int>    step_nums;
+  std::vector<int>    num_blocks;
+  std::vector<double> entropy;
+  std::vector<double> entropy_delta;
+  for (std::size_t i = 0; i < steps.size(); i++) {
+    step_nums.push_back(i + 1);
+    num_blocks.push_back(steps[i].num_blocks);
+    entropy.push_back(steps[i].entropy);
+    entropy_delta.push_back(steps[i].entropy_delta);
+  }
+
+  Output_Table table;
+  table.add_column("step", step_nums)
+      .add_column("num_blocks", num_blocks)
+      .add_column("entropy", entropy)
+      .add_column("entropy_delta", entropy_delta);
+  return table;
+}
+
+Output_Table sweep_trace_table(const MCMC_Sweeps& sweeps)
+{
+  std::vector<int> sweep_nums;
+  for (std::size_t i = 0; i < sweeps.sweep_entropy_delta.size(); i++) {
+    sweep_nums.push_back(i + 1);
+  }
+
+  Output_Table table;
+  table.add_column("sweep", sweep_nums)
+      .add_column("entropy_delta", sweeps.sweep_entropy_delta)
+      .add_column("num_nodes_moved", sweeps.sweep_num_nodes_moved);
+  return table;
+}
+
+// Pair keys join the two node ids with "--", which ids can contain too. The
+// key is split at the first "--" that leaves a node of the level on both sides.
+Output_Table consensus_table(const MCMC_Sweeps& sweeps, const LevelPtr& node_map)
+{
+  std::vector<std::string> node_a;
+  std::vector<std::string> node_b;
+  std::vector<int>         times_connected;
+  for (const auto& pair : sweeps.block_consensus.concensus_pairs) {
+    const std::string& key   = pair.first;
+    std::size_t        split = key.find("--");
+    while (split != std::string::npos
+           && (node_map->count(key.substr(0, split)) == 0 || node_map->count(key.substr(split + 2)) == 0)) {
+      split = key.find("--", split + 1);
+    }
+    if (split == std::string::npos) {
+      throw std::runtime_error("Consensus pair " + key + " isn't made up of two nodes of the swept level.");
+    }
+    node_a.push_back(key.substr(0, split));
+    node_b.push_back(key.substr(split + 2));
+    times_connected.push_back(pair.second.times_connected);
+  }
+
+  Output_Table table;
+  table.add_column("node_a", node_a)
+      .add_column("node_b", node_b)
+      .add_column("times_connected", times_connected);
+  return table;
+}
+
+// Fill options from the arguments. Returns false if they don't make sense.
+bool parse_options(int argc, char** argv, Cli_Options& options)
+{
+  if (argc < 2) return false;
+  options.command = argv[1];
+  if (options.command != "collapse" && options.command != "run" && options.command != "sweep") return false;
+
+  for (int i = 2; i < argc; i++) {
+    const std::string arg       = argv[i];
+    const bool        has_value = i + 1 < argc;
+
+    if (arg == "--all-steps") {
+      options.report_all_steps = true;
+    }
+    else if (arg == "--by-component") {
+      options.by_component = true;
+    }
+    else if (arg == "--fixed-blocks") {
+      options.variable_num_blocks = false;
+    }
+    else if (arg == "--no-degree-correction") {
+      options.degree_corrected = false;
+    }
+    else if (arg == "--resume") {
+      options.resume = true;
+    }
+    else if (!has_value) {
+      return false;
+    }
+    else if (arg == "--edges") {
+      options.edges_path = argv[++i];
+    }
+    else if (arg == "--nodes") {
+      options.nodes_path = argv[++i];
+    }
+    else if (arg == "--state") {
+      options.state_path = argv[++i];
+    }
+    else if (arg == "--node-type") {
+      options.default_node_type = argv[++i];
+    }
+    else if (arg == "--seed") {
+      options.seed = std::stoi(argv[++i]);
+    }
+    else if (arg == "--level") {
+      options.level = std::stoi(argv[++i]);
+    }
+    else if (arg == "--blocks") {
+      options.desired_num_blocks = std::stoi(argv[++i]);
+    }
+    else if (arg == "--mcmc-steps") {
+      options.num_mcmc_steps = std::stoi(argv[++i]);
+    }
+    else if (arg == "--checks-per-block") {
+      options.num_checks_per_block = std::stoi(argv[++i]);
+    }
+    else if (arg == "--sigma") {
+      options.sigma = std::stod(argv[++i]);
+    }
+    else if (arg == "--eps") {
+      options.eps = std::stod(argv[++i]);
+    }
+    else if (arg == "--block-nums") {
+      options.block_nums = parse_int_list(argv[++i]);
+    }
+    else if (arg == "--sweeps") {
+      options.num_sweeps = std::stoi(argv[++i]);
+    }
+    else if (arg == "--initial-blocks") {
+      options.initial_num_blocks = std::stoi(argv[++i]);
+    }
+    else if (arg == "--checkpoint") {
+      options.checkpoint_path = argv[++i];
+    }
+    else if (arg == "--checkpoint-every") {
+      options.checkpoint_every = std::stoi(argv[++i]);
+    }
+    else if (arg == "--checkpoint-seconds") {
+      options.checkpoint_seconds = std::stod(argv[++i]);
+    }
+    else if (arg == "--threads") {
+      options.num_threads = std::stoi(argv[++i]);
+    }
+    else if (arg == "--format") {
+      options.format = argv[++i];
+    }
+    else if (arg == "--out-state") {
+      options.state_out_path = argv[++i];
+    }
+    else if (arg == "--out-steps") {
+      options.steps_out_path = argv[++i];
+    }
+    else if (arg == "--out-trace") {
+      options.trace_out_path = argv[++i];
+    }
+    else if (arg == "--out-moves") {
+      options.moves_out_path = argv[++i];
+    }
+    else if (arg == "--out-consensus") {
+      options.consensus_out_path = argv[++i];
+    }
+    else if (arg == "--out-stats") {
+      options.stats_out_path = argv[++i];
+    }
+    else {
+      return false;
+    }
+  }
+
+  if (options.resume && options.checkpoint_path.empty()) return false;
+  return !(options.command == "run" && options.block_nums.empty());
+}
+
+int run_command(const Cli_Options& options)
+{
+  // Component collapses always start from the data level and only report the
+  // final merge step
+  if (options.by_component && options.level != 0) {
+    throw std::invalid_argument("--by-component collapses always start from level 0, --level can't be used with it.");
+  }
+  if (options.by_component && options.report_all_steps) {
+    throw std::invalid_argument("--by-component collapses only report their final state, --all-steps can't be used with it.");
+  }
+
+  SBM net(options.seed);
+  net.set_degree_corrected(options.degree_corrected);
+  load_network(net, options);
+  if (!options.state_path.empty()) load_state(net, options.state_path);
+
+  std::cerr << net.get_level(0)->size() << " nodes, " << net.edges.size() << " edges" << std::endl;
+
+  if (options.num_threads > 1 && !(options.command == "collapse" && options.by_component)) {
+    std::cerr << "Only --by-component collapses use more than one thread." << std::endl;
+  }
+
+  const auto write_if_asked = [&](const std::string& path, const Output_Table& table) {
+    if (!path.empty()) table.write(path, options.format);
+  };
+
+  // Level the results are reported on
+  int level = options.level;
+
+  if (options.command == "sweep") {
+    const bool  track_pairs = !options.consensus_out_path.empty();
+    MCMC_Sweeps results(0);
+
+    if (options.resume) {
+      // The chain's level comes from the checkpoint along with its other settings
+      level = read_checkpoint(options.checkpoint_path).level;
+      if (!options.moves_out_path.empty()) net.start_move_log(options.moves_out_path);
+      results = net.resume_sweeps(options.checkpoint_path, options.checkpoint_every, options.checkpoint_seconds);
+    }
+    else {
+      if (options.state_path.empty()) net.initialize_blocks(options.level, options.initial_num_blocks);
+      if (!options.moves_out_path.empty()) net.start_move_log(options.moves_out_path);
+
+      results = options.checkpoint_path.empty()
+          ? net.mcmc_sweep(options.level, options.num_sweeps, options.eps, options.variable_num_blocks, track_pairs)
+          : net.mcmc_sweep_checkpointed(options.level,
+                                        options.num_sweeps,
+                                        options.eps,
+                                        options.variable_num_blocks,
+                                        track_pairs,
+                                        options.checkpoint_path,
+                                        options.checkpoint_every,
+                                        options.checkpoint_seconds);
+    }
+
+    write_if_asked(options.trace_out_path, sweep_trace_table(results));
+    if (!options.consensus_out_path.empty()) {
+      consensus_table(results, net.get_level(level)).write(options.consensus_out_path, options.format);
+    }
+    net.stop_move_log();
+  }
+  else {
+    CollapseResults steps;
+    if (options.command == "run") {
+      steps = net.collapse_run(options.level,
+                               options.num_mcmc_steps,
+                               options.num_checks_per_block,
+                               options.sigma,
+                               options.eps,
+                               options.block_nums);
+    }
+    else if (options.by_component) {
+      steps = net.collapse_components(options.num_mcmc_steps,
+                                      options.desired_num_blocks,
+                                      options.num_checks_per_block,
+                                      options.sigma,
+                                      options.eps,
+                                      options.num_threads);
+    }
+    else {
+      steps = net.collapse_blocks(options.level,
+                                  options.num_mcmc_steps,
+                                  options.desired_num_blocks,
+                                  options.num_checks_per_block,
+                                  options.sigma,
+                                  options.eps,
+                                  options.report_all_steps);
+    }
+
+    write_if_asked(options.trace_out_path, collapse_trace_table(steps));
+    write_if_asked(options.steps_out_path, steps_table(steps));
+  }
+
+  std::cerr << net.get_level(level + 1)->size() << " blocks, entropy "
+            << net.get_entropy(level) << std::endl;
+
+  write_if_asked(options.state_out_path, state_table(net.get_state()));
+  if (!options.stats_out_path.empty()) net.write_stats(options.stats_out_path);
+
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  Cli_Options options;
+  try {
+    if (!parse_options(argc, argv, options)) {
+      std::cerr << USAGE;
+      return 2;
+    }
+    return run_command(options);
+  }
+  catch (const std::exception& error) {
+    std::cerr << "Error: " << error.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,21 @@
+#ifndef __COMMAND_LINE_INCLUDED__
+#define __COMMAND_LINE_INCLUDED__
+// Helpers for reading the arguments of the command line tool and benchmarks
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Comma separated integers, e.g. "1000,10000,100000"
+inline std::vector<int> parse_int_list(const std::string& list)
+{
+  std::vector<int>  values;
+  std::stringstream stream(list);
+  std::string       value;
+  while (std::getline(stream, value, ',')) {
+    values.push_back(std::stoi(value));
+  }
+  return values;
+}
+
+#endif
@@ -927,3 +927,13 @@ SBM build_unipartite_simulated()
 
   return my_SBM;
 }
+
+// Simulated network with three planted blocks, its nodes started off in three
+// random blocks
+SBM build_planted_SBM(const int& num_nodes, const int& seed)
+{
+  SBM my_SBM(seed);
+  my_SBM.add_sim_network(simulate_network(planted_partition_spec(num_nodes, 3, 6, 0.8, 0, seed), seed), false);
+  my_SBM.initialize_blocks(0, 3);
+  return my_SBM;
+}
@@ -10,7 +10,7 @@ OPTIMIZATION_LEVEL=""
 # Compile the main classes
 g++ -std=c++11 ${OPTIMIZATION_LEVEL} -c \
   -DNO_RCPP=1 \
-  Node.cpp Block_Consensus.cpp SBM.cpp Sampler.cpp 
+  Node.cpp Block_Consensus.cpp SBM.cpp Sampler.cpp Batch_Fit.cpp Fit_Job.cpp Network_Sim.cpp capi/sbm_c.cpp
 
 
 echo "=============================================================================\nCompiling Tests..."
@@ -24,14 +24,24 @@ fi
 
 
 # Compile all the tests
-g++ -std=c++11 ${OPTIMIZATION_LEVEL} -DNO_RCPP=1\
+g++ -std=c++11 ${OPTIMIZATION_LEVEL} -pthread -DNO_RCPP=1\
   cpp_tests/tests-main.o \
-  Node.o SBM.o Sampler.o Block_Consensus.o \
+  Node.o SBM.o Sampler.o Block_Consensus.o Batch_Fit.o Fit_Job.o Network_Sim.o sbm_c.o \
   cpp_tests/tests-node.cpp \
   cpp_tests/tests-edge.cpp \
   cpp_tests/tests-sampler.cpp \
   cpp_tests/tests-network.cpp \
   cpp_tests/tests-sbm.cpp \
+  cpp_tests/tests-batch-fit.cpp \
+  cpp_tests/tests-fit-job.cpp \
+  cpp_tests/tests-profiling.cpp \
+  cpp_tests/tests-partition-similarity.cpp \
+  cpp_tests/tests-network-sim.cpp \
+  cpp_tests/tests-output-table.cpp \
+  cpp_tests/tests-proposal-trace.cpp \
+  cpp_tests/tests-checkpoint.cpp \
+  cpp_tests/tests-move-log.cpp \
+  cpp_tests/tests-c-api.cpp \
   -o cpp_tests/run_tests.o 
 
 
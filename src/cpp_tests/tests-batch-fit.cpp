@@ -0,0 +1,70 @@
+#include "../Batch_Fit.h"
+#include "catch.hpp"
+
+TEST_CASE("Batch fitting of many small networks", "[Batch]")
+{
+  // Two tight triangles joined by a single edge
+  std::vector<std::string> edge_graphs { "pair", "pair", "pair", "pair", "pair", "pair", "pair" };
+  std::vector<std::string> edges_from { "a1", "a1", "a2", "b1", "b1", "b2", "a3" };
+  std::vector<std::string> edges_to { "a2", "a3", "a3", "b2", "b3", "b3", "b1" };
+
+  // A small bipartite star with node types given explicitly. Node ids repeat
+  // those of the first network on purpose.
+  const std::vector<std::string> star_from { "a1", "a1", "a1", "a2" };
+  const std::vector<std::string> star_to { "h1", "h2", "h3", "h1" };
+  for (std::size_t i = 0; i < star_from.size(); i++) {
+    edge_graphs.push_back("star");
+    edges_from.push_back(star_from[i]);
+    edges_to.push_back(star_to[i]);
+  }
+  const std::vector<std::string> node_graphs { "star", "star", "star", "star", "star" };
+  const std::vector<std::string> node_ids { "a1", "a2", "h1", "h2", "h3" };
+  const std::vector<std::string> node_types { "leaf", "leaf", "hub", "hub", "hub" };
+
+  for (const int num_threads : { 1, 2 }) {
+    const NetworkFits fits = fit_network_batch(edge_graphs, edges_from, edges_to,
+                                               node_graphs, node_ids, node_types,
+                                               "node", 1, 2, 2, 5, 2, 0.1, 42, num_threads);
+
+    // Results come back in order of first appearance
+    REQUIRE(fits.size() == 2);
+    REQUIRE(fits[0].graph == "pair");
+    REQUIRE(fits[1].graph == "star");
+
+    REQUIRE(fits[0].num_nodes == 6);
+    REQUIRE(fits[0].num_edges == 7);
+    REQUIRE(fits[1].num_nodes == 5);
+    REQUIRE(fits[1].num_edges == 4);
+
+    // Bipartite network needs at least one block per type
+    REQUIRE(fits[1].num_blocks >= 2);
+
+    // Reported entropy is the entropy of the reported partition
+    for (const auto& fit : fits) {
+      REQUIRE(fit.node_ids.size() == fit.num_nodes);
+
+      SBM                      check_model;
+      std::vector<std::string> types;
+      std::vector<int>         levels(fit.num_nodes, 0);
+      for (const auto& id : fit.node_ids) {
+        const bool is_hub = fit.graph == "star" && id[0] == 'h';
+        types.push_back(fit.graph == "pair" ? "node" : (is_hub ? "hub" : "leaf"));
+        check_model.add_node(id, types.back());
+      }
+      for (std::size_t i = 0; i < edge_graphs.size(); i++) {
+        if (edge_graphs[i] == fit.graph) {
+          check_model.add_edge(edges_from[i], edges_to[i]);
+        }
+      }
+      check_model.set_state(fit.node_ids, fit.blocks, levels, types);
+
+      REQUIRE(check_model.get_level(1)->size() == fit.num_blocks);
+      REQUIRE(check_model.get_entropy(0) == Approx(fit.entropy));
+    }
+  }
+
+  // Mismatched inputs are caught before any fitting happens
+  REQUIRE_THROWS(fit_network_batch(edge_graphs, edges_from, star_to,
+                                   node_graphs, node_ids, node_types,
+                                   "node", 1, 0, 0, 5, 2, 0.1, 42, 1));
+}
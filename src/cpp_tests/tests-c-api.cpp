@@ -0,0 +1,167 @@
+#include "../capi/sbm_c.h"
+#include "../Network_Sim.h"
+#include "../partition_similarity.h"
+#include "catch.hpp"
+
+#include <set>
+
+TEST_CASE("C interface fits a graph through caller buffers", "[C_API]")
+{
+  REQUIRE(sbm_api_version() == SBM_C_API_VERSION);
+
+  // Two planted blocks loaded in bulk
+  const Sim_Network planted = simulate_network(planted_partition_spec(60, 2, 8, 0.95, 0, 5), 5);
+
+  std::vector<const char*> ids;
+  for (const auto& id : planted.node_ids) {
+    ids.push_back(id.c_str());
+  }
+  const std::vector<int32_t> from(planted.edges_from.begin(), planted.edges_from.end());
+  const std::vector<int32_t> to(planted.edges_to.begin(), planted.edges_to.end());
+
+  sbm_graph* graph = nullptr;
+  REQUIRE(sbm_graph_create(&graph) == SBM_OK);
+  REQUIRE(sbm_graph_add_nodes(graph, ids.size(), ids.data(), nullptr) == SBM_OK);
+  REQUIRE(sbm_graph_add_edges(graph, from.size(), from.data(), to.data()) == SBM_OK);
+  REQUIRE(sbm_graph_num_nodes(graph) == 60);
+  REQUIRE(sbm_graph_num_edges(graph) == from.size());
+
+  // Bad edges are refused with a message
+  const int32_t bad_end = 60;
+  REQUIRE(sbm_graph_add_edges(graph, 1, &bad_end, &bad_end) == SBM_INVALID_ARGUMENT);
+  REQUIRE(std::string(sbm_last_error()).find("hasn't been added") != std::string::npos);
+
+  sbm_model* model = nullptr;
+  REQUIRE(sbm_model_create(graph, 42, 1, &model) == SBM_OK);
+  sbm_graph_free(graph);
+
+  sbm_results* results = nullptr;
+  REQUIRE(sbm_results_create(&results) == SBM_OK);
+
+  // Sweeping needs blocks first
+  REQUIRE(sbm_model_sweep(model, 2, 0.1, 1, results) == SBM_INVALID_ARGUMENT);
+
+  REQUIRE(sbm_model_collapse(model, 10, 2, 5, 2, 0.1, 1, results) == SBM_OK);
+  const size_t num_steps = sbm_results_num_steps(results);
+  REQUIRE(num_steps > 1);
+
+  std::vector<int32_t> step_num_blocks(num_steps);
+  std::vector<double>  step_entropy(num_steps);
+  REQUIRE(sbm_results_get_steps(results, step_num_blocks.data(), step_entropy.data(), nullptr, num_steps) == SBM_OK);
+  REQUIRE(step_num_blocks.back() == 2);
+  REQUIRE(sbm_results_get_steps(results, step_num_blocks.data(), nullptr, nullptr, 1) == SBM_BUFFER_TOO_SMALL);
+
+  std::vector<int32_t> blocks(60);
+  size_t               num_nodes = 0;
+  REQUIRE(sbm_results_get_step_blocks(results, num_steps - 1, blocks.data(), blocks.size(), &num_nodes) == SBM_OK);
+  REQUIRE(num_nodes == 60);
+  REQUIRE(std::set<int32_t>(blocks.begin(), blocks.end()).size() == 2);
+
+  // Final model state matches the last step and mostly recovers the planted blocks
+  std::vector<int32_t> model_blocks(60);
+  REQUIRE(sbm_model_get_blocks(model, 1, model_blocks.data(), model_blocks.size(), &num_nodes) == SBM_OK);
+  REQUIRE(model_blocks == blocks);
+  const std::vector<int> found(model_blocks.begin(), model_blocks.end());
+  REQUIRE(compare_partitions(planted.node_blocks, found).nmi > 0.8);
+
+  size_t num_blocks = 0;
+  REQUIRE(sbm_model_num_blocks(model, 1, &num_blocks) == SBM_OK);
+  REQUIRE(num_blocks == 2);
+
+  // Blocks set from labels, then swept
+  std::vector<int32_t> labels(60);
+  for (int i = 0; i < 60; i++) {
+    labels[i] = 10 + i % 3;
+  }
+  REQUIRE(sbm_model_set_blocks(model, labels.size(), labels.data()) == SBM_OK);
+  REQUIRE(sbm_model_num_blocks(model, 1, &num_blocks) == SBM_OK);
+  REQUIRE(num_blocks == 3);
+  REQUIRE(sbm_model_get_blocks(model, 1, model_blocks.data(), model_blocks.size(), &num_nodes) == SBM_OK);
+  REQUIRE(model_blocks[4] == model_blocks[1]);
+
+  double entropy_before = 0;
+  REQUIRE(sbm_model_entropy(model, 0, &entropy_before) == SBM_OK);
+
+  REQUIRE(sbm_model_sweep(model, 5, 0.1, 0, results) == SBM_OK);
+  REQUIRE(sbm_results_num_steps(results) == 5);
+  std::vector<double>  entropy_deltas(5);
+  std::vector<int32_t> nodes_moved(5);
+  REQUIRE(sbm_results_get_sweeps(results, entropy_deltas.data(), nodes_moved.data(), 5) == SBM_OK);
+  REQUIRE(sbm_results_get_steps(results, nullptr, nullptr, nullptr, 0) == SBM_INVALID_ARGUMENT);
+
+  double entropy_after = 0;
+  REQUIRE(sbm_model_entropy(model, 0, &entropy_after) == SBM_OK);
+  double total_delta = 0;
+  for (const double& delta : entropy_deltas) {
+    total_delta += delta;
+  }
+  REQUIRE(entropy_after - entropy_before == Approx(total_delta).margin(1e-6));
+
+  // Levels without blocks are reported rather than crashing
+  REQUIRE(sbm_model_get_blocks(model, 5, model_blocks.data(), model_blocks.size(), &num_nodes) == SBM_INVALID_ARGUMENT);
+
+  sbm_results_free(results);
+  sbm_model_free(model);
+}
+
+TEST_CASE("C interface collapses components separately", "[C_API]")
+{
+  // Two copies of a planted network with no edges between them
+  const Sim_Network planted = simulate_network(planted_partition_spec(40, 2, 8, 0.95, 0, 5), 5);
+
+  std::vector<std::string> id_strings;
+  for (const std::string prefix : { "x_", "y_" }) {
+    for (const auto& id : planted.node_ids) {
+      id_strings.push_back(prefix + id);
+    }
+  }
+  std::vector<const char*> ids;
+  for (const auto& id : id_strings) {
+    ids.push_back(id.c_str());
+  }
+  std::vector<int32_t> from(planted.edges_from.begin(), planted.edges_from.end());
+  std::vector<int32_t> to(planted.edges_to.begin(), planted.edges_to.end());
+  for (std::size_t i = 0; i < planted.edges_from.size(); i++) {
+    from.push_back(planted.edges_from[i] + 40);
+    to.push_back(planted.edges_to[i] + 40);
+  }
+
+  sbm_graph* graph = nullptr;
+  REQUIRE(sbm_graph_create(&graph) == SBM_OK);
+  REQUIRE(sbm_graph_add_nodes(graph, ids.size(), ids.data(), nullptr) == SBM_OK);
+  REQUIRE(sbm_graph_add_edges(graph, from.size(), from.data(), to.data()) == SBM_OK);
+
+  sbm_results* results = nullptr;
+  REQUIRE(sbm_results_create(&results) == SBM_OK);
+
+  // The thread count only changes how the work is spread, every run gives a
+  // single final step with each component collapsed to its own two blocks
+  for (const int32_t num_threads : { 1, 2 }) {
+    sbm_model* model = nullptr;
+    REQUIRE(sbm_model_create(graph, 42, 1, &model) == SBM_OK);
+
+    REQUIRE(sbm_model_collapse_components(model, 2, 2, 5, 2, 0.1, num_threads, results) == SBM_OK);
+    REQUIRE(sbm_results_num_steps(results) == 1);
+
+    std::vector<int32_t> blocks(80);
+    size_t               num_nodes = 0;
+    REQUIRE(sbm_results_get_step_blocks(results, 0, blocks.data(), blocks.size(), &num_nodes) == SBM_OK);
+    const std::set<int32_t> x_blocks(blocks.begin(), blocks.begin() + 40);
+    const std::set<int32_t> y_blocks(blocks.begin() + 40, blocks.end());
+    REQUIRE(x_blocks.size() == 2);
+    REQUIRE(y_blocks.size() == 2);
+    for (const int32_t& block : x_blocks) {
+      REQUIRE(y_blocks.count(block) == 0);
+    }
+
+    sbm_model_free(model);
+  }
+
+  sbm_model* model = nullptr;
+  REQUIRE(sbm_model_create(graph, 42, 1, &model) == SBM_OK);
+  REQUIRE(sbm_model_collapse_components(model, 2, 2, 5, 2, 0.1, 0, results) == SBM_INVALID_ARGUMENT);
+
+  sbm_model_free(model);
+  sbm_results_free(results);
+  sbm_graph_free(graph);
+}
@@ -0,0 +1,207 @@
+#include "../SBM.h"
+#include "catch.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+// From network_builders.cpp
+SBM build_planted_SBM(const int& num_nodes, const int& seed);
+
+TEST_CASE("Checkpointed sweeps match plain sweeps", "[Chain_Checkpoint]")
+{
+  const std::string path   = "checkpoint_test.sbmchain";
+  const SBM         my_SBM = build_planted_SBM(60, 3);
+
+  SBM        plain    = my_SBM.clone(42);
+  const auto expected = plain.mcmc_sweep(0, 10, 0.1, true, true);
+
+  SBM        checkpointed = my_SBM.clone(42);
+  const auto results      = checkpointed.mcmc_sweep_checkpointed(0, 10, 0.1, true, true, path, 4, 0);
+
+  REQUIRE(results.sweep_entropy_delta == expected.sweep_entropy_delta);
+  REQUIRE(results.sweep_num_nodes_moved == expected.sweep_num_nodes_moved);
+  REQUIRE(results.nodes_moved == expected.nodes_moved);
+  REQUIRE(checkpointed.get_state().parent == plain.get_state().parent);
+
+  // The last checkpoint is of where the chain ended
+  const Chain_Checkpoint checkpoint = read_checkpoint(path);
+  REQUIRE(checkpoint.sweeps_done == 10);
+  REQUIRE(checkpoint.num_sweeps == 10);
+  REQUIRE(checkpoint.track_pairs);
+  REQUIRE(checkpoint.degree_corrected);
+  REQUIRE(checkpoint.sweep_entropy_delta == expected.sweep_entropy_delta);
+  REQUIRE(checkpoint.state_parent == plain.get_state().parent);
+  REQUIRE(checkpoint.edges->from.size() == my_SBM.edges.size());
+
+  Block_Consensus pair_counts;
+  checkpoint.get_pair_counts(pair_counts);
+  REQUIRE(pair_counts.concensus_pairs.size() == expected.block_consensus.concensus_pairs.size());
+  for (const auto& pair : expected.block_consensus.concensus_pairs) {
+    REQUIRE(pair_counts.concensus_pairs.at(pair.first).times_connected == pair.second.times_connected);
+  }
+
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Resumed chains carry on exactly where they left off", "[Chain_Checkpoint]")
+{
+  const std::string path       = "resume_test.sbmchain";
+  const int         num_sweeps = 400;
+  const SBM         my_SBM     = build_planted_SBM(60, 5);
+
+  SBM        plain    = my_SBM.clone(7);
+  const auto expected = plain.mcmc_sweep(0, num_sweeps, 0.1, true, true);
+
+  // Stand in for the run being killed part way through by stopping it once
+  // the first checkpoint is on disk
+  SBM interrupted         = my_SBM.clone(7);
+  interrupted.fit_control = std::make_shared<Fit_Control>();
+  std::remove(path.c_str());
+
+  std::thread stopper([&interrupted, &path]() {
+    while (!std::ifstream(path)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    interrupted.fit_control->stop_requested = true;
+  });
+  const auto first_leg = interrupted.mcmc_sweep_checkpointed(0, num_sweeps, 0.1, true, true, path, 1, 0);
+  stopper.join();
+
+  const int stopped_at = first_leg.sweep_entropy_delta.size();
+  REQUIRE(read_checkpoint(path).sweeps_done == stopped_at);
+
+  // Resume on a fresh model of the same network, as after a crash
+  SBM        resumed    = build_planted_SBM(60, 5);
+  const auto second_leg = resumed.resume_sweeps(path, 50, 0);
+
+  // Every move is the same. Entropy changes are summed over blocks in memory
+  // order so can be out in their last bits.
+  REQUIRE(second_leg.sweep_num_nodes_moved == expected.sweep_num_nodes_moved);
+  REQUIRE(second_leg.sweep_entropy_delta.size() == num_sweeps);
+  for (int i = 0; i < num_sweeps; i++) {
+    REQUIRE(second_leg.sweep_entropy_delta[i] == Approx(expected.sweep_entropy_delta[i]));
+  }
+  REQUIRE(resumed.get_state().parent == plain.get_state().parent);
+
+  for (const auto& pair : expected.block_consensus.concensus_pairs) {
+    REQUIRE(second_leg.block_consensus.concensus_pairs.at(pair.first).times_connected == pair.second.times_connected);
+  }
+
+  // Moves are only given for the sweeps run since resuming
+  std::list<std::string> moves_after_stop = expected.nodes_moved;
+  int                    moves_before     = 0;
+  for (int i = 0; i < stopped_at; i++) {
+    moves_before += expected.sweep_num_nodes_moved[i];
+  }
+  for (int i = 0; i < moves_before; i++) {
+    moves_after_stop.pop_front();
+  }
+  REQUIRE(second_leg.nodes_moved == moves_after_stop);
+
+  // A finished chain has nothing left to do
+  const auto nothing_left = resumed.resume_sweeps(path, 50, 0);
+  REQUIRE(nothing_left.sweep_entropy_delta.size() == num_sweeps);
+  REQUIRE(nothing_left.nodes_moved.empty());
+
+  // Checkpoints only resume on the network they came from
+  SBM other_network = build_planted_SBM(60, 6);
+  REQUIRE_THROWS(other_network.resume_sweeps(path, 50, 0));
+
+  // or under the model they came from
+  SBM uncorrected = build_planted_SBM(60, 5);
+  uncorrected.set_degree_corrected(false);
+  REQUIRE_THROWS(uncorrected.resume_sweeps(path, 50, 0));
+
+  // Tracing would repeat the proposals made after the checkpoint was taken
+  SBM traced = build_planted_SBM(60, 5);
+  traced.start_proposal_trace("resume_test.sbmtrace");
+  REQUIRE_THROWS(traced.resume_sweeps(path, 50, 0));
+  traced.stop_proposal_trace();
+  std::remove("resume_test.sbmtrace");
+
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Checkpoint writer keeps the last whole checkpoint", "[Chain_Checkpoint]")
+{
+  const std::string path = "writer_test.sbmchain";
+
+  {
+    Checkpoint_Writer writer(path);
+    for (int i = 1; i <= 50; i++) {
+      Chain_Checkpoint checkpoint;
+      checkpoint.num_sweeps  = 50;
+      checkpoint.sweeps_done = i;
+      checkpoint.sweep_order = { 2, 0, 1 };
+      checkpoint.state_id    = { "a", "b", "c" };
+      writer.submit(std::move(checkpoint));
+    }
+    writer.close();
+  }
+
+  // Older checkpoints may have been skipped but the last one is always written
+  const Chain_Checkpoint checkpoint = read_checkpoint(path);
+  REQUIRE(checkpoint.sweeps_done == 50);
+  REQUIRE(checkpoint.sweep_order == std::vector<int>({ 2, 0, 1 }));
+  REQUIRE(checkpoint.state_id == std::vector<std::string>({ "a", "b", "c" }));
+
+  // A checkpoint cut short isn't taken for a whole one
+  std::string contents;
+  {
+    std::ifstream file(path, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(contents.data(), contents.size() - 3);
+  }
+  REQUIRE_THROWS(read_checkpoint(path));
+
+  std::remove(path.c_str());
+  REQUIRE_THROWS(read_checkpoint(path));
+}
+
+TEST_CASE("Checkpoint paths that can't be written fail straight away", "[Chain_Checkpoint]")
+{
+  const std::string path = "no_such_directory/chain.sbmchain";
+
+  SBM        my_SBM = build_planted_SBM(60, 3);
+  const auto before = my_SBM.get_state();
+
+  REQUIRE_THROWS(my_SBM.mcmc_sweep_checkpointed(0, 10, 0.1, true, false, path, 1, 0));
+
+  // No sweeps were run
+  REQUIRE(my_SBM.get_state().parent == before.parent);
+}
+
+TEST_CASE("Failed checkpoint writes are reported by the next checkpoint", "[Chain_Checkpoint]")
+{
+  const std::string directory = "checkpoint_test_directory";
+  const std::string path      = directory + "/chain.sbmchain";
+  mkdir(directory.c_str(), 0755);
+
+  Checkpoint_Writer writer(path);
+
+  // Take the destination away after the writer has started
+  rmdir(directory.c_str());
+
+  Chain_Checkpoint checkpoint;
+  checkpoint.sweep_order = { 0, 1, 2 };
+  writer.submit(Chain_Checkpoint(checkpoint));
+
+  bool reported = false;
+  for (int i = 0; i < 1000 && !reported; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    try {
+      writer.submit(Chain_Checkpoint(checkpoint));
+    } catch (const std::exception&) {
+      reported = true;
+    }
+  }
+  REQUIRE(reported);
+  REQUIRE_THROWS(writer.close());
+}
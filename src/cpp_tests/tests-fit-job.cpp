@@ -0,0 +1,104 @@
+#include "../Fit_Job.h"
+#include "catch.hpp"
+
+#include <chrono>
+#include <thread>
+
+// From network_builders.cpp
+SBM build_planted_SBM(const int& num_nodes, const int& seed);
+
+void wait_for(const Fit_Job& job)
+{
+  while (!job.done()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+}
+
+TEST_CASE("Sweep jobs match sweeps run in place", "[Fit_Job]")
+{
+  SBM my_SBM = build_planted_SBM(60, 3);
+  const State_Dump start_state = my_SBM.get_state();
+
+  const auto job = Fit_Job::start_sweeps(my_SBM, 0, 8, 0.1, false, false, 42);
+  wait_for(*job);
+
+  const Job_Progress progress = job->progress();
+  REQUIRE(progress.status == Job_Status::finished);
+  REQUIRE(progress.steps_done == 8);
+  REQUIRE(progress.num_steps == 8);
+  REQUIRE(progress.trace.size() == 8);
+
+  // Polling from a step on only gives what's new since then
+  REQUIRE(job->progress(6).trace.size() == 2);
+  REQUIRE(job->progress(6).trace[0] == progress.trace[6]);
+
+  // The original model is untouched
+  REQUIRE(my_SBM.get_state().parent == start_state.parent);
+
+  // Sweeping a copy with the same seed in place gives the same results
+  SBM        in_place = my_SBM.clone(42);
+  const auto expected = in_place.mcmc_sweep(0, 8, 0.1, false, false);
+
+  const MCMC_Sweeps& results = job->sweep_results();
+  REQUIRE(results.sweep_entropy_delta == expected.sweep_entropy_delta);
+  REQUIRE(results.nodes_moved == expected.nodes_moved);
+  REQUIRE(progress.trace == expected.sweep_entropy_delta);
+  REQUIRE(job->final_state().parent == in_place.get_state().parent);
+
+  // Pair tracking counts the same pairs as it does in place
+  const auto pairs_job = Fit_Job::start_sweeps(my_SBM, 0, 8, 0.1, true, true, 42);
+  wait_for(*pairs_job);
+
+  SBM         pairs_in_place = my_SBM.clone(42);
+  const auto  expected_pairs = pairs_in_place.mcmc_sweep(0, 8, 0.1, true, true).block_consensus.concensus_pairs;
+  const auto& job_pairs      = pairs_job->sweep_results().block_consensus.concensus_pairs;
+  REQUIRE(job_pairs.size() == expected_pairs.size());
+  REQUIRE(job_pairs.size() == 60 * 59 / 2);
+  for (const auto& pair : expected_pairs) {
+    REQUIRE(job_pairs.at(pair.first).times_connected == pair.second.times_connected);
+  }
+}
+
+TEST_CASE("Collapse run jobs report each target and can be cancelled", "[Fit_Job]")
+{
+  SBM my_SBM = build_planted_SBM(60, 5);
+
+  const auto job = Fit_Job::start_collapse_run(my_SBM, 0, 2, 3, 2, 0.1, { 6, 3 }, 7);
+  wait_for(*job);
+
+  const Job_Progress progress = job->progress();
+  REQUIRE(progress.status == Job_Status::finished);
+  REQUIRE(progress.steps_done == 2);
+  REQUIRE(progress.num_blocks == 3);
+
+  const CollapseResults& results = job->collapse_results();
+  REQUIRE(results.size() == 2);
+  REQUIRE(results[0].num_blocks == 6);
+  REQUIRE(results[1].num_blocks == 3);
+  REQUIRE(progress.trace[1] == results[1].entropy);
+
+  // A long job stops soon after being cancelled, keeping what it finished
+  const auto long_job = Fit_Job::start_sweeps(build_planted_SBM(200, 9), 0, 100000, 0.1, true, false, 1);
+  long_job->cancel();
+  wait_for(*long_job);
+
+  const Job_Progress cancelled = long_job->progress();
+  REQUIRE(cancelled.status == Job_Status::cancelled);
+  REQUIRE(cancelled.steps_done < 100000);
+  REQUIRE(int(long_job->sweep_results().sweep_entropy_delta.size()) == cancelled.steps_done);
+
+  // Letting go of a running job stops it and waits for its thread
+  std::shared_ptr<Fit_Job> discarded = Fit_Job::start_sweeps(build_planted_SBM(200, 9), 0, 100000, 0.1, true, false, 1);
+  discarded.reset();
+}
+
+TEST_CASE("Failed jobs pass on their error", "[Fit_Job]")
+{
+  // No level 3 to sweep
+  const auto job = Fit_Job::start_sweeps(build_planted_SBM(30, 1), 3, 5, 0.1, false, false, 1);
+  wait_for(*job);
+
+  REQUIRE(job->progress().status == Job_Status::failed);
+  REQUIRE(job->progress().error != "");
+  REQUIRE_THROWS(job->sweep_results());
+}
@@ -0,0 +1,175 @@
+#include "../SBM.h"
+#include "catch.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+// From network_builders.cpp
+SBM build_planted_SBM(const int& num_nodes, const int& seed);
+
+// Parents of the data nodes, in id order
+std::vector<std::string> data_node_parents(const State_Dump& state)
+{
+  std::vector<std::string> parents;
+  for (std::size_t i = 0; i < state.id.size(); i++) {
+    if (state.level[i] == 0) parents.push_back(state.parent[i]);
+  }
+  return parents;
+}
+
+std::vector<std::string> data_node_parents(const Output_Table& state)
+{
+  std::vector<std::string> parents;
+  for (std::size_t i = 0; i < state.num_rows(); i++) {
+    if (state.columns[3].integers[i] == 0) parents.push_back(state.columns[1].texts[i]);
+  }
+  return parents;
+}
+
+TEST_CASE("Replaying a move log rebuilds the partition after any sweep", "[Move_Log]")
+{
+  const std::string path       = "move_log_test.sbmmoves";
+  const int         num_sweeps = 30;
+
+  SBM                                   my_SBM = build_planted_SBM(60, 3);
+  std::vector<std::vector<std::string>> parents_after_sweep;
+  parents_after_sweep.push_back(data_node_parents(my_SBM.get_state()));
+
+  my_SBM.start_move_log(path);
+  int num_moves = 0;
+  my_SBM.mcmc_sweep_stream(0, num_sweeps, 0.1, true, [&](const Sweep_Record& record) {
+    num_moves += record.nodes_moved.size();
+    parents_after_sweep.push_back(data_node_parents(my_SBM.get_state()));
+    return true;
+  });
+  REQUIRE(my_SBM.stop_move_log() == num_moves);
+
+  const Move_Replay replay(path);
+  REQUIRE(replay.num_moves() == num_moves);
+  REQUIRE(replay.num_sweeps() <= num_sweeps);
+
+  for (int sweep = 0; sweep <= num_sweeps; sweep++) {
+    REQUIRE(data_node_parents(replay.state_after(sweep)) == parents_after_sweep[sweep]);
+  }
+
+  // Every move applied gives the model's final state, empty blocks aside
+  my_SBM.clean_empty_blocks();
+  const State_Dump   final_state = my_SBM.get_state();
+  const Output_Table replayed    = replay_move_log(path, -1);
+  REQUIRE(replayed.columns[0].texts == final_state.id);
+  REQUIRE(replayed.columns[1].texts == final_state.parent);
+  REQUIRE(replayed.columns[2].texts == final_state.type);
+  REQUIRE(replayed.columns[3].integers == final_state.level);
+
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Move logs cut short replay up to their last full section", "[Move_Log]")
+{
+  const std::string path = "move_log_cut_test.sbmmoves";
+
+  // Enough moves to fill a couple of blocks
+  const int num_moves = Move_Log::block_moves * 2 + 10;
+  {
+    Move_Log log(path);
+    log.record_state({ "a", "b", "block_0", "block_1" },
+                     { "block_0", "block_0", "none", "none" },
+                     { 0, 0, 1, 1 },
+                     { "node", "node", "node", "node" });
+    for (int i = 0; i < num_moves; i++) {
+      log.record(i, i % 2 == 0 ? "a" : "b", "block_" + std::to_string(i % 3), "none");
+    }
+    REQUIRE(log.size() == num_moves);
+    log.close();
+  }
+
+  const Move_Replay whole(path);
+  REQUIRE(whole.num_moves() == num_moves);
+  REQUIRE(whole.num_sweeps() == num_moves);
+
+  // A block first seen as a destination takes its level and type from the
+  // node moved into it, and emptied blocks are dropped
+  const Output_Table after_three = whole.state_after(3);
+  REQUIRE(after_three.columns[0].texts == std::vector<std::string>({ "a", "b", "block_1", "block_2" }));
+  REQUIRE(after_three.columns[1].texts == std::vector<std::string>({ "block_2", "block_1", "none", "none" }));
+  REQUIRE(after_three.columns[3].integers == std::vector<int>({ 0, 0, 1, 1 }));
+
+  // Lop off the end of the file, taking the last block of moves with it
+  std::string contents;
+  {
+    std::ifstream file(path, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(contents.data(), contents.size() - 20);
+  }
+
+  const Move_Replay cut(path);
+  REQUIRE(cut.num_moves() == Move_Log::block_moves * 2);
+
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write("SBMTRACE", 8);
+  }
+  REQUIRE_THROWS(Move_Replay(path));
+
+  std::remove(path.c_str());
+  REQUIRE_THROWS(Move_Replay(path));
+}
+
+TEST_CASE("Blocks created during a logged run keep their parents", "[Move_Log]")
+{
+  const std::string path = "move_log_parent_test.sbmmoves";
+  {
+    Move_Log log(path);
+    log.record_state({ "a", "b", "block_0", "top_0", "top_1" },
+                     { "block_0", "block_0", "top_0", "none", "none" },
+                     { 0, 0, 1, 2, 2 },
+                     { "node", "node", "node", "node", "node" });
+    log.record(0, "a", "block_1", "top_1");
+    log.record(1, "b", "block_1", "top_0");
+    log.close();
+  }
+
+  // Its parent is the one the block had when first moved into, and it only
+  // shows up once it has been
+  const Move_Replay replay(path);
+  const Output_Table before = replay.state_after(0);
+  REQUIRE(before.columns[0].texts == std::vector<std::string>({ "a", "b", "block_0", "top_0" }));
+
+  const Output_Table after = replay.state_after(-1);
+  REQUIRE(after.columns[0].texts == std::vector<std::string>({ "a", "b", "block_1", "top_1" }));
+  REQUIRE(after.columns[1].texts == std::vector<std::string>({ "block_1", "block_1", "top_1", "none" }));
+  REQUIRE(after.columns[3].integers == std::vector<int>({ 0, 0, 1, 2 }));
+
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Only plain sweeps can run while a move log is open", "[Move_Log]")
+{
+  const std::string path = "move_log_reject_test.sbmmoves";
+
+  // Three levels so any block created has a level above it
+  SBM my_SBM = build_planted_SBM(60, 3);
+  my_SBM.initialize_blocks(1, 2);
+
+  my_SBM.start_move_log(path);
+  REQUIRE_THROWS(my_SBM.collapse_blocks(0, 1, 3, 5, 2, 0.1, false));
+  REQUIRE_THROWS(my_SBM.mcmc_sweep_local({ "a-0_1" }, 1, 0, 2, 0.1, false));
+  REQUIRE_THROWS(my_SBM.mcmc_sweep_nested(2, 0.1));
+  my_SBM.mcmc_sweep(0, 10, 0.1, true, false);
+  my_SBM.stop_move_log();
+
+  my_SBM.clean_empty_blocks();
+  const State_Dump   final_state = my_SBM.get_state();
+  const Output_Table replayed    = replay_move_log(path, -1);
+  REQUIRE(replayed.columns[0].texts == final_state.id);
+  REQUIRE(replayed.columns[1].texts == final_state.parent);
+  REQUIRE(replayed.columns[3].integers == final_state.level);
+
+  // Once the log is closed anything goes
+  my_SBM.collapse_blocks(0, 1, 3, 5, 2, 0.1, false);
+
+  std::remove(path.c_str());
+}
@@ -0,0 +1,145 @@
+#include "../SBM.h"
+#include "catch.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+TEST_CASE("Alias sampler draws in proportion to weights", "[Network_Sim]")
+{
+  const Alias_Sampler sampler({ 1, 0, 3, 4 });
+  REQUIRE(sampler.size() == 4);
+
+  std::mt19937     generator(42);
+  std::vector<int> counts(4, 0);
+  const int        num_draws = 80000;
+  for (int i = 0; i < num_draws; i++) {
+    counts[sampler.draw(generator)]++;
+  }
+
+  REQUIRE(counts[1] == 0);
+  REQUIRE(counts[0] / double(num_draws) == Approx(0.125).margin(0.01));
+  REQUIRE(counts[2] / double(num_draws) == Approx(0.375).margin(0.01));
+  REQUIRE(counts[3] / double(num_draws) == Approx(0.5).margin(0.01));
+
+  REQUIRE_THROWS(Alias_Sampler({}));
+  REQUIRE_THROWS(Alias_Sampler({ 0, 0 }));
+  REQUIRE_THROWS(Alias_Sampler({ 1, -1 }));
+}
+
+TEST_CASE("Planted partition networks have the requested shape", "[Network_Sim]")
+{
+  const int    num_nodes   = 2000;
+  const int    num_blocks  = 5;
+  const double mean_degree = 8;
+
+  const Sim_Spec    spec    = planted_partition_spec(num_nodes, num_blocks, mean_degree, 0.75, 2.5, 42);
+  const Sim_Network network = simulate_network(spec, 42);
+
+  REQUIRE(network.num_nodes() == num_nodes);
+  REQUIRE(network.node_ids[7] == "n7");
+  REQUIRE(network.node_blocks[7] == 7 % num_blocks);
+
+  // Poisson total around the expected number of edges
+  const double expected_edges = num_nodes * mean_degree / 2;
+  REQUIRE(network.num_edges() == Approx(expected_edges).epsilon(0.05));
+
+  int num_within = 0;
+  for (int i = 0; i < network.num_edges(); i++) {
+    REQUIRE(network.edges_from[i] != network.edges_to[i]);
+    if (network.node_blocks[network.edges_from[i]] == network.node_blocks[network.edges_to[i]]) num_within++;
+  }
+  REQUIRE(num_within / double(network.num_edges()) == Approx(0.75).margin(0.03));
+
+  // Same seed, same network
+  const Sim_Network repeat = simulate_network(spec, 42);
+  REQUIRE(repeat.edges_from == network.edges_from);
+  REQUIRE(repeat.edges_to == network.edges_to);
+
+  // Exact counts place the rounded expected number of edges
+  Sim_Spec exact_spec          = spec;
+  exact_spec.exact_edge_counts = true;
+  REQUIRE(simulate_network(exact_spec, 1).num_edges() == expected_edges);
+}
+
+TEST_CASE("Edge files round trip", "[Network_Sim]")
+{
+  const Sim_Network network = simulate_network(planted_partition_spec(300, 3, 6, 0.8, 0, 7), 7);
+
+  const std::string path = "network_sim_test.sbmedges";
+  write_edge_file(network, path);
+  const Sim_Network loaded = read_edge_file(path);
+  std::remove(path.c_str());
+
+  REQUIRE(loaded.node_blocks == network.node_blocks);
+  REQUIRE(loaded.node_ids == network.node_ids);
+  REQUIRE(loaded.edges_from == network.edges_from);
+  REQUIRE(loaded.edges_to == network.edges_to);
+  REQUIRE(loaded.node_types == network.node_types);
+
+  // Node types are kept
+  Sim_Spec typed_spec = planted_partition_spec(40, 2, 4, 0.8, 0, 3);
+  for (int i = 0; i < 40; i++) {
+    typed_spec.node_types.push_back(i % 3 == 0 ? "b" : "a");
+  }
+  const Sim_Network typed = simulate_network(typed_spec, 3);
+  write_edge_file(typed, path);
+  REQUIRE(read_edge_file(path).node_types == typed.node_types);
+  std::remove(path.c_str());
+
+  // Files written before types were kept have every node of type "a"
+  {
+    std::ofstream old_file(path, std::ios::binary);
+    const std::uint32_t header[]    = { 1, 0 }; // Version, no flags
+    const std::uint64_t counts[]    = { 2, 1 };
+    const std::int32_t  blocks[]    = { 0, 0 };
+    const std::uint32_t edge_ends[] = { 0, 1 };
+    old_file.write("SBMEDGES", 8);
+    old_file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    old_file.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+    old_file.write(reinterpret_cast<const char*>(blocks), sizeof(blocks));
+    old_file.write(reinterpret_cast<const char*>(edge_ends), sizeof(edge_ends));
+  }
+  const Sim_Network old_network = read_edge_file(path);
+  std::remove(path.c_str());
+  REQUIRE(old_network.node_types == std::vector<std::string> { "a", "a" });
+  REQUIRE(old_network.num_edges() == 1);
+
+  REQUIRE_THROWS(read_edge_file("not_a_real_file.sbmedges"));
+}
+
+TEST_CASE("Simulating from a model's blocks keeps its block edge counts", "[Network_Sim]")
+{
+  const Sim_Network planted = simulate_network(planted_partition_spec(400, 4, 6, 0.8, 2.5, 3), 3);
+
+  SBM model(3);
+  model.add_sim_network(planted, true);
+
+  REQUIRE(model.get_level(0)->size() == 400);
+  REQUIRE(model.get_level(1)->size() == 4);
+  REQUIRE(model.edges.size() == planted.num_edges());
+  REQUIRE(model.get_node_by_id("n5")->parent == model.get_node_by_id("n9")->parent);
+
+  // Exact draws keep every block pair's count and each node's id and type
+  const Sim_Network replicate = model.simulate_from_blocks(1, 11, true);
+  REQUIRE(replicate.num_nodes() == planted.num_nodes());
+  REQUIRE(replicate.num_edges() == planted.num_edges());
+
+  SBM replicate_model(11);
+  replicate_model.add_sim_network(replicate, false);
+  replicate_model.set_state(model.get_state().id,
+                            model.get_state().parent,
+                            model.get_state().level,
+                            model.get_state().type);
+
+  const BlockEdgeCounts original_counts  = model.get_block_edge_counts(1);
+  const BlockEdgeCounts replicate_counts = replicate_model.get_block_edge_counts(1);
+  REQUIRE(original_counts.size() == replicate_counts.size());
+  for (const auto& pair : original_counts) {
+    REQUIRE(replicate_counts.at(pair.first) == pair.second);
+  }
+
+  // A model needs blocks to simulate from
+  SBM unblocked(1);
+  unblocked.add_sim_network(planted, false);
+  REQUIRE_THROWS(unblocked.simulate_from_blocks(1, 1, true));
+}
@@ -456,3 +456,43 @@ TEST_CASE("State dumping and restoring", "[Network")
   REQUIRE(
       print_ids_to_string(state1.parent) == print_ids_to_string(state3.parent));
 }
+
+TEST_CASE("Cached type compatibility and neighbor counts", "[Network]")
+{
+  SBM my_net;
+  my_net.add_node("a1", "a");
+  my_net.add_node("a2", "a");
+  my_net.add_node("b1", "b");
+  my_net.add_node("c1", "c");
+
+  // Only a-b and b-c edges are allowed
+  my_net.add_edge_types({ "a", "b" }, { "b", "c" });
+  const int a = my_net.type_ids.at("a");
+  const int b = my_net.type_ids.at("b");
+  const int c = my_net.type_ids.at("c");
+
+  REQUIRE(my_net.types_compatible(a, b));
+  REQUIRE(my_net.types_compatible(c, b));
+  REQUIRE(!my_net.types_compatible(a, c));
+  REQUIRE(!my_net.types_compatible(a, a));
+  REQUIRE_THROWS(my_net.add_edge("a1", "c1"));
+
+  // Type b nodes can connect to everything else
+  REQUIRE(my_net.neighbor_counts_by_level[0][b] == 3);
+  REQUIRE(my_net.neighbor_counts_by_level[0][a] == 1);
+
+  // Counts follow blocks as they are created and removed
+  my_net.initialize_blocks(0, -1);
+  REQUIRE(my_net.type_counts_by_level[1][a] == 2);
+  REQUIRE(my_net.neighbor_counts_by_level[1][b] == 3);
+
+  my_net.initialize_blocks(0, 1);
+  REQUIRE(my_net.type_counts_by_level[1][a] == 1);
+  REQUIRE(my_net.neighbor_counts_by_level[1][b] == 2);
+  REQUIRE(my_net.node_type_counts.at("a").at(1) == 1);
+
+  my_net.create_block_node("c", 1);
+  REQUIRE(my_net.neighbor_counts_by_level[1][b] == 3);
+  my_net.clean_empty_blocks();
+  REQUIRE(my_net.neighbor_counts_by_level[1][b] == 2);
+}
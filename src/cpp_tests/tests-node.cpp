@@ -354,3 +354,61 @@ TEST_CASE("Tracking node degrees", "[Node]")
   REQUIRE(a21->degree == (a21->edges).size());
   REQUIRE(b21->degree == (b21->edges).size());
 }
+
+TEST_CASE("Edges are segmented by neighbor type", "[Node]")
+{
+  NodePtr a1 = std::make_shared<Node>("a1", 0, "a");
+  NodePtr b1 = std::make_shared<Node>("b1", 0, "b");
+  NodePtr b2 = std::make_shared<Node>("b2", 0, "b");
+  NodePtr c1 = std::make_shared<Node>("c1", 0, "c");
+  NodePtr c2 = std::make_shared<Node>("c2", 0, "c");
+
+  NodePtr a11 = std::make_shared<Node>("a11", 1, "a");
+  a1->set_parent(a11);
+
+  // Interleave the types of a1's neighbors
+  Node::connect_nodes(a1, b1);
+  Node::connect_nodes(a1, c1);
+  Node::connect_nodes(a1, b2);
+  Node::connect_nodes(a1, c2);
+  Node::connect_nodes(a1, b1);
+
+  // Neighbors are grouped by type. Order within a type isn't kept as later
+  // segments make room by moving their first neighbor to their end.
+  std::string edge_types;
+  for (const auto& edge : a1->edges) edge_types += edge->type;
+  REQUIRE(edge_types == "bbbcc");
+  REQUIRE("b1, b1, b2" == print_node_ids(a1->get_edges_of_type("b", 0)));
+  REQUIRE("c1, c2" == print_node_ids(a1->get_edges_of_type("c", 0)));
+  REQUIRE(a1->get_edges_of_type("a", 0).size() == 0);
+
+  const EdgeRange c_edges = a1->edges_of_type("c");
+  REQUIRE(c_edges.second - c_edges.first == 2);
+  REQUIRE((*c_edges.first)->type == "c");
+
+  // Removing from the front segment pulls every later segment back by one
+  a1->erase_edge(b2);
+  edge_types.clear();
+  for (const auto& edge : a1->edges) edge_types += edge->type;
+  REQUIRE(edge_types == "bbcc");
+  REQUIRE("b1, b1" == print_node_ids(a1->get_edges_of_type("b", 0)));
+  REQUIRE("c1, c2" == print_node_ids(a1->get_edges_of_type("c", 0)));
+  a1->insert_edge(b2);
+  a1->insert_edge(c1, 2);
+  REQUIRE("b1, b1, b2" == print_node_ids(a1->get_edges_of_type("b", 0)));
+  REQUIRE("c1, c1, c1, c2" == print_node_ids(a1->get_edges_of_type("c", 0)));
+  a1->erase_edge(c1);
+  a1->erase_edge(c1);
+
+  // Parent gets the same segments
+  REQUIRE("b1, b1, b2" == print_node_ids(a11->get_edges_of_type("b", 0)));
+  REQUIRE("c1, c2" == print_node_ids(a11->get_edges_of_type("c", 0)));
+
+  // Removing a node's edges from its parent only touches the right segments
+  NodePtr a12 = std::make_shared<Node>("a12", 1, "a");
+  a1->set_parent(a12);
+  REQUIRE(a11->degree == 0);
+  REQUIRE(a11->edges_of_type("b").first == a11->edges_of_type("b").second);
+  REQUIRE("c1, c2" == print_node_ids(a12->get_edges_of_type("c", 0)));
+  REQUIRE(a12->degree == 5);
+}
@@ -0,0 +1,60 @@
+#include "../output_table.h"
+#include "catch.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+std::string read_file(const std::string& path)
+{
+  std::ifstream     file(path, std::ios::binary);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+TEST_CASE("Tables are written as tab separated text", "[Output_Table]")
+{
+  Output_Table table;
+  table.add_column("id", std::vector<std::string> { "a", "b" })
+      .add_column("level", std::vector<int> { 0, 1 })
+      .add_column("entropy", std::vector<double> { 1.5, -2 });
+  REQUIRE(table.num_rows() == 2);
+
+  const std::string path = "output_table_test.tsv";
+  table.write(path, "tsv");
+  REQUIRE(read_file(path) == "id\tlevel\tentropy\na\t0\t1.5\nb\t1\t-2\n");
+  std::remove(path.c_str());
+
+  // Ragged tables and unknown formats are refused
+  table.add_column("extra", std::vector<int> { 1 });
+  REQUIRE_THROWS(table.write(path, "tsv"));
+  REQUIRE_THROWS(Output_Table().write(path, "csv"));
+}
+
+TEST_CASE("Tables are written as binary columns", "[Output_Table]")
+{
+  Output_Table table;
+  table.add_column("n", std::vector<int> { 7, 8, 9 })
+      .add_column("name", std::vector<std::string> { "x", "yy", "" });
+
+  const std::string path = "output_table_test.bin";
+  table.write(path, "binary");
+  const std::string contents = read_file(path);
+  std::remove(path.c_str());
+
+  // Marker, version, 2 columns and 3 rows
+  REQUIRE(contents.substr(0, 8) == "SBMTABLE");
+  std::uint32_t num_columns;
+  std::uint64_t num_rows;
+  std::memcpy(&num_columns, contents.data() + 12, sizeof(num_columns));
+  std::memcpy(&num_rows, contents.data() + 16, sizeof(num_rows));
+  REQUIRE(num_columns == 2);
+  REQUIRE(num_rows == 3);
+
+  // Header and fixed sizes, then strings with their lengths
+  const std::size_t int_column_bytes    = 1 + 4 + 1 + 3 * 4;
+  const std::size_t string_column_bytes = 1 + 4 + 4 + (4 + 1) + (4 + 2) + 4;
+  REQUIRE(contents.size() == 24 + int_column_bytes + string_column_bytes);
+}
@@ -0,0 +1,53 @@
+#include "../partition_similarity.h"
+#include "catch.hpp"
+
+#include <string>
+
+TEST_CASE("Identical partitions match under any labels", "[Partition_Similarity]")
+{
+  const std::vector<std::string> partition_a = { "x", "x", "y", "y", "z", "z", "z" };
+  const std::vector<std::string> partition_b = { "3", "3", "1", "1", "2", "2", "2" };
+
+  const std::vector<int> ids_a = dense_labels(partition_a);
+  REQUIRE(ids_a == std::vector<int> { 0, 0, 1, 1, 2, 2, 2 });
+
+  const Partition_Similarity similarity = compare_partitions(ids_a, dense_labels(partition_b));
+  REQUIRE(similarity.nmi == Approx(1));
+  REQUIRE(similarity.ari == Approx(1));
+  REQUIRE(similarity.vi == Approx(0).margin(1e-12));
+}
+
+TEST_CASE("Partition similarities match hand calculated values", "[Partition_Similarity]")
+{
+  const std::vector<int> partition_a = { 0, 0, 0, 1, 1, 1 };
+  const std::vector<int> partition_b = { 0, 0, 1, 1, 2, 2 };
+
+  const Partition_Similarity similarity = compare_partitions(partition_a, partition_b);
+  REQUIRE(similarity.nmi == Approx(0.5158037));
+  REQUIRE(similarity.ari == Approx(0.2424242));
+  REQUIRE(similarity.vi == Approx(0.8675632));
+
+  // Order of the partitions doesn't matter
+  const Partition_Similarity flipped = compare_partitions(partition_b, partition_a);
+  REQUIRE(flipped.nmi == Approx(similarity.nmi));
+  REQUIRE(flipped.ari == Approx(similarity.ari));
+  REQUIRE(flipped.vi == Approx(similarity.vi));
+
+  // One big group shares no information with every node on its own
+  const Partition_Similarity unrelated = compare_partitions({ 0, 0, 0, 0 }, { 0, 1, 2, 3 });
+  REQUIRE(unrelated.nmi == Approx(0).margin(1e-12));
+  REQUIRE(unrelated.ari == Approx(0).margin(1e-12));
+  REQUIRE(unrelated.vi == Approx(std::log(4)));
+
+  REQUIRE_THROWS(compare_partitions({ 0, 1 }, { 0, 1, 2 }));
+}
+
+TEST_CASE("Partitions of fewer than two nodes always agree", "[Partition_Similarity]")
+{
+  for (const std::vector<int>& labels : { std::vector<int> {}, std::vector<int> { 0 } }) {
+    const Partition_Similarity similarity = compare_partitions(labels, labels);
+    REQUIRE(similarity.nmi == 1);
+    REQUIRE(similarity.ari == 1);
+    REQUIRE(similarity.vi == 0);
+  }
+}
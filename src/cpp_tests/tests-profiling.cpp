@@ -0,0 +1,135 @@
+#include "../profiling/Instrument.h"
+#include "catch.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+// Count non-overlapping occurrences of a pattern in a string
+int count_occurrences(const std::string& text, const std::string& pattern)
+{
+  int count = 0;
+  for (auto pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + pattern.size())) {
+    count++;
+  }
+  return count;
+}
+
+TEST_CASE("Profiler collects scopes from many threads", "[Profiling]")
+{
+  const std::string trace_path  = "profiling_test_trace.json";
+  const int         num_threads = 4;
+  const int         num_scopes  = 1000;
+
+  // Scopes outside of a session are ignored
+  {
+    InstrumentationTimer ignored("before_session");
+  }
+
+  Instrumentor::Get().BeginSession("Test", trace_path);
+  REQUIRE(Instrumentor::Get().Active());
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < num_scopes; i++) {
+        InstrumentationTimer timer("worker_scope");
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  Instrumentor::Get().EndSession();
+  REQUIRE_FALSE(Instrumentor::Get().Active());
+
+  std::ifstream     trace_file(trace_path);
+  std::stringstream trace;
+  trace << trace_file.rdbuf();
+  std::remove(trace_path.c_str());
+  const std::string trace_json = trace.str();
+
+  // Every scope made it out and the file is closed off properly
+  REQUIRE(count_occurrences(trace_json, "\"name\":\"worker_scope\"") == num_threads * num_scopes);
+  REQUIRE(count_occurrences(trace_json, "before_session") == 0);
+  REQUIRE(trace_json.substr(0, 16) == "{\"traceEvents\":[");
+  REQUIRE(trace_json.substr(trace_json.size() - 2) == "}}");
+  REQUIRE(count_occurrences(trace_json, "\"droppedEvents\":0") == 1);
+
+  // Each thread gets its own id
+  std::set<std::string> thread_ids;
+  for (auto pos = trace_json.find("\"tid\":"); pos != std::string::npos; pos = trace_json.find("\"tid\":", pos + 1)) {
+    thread_ids.insert(trace_json.substr(pos + 6, trace_json.find(',', pos) - pos - 6));
+  }
+  REQUIRE(thread_ids.size() == num_threads);
+}
+
+TEST_CASE("Profiling is filtered by category and sampled", "[Profiling]")
+{
+  const std::string trace_path = "profiling_test_trace.json";
+
+  // Nothing is switched on outside of a session
+  REQUIRE_FALSE(profile_category_enabled(ProfileCategory::proposal));
+
+  Instrumentor::Get().BeginSession("Test", trace_path, "proposal:10, entropy");
+  REQUIRE(profile_category_enabled(ProfileCategory::proposal));
+  REQUIRE(profile_category_enabled(ProfileCategory::entropy));
+  REQUIRE_FALSE(profile_category_enabled(ProfileCategory::merge));
+
+  for (int i = 0; i < 100; i++) {
+    InstrumentationTimer proposal_timer("proposal_scope", ProfileCategory::proposal);
+    InstrumentationTimer entropy_timer("entropy_scope", ProfileCategory::entropy);
+    InstrumentationTimer merge_timer("merge_scope", ProfileCategory::merge);
+  }
+
+  Instrumentor::Get().EndSession();
+  REQUIRE_FALSE(profile_category_enabled(ProfileCategory::proposal));
+
+  std::ifstream     trace_file(trace_path);
+  std::stringstream trace;
+  trace << trace_file.rdbuf();
+  std::remove(trace_path.c_str());
+  const std::string trace_json = trace.str();
+
+  // Only every 10th proposal scope, every entropy scope, and no merge scopes
+  REQUIRE(count_occurrences(trace_json, "\"name\":\"proposal_scope\"") == 10);
+  REQUIRE(count_occurrences(trace_json, "\"name\":\"entropy_scope\"") == 100);
+  REQUIRE(count_occurrences(trace_json, "merge_scope") == 0);
+  REQUIRE(count_occurrences(trace_json, "\"cat\":\"entropy\"") == 100);
+
+  // Bad category lists are caught before anything is started
+  REQUIRE_THROWS(Instrumentor::Get().BeginSession("Test", trace_path, "proposals"));
+  REQUIRE_THROWS(Instrumentor::Get().BeginSession("Test", trace_path, "merge:0"));
+  REQUIRE_FALSE(Instrumentor::Get().Active());
+
+  const ProfileSettings all = parse_profile_spec("all:5");
+  REQUIRE(all.categories == (1u << NUM_PROFILE_CATEGORIES) - 1);
+  REQUIRE(all.sample_every[int(ProfileCategory::consensus)] == 5);
+}
+
+TEST_CASE("Allocations are counted against the enclosing category", "[Profiling]")
+{
+  reset_allocation_counts();
+
+  {
+    PROFILE_SCOPE("allocating", merge);
+    std::vector<int> values(1000);
+    values[0] = 1;
+  }
+
+  const auto counts = allocation_counts();
+  REQUIRE(counts.size() == NUM_PROFILE_CATEGORIES + 1);
+  REQUIRE(counts.back().category == "other");
+
+  const AllocationCount& merge_count = counts[int(ProfileCategory::merge)];
+  REQUIRE(merge_count.category == "merge");
+
+  // Only builds with the replacement operator new linked in see anything
+  if (allocation_counting_enabled()) {
+    REQUIRE(merge_count.allocations >= 1);
+    REQUIRE(merge_count.bytes >= 1000 * sizeof(int));
+  } else {
+    REQUIRE(merge_count.allocations == 0);
+    REQUIRE(merge_count.bytes == 0);
+  }
+}
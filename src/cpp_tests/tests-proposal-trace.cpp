@@ -0,0 +1,130 @@
+#include "../SBM.h"
+#include "catch.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+TEST_CASE("Proposal traces round trip through their binary file", "[Proposal_Trace]")
+{
+  const std::string path = "proposal_trace_test.sbmtrace";
+
+  // Enough rows to fill a few blocks, with ids reused across them
+  const int num_rows = Proposal_Trace::block_rows * 2 + 10;
+  {
+    Proposal_Trace trace(path);
+    for (int i = 0; i < num_rows; i++) {
+      trace.record(i / 100,
+                   "node_" + std::to_string(i % 50),
+                   "block_" + std::to_string(i % 3),
+                   "block_" + std::to_string((i + 1) % 3),
+                   i * 0.5,
+                   1.0 / (i + 1),
+                   i % 2 == 0);
+    }
+    REQUIRE(trace.size() == num_rows);
+    trace.close();
+
+    // A closed trace refuses more rows rather than waiting on its writer
+    REQUIRE_THROWS(trace.record(0, "node_0", "block_0", "block_1", 0, 1, true));
+    REQUIRE(trace.size() == num_rows);
+    trace.close();
+  }
+
+  const Output_Table table = read_proposal_trace(path);
+  REQUIRE(table.num_rows() == num_rows);
+  REQUIRE(table.columns.size() == 7);
+  REQUIRE(table.columns[0].name == "sweep_num");
+  REQUIRE(table.columns[6].name == "move_accepted");
+
+  for (const int i : { 0, 1, 77, int(Proposal_Trace::block_rows), num_rows - 1 }) {
+    REQUIRE(table.columns[0].integers[i] == i / 100);
+    REQUIRE(table.columns[1].texts[i] == "node_" + std::to_string(i % 50));
+    REQUIRE(table.columns[2].texts[i] == "block_" + std::to_string(i % 3));
+    REQUIRE(table.columns[3].texts[i] == "block_" + std::to_string((i + 1) % 3));
+    REQUIRE(table.columns[4].numbers[i] == i * 0.5);
+    REQUIRE(table.columns[5].numbers[i] == 1.0 / (i + 1));
+    REQUIRE(table.columns[6].integers[i] == (i % 2 == 0));
+  }
+
+  // A trace cut off part way through its last block keeps the earlier blocks
+  std::string contents;
+  {
+    std::ifstream file(path, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(contents.data(), contents.size() - 100);
+  }
+  REQUIRE(read_proposal_trace(path).num_rows() == Proposal_Trace::block_rows * 2);
+
+  std::remove(path.c_str());
+  REQUIRE_THROWS(read_proposal_trace(path));
+}
+
+TEST_CASE("Sweeps record their proposals to a trace", "[Proposal_Trace]")
+{
+  const std::string path = "sweep_trace_test.sbmtrace";
+
+  SBM my_SBM(42);
+  my_SBM.add_sim_network(simulate_network(planted_partition_spec(60, 3, 6, 0.8, 0, 1), 2), false);
+  my_SBM.initialize_blocks(0, 3);
+
+  my_SBM.start_proposal_trace(path);
+  const auto results   = my_SBM.mcmc_sweep(0, 5, 0.1, false, false);
+  const int  num_rows  = my_SBM.stop_proposal_trace();
+  const auto proposals = read_proposal_trace(path);
+  std::remove(path.c_str());
+
+  REQUIRE(int(proposals.num_rows()) == num_rows);
+
+  // Accepted proposals are exactly the moves the sweeps made
+  std::list<std::string> accepted_nodes;
+  double                 accepted_delta = 0;
+  for (int i = 0; i < num_rows; i++) {
+    REQUIRE(proposals.columns[2].texts[i] != proposals.columns[3].texts[i]);
+    if (proposals.columns[6].integers[i] == 1) {
+      accepted_nodes.push_back(proposals.columns[1].texts[i]);
+      accepted_delta += proposals.columns[4].numbers[i];
+    }
+  }
+  REQUIRE(accepted_nodes == results.nodes_moved);
+
+  double sweeps_delta = 0;
+  for (const double& delta : results.sweep_entropy_delta) {
+    sweeps_delta += delta;
+  }
+  REQUIRE(accepted_delta == Approx(sweeps_delta));
+
+  // Nothing more is recorded once the trace is stopped
+  my_SBM.mcmc_sweep(0, 1, 0.1, false, false);
+  REQUIRE(my_SBM.stop_proposal_trace() == 0);
+}
+
+TEST_CASE("Copies of a model don't share its proposal trace", "[Proposal_Trace]")
+{
+  const std::string path = "copied_trace_test.sbmtrace";
+
+  SBM my_SBM(42);
+  my_SBM.add_sim_network(simulate_network(planted_partition_spec(30, 3, 6, 0.8, 0, 1), 2), false);
+  my_SBM.initialize_blocks(0, 3);
+  my_SBM.start_proposal_trace(path);
+  my_SBM.start_move_log(path + ".moves");
+
+  SBM copy = my_SBM;
+  REQUIRE(!copy.proposal_trace);
+  REQUIRE(!copy.move_log);
+
+  // Assigning over a model with a trace leaves it with its own
+  copy = SBM(7);
+  my_SBM = copy;
+  REQUIRE(my_SBM.proposal_trace);
+  REQUIRE(my_SBM.move_log);
+
+  REQUIRE(copy.stop_proposal_trace() == 0);
+  REQUIRE(copy.stop_move_log() == 0);
+  my_SBM.stop_proposal_trace();
+  my_SBM.stop_move_log();
+  std::remove(path.c_str());
+  std::remove((path + ".moves").c_str());
+}
@@ -353,3 +353,806 @@ TEST_CASE("Agglomerative merging on larger network", "[SBM]")
   // Make sure that we have lumped together at least some blocks
   REQUIRE(my_SBM.get_level(1)->size() < my_SBM.get_level(0)->size());
 }
+
+TEST_CASE("Block assignment for new nodes matches full entropy calculation", "[SBM]")
+{
+  // Score a new a-type node connected to b1, b3, and b4
+  SBM my_SBM = build_simple_SBM();
+
+  const State_Dump pre_state   = my_SBM.get_state();
+  const auto       assignments = my_SBM.assign_new_nodes({ "a5" }, { "a" },
+                                                   { "a5", "a5", "a5" },
+                                                   { "b1", "b3", "b4" });
+
+  // Scoring should not have changed the model
+  REQUIRE(my_SBM.get_state().parent == pre_state.parent);
+  REQUIRE(assignments.size() == 1);
+
+  // Now actually add the node to a copy of the network and try it in every block
+  SBM full_SBM = build_simple_SBM();
+  full_SBM.add_node("a5", "a");
+  full_SBM.add_edge("a5", "b1");
+  full_SBM.add_edge("a5", "b3");
+  full_SBM.add_edge("a5", "b4");
+  const NodePtr a5 = full_SBM.get_node_by_id("a5");
+
+  std::map<std::string, double> block_entropies;
+  for (const auto& block : full_SBM.get_nodes_of_type_at_level("a", 1)) {
+    a5->set_parent(block);
+    block_entropies[block->id] = full_SBM.get_entropy(0);
+  }
+
+  double best_entropy = block_entropies.begin()->second;
+  for (const auto& block_entropy : block_entropies) {
+    best_entropy = std::min(best_entropy, block_entropy.second);
+  }
+
+  double normalizer = 0;
+  for (const auto& block_entropy : block_entropies) {
+    normalizer += std::exp(best_entropy - block_entropy.second);
+  }
+
+  // (Compare entropies rather than ids as some blocks are tied)
+  REQUIRE(block_entropies[assignments[0].best_block] == Approx(best_entropy));
+  REQUIRE(assignments[0].prob == Approx(1 / normalizer));
+}
+
+TEST_CASE("Block assignment for new nodes is same across thread counts", "[SBM]")
+{
+  SBM my_SBM = build_bipartite_simulated();
+  my_SBM.initialize_blocks(0, 3);
+
+  const std::vector<std::string> new_nodes { "n1", "n2", "n3", "n4" };
+  const std::vector<std::string> new_types { "a", "a", "b", "b" };
+  const std::vector<std::string> edges_from { "n1", "n1", "n2", "n3", "n3", "n3", "n4" };
+  const std::vector<std::string> edges_to { "b1", "b2", "b7", "a1", "a9", "a10", "a4" };
+
+  const auto serial   = my_SBM.assign_new_nodes(new_nodes, new_types, edges_from, edges_to, 0, 1);
+  const auto threaded = my_SBM.assign_new_nodes(new_nodes, new_types, edges_from, edges_to, 0, 3);
+
+  REQUIRE(serial.size() == 4);
+  for (int i = 0; i < 4; i++) {
+    REQUIRE(serial[i].id == new_nodes[i]);
+    REQUIRE(serial[i].best_block == threaded[i].best_block);
+    REQUIRE(serial[i].prob == threaded[i].prob);
+  }
+
+  // Edges need to start from nodes in the batch
+  REQUIRE_THROWS(my_SBM.assign_new_nodes(new_nodes, new_types, { "a1" }, { "b1" }));
+}
+
+TEST_CASE("Local MCMC sweeps only touch neighborhood of seed nodes", "[SBM]")
+{
+  SBM my_SBM = build_bipartite_simulated();
+  my_SBM.initialize_blocks(0, 3);
+
+  // With a hop radius of zero a single sweep can only move the seed itself
+  const auto seed_only = my_SBM.mcmc_sweep_local({ "a1" }, 0, 0, 1, 0.1);
+  REQUIRE(seed_only.sweep_entropy_delta.size() == 1);
+  for (const auto& moved_id : seed_only.nodes_moved) {
+    REQUIRE(moved_id == "a1");
+  }
+
+  // One hop out lets the seed's neighbors move as well
+  const NodePtr         a1 = my_SBM.get_node_by_id("a1");
+  std::set<std::string> neighborhood { "a1" };
+  for (const auto& neighbor : a1->edges) {
+    neighborhood.insert(neighbor->id);
+  }
+
+  const auto one_hop = my_SBM.mcmc_sweep_local({ "a1" }, 1, 0, 1, 0.1);
+  for (const auto& moved_id : one_hop.nodes_moved) {
+    REQUIRE(neighborhood.count(moved_id) == 1);
+  }
+
+  // Entropy changes reported should line up with the actual change in model entropy
+  const double pre_entropy = my_SBM.get_entropy(0);
+  const auto   many_sweeps = my_SBM.mcmc_sweep_local({ "a1", "b3" }, 1, 0, 10, 0.1);
+
+  double reported_delta = 0;
+  for (const double& sweep_delta : many_sweeps.sweep_entropy_delta) {
+    reported_delta += sweep_delta;
+  }
+  REQUIRE(my_SBM.get_entropy(0) - pre_entropy == Approx(reported_delta).margin(0.1));
+}
+
+TEST_CASE("Sweeps with variable block numbers only remove the blocks they empty", "[SBM]")
+{
+  SBM my_SBM = build_bipartite_simulated();
+  my_SBM.initialize_blocks(0, 3);
+
+  // A block left empty before sweeping, away from any node
+  const NodePtr stray_block = my_SBM.create_block_node("a", 1);
+
+  // Local sweeps don't go looking for it, only blocks their moves empty go
+  const int64_t cleanup_before = my_SBM.stats.cleanup_ns;
+  my_SBM.mcmc_sweep_local({ "a1" }, 1, 0, 5, 0.1, true);
+  const int64_t local_removed = my_SBM.stats.blocks_removed;
+  REQUIRE(my_SBM.stats.cleanup_ns == cleanup_before);
+  for (const auto& block : *my_SBM.get_level(1)) {
+    REQUIRE((block.second->children.size() > 0 || block.second == stray_block));
+  }
+
+  // Whole level sweeps clear empty blocks out before any node can move into
+  // them. The first stray may have been taken up by the local sweep, so use a
+  // fresh one. Its id is free to be reused afterwards, so look for the block
+  // itself.
+  const NodePtr second_stray = my_SBM.create_block_node("a", 1);
+  my_SBM.mcmc_sweep(0, 5, 0.1, true, false);
+  for (const auto& block : *my_SBM.get_level(1)) {
+    REQUIRE(block.second != second_stray);
+    REQUIRE(block.second->children.size() > 0);
+  }
+
+  // Every fresh block offered to a node that didn't take it gets removed
+  REQUIRE(my_SBM.stats.blocks_removed > local_removed);
+  REQUIRE(my_SBM.stats.blocks_created - my_SBM.stats.blocks_removed == int64_t(my_SBM.get_level(1)->size()));
+}
+
+TEST_CASE("New blocks never take the id of a live block", "[SBM]")
+{
+  SBM my_SBM;
+  my_SBM.add_node("a1", "a", 0);
+  my_SBM.add_node("a2", "a", 0);
+
+  // Blocks a-1_0, a-1_1 and a-1_2 with the first left empty and removed, so
+  // the level's size points at an id still in use
+  const NodePtr empty_block = my_SBM.create_block_node("a", 1);
+  const NodePtr block_1     = my_SBM.create_block_node("a", 1);
+  const NodePtr block_2     = my_SBM.create_block_node("a", 1);
+  my_SBM.get_node_by_id("a1")->set_parent(block_1);
+  my_SBM.get_node_by_id("a2")->set_parent(block_2);
+  my_SBM.clean_empty_blocks();
+  REQUIRE(my_SBM.get_level(1)->size() == 2);
+  REQUIRE(block_2->id == "a-1_2");
+
+  const NodePtr new_block = my_SBM.create_block_node("a", 1);
+  REQUIRE(new_block->id != block_1->id);
+  REQUIRE(new_block->id != block_2->id);
+
+  // The live block is still the one the level holds under its id
+  REQUIRE(my_SBM.get_level(1)->size() == 3);
+  REQUIRE(my_SBM.get_level(1)->at(block_2->id) == block_2);
+  REQUIRE(my_SBM.get_node_by_id("a2")->parent == block_2);
+}
+
+TEST_CASE("Streamed MCMC sweeps match accumulated sweeps", "[SBM]")
+{
+  // Two identical models with identical random states
+  SBM accumulated = build_bipartite_simulated();
+  SBM streamed    = build_bipartite_simulated();
+  accumulated.initialize_blocks(0, 3);
+  streamed.initialize_blocks(0, 3);
+
+  const int  num_sweeps = 6;
+  const auto results    = accumulated.mcmc_sweep(0, num_sweeps, 0.1, false, false);
+
+  const std::vector<std::string> node_ids = streamed.get_sweep_node_ids(0);
+  std::vector<double>            entropy_deltas;
+  std::list<std::string>         nodes_moved;
+
+  const int sweeps_run = streamed.mcmc_sweep_stream(0, num_sweeps, 0.1, false, [&](const Sweep_Record& record) {
+    REQUIRE(record.sweep == int(entropy_deltas.size()));
+    entropy_deltas.push_back(record.entropy_delta);
+    for (const int& node_index : record.nodes_moved) {
+      nodes_moved.push_back(node_ids[node_index]);
+    }
+    return true;
+  });
+
+  // Same moves in the same order
+  REQUIRE(sweeps_run == num_sweeps);
+  REQUIRE(entropy_deltas == results.sweep_entropy_delta);
+  REQUIRE(nodes_moved == results.nodes_moved);
+  REQUIRE(streamed.get_entropy(0) == Approx(accumulated.get_entropy(0)));
+
+  // Returning false from the callback stops the run
+  int        sweeps_seen = 0;
+  const auto stop_early  = [&](const Sweep_Record&) { return ++sweeps_seen < 2; };
+  REQUIRE(streamed.mcmc_sweep_stream(0, 10, 0.1, false, stop_early) == 2);
+  REQUIRE(sweeps_seen == 2);
+
+  // Chunks carry on the sweep numbering and flatten the moves
+  const Sweep_Chunk chunk = streamed.mcmc_sweep_chunk(0, 4, 0.1, false, 20);
+  REQUIRE(chunk.sweep == std::vector<int> { 20, 21, 22, 23 });
+
+  int total_moves = 0;
+  for (const int& num_moved : chunk.num_nodes_moved) {
+    total_moves += num_moved;
+  }
+  REQUIRE(int(chunk.move_node.size()) == total_moves);
+  REQUIRE(chunk.move_sweep.size() == chunk.move_node.size());
+  for (const int& node_index : chunk.move_node) {
+    REQUIRE(node_index < int(node_ids.size()));
+  }
+}
+
+TEST_CASE("Streams split into chunks make the same moves as one run", "[SBM]")
+{
+  SBM whole = build_bipartite_simulated();
+  SBM split = build_bipartite_simulated();
+  whole.initialize_blocks(0, 3);
+  split.initialize_blocks(0, 3);
+
+  const auto results = whole.mcmc_sweep(0, 6, 0.1, false, false);
+
+  // Numbered from 1 as the R wrapper does
+  const std::vector<std::string> node_ids = split.get_sweep_node_ids(0);
+  std::vector<double>            entropy_deltas;
+  std::list<std::string>         nodes_moved;
+  for (const int& first_sweep : { 1, 3, 5 }) {
+    const Sweep_Chunk chunk = split.mcmc_sweep_chunk(0, 2, 0.1, false, first_sweep);
+    entropy_deltas.insert(entropy_deltas.end(), chunk.entropy_delta.begin(), chunk.entropy_delta.end());
+    for (const int& node_index : chunk.move_node) {
+      nodes_moved.push_back(node_ids[node_index]);
+    }
+  }
+
+  REQUIRE(entropy_deltas == results.sweep_entropy_delta);
+  REQUIRE(nodes_moved == results.nodes_moved);
+}
+
+// Two disconnected copies of the simulated unipartite network plus a loner
+SBM build_disconnected_SBM(const int seed)
+{
+  SBM       my_SBM(seed);
+  const SBM original = build_unipartite_simulated();
+
+  for (const std::string prefix : { "x_", "y_" }) {
+    for (const auto& node : *original.get_level(0)) {
+      my_SBM.add_node(prefix + node.first, node.second->type);
+    }
+    for (const auto& edge : original.edges) {
+      my_SBM.add_edge(prefix + edge.node_a->id, prefix + edge.node_b->id);
+    }
+  }
+  my_SBM.add_node("lonely", "a");
+
+  return my_SBM;
+}
+
+TEST_CASE("Connected components are tracked as network is built", "[SBM]")
+{
+  SBM my_SBM = build_disconnected_SBM(42);
+
+  const auto components = my_SBM.get_components();
+  REQUIRE(components.size() == 3);
+
+  // Largest first, ties broken by node ids
+  const int copy_size = my_SBM.get_level(0)->size() / 2;
+  REQUIRE(components[0].size() == copy_size);
+  REQUIRE(components[1].size() == copy_size);
+  REQUIRE(components[2].size() == 1);
+  REQUIRE(components[0][0]->id.substr(0, 2) == "x_");
+  REQUIRE(components[2][0]->id == "lonely");
+
+  // Connecting the loner merges its component in
+  my_SBM.add_edge("lonely", "y_g1_1");
+  REQUIRE(my_SBM.get_components().size() == 2);
+}
+
+TEST_CASE("Blocks whose members have no edges can still be merged", "[SBM]")
+{
+  SBM my_SBM = build_disconnected_SBM(42);
+  my_SBM.add_node("lonely_2", "a");
+  my_SBM.initialize_blocks(0);
+  my_SBM.initialize_blocks(1);
+
+  // A block of unconnected nodes has no neighbors to base a proposal on, so a
+  // random block of the same type is offered instead
+  Sampler       node_chooser(42);
+  const NodePtr lonely_block = my_SBM.get_node_by_id("lonely")->parent;
+  for (int i = 0; i < 20; i++) {
+    const NodePtr proposal = my_SBM.propose_move(lonely_block, 0.1, node_chooser);
+    REQUIRE(proposal->level == 2);
+    REQUIRE(proposal->type == "a");
+  }
+  REQUIRE(my_SBM.stats.random_block_proposals == 20);
+  REQUIRE(my_SBM.stats.neighbor_proposals == 0);
+
+  // Connected nodes still go through their neighbors
+  const NodePtr connected_block = my_SBM.get_node_by_id("x_g1_1")->parent;
+  my_SBM.propose_move(connected_block, 0.0, node_chooser);
+  REQUIRE(my_SBM.stats.random_block_proposals == 20);
+  REQUIRE(my_SBM.stats.neighbor_proposals == 1);
+
+  // Full agglomerative merging gets the unconnected nodes into shared blocks
+  my_SBM.collapse_blocks(0, 0, 4, 5, 1.5, 0.1, false);
+  REQUIRE(my_SBM.get_level(1)->size() == 4);
+  for (const auto& node : *my_SBM.get_level(0)) {
+    REQUIRE(node.second->parent != nullptr);
+  }
+}
+
+TEST_CASE("Collapsing components independently", "[SBM]")
+{
+  // Run the same checks single and multi-threaded
+  for (const int num_threads : { 1, 3 }) {
+    SBM my_SBM = build_disconnected_SBM(42);
+
+    const auto results = my_SBM.collapse_components(0, 3, 5, 1.5, 0.1, num_threads);
+    REQUIRE(results.size() == 1);
+
+    // Summed entropy of components should be the entropy of the whole network
+    REQUIRE(results[0].entropy == Approx(my_SBM.get_entropy(0)));
+    REQUIRE(results[0].num_blocks == my_SBM.get_level(1)->size());
+
+    // Every component gets collapsed down to (at most) the desired number of blocks
+    REQUIRE(my_SBM.get_level(1)->size() <= 3 + 3 + 1);
+
+    // No block should contain nodes from more than one component
+    for (const auto& block : *my_SBM.get_level(1)) {
+      std::set<std::string> prefixes;
+      for (const auto& child : block.second->children) {
+        prefixes.insert(child->id.substr(0, 2));
+      }
+      REQUIRE(prefixes.size() == 1);
+    }
+  }
+}
+
+TEST_CASE("Sweeping components independently", "[SBM]")
+{
+  SBM my_SBM = build_disconnected_SBM(42);
+
+  // Blocks spanning components can't be swept separately
+  my_SBM.initialize_blocks(0, 2);
+  REQUIRE_THROWS(my_SBM.mcmc_sweep_components(1, 0.1, true));
+
+  my_SBM.collapse_components(0, 3, 5, 1.5, 0.1);
+
+  std::vector<std::vector<std::string>> parents_by_threads;
+  for (const int num_threads : { 1, 3 }) {
+    SBM swept = my_SBM.clone(7);
+
+    const double pre_entropy = swept.get_entropy(0);
+    const auto   results     = swept.mcmc_sweep_components(10, 0.1, false, num_threads);
+    REQUIRE(results.sweep_entropy_delta.size() == 10);
+
+    int    num_moved   = 0;
+    double total_delta = 0;
+    for (int i = 0; i < 10; i++) {
+      num_moved += results.sweep_num_nodes_moved[i];
+      total_delta += results.sweep_entropy_delta[i];
+    }
+    REQUIRE(int(results.nodes_moved.size()) == num_moved);
+
+    // The components' entropy changes add up to the whole network's
+    REQUIRE(swept.get_entropy(0) - pre_entropy == Approx(total_delta).margin(0.001));
+
+    // New blocks can be made and blocks still sit within a single component
+    swept.mcmc_sweep_components(10, 0.1, true, num_threads);
+    for (const auto& block : *swept.get_level(1)) {
+      std::set<std::string> prefixes;
+      for (const auto& child : block.second->children) {
+        prefixes.insert(child->id.substr(0, 2));
+      }
+      REQUIRE(prefixes.size() == 1);
+    }
+
+    std::vector<std::string> parents;
+    for (const auto& node : *swept.get_level(0)) {
+      parents.push_back(node.second->parent->id);
+    }
+    parents_by_threads.push_back(parents);
+  }
+
+  // Thread count never changes the results
+  REQUIRE(parents_by_threads[0] == parents_by_threads[1]);
+}
+
+// Simulated network with a random four level block hierarchy on top of it
+SBM build_nested_SBM()
+{
+  SBM my_SBM = build_unipartite_simulated();
+  my_SBM.initialize_blocks(0, 6);
+  my_SBM.initialize_blocks(1, 3);
+  my_SBM.initialize_blocks(2, 2);
+  my_SBM.clean_empty_blocks();
+  return my_SBM;
+}
+
+TEST_CASE("Nested move entropy deltas match full nested entropy", "[SBM]")
+{
+  SBM       my_SBM    = build_nested_SBM();
+  const int top_level = my_SBM.get_top_level();
+  REQUIRE(top_level == 3);
+
+  Sampler move_sampler(42);
+
+  // Try random moves at every level, checking the reported delta against the
+  // change in the brute-force nested entropy. Moves above the data level have
+  // edges internal to the node being moved and can change several levels.
+  for (int i = 0; i < 60; i++) {
+    const int     level     = i % top_level;
+    const NodePtr node      = move_sampler.sample(my_SBM.get_nodes_of_type_at_level("a", level));
+    const NodePtr new_block = move_sampler.sample(my_SBM.get_nodes_of_type_at_level("a", level + 1));
+
+    if (new_block == node->parent) {
+      continue;
+    }
+
+    const double pre_entropy       = my_SBM.get_nested_entropy();
+    const double pre_level_entropy = my_SBM.get_entropy(level);
+    const auto   decision          = my_SBM.make_nested_proposal_decision(node, new_block, 0.1, top_level);
+    const auto   level_decision    = my_SBM.make_proposal_decision(node, new_block, 0.1);
+
+    node->set_parent(new_block);
+    REQUIRE(my_SBM.get_nested_entropy() - pre_entropy == Approx(decision.entropy_delta));
+
+    // Single level decisions also need to account for edges internal to blocks
+    REQUIRE(my_SBM.get_entropy(level) - pre_level_entropy == Approx(level_decision.entropy_delta));
+
+    my_SBM.clean_empty_blocks();
+  }
+}
+
+TEST_CASE("Nested MCMC sweeps", "[SBM]")
+{
+  SBM my_SBM = build_nested_SBM();
+
+  const double pre_entropy = my_SBM.get_nested_entropy();
+  const auto   results     = my_SBM.mcmc_sweep_nested(5, 0.1);
+  REQUIRE(results.sweep_entropy_delta.size() == 5);
+
+  // Reported deltas add up to the actual change in nested entropy
+  double reported_delta = 0;
+  for (const double& sweep_delta : results.sweep_entropy_delta) {
+    reported_delta += sweep_delta;
+  }
+  REQUIRE(my_SBM.get_nested_entropy() - pre_entropy == Approx(reported_delta));
+
+  // Hierarchy is still complete with no empty blocks
+  for (int level = 1; level <= my_SBM.get_top_level(); level++) {
+    for (const auto& block : *my_SBM.get_level(level)) {
+      REQUIRE(block.second->children.size() > 0);
+    }
+  }
+
+  // Models without blocks can't be swept
+  SBM no_blocks = build_unipartite_simulated();
+  REQUIRE_THROWS(no_blocks.mcmc_sweep_nested(1, 0.1));
+}
+
+TEST_CASE("Collapsing a full block hierarchy", "[SBM]")
+{
+  for (const int num_threads : { 1, 3 }) {
+    SBM my_SBM = build_unipartite_simulated();
+
+    const auto results   = my_SBM.collapse_hierarchy(2, 3, 5, 1.5, 0.1, num_threads);
+    const int  top_level = my_SBM.get_top_level();
+
+    // One collapse per level, ending with a single block
+    REQUIRE(results.size() == top_level);
+    REQUIRE(top_level > 1);
+    REQUIRE(my_SBM.get_level(top_level)->size() == 1);
+
+    for (int level = 0; level < top_level; level++) {
+      // Every level is smaller than the one below it and fully assigned
+      REQUIRE(my_SBM.get_level(level + 1)->size() < my_SBM.get_level(level)->size());
+      REQUIRE(results[level].num_blocks == my_SBM.get_level(level + 1)->size());
+      for (const auto& node : *my_SBM.get_level(level)) {
+        REQUIRE(node.second->parent);
+      }
+
+      // Level entropies computed by the level models match the full hierarchy
+      REQUIRE(results[level].entropy == Approx(my_SBM.get_entropy(level)));
+    }
+
+    // The hierarchy is ready to be refined with nested sweeps
+    const double pre_entropy = my_SBM.get_nested_entropy();
+    const auto   sweeps      = my_SBM.mcmc_sweep_nested(2, 0.1);
+    REQUIRE(my_SBM.get_nested_entropy() - pre_entropy == Approx(sweeps.sweep_entropy_delta[0] + sweeps.sweep_entropy_delta[1]));
+  }
+}
+
+TEST_CASE("A hierarchy that can't be collapsed leaves existing blocks alone", "[SBM]")
+{
+  // Two nodes of different types are already down to one block per type
+  SBM my_SBM;
+  my_SBM.add_node("a1", "a");
+  my_SBM.add_node("b1", "b");
+  my_SBM.add_edge("a1", "b1");
+  my_SBM.initialize_blocks(0);
+  const State_Dump before = my_SBM.get_state();
+
+  REQUIRE(my_SBM.collapse_hierarchy(2, 3, 5, 1.5, 0.1, 1).empty());
+
+  const State_Dump after = my_SBM.get_state();
+  REQUIRE(after.id == before.id);
+  REQUIRE(after.parent == before.parent);
+}
+
+TEST_CASE("Collapse runs score each result from scratch and keep the best", "[SBM]")
+{
+  SBM        my_SBM  = build_bipartite_simulated();
+  const auto results = my_SBM.collapse_run(0, 2, 5, 2, 0.1, { 2, 4, 6 });
+  REQUIRE(results.size() == 3);
+
+  double lowest_entropy = results[0].entropy;
+  for (const auto& result : results) {
+    SBM rescored = build_bipartite_simulated();
+    rescored.set_state(result.state.id, result.state.parent, result.state.level, result.state.type);
+    REQUIRE(result.entropy == Approx(rescored.get_entropy(0)));
+    lowest_entropy = std::min(lowest_entropy, result.entropy);
+  }
+
+  REQUIRE(my_SBM.get_entropy(0) == Approx(lowest_entropy));
+}
+
+TEST_CASE("Adding edges in bulk matches adding them one at a time", "[SBM]")
+{
+  SBM one_at_a_time;
+  SBM bulk;
+  for (SBM* model : { &one_at_a_time, &bulk }) {
+    model->add_node("a1", "a");
+    model->add_node("a2", "a");
+    model->add_node("b1", "b");
+  }
+
+  for (int i = 0; i < 3; i++) {
+    one_at_a_time.add_edge("a1", "b1");
+  }
+  one_at_a_time.add_edge("a1", "a2");
+  bulk.add_edges("a1", "b1", 3);
+  bulk.add_edges("a1", "a2", 1);
+
+  REQUIRE(bulk.edges.size() == one_at_a_time.edges.size());
+  for (const std::string id : { "a1", "a2", "b1" }) {
+    const NodePtr bulk_node = bulk.get_node_by_id(id);
+    REQUIRE(bulk_node->degree == one_at_a_time.get_node_by_id(id)->degree);
+    REQUIRE(print_node_ids(bulk_node->edges) == print_node_ids(one_at_a_time.get_node_by_id(id)->edges));
+  }
+  REQUIRE(bulk.get_components().size() == 1);
+}
+
+TEST_CASE("Simple non-degree-corrected entropy calculation (unipartite)", "[SBM]")
+{
+  SBM unipartite_sbm = build_simple_SBM_unipartite();
+  unipartite_sbm.set_degree_corrected(false);
+
+  // Hand calculated: E - sum_rs(e_rs*ln(e_rs/(n_r*n_s)))/2
+  REQUIRE(unipartite_sbm.get_entropy(0) == Approx(16.328782));
+
+  // Moving n4 to group c is now scored by block sizes rather than degrees
+  const NodePtr n4 = unipartite_sbm.get_node_by_id("n4", 0);
+  const NodePtr c  = unipartite_sbm.get_node_by_id("c", 1);
+  REQUIRE(unipartite_sbm.make_proposal_decision(n4, c, 0.1).entropy_delta == Approx(0.013551));
+
+  n4->set_parent(c);
+  REQUIRE(unipartite_sbm.get_entropy(0) == Approx(16.342333));
+}
+
+TEST_CASE("Non-degree-corrected move and merge deltas match full entropy", "[SBM]")
+{
+  Sampler random(312);
+
+  SBM my_SBM = build_bipartite_simulated();
+  my_SBM.set_degree_corrected(false);
+  my_SBM.initialize_blocks(0, 3);
+
+  bool all_zeros = true;
+  for (const auto& node : *my_SBM.get_level(0)) {
+    const NodePtr& node_to_move     = node.second;
+    const NodePtr  group_to_move_to = random.sample(my_SBM.get_nodes_of_type_at_level(node_to_move->type, 1));
+
+    const double pre_entropy    = my_SBM.get_entropy(0);
+    const double reported_delta = my_SBM.make_proposal_decision(node_to_move, group_to_move_to, 0.1).entropy_delta;
+
+    node_to_move->set_parent(group_to_move_to);
+    const double true_delta = my_SBM.get_entropy(0) - pre_entropy;
+    if (true_delta != 0)
+      all_zeros = false;
+
+    REQUIRE(true_delta == Approx(reported_delta).margin(1e-9));
+  }
+  REQUIRE(!all_zeros);
+
+  // A single merge reports the change in entropy it causes
+  SBM merge_SBM = build_bipartite_simulated();
+  merge_SBM.set_degree_corrected(false);
+  merge_SBM.initialize_blocks(0, 6);
+
+  const double     pre_merge_entropy = merge_SBM.get_entropy(0);
+  const Merge_Step merge             = merge_SBM.agglomerative_merge(1, 1, 5, 0.1);
+  REQUIRE(merge_SBM.get_entropy(0) - pre_merge_entropy == Approx(merge.entropy_delta));
+}
+
+TEST_CASE("Non-degree-corrected nested move deltas match full nested entropy", "[SBM]")
+{
+  SBM my_SBM = build_nested_SBM();
+  my_SBM.set_degree_corrected(false);
+  const int top_level = my_SBM.get_top_level();
+
+  Sampler move_sampler(42);
+
+  for (int i = 0; i < 60; i++) {
+    const int     level     = i % top_level;
+    const NodePtr node      = move_sampler.sample(my_SBM.get_nodes_of_type_at_level("a", level));
+    const NodePtr new_block = move_sampler.sample(my_SBM.get_nodes_of_type_at_level("a", level + 1));
+
+    if (new_block == node->parent) {
+      continue;
+    }
+
+    const double pre_entropy = my_SBM.get_nested_entropy();
+    const auto   decision    = my_SBM.make_nested_proposal_decision(node, new_block, 0.1, top_level);
+
+    node->set_parent(new_block);
+    REQUIRE(my_SBM.get_nested_entropy() - pre_entropy == Approx(decision.entropy_delta).margin(1e-9));
+
+    my_SBM.clean_empty_blocks();
+  }
+}
+
+TEST_CASE("Network structure detection", "[SBM]")
+{
+  REQUIRE(build_simple_SBM_unipartite().get_structure() == Network_Structure::unipartite);
+
+  SBM bipartite_SBM = build_bipartite_simulated();
+  REQUIRE(bipartite_SBM.get_structure() == Network_Structure::bipartite);
+
+  // Specialised sweeps still report the entropy changes they make
+  bipartite_SBM.initialize_blocks(0, 3);
+  const double pre_entropy = bipartite_SBM.get_entropy(0);
+  const auto   sweeps      = bipartite_SBM.mcmc_sweep(0, 5, 0.1, false, false);
+
+  double reported_delta = 0;
+  for (const double& sweep_delta : sweeps.sweep_entropy_delta) {
+    reported_delta += sweep_delta;
+  }
+  REQUIRE(bipartite_SBM.get_entropy(0) - pre_entropy == Approx(reported_delta));
+
+  // A single within-type edge means types have to be looked up again
+  SBM polypartite_SBM = build_simple_SBM();
+  polypartite_SBM.add_edge("a1", "a2");
+  REQUIRE(polypartite_SBM.get_structure() == Network_Structure::polypartite);
+
+  // As do networks with more than two types
+  SBM tripartite_SBM = build_simple_SBM_unipartite();
+  tripartite_SBM.add_node("x1", "b");
+  tripartite_SBM.add_node("y1", "c");
+  tripartite_SBM.add_edge("n1", "x1");
+  tripartite_SBM.add_edge("n1", "y1");
+  REQUIRE(tripartite_SBM.get_structure() == Network_Structure::polypartite);
+}
+
+TEST_CASE("Engine stats count the work done", "[SBM]")
+{
+  SBM my_SBM = build_bipartite_simulated();
+  my_SBM.initialize_blocks(0, 4);
+
+  const int num_nodes = my_SBM.get_level(0)->size();
+  my_SBM.reset_stats();
+
+  // Every node gets one proposal a sweep and ends up in exactly one bucket
+  const auto   sweeps = my_SBM.mcmc_sweep(0, 3, 0.1, true, false);
+  Engine_Stats stats  = my_SBM.get_stats();
+
+  int num_moved = 0;
+  for (const int& moved : sweeps.sweep_num_nodes_moved) {
+    num_moved += moved;
+  }
+
+  REQUIRE(stats.proposals == 3 * num_nodes);
+  REQUIRE(stats.proposals == stats.proposals_accepted + stats.proposals_rejected + stats.proposals_unchanged);
+  REQUIRE(stats.proposals_accepted == num_moved);
+  REQUIRE(stats.random_block_proposals + stats.neighbor_proposals == stats.proposals);
+
+  // A fresh block is offered to every node with variable block numbers
+  REQUIRE(stats.blocks_created == stats.proposals);
+  REQUIRE(stats.blocks_removed > 0);
+  REQUIRE(stats.propose_ns > 0);
+  REQUIRE(stats.evaluate_ns > 0);
+  REQUIRE(stats.cleanup_ns > 0);
+
+  // Merging scores candidate pairs and removes blocks
+  my_SBM.reset_stats();
+  my_SBM.agglomerative_merge(1, 1, 3, 0.1);
+  stats = my_SBM.get_stats();
+  REQUIRE(stats.proposals == 0);
+  REQUIRE(stats.merge_candidates_scored > 0);
+  REQUIRE(stats.blocks_removed >= 1);
+
+  // Metrics file holds the same numbers
+  const std::string metrics_path = "engine_stats_test.json";
+  my_SBM.write_stats(metrics_path);
+  std::ifstream     metrics_file(metrics_path);
+  std::stringstream metrics;
+  metrics << metrics_file.rdbuf();
+  std::remove(metrics_path.c_str());
+
+  REQUIRE(metrics.str() == stats.to_json() + "\n");
+  REQUIRE(metrics.str().find("\"merge_candidates_scored\":" + std::to_string(stats.merge_candidates_scored)) != std::string::npos);
+}
+
+TEST_CASE("Memory report covers every structure of the model", "[SBM]")
+{
+  SBM my_SBM = build_simple_SBM();
+
+  const Memory_Report report = my_SBM.memory_report();
+
+  const auto find_entry = [&](const std::string& structure, const int level) {
+    return std::find_if(report.begin(), report.end(), [&](const Memory_Entry& entry) {
+      return entry.structure == structure && entry.level == level;
+    });
+  };
+
+  // Each node level gets its own entries
+  for (const auto& level : my_SBM.nodes) {
+    const auto node_entry = find_entry("nodes", level.first);
+    REQUIRE(node_entry != report.end());
+    REQUIRE(node_entry->count == level.second->size());
+    REQUIRE(node_entry->bytes >= level.second->size() * sizeof(Node));
+
+    std::size_t num_edge_ends = 0;
+    for (const auto& node : *level.second) {
+      num_edge_ends += node.second->edges.size();
+    }
+    const auto edge_entry = find_entry("edge_lists", level.first);
+    REQUIRE(edge_entry != report.end());
+    REQUIRE(edge_entry->count == num_edge_ends);
+    REQUIRE(edge_entry->bytes >= num_edge_ends * sizeof(NodePtr));
+  }
+
+  // Model wide structures
+  const auto edge_entry = find_entry("edges", -1);
+  REQUIRE(edge_entry != report.end());
+  REQUIRE(edge_entry->count == my_SBM.edges.size());
+
+  // The estimate of a state export matches the size of a real one
+  const State_Dump state      = my_SBM.get_state();
+  const auto       state_entry = find_entry("state_dump", -1);
+  REQUIRE(state_entry != report.end());
+  REQUIRE(state_entry->count == state.id.size());
+  REQUIRE(state_entry->bytes <= state.memory_bytes());
+
+  // Consensus pairs grow the consensus' footprint
+  Block_Consensus consensus;
+  const std::size_t empty_bytes = consensus.memory_bytes();
+  consensus.initialize(my_SBM.get_level(0));
+  REQUIRE(consensus.memory_bytes() > empty_bytes);
+
+  // Nothing has been swept yet so there are no sweep results to report
+  REQUIRE(find_entry("sweep_results", -1) == report.end());
+  REQUIRE(find_entry("pair_consensus", -1) == report.end());
+
+  // After a sweep run the report includes what its results held
+  const MCMC_Sweeps   sweeps       = my_SBM.mcmc_sweep(0, 3, 0.1, false, true);
+  const Memory_Report swept_report = my_SBM.memory_report();
+  const auto find_swept = [&](const std::string& structure) {
+    return std::find_if(swept_report.begin(), swept_report.end(), [&](const Memory_Entry& entry) {
+      return entry.structure == structure && entry.level == -1;
+    });
+  };
+
+  const auto results_entry = find_swept("sweep_results");
+  REQUIRE(results_entry != swept_report.end());
+  REQUIRE(results_entry->count == 3);
+
+  const auto pairs_entry = find_swept("pair_consensus");
+  REQUIRE(pairs_entry != swept_report.end());
+  REQUIRE(pairs_entry->count == sweeps.block_consensus.concensus_pairs.size());
+  REQUIRE(pairs_entry->bytes == sweeps.block_consensus.memory_bytes());
+  REQUIRE(pairs_entry->bytes > empty_bytes);
+}
+
+TEST_CASE("New blocks never reuse the id of a block still in use", "[SBM]")
+{
+  SBM my_SBM = build_unipartite_simulated();
+  my_SBM.initialize_blocks(0, 3);
+
+  // Empty out the first block so the level's size matches the id of the last
+  const NodePtr first_block = my_SBM.get_node_by_id("a-1_0", 1);
+  const NodePtr last_block  = my_SBM.get_node_by_id("a-1_2", 1);
+  for (const NodePtr& child : NodeVec(first_block->children.begin(), first_block->children.end())) {
+    child->set_parent(last_block);
+  }
+  my_SBM.clean_empty_blocks();
+  REQUIRE(my_SBM.get_level(1)->size() == 2);
+
+  const NodePtr new_block = my_SBM.create_block_node("a", 1);
+  REQUIRE(new_block->id != "a-1_2");
+  REQUIRE(my_SBM.get_level(1)->size() == 3);
+  REQUIRE(my_SBM.get_node_by_id("a-1_2", 1) == last_block);
+}
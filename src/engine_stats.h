@@ -0,0 +1,106 @@
+#ifndef __ENGINE_STATS_INCLUDED__
+#define __ENGINE_STATS_INCLUDED__
+// Always-on counters of what a model's fitting has been spending its time on.
+// Everything is a plain add to a model owned integer so keeping them costs next
+// to nothing next to the work being counted. Phase times are taken with a
+// single clock read at each phase boundary.
+
+#include "profiling/Instrument.h"
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+struct Engine_Stats {
+  // Node move proposals in MCMC sweeps
+  int64_t proposals           = 0; // Moves proposed
+  int64_t proposals_accepted  = 0; // Scored and taken
+  int64_t proposals_rejected  = 0; // Scored and turned down
+  int64_t proposals_unchanged = 0; // Proposed the node's current block so never scored
+
+  // Where proposed blocks came from (includes proposals made for merges)
+  int64_t random_block_proposals = 0; // Uniformly drawn block
+  int64_t neighbor_proposals     = 0; // Block of a neighbor's neighbor
+
+  // Block bookkeeping
+  int64_t blocks_created = 0; // New empty block nodes
+  int64_t blocks_removed = 0; // Blocks deleted when emptied or merged away
+
+  // Agglomerative merging
+  int64_t merge_candidates_scored = 0; // Block pairs with a merge delta computed
+
+  // Nanoseconds spent in each phase of a node move attempt
+  int64_t propose_ns  = 0; // Counting candidates and drawing a block
+  int64_t evaluate_ns = 0; // Scoring the proposal
+  int64_t apply_ns    = 0; // Moving the node and recording the move
+  int64_t cleanup_ns  = 0; // Removing empty blocks
+
+  Engine_Stats& operator+=(const Engine_Stats& other)
+  {
+    proposals += other.proposals;
+    proposals_accepted += other.proposals_accepted;
+    proposals_rejected += other.proposals_rejected;
+    proposals_unchanged += other.proposals_unchanged;
+    random_block_proposals += other.random_block_proposals;
+    neighbor_proposals += other.neighbor_proposals;
+    blocks_created += other.blocks_created;
+    blocks_removed += other.blocks_removed;
+    merge_candidates_scored += other.merge_candidates_scored;
+    propose_ns += other.propose_ns;
+    evaluate_ns += other.evaluate_ns;
+    apply_ns += other.apply_ns;
+    cleanup_ns += other.cleanup_ns;
+    return *this;
+  }
+
+  // Names and values in a fixed order, used by every export
+  template <typename Visitor>
+  void for_each(Visitor visit) const
+  {
+    visit("proposals", proposals);
+    visit("proposals_accepted", proposals_accepted);
+    visit("proposals_rejected", proposals_rejected);
+    visit("proposals_unchanged", proposals_unchanged);
+    visit("random_block_proposals", random_block_proposals);
+    visit("neighbor_proposals", neighbor_proposals);
+    visit("blocks_created", blocks_created);
+    visit("blocks_removed", blocks_removed);
+    visit("merge_candidates_scored", merge_candidates_scored);
+    visit("propose_ns", propose_ns);
+    visit("evaluate_ns", evaluate_ns);
+    visit("apply_ns", apply_ns);
+    visit("cleanup_ns", cleanup_ns);
+  }
+
+  // Flat JSON object of every counter
+  std::string to_json() const
+  {
+    std::ostringstream json;
+    json << "{";
+    bool first = true;
+    for_each([&](const char* name, const int64_t& value) {
+      json << (first ? "" : ",") << "\"" << name << "\":" << value;
+      first = false;
+    });
+    json << "}";
+    return json.str();
+  }
+};
+
+// Adds the time from construction to destruction onto a stats counter
+class Stats_Timer {
+  public:
+  explicit Stats_Timer(int64_t& total_ns)
+      : total_ns(total_ns)
+      , start(profile_now_ns())
+  {
+  }
+  ~Stats_Timer() { total_ns += profile_now_ns() - start; }
+
+  private:
+  int64_t&      total_ns;
+  const int64_t start;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef __ENTROPY_MODELS_INCLUDED__
+#define __ENTROPY_MODELS_INCLUDED__
+// Policy classes for the edge model used to score a partition. The entropy
+// kernels in SBM are templated on one of these so each variant gets its own
+// fully inlined code with no branching on the model inside the loops.
+//
+// Both models share the same block-pair summation, sum of
+// e_rs*ln(e_rs/(w_r*w_s)), and differ only in what the weight w of a block is
+// and in the terms that depend on the nodes alone.
+
+#include "Node.h"
+#include "sbm_helpers.h"
+
+#include <math.h>
+
+// Degree-corrected microcanonical SBM. A block's weight is its total degree so
+// a moving node carries its degree with it.
+//   S = -E - sum_k(N_k*ln(k!)) - sum_rs(e_rs*ln(e_rs/(e_r*e_s)))/2
+struct Degree_Corrected {
+  // Weight a node of a given degree adds to the block it belongs to
+  static double member_weight(const double& degree) { return degree; }
+
+  // Weight of a block itself
+  static double block_weight(const NodePtr& block) { return block->degree; }
+
+  // Weight edges add to a block when they are attached to one of its
+  // descendants (rather than a direct child) or to the block from outside
+  static double edge_weight(const double& num_edges) { return num_edges; }
+
+  // Contribution of a node of a given degree to the node-only terms
+  static double degree_term(const double& degree) { return lgamma(degree + 1); }
+
+  // Contribution of the total edge count to the node-only terms
+  static double edge_count_term(const double& n_total_edges) { return n_total_edges; }
+};
+
+// Non-degree-corrected (traditional) microcanonical SBM. A block's weight is its
+// number of members so nodes all count the same regardless of degree. Cheaper
+// as no degree terms or degree bookkeeping enter the scores.
+//   S = E - sum_rs(e_rs*ln(e_rs/(n_r*n_s)))/2
+struct Non_Degree_Corrected {
+  static double member_weight(const double& /* degree */) { return 1; }
+
+  static double block_weight(const NodePtr& block) { return block->children.size(); }
+
+  static double edge_weight(const double& /* num_edges */) { return 0; }
+
+  static double degree_term(const double& /* degree */) { return 0; }
+
+  static double edge_count_term(const double& n_total_edges) { return -n_total_edges; }
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef __MEMORY_ACCOUNTING_INCLUDED__
+#define __MEMORY_ACCOUNTING_INCLUDED__
+// Helpers for estimating how many bytes the model's structures take up without
+// touching the allocator. Container overheads follow libstdc++'s layouts so
+// totals are close, not exact, on other standard libraries.
+
+#include "Node.h"
+
+#include <string>
+#include <vector>
+
+// Links and color of a std::map/std::set tree node, on top of its value
+constexpr std::size_t TREE_NODE_OVERHEAD = 32;
+
+// Links of a std::list node, on top of its value
+constexpr std::size_t LIST_NODE_OVERHEAD = 16;
+
+// Reference counts and vtable of a make_shared control block
+constexpr std::size_t SHARED_BLOCK_OVERHEAD = 16;
+
+// Heap part of a string. Short strings live inside the string itself.
+inline std::size_t string_heap_bytes(const std::string& str)
+{
+  return str.capacity() > 15 ? str.capacity() + 1 : 0;
+}
+
+// Heap part of a vector of plain values
+template <typename T>
+inline std::size_t vector_heap_bytes(const std::vector<T>& vec)
+{
+  return vec.capacity() * sizeof(T);
+}
+
+// Heap part of a vector of strings, including the strings' own buffers
+inline std::size_t vector_heap_bytes(const std::vector<std::string>& vec)
+{
+  std::size_t bytes = vec.capacity() * sizeof(std::string);
+  for (const auto& str : vec) {
+    bytes += string_heap_bytes(str);
+  }
+  return bytes;
+}
+
+// Bytes used by one structure of the model, at one level of it or across the
+// whole model when level is -1
+struct Memory_Entry {
+  std::string structure;
+  int         level;
+  std::size_t count; // Number of elements held
+  std::size_t bytes;
+  Memory_Entry(const std::string& structure, const int level)
+      : structure(structure)
+      , level(level)
+      , count(0)
+      , bytes(0)
+  {
+  }
+};
+
+using Memory_Report = std::vector<Memory_Entry>;
+
+#endif
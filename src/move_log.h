@@ -0,0 +1,374 @@
+#ifndef __MOVE_LOG_INCLUDED__
+#define __MOVE_LOG_INCLUDED__
+// Records the moves accepted while sweeping a model to a compact binary file so
+// the partition at any point of a long run can be rebuilt afterwards without
+// running it again. Rebuilding just applies the moves in order to the starting
+// partition: no proposals are scored and no random numbers drawn.
+//
+// The file is an 8 byte "SBMMOVES" marker and a 32 bit version followed by
+// sections, each starting with a one byte kind:
+//   1  ids:   32 bit count, then that many ids as a 32 bit length and bytes.
+//             Ids are numbered from 0 across the whole file in the order given.
+//   3  state: 32 bit count n, then the columns node, parent, level and type (n
+//             32 bit ints each, as id numbers apart from level). A parent of
+//             -1 means the node has none.
+//   4  new blocks: 32 bit count n, then the columns block and parent (n 32
+//             bit ints each, as id numbers) of blocks created during the run.
+//             A parent of -1 means the block has none.
+//   2  moves: 32 bit count n, then the columns sweep, node and new_block (n 32
+//             bit ints each, as id numbers apart from sweep).
+//   0  end of the log.
+// A log holds the partition the model started in and then the moves of a
+// single run of sweeps. Ids and new blocks always come before the first
+// section that uses them, so a log cut short can still be read up to its last
+// full section.
+// Numbers are in the machine's byte order.
+//
+// Accepted moves are a small fraction of proposals so unlike Proposal_Trace
+// the log is written from the sweeping thread, a block of moves at a time.
+// Sections are read and written with the helpers in binary_sections.h.
+
+#include "binary_sections.h"
+#include "output_table.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Move_Log {
+  public:
+  // Moves gathered before they're written out
+  static constexpr std::size_t block_moves = 1 << 16;
+
+  explicit Move_Log(const std::string& path)
+      : file(path, std::ios::binary)
+  {
+    if (!file) {
+      RANGE_ERROR("Could not open " + path + " to write move log to.");
+    }
+    file.write("SBMMOVES", 8);
+    write_section_value<std::uint32_t>(file, 1);
+  }
+
+  ~Move_Log()
+  {
+    if (file.is_open()) {
+      finish();
+    }
+  }
+
+  Move_Log(const Move_Log&) = delete;
+  Move_Log& operator=(const Move_Log&) = delete;
+
+  // Record the partition moves are made from, as given by SBM::get_state().
+  // Needs to come before any moves.
+  void record_state(const std::vector<std::string>& id,
+                    const std::vector<std::string>& parent,
+                    const std::vector<int>&         level,
+                    const std::vector<std::string>& type)
+  {
+    const std::size_t         n = id.size();
+    std::vector<std::int32_t> node_nums, parent_nums, levels, type_nums;
+    node_nums.reserve(n);
+    parent_nums.reserve(n);
+    levels.reserve(n);
+    type_nums.reserve(n);
+    for (std::size_t i = 0; i < n; i++) {
+      node_nums.push_back(id_number(id[i]));
+      parent_nums.push_back(parent[i] == "none" ? -1 : id_number(parent[i]));
+      levels.push_back(level[i]);
+      type_nums.push_back(id_number(type[i]));
+    }
+
+    write_new_ids();
+    write_section_value<std::uint8_t>(file, 3);
+    write_section_value<std::uint32_t>(file, n);
+    write_section_column(file, node_nums);
+    write_section_column(file, parent_nums);
+    write_section_column(file, levels);
+    write_section_column(file, type_nums);
+    end_sections(file);
+  }
+
+  // Record a node moving to new_block. new_block_parent ("none" if it has
+  // none) is only kept the first time new_block is seen, as that's when a
+  // block created during the run gets its place in the levels above.
+  void record(const int&         sweep,
+              const std::string& node,
+              const std::string& new_block,
+              const std::string& new_block_parent)
+  {
+    sweep_col.push_back(sweep);
+    node_col.push_back(id_number(node));
+
+    const std::size_t known_ids = id_numbers.size();
+    block_col.push_back(id_number(new_block));
+    if (id_numbers.size() > known_ids) {
+      created_block_col.push_back(block_col.back());
+      created_parent_col.push_back(new_block_parent == "none" ? -1 : id_number(new_block_parent));
+    }
+    num_moves++;
+
+    if (sweep_col.size() == block_moves) {
+      write_moves();
+    }
+  }
+
+  std::uint64_t size() const { return num_moves; }
+
+  // Write out everything recorded and close the file
+  void close()
+  {
+    finish();
+    if (!file) {
+      RANGE_ERROR("Failed writing move log.");
+    }
+  }
+
+  private:
+  std::ofstream                        file;
+  std::unordered_map<std::string, int> id_numbers;
+  std::vector<std::string>             new_ids;
+  std::vector<std::int32_t>            sweep_col;
+  std::vector<std::int32_t>            node_col;
+  std::vector<std::int32_t>            block_col;
+  std::vector<std::int32_t>            created_block_col;
+  std::vector<std::int32_t>            created_parent_col;
+  std::uint64_t                        num_moves = 0;
+
+  int id_number(const std::string& id)
+  {
+    const auto inserted = id_numbers.emplace(id, id_numbers.size());
+    if (inserted.second) {
+      new_ids.push_back(id);
+    }
+    return inserted.first->second;
+  }
+
+  void finish()
+  {
+    write_moves();
+    write_new_ids();
+    write_section_value<std::uint8_t>(file, 0);
+    file.close();
+  }
+
+  void write_new_ids()
+  {
+    if (new_ids.empty()) return;
+    write_id_section(file, new_ids);
+    new_ids.clear();
+  }
+
+  void write_moves()
+  {
+    if (sweep_col.empty()) return;
+    write_new_ids();
+
+    if (!created_block_col.empty()) {
+      write_section_value<std::uint8_t>(file, 4);
+      write_section_value<std::uint32_t>(file, created_block_col.size());
+      write_section_column(file, created_block_col);
+      write_section_column(file, created_parent_col);
+      created_block_col.clear();
+      created_parent_col.clear();
+    }
+
+    write_section_value<std::uint8_t>(file, 2);
+    write_section_value<std::uint32_t>(file, sweep_col.size());
+    write_section_column(file, sweep_col);
+    write_section_column(file, node_col);
+    write_section_column(file, block_col);
+    sweep_col.clear();
+    node_col.clear();
+    block_col.clear();
+    end_sections(file);
+  }
+};
+
+// Rebuilds partitions from a log written by Move_Log. The whole log is loaded
+// up front, after which getting the state at any sweep is a single pass over
+// the moves made before it.
+class Move_Replay {
+  public:
+  explicit Move_Replay(const std::string& path)
+  {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+      RANGE_ERROR("Could not open move log " + path + ".");
+    }
+
+    char          marker[8];
+    std::uint32_t version = 0;
+    file.read(marker, 8);
+    if (!file || std::string(marker, 8) != "SBMMOVES") {
+      LOGIC_ERROR(path + " is not a move log.");
+    }
+    if (!read_section_value(file, version) || version != 1) {
+      LOGIC_ERROR("Unsupported move log version in " + path + ".");
+    }
+
+    std::uint8_t  kind = 0;
+    std::uint32_t n    = 0;
+    while (read_section_value(file, kind) && kind != 0 && read_section_value(file, n)) {
+      if (kind == 1) {
+        if (!read_id_section(file, n, ids)) break;
+      }
+      else if (kind == 3) {
+        std::vector<int> state_node, state_parent, state_level, state_type;
+        read_section_column<std::int32_t>(file, n, state_node);
+        read_section_column<std::int32_t>(file, n, state_parent);
+        read_section_column<std::int32_t>(file, n, state_level);
+        read_section_column<std::int32_t>(file, n, state_type);
+        if (!file) break;
+        if (!sweep.empty()) {
+          LOGIC_ERROR("Move log " + path + " has a starting state after its first moves.");
+        }
+        check_numbers(state_node, path);
+        check_numbers(state_parent, path, true);
+        check_numbers(state_type, path);
+
+        start_parent.assign(ids.size(), -1);
+        start_level.assign(ids.size(), -1);
+        start_type.assign(ids.size(), -1);
+        for (std::uint32_t i = 0; i < n; i++) {
+          start_parent[state_node[i]] = state_parent[i];
+          start_level[state_node[i]]  = state_level[i];
+          start_type[state_node[i]]   = state_type[i];
+        }
+      }
+      else if (kind == 4) {
+        std::vector<int> created_block, created_parent;
+        read_section_column<std::int32_t>(file, n, created_block);
+        read_section_column<std::int32_t>(file, n, created_parent);
+        if (!file) break;
+        check_numbers(created_block, path);
+        check_numbers(created_parent, path, true);
+
+        // Only takes effect once the block is moved into
+        start_parent.resize(ids.size(), -1);
+        for (std::uint32_t i = 0; i < n; i++) {
+          start_parent[created_block[i]] = created_parent[i];
+        }
+      }
+      else if (kind == 2) {
+        const std::size_t moves_before = sweep.size();
+
+        read_section_column<std::int32_t>(file, n, sweep);
+        read_section_column<std::int32_t>(file, n, node);
+        read_section_column<std::int32_t>(file, n, new_block);
+
+        if (!file) {
+          // Drop the partly read section
+          for (auto* column : { &sweep, &node, &new_block }) {
+            column->resize(moves_before);
+          }
+          break;
+        }
+      }
+      else {
+        LOGIC_ERROR("Corrupt section in move log " + path + ".");
+      }
+    }
+
+    if (start_level.empty()) {
+      LOGIC_ERROR("Move log " + path + " has no starting state.");
+    }
+    check_numbers(node, path);
+    check_numbers(new_block, path);
+  }
+
+  std::size_t num_moves() const { return sweep.size(); }
+
+  // Number of sweeps the log has moves for
+  int num_sweeps() const { return sweep.empty() ? 0 : sweep.back() + 1; }
+
+  // The partition after the first num_sweeps sweeps, or after every move if
+  // num_sweeps is negative. Has the same columns and rows as SBM::get_state()
+  // once empty blocks are cleaned out.
+  Output_Table state_after(const int& num_sweeps) const
+  {
+    const std::size_t num_ids = ids.size();
+
+    std::vector<int> parent = start_parent;
+    std::vector<int> level  = start_level;
+    std::vector<int> type   = start_type;
+    parent.resize(num_ids, -1);
+    level.resize(num_ids, -1);
+    type.resize(num_ids, -1);
+
+    for (std::size_t i = 0; i < sweep.size(); i++) {
+      if (num_sweeps >= 0 && sweep[i] >= num_sweeps) break;
+
+      // Blocks created during the run first show up as a move's destination,
+      // with their parent already given by the log's new blocks
+      if (level[new_block[i]] < 0) {
+        level[new_block[i]] = level[node[i]] + 1;
+        type[new_block[i]]  = type[node[i]];
+      }
+      parent[node[i]] = new_block[i];
+    }
+
+    // Nodes in the order get_state() gives them: by level then id
+    std::vector<int> order;
+    for (std::size_t i = 0; i < num_ids; i++) {
+      if (level[i] >= 0) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](const int& a, const int& b) {
+      return level[a] != level[b] ? level[a] < level[b] : ids[a] < ids[b];
+    });
+
+    // Blocks left without children are dropped. Going up a level at a time
+    // means every block's children are counted before it's reached.
+    std::vector<int>         num_children(num_ids, 0);
+    std::vector<std::string> id_col, parent_col, type_col;
+    std::vector<int>         level_col;
+    for (const int& i : order) {
+      if (level[i] > 0 && num_children[i] == 0) continue;
+      if (parent[i] >= 0) num_children[parent[i]]++;
+
+      id_col.push_back(ids[i]);
+      parent_col.push_back(parent[i] >= 0 ? ids[parent[i]] : "none");
+      type_col.push_back(ids[type[i]]);
+      level_col.push_back(level[i]);
+    }
+
+    Output_Table table;
+    table.add_column("id", id_col)
+        .add_column("parent", parent_col)
+        .add_column("type", type_col)
+        .add_column("level", level_col);
+    return table;
+  }
+
+  private:
+  std::vector<std::string> ids;
+  std::vector<int>         start_parent;
+  std::vector<int>         start_level;
+  std::vector<int>         start_type;
+  std::vector<int>         sweep;
+  std::vector<int>         node;
+  std::vector<int>         new_block;
+
+  void check_numbers(const std::vector<int>& numbers, const std::string& path, const bool& allow_none = false) const
+  {
+    const int lowest = allow_none ? -1 : 0;
+    for (const int& number : numbers) {
+      if (number < lowest || number >= int(ids.size())) {
+        LOGIC_ERROR("Move log " + path + " refers to an id it doesn't contain.");
+      }
+    }
+  }
+};
+
+// Load a move log and rebuild the partition after its first num_sweeps sweeps
+// (every move if negative)
+inline Output_Table replay_move_log(const std::string& path, const int& num_sweeps)
+{
+  return Move_Replay(path).state_after(num_sweeps);
+}
+
+#endif
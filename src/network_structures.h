@@ -0,0 +1,43 @@
+#ifndef __NETWORK_STRUCTURES_INCLUDED__
+#define __NETWORK_STRUCTURES_INCLUDED__
+// Tags for the type structure of a network. The sweep and merge kernels in SBM
+// are templated on one of these so the common cases skip the node type lookups
+// the general case needs. Their flags are compile time constants so branches on
+// them drop out of each specialised kernel.
+
+// How the node types of a network connect
+enum class Network_Structure {
+  unipartite, // A single node type
+  bipartite,  // Two node types with edges only running between them
+  polypartite // Anything else
+};
+
+// Every node and block is the same type. Any block at a level is a candidate
+// for a node to join and any block can be its neighbor.
+struct Unipartite_Network {
+  static constexpr bool single_type = true;
+
+  // Do the neighbors of a node's neighbors always share its type?
+  static constexpr bool neighbors_share_type = true;
+};
+
+// Two types with edges only running between them. A node's neighbors can only be
+// of the other type so the neighbors of its neighbors are all of its own type.
+struct Bipartite_Network {
+  static constexpr bool single_type          = false;
+  static constexpr bool neighbors_share_type = true;
+};
+
+// General case, the neighbors of a node's neighbors need to be filtered by type.
+struct Polypartite_Network {
+  static constexpr bool single_type          = false;
+  static constexpr bool neighbors_share_type = false;
+};
+
+// Blocks a node could be moved to and blocks its neighbors could belong to
+struct Move_Block_Counts {
+  int candidates         = 0;
+  int possible_neighbors = 0;
+};
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef __OUTPUT_TABLE_INCLUDED__
+#define __OUTPUT_TABLE_INCLUDED__
+// A small column oriented table for writing results to disk outside of R,
+// either as tab separated text or as a compact binary file. The binary format
+// is an 8 byte "SBMTABLE" marker, a 32 bit version, a 32 bit column count and
+// a 64 bit row count, then every column in turn: a one byte type (0 = 32 bit
+// int, 1 = 64 bit double, 2 = string), its name as a 32 bit length and bytes,
+// and its values. Strings are written as a 32 bit length and bytes. Numbers
+// are in the machine's byte order.
+
+#include "Node.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <vector>
+
+enum class Column_Type : std::uint8_t {
+  integer = 0,
+  number  = 1,
+  text    = 2
+};
+
+struct Table_Column {
+  std::string              name;
+  Column_Type              type;
+  std::vector<int>         integers;
+  std::vector<double>      numbers;
+  std::vector<std::string> texts;
+
+  std::size_t size() const
+  {
+    return type == Column_Type::integer ? integers.size()
+        : type == Column_Type::number   ? numbers.size()
+                                        : texts.size();
+  }
+};
+
+class Output_Table {
+  public:
+  std::vector<Table_Column> columns;
+
+  Output_Table& add_column(const std::string& name, const std::vector<int>& values)
+  {
+    new_column(name, Column_Type::integer).integers = values;
+    return *this;
+  }
+  Output_Table& add_column(const std::string& name, const std::vector<double>& values)
+  {
+    new_column(name, Column_Type::number).numbers = values;
+    return *this;
+  }
+  Output_Table& add_column(const std::string& name, const std::vector<std::string>& values)
+  {
+    new_column(name, Column_Type::text).texts = values;
+    return *this;
+  }
+
+  std::size_t num_rows() const { return columns.empty() ? 0 : columns.front().size(); }
+
+  // Write as "tsv" or "binary". Files are written next to the destination
+  // and moved into place so readers never see a partial table.
+  void write(const std::string& path, const std::string& format) const
+  {
+    if (format != "tsv" && format != "binary") {
+      LOGIC_ERROR("Unknown table format " + format + ", use tsv or binary.");
+    }
+    for (const auto& column : columns) {
+      if (column.size() != num_rows()) {
+        LOGIC_ERROR("Column " + column.name + " has a different number of rows to the rest of the table.");
+      }
+    }
+
+    const std::string temp_path = path + ".tmp";
+    {
+      std::ofstream file(temp_path, std::ios::binary);
+      if (!file) {
+        RANGE_ERROR("Could not open " + temp_path + " to write table to.");
+      }
+      if (format == "tsv") {
+        write_tsv(file);
+      }
+      else {
+        write_binary(file);
+      }
+      if (!file) {
+        RANGE_ERROR("Failed writing table to " + temp_path + ".");
+      }
+    }
+
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+      RANGE_ERROR("Could not move table into " + path + ".");
+    }
+  }
+
+  private:
+  Table_Column& new_column(const std::string& name, const Column_Type& type)
+  {
+    columns.emplace_back();
+    columns.back().name = name;
+    columns.back().type = type;
+    return columns.back();
+  }
+
+  void write_tsv(std::ofstream& file) const
+  {
+    file << std::setprecision(std::numeric_limits<double>::max_digits10);
+    for (std::size_t j = 0; j < columns.size(); j++) {
+      file << (j == 0 ? "" : "\t") << columns[j].name;
+    }
+    file << "\n";
+
+    const std::size_t n = num_rows();
+    for (std::size_t i = 0; i < n; i++) {
+      for (std::size_t j = 0; j < columns.size(); j++) {
+        const Table_Column& column = columns[j];
+        if (j > 0) file << "\t";
+        if (column.type == Column_Type::integer) {
+          file << column.integers[i];
+        }
+        else if (column.type == Column_Type::number) {
+          file << column.numbers[i];
+        }
+        else {
+          file << column.texts[i];
+        }
+      }
+      file << "\n";
+    }
+  }
+
+  template <typename T>
+  static void write_value(std::ofstream& file, const T& value)
+  {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  static void write_string(std::ofstream& file, const std::string& value)
+  {
+    write_value<std::uint32_t>(file, value.size());
+    file.write(value.data(), value.size());
+  }
+
+  void write_binary(std::ofstream& file) const
+  {
+    file.write("SBMTABLE", 8);
+    write_value<std::uint32_t>(file, 1);
+    write_value<std::uint32_t>(file, columns.size());
+    write_value<std::uint64_t>(file, num_rows());
+
+    for (const auto& column : columns) {
+      write_value<std::uint8_t>(file, static_cast<std::uint8_t>(column.type));
+      write_string(file, column.name);
+      if (column.type == Column_Type::integer) {
+        const std::vector<std::int32_t> values(column.integers.begin(), column.integers.end());
+        file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(std::int32_t));
+      }
+      else if (column.type == Column_Type::number) {
+        file.write(reinterpret_cast<const char*>(column.numbers.data()), column.numbers.size() * sizeof(double));
+      }
+      else {
+        for (const auto& value : column.texts) {
+          write_string(file, value);
+        }
+      }
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef __PARALLEL_HELPERS_INCLUDED__
+#define __PARALLEL_HELPERS_INCLUDED__
+// Small helpers for spreading independent pieces of work across threads.
+
+#include "Node.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// Resolves a requested thread count. Anything below 1 means "use all cores".
+inline int resolve_num_threads(const int& num_threads)
+{
+  if (num_threads > 0) {
+    return num_threads;
+  }
+  const int num_cores = std::thread::hardware_concurrency();
+  return num_cores > 0 ? num_cores : 1;
+}
+
+// Marks the current thread as a worker for as long as it is in scope
+struct Worker_Scope {
+  bool was_worker;
+  Worker_Scope()
+      : was_worker(in_worker_thread())
+  {
+    in_worker_thread() = true;
+  }
+  ~Worker_Scope()
+  {
+    in_worker_thread() = was_worker;
+  }
+};
+
+// Calls task(i) for every i in [0, num_tasks). Tasks are handed out in order
+// so callers that want the biggest jobs started first should sort them that
+// way. Tasks only run as workers when they're on a thread of their own. On the
+// calling thread they can warn and throw as any other code there would. Errors
+// thrown on a worker are rethrown on the calling thread once all workers have
+// stopped.
+template <typename Task>
+void parallel_for(const int num_tasks, const int num_threads, const Task& task)
+{
+  const int num_workers = std::min(resolve_num_threads(num_threads), num_tasks);
+
+  // Not worth spinning up threads, just run everything here
+  if (num_workers <= 1) {
+    for (int i = 0; i < num_tasks; i++) {
+      task(i);
+    }
+    return;
+  }
+
+  std::atomic<int>                next_task(0);
+  std::atomic<bool>               failed(false);
+  std::vector<std::exception_ptr> worker_errors(num_workers);
+  std::vector<std::thread>        workers;
+  workers.reserve(num_workers);
+
+  for (int w = 0; w < num_workers; w++) {
+    workers.emplace_back([&, w]() {
+      Worker_Scope worker_scope;
+      try {
+        for (int i = next_task++; i < num_tasks && !failed; i = next_task++) {
+          task(i);
+        }
+      }
+      catch (...) {
+        worker_errors[w] = std::current_exception();
+        failed           = true;
+      }
+    });
+  }
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  for (const auto& error : worker_errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef __PARTITION_SIMILARITY_INCLUDED__
+#define __PARTITION_SIMILARITY_INCLUDED__
+// Measures of how closely two partitions of the same nodes agree. Everything
+// comes from a single contingency table of label pairs built with one pass
+// over the nodes, so comparisons are O(N) in the number of nodes.
+
+#include "Node.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct Partition_Similarity {
+  double nmi; // Normalized mutual information, 1 for identical partitions
+  double ari; // Adjusted Rand index, 1 for identical and around 0 for chance
+  double vi;  // Variation of information in nats, 0 for identical partitions
+};
+
+// Replace arbitrary labels with integers counting up from 0 in order of first
+// appearance
+template <typename Label>
+std::vector<int> dense_labels(const std::vector<Label>& labels)
+{
+  std::unordered_map<Label, int> label_ids;
+  std::vector<int>               ids;
+  ids.reserve(labels.size());
+
+  for (const auto& label : labels) {
+    const auto id = label_ids.emplace(label, label_ids.size()).first->second;
+    ids.push_back(id);
+  }
+
+  return ids;
+}
+
+// Compare two partitions given as dense labels (see dense_labels()) of the
+// same nodes in the same order
+inline Partition_Similarity compare_partitions(const std::vector<int>& labels_a,
+                                               const std::vector<int>& labels_b)
+{
+  if (labels_a.size() != labels_b.size()) {
+    LOGIC_ERROR("Partitions being compared need to cover the same nodes.");
+  }
+  const double n = labels_a.size();
+
+  // With fewer than two nodes there is only one way to partition them and no
+  // pairs for the Rand index to count, so the partitions agree by definition
+  if (n < 2) {
+    return Partition_Similarity { 1, 1, 0 };
+  }
+
+  // Marginal sizes of every group and the joint counts of every pair of
+  // groups that share a node
+  std::vector<double>                  sizes_a;
+  std::vector<double>                  sizes_b;
+  std::unordered_map<uint64_t, double> joint_sizes;
+  joint_sizes.reserve(labels_a.size());
+
+  for (std::size_t i = 0; i < labels_a.size(); i++) {
+    const int a = labels_a[i];
+    const int b = labels_b[i];
+    if (a >= int(sizes_a.size())) sizes_a.resize(a + 1, 0);
+    if (b >= int(sizes_b.size())) sizes_b.resize(b + 1, 0);
+    sizes_a[a]++;
+    sizes_b[b]++;
+    joint_sizes[(uint64_t(a) << 32) | uint64_t(b)]++;
+  }
+
+  // Pairs of nodes that can be drawn from a group of a given size
+  const auto pairs = [](const double size) { return size * (size - 1) / 2; };
+
+  double entropy_a = 0, entropy_b = 0, pairs_a = 0, pairs_b = 0;
+  for (const double& size : sizes_a) {
+    if (size == 0) continue;
+    entropy_a -= size / n * std::log(size / n);
+    pairs_a += pairs(size);
+  }
+  for (const double& size : sizes_b) {
+    if (size == 0) continue;
+    entropy_b -= size / n * std::log(size / n);
+    pairs_b += pairs(size);
+  }
+
+  double mutual_info = 0, pairs_joint = 0;
+  for (const auto& joint : joint_sizes) {
+    const double size   = joint.second;
+    const double size_a = sizes_a[joint.first >> 32];
+    const double size_b = sizes_b[joint.first & 0xFFFFFFFF];
+    mutual_info += size / n * std::log(n * size / (size_a * size_b));
+    pairs_joint += pairs(size);
+  }
+
+  Partition_Similarity similarity;
+
+  // Mutual information over the mean of the two entropies. Two single group
+  // partitions have no entropy but agree completely.
+  const double entropy_sum = entropy_a + entropy_b;
+  similarity.nmi           = entropy_sum > 0 ? 2 * mutual_info / entropy_sum : 1;
+
+  // Rand index corrected by what matching group sizes would give by chance
+  const double expected_pairs = pairs_a * pairs_b / pairs(n);
+  const double max_pairs      = (pairs_a + pairs_b) / 2;
+  similarity.ari              = max_pairs != expected_pairs
+      ? (pairs_joint - expected_pairs) / (max_pairs - expected_pairs)
+      : 1;
+
+  similarity.vi = std::max(0.0, entropy_sum - 2 * mutual_info);
+
+  return similarity;
+}
+
+#endif
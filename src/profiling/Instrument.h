@@ -1,135 +1,546 @@
 #pragma once
+// Scope profiler writing Chrome trace (chrome://tracing) JSON.
+//
+// Timed scopes only ever touch memory owned by their own thread: each thread
+// gets a fixed size single-producer/single-consumer ring buffer that it pushes
+// finished scopes into without locking. A background thread drains all the
+// buffers to the output file every few milliseconds so file IO never happens
+// on a profiled thread. If a buffer fills faster than it is drained new events
+// are dropped (and counted) rather than blocking the thread being profiled.
+//
+// Scopes are compiled in unless NO_PROFILING is defined and are switched on and
+// off at runtime by category, either through Instrumentor::BeginSession (which
+// SBM::start_profiling calls) or by setting the SBMR_PROFILE environment
+// variable before the first model is made. While a category is off its scopes
+// cost a single load and branch. Sessions are process wide.
+//
+// Categories are given as a comma separated list, each optionally followed by
+// :N to record only every Nth scope of that category on each thread, e.g.
+// "proposal:100,merge,entropy". "all" switches on every category.
 
-#include <string>
-#include <chrono>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
-
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <vector>
+
+// What part of the engine a scope belongs to
+enum class ProfileCategory : int {
+  model,     // Building and bookkeeping of the network and its blocks
+  proposal,  // Proposing and scoring node moves in MCMC sweeps
+  merge,     // Agglomerative merging and collapsing of blocks
+  entropy,   // Full entropy calculations
+  state_io,  // Exporting and loading model state
+  consensus, // Pairwise block consensus tracking
+  num_categories
+};
+
+constexpr int NUM_PROFILE_CATEGORIES = int(ProfileCategory::num_categories);
+
+inline const char* profile_category_name(const ProfileCategory category)
+{
+  static const char* names[NUM_PROFILE_CATEGORIES] = {
+    "model", "proposal", "merge", "entropy", "state_io", "consensus"
+  };
+  return names[int(category)];
+}
+
+// Runtime switches read by every scope. Kept as static members of a class
+// template so the header alone can define them and they are constant
+// initialized: no guard is checked when reading them.
+template <typename Unused = void>
+struct ProfileSwitches {
+  static std::atomic<uint32_t> enabled;                              // Bit per category
+  static std::atomic<uint32_t> sample_every[NUM_PROFILE_CATEGORIES]; // 0 or 1 means all
+};
+template <typename Unused>
+std::atomic<uint32_t> ProfileSwitches<Unused>::enabled(0);
+template <typename Unused>
+std::atomic<uint32_t> ProfileSwitches<Unused>::sample_every[NUM_PROFILE_CATEGORIES];
+
+inline bool profile_category_enabled(const ProfileCategory category)
+{
+  return ProfileSwitches<>::enabled.load(std::memory_order_relaxed) & (1u << int(category));
+}
 
-struct ProfileResult
+// Should this scope of an enabled category be recorded under its sampling rate?
+inline bool profile_take_sample(const ProfileCategory category)
 {
-  std::string Name;
-  long long Start, End;
-  uint32_t ThreadID;
+  const uint32_t every = ProfileSwitches<>::sample_every[int(category)].load(std::memory_order_relaxed);
+  if (every <= 1) return true;
+
+  static thread_local uint32_t seen[NUM_PROFILE_CATEGORIES] = {};
+  return ++seen[int(category)] % every == 0;
+}
+
+// Which categories to record and how often
+struct ProfileSettings {
+  uint32_t categories = 0;
+  uint32_t sample_every[NUM_PROFILE_CATEGORIES] {};
+};
+
+// Parse a category list like "proposal:100,merge" into settings
+inline ProfileSettings parse_profile_spec(const std::string& spec)
+{
+  ProfileSettings settings;
+
+  std::stringstream spec_stream(spec);
+  std::string       entry;
+  while (std::getline(spec_stream, entry, ',')) {
+    entry.erase(std::remove(entry.begin(), entry.end(), ' '), entry.end());
+    if (entry.empty()) continue;
+
+    uint32_t          every     = 1;
+    const std::size_t rate_sep  = entry.find(':');
+    const std::string cat_name  = entry.substr(0, rate_sep);
+    if (rate_sep != std::string::npos) {
+      const long rate = std::strtol(entry.c_str() + rate_sep + 1, nullptr, 10);
+      if (rate < 1) {
+        throw std::invalid_argument("Profiling sample rate for " + cat_name + " must be a positive integer.");
+      }
+      every = rate;
+    }
+
+    bool matched = false;
+    for (int i = 0; i < NUM_PROFILE_CATEGORIES; i++) {
+      if (cat_name == "all" || cat_name == profile_category_name(ProfileCategory(i))) {
+        settings.categories |= 1u << i;
+        settings.sample_every[i] = every;
+        matched                  = true;
+      }
+    }
+    if (!matched) {
+      throw std::invalid_argument("Unknown profiling category " + cat_name + ". Options are all, model, proposal, merge, entropy, state_io, and consensus.");
+    }
+  }
+
+  return settings;
+}
+
+// Allocation counting. When built with SBMR_COUNT_ALLOCATIONS defined and
+// profiling/allocation_counting.cpp linked in, every call to operator new is
+// counted against the category of the innermost profiling scope the calling
+// thread is in, or against "other" outside of any scope. Handy for sizing
+// machines and catching allocation regressions in benchmarks. R builds never
+// define it as replacing operator new would reach into the whole R session.
+struct AllocationCount {
+  std::string category;
+  uint64_t    allocations;
+  uint64_t    bytes;
+};
+
+template <typename Unused = void>
+struct AllocationCounters {
+  // One slot per category plus a last one for allocations outside any scope
+  static std::atomic<uint64_t> allocations[NUM_PROFILE_CATEGORIES + 1];
+  static std::atomic<uint64_t> bytes[NUM_PROFILE_CATEGORIES + 1];
 };
+template <typename Unused>
+std::atomic<uint64_t> AllocationCounters<Unused>::allocations[NUM_PROFILE_CATEGORIES + 1];
+template <typename Unused>
+std::atomic<uint64_t> AllocationCounters<Unused>::bytes[NUM_PROFILE_CATEGORIES + 1];
+
+// Category new allocations on this thread are counted against
+inline int& allocation_phase()
+{
+  static thread_local int phase = NUM_PROFILE_CATEGORIES;
+  return phase;
+}
 
-struct InstrumentationSession
+// Called by the replacement operator new
+inline void record_allocation(const std::size_t size)
 {
-  std::string Name;
+  const int phase = allocation_phase();
+  AllocationCounters<>::allocations[phase].fetch_add(1, std::memory_order_relaxed);
+  AllocationCounters<>::bytes[phase].fetch_add(size, std::memory_order_relaxed);
+}
+
+// Was this build made with allocation counting?
+constexpr bool allocation_counting_enabled()
+{
+#if SBMR_COUNT_ALLOCATIONS
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Allocations and bytes requested by each category since the last reset
+inline std::vector<AllocationCount> allocation_counts()
+{
+  std::vector<AllocationCount> counts;
+  for (int i = 0; i <= NUM_PROFILE_CATEGORIES; i++) {
+    counts.push_back({ i < NUM_PROFILE_CATEGORIES ? profile_category_name(ProfileCategory(i)) : "other",
+                       AllocationCounters<>::allocations[i].load(std::memory_order_relaxed),
+                       AllocationCounters<>::bytes[i].load(std::memory_order_relaxed) });
+  }
+  return counts;
+}
+
+inline void reset_allocation_counts()
+{
+  for (int i = 0; i <= NUM_PROFILE_CATEGORIES; i++) {
+    AllocationCounters<>::allocations[i].store(0, std::memory_order_relaxed);
+    AllocationCounters<>::bytes[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+struct ProfileResult {
+  const char*     Name;     // Must outlive the session. Literals and __FUNCTION__ do
+  ProfileCategory Category;
+  int64_t         Start;    // Steady clock nanoseconds
+  int64_t         Duration; // Nanoseconds
 };
 
-class Instrumentor
+// Nanoseconds on a monotonic clock
+inline int64_t profile_now_ns()
 {
-private:
-  InstrumentationSession *m_CurrentSession;
-  std::ofstream m_OutputStream;
-  int m_ProfileCount;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Ring buffer of finished scopes for a single thread. Only the owning thread
+// pushes and only the drain thread pops.
+class ThreadProfileBuffer {
+  public:
+  static constexpr std::size_t Capacity = 1 << 16; // Power of two
+
+  explicit ThreadProfileBuffer(const uint32_t thread_id)
+      : ThreadID(thread_id)
+      , m_Events(std::size_t(Capacity))
+      , m_Head(0)
+      , m_CachedTail(0)
+      , m_Dropped(0)
+      , m_Tail(0)
+      , m_Retired(false)
+  {
+  }
+
+  const uint32_t ThreadID; // Stable small id in order of first profiled scope
+
+  void Push(const ProfileResult& result)
+  {
+    const std::size_t head = m_Head.load(std::memory_order_relaxed);
+    // Only go to the shared tail when the last copy of it says we're full
+    if (head - m_CachedTail >= Capacity) {
+      m_CachedTail = m_Tail.load(std::memory_order_acquire);
+      if (head - m_CachedTail >= Capacity) {
+        m_Dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+    m_Events[head & (Capacity - 1)] = result;
+    m_Head.store(head + 1, std::memory_order_release);
+  }
+
+  // Hand every buffered event to write_event, oldest first
+  template <typename Writer>
+  void Drain(Writer& write_event)
+  {
+    const std::size_t head = m_Head.load(std::memory_order_acquire);
+    std::size_t       tail = m_Tail.load(std::memory_order_relaxed);
+    for (; tail != head; tail++) {
+      write_event(m_Events[tail & (Capacity - 1)], ThreadID);
+    }
+    m_Tail.store(tail, std::memory_order_release);
+  }
+
+  uint64_t TakeDropped() { return m_Dropped.exchange(0, std::memory_order_relaxed); }
+
+  // Set when the owning thread exits so the buffer can be let go once drained
+  void Retire() { m_Retired.store(true, std::memory_order_release); }
+  bool Retired() const { return m_Retired.load(std::memory_order_acquire); }
 
-public:
+  private:
+  std::vector<ProfileResult> m_Events;
+
+  // Producer and consumer positions are padded onto their own cache lines so
+  // the two threads don't fight over them
+  char                     m_ProducerPad[64];
+  std::atomic<std::size_t> m_Head;
+  std::size_t              m_CachedTail; // Producer's last look at m_Tail
+  std::atomic<uint64_t>    m_Dropped;
+  char                     m_ConsumerPad[64];
+  std::atomic<std::size_t> m_Tail;
+  std::atomic<bool>        m_Retired;
+};
+
+using ProfileBufferPtr = std::shared_ptr<ThreadProfileBuffer>;
+
+class Instrumentor {
+  public:
   Instrumentor()
-      : m_CurrentSession(nullptr), m_ProfileCount(0)
+      : m_Active(false)
+      , m_SessionStart(0)
+      , m_ProfileCount(0)
+      , m_DroppedCount(0)
+      , m_NextThreadID(0)
   {
   }
 
-  void BeginSession(const std::string &name, const std::string &filepath = "profiling/results.json")
+  ~Instrumentor() { EndSession(); }
+
+  // Start recording scopes of the categories in spec (see top of file) to a
+  // trace file. Ends any session already running.
+  void BeginSession(const std::string& name,
+                    const std::string& filepath = "profiling/results.json",
+                    const std::string& spec     = "all")
   {
+    const ProfileSettings settings = parse_profile_spec(spec);
+
+    EndSession();
+
+    std::lock_guard<std::mutex> lock(m_SessionMutex);
     m_OutputStream.open(filepath);
-    WriteHeader();
-    m_CurrentSession = new InstrumentationSession{name};
+    if (!m_OutputStream) {
+      throw std::runtime_error("Could not open " + filepath + " to write profile to.");
+    }
+    m_OutputStream << "{\"traceEvents\":[";
+    m_ProfileCount = 0;
+    m_DroppedCount = 0;
+
+    // Throw away anything left over from scopes that finished between sessions
+    DiscardBuffered();
+
+    m_SessionName  = name;
+    m_SessionStart = profile_now_ns();
+    m_StopDrain    = false;
+    m_Active.store(true, std::memory_order_release);
+    m_DrainThread = std::thread(&Instrumentor::DrainLoop, this);
+
+    for (int i = 0; i < NUM_PROFILE_CATEGORIES; i++) {
+      ProfileSwitches<>::sample_every[i].store(settings.sample_every[i], std::memory_order_relaxed);
+    }
+    ProfileSwitches<>::enabled.store(settings.categories, std::memory_order_release);
   }
 
-  void EndSession()
+  // Start a session if the SBMR_PROFILE environment variable lists categories
+  // to record. Output goes to SBMR_PROFILE_FILE, or sbmr_profile.json, and the
+  // session runs until ended or the process exits. Only looks once.
+  static void BeginSessionFromEnvironment()
   {
-    WriteFooter();
-    m_OutputStream.close();
-    delete m_CurrentSession;
-    m_CurrentSession = nullptr;
-    m_ProfileCount = 0;
+    static const bool checked = []() {
+      const char* spec = std::getenv("SBMR_PROFILE");
+      if (spec && *spec) {
+        const char* file = std::getenv("SBMR_PROFILE_FILE");
+        Get().BeginSession("SBMR_PROFILE", file && *file ? file : "sbmr_profile.json", spec);
+      }
+      return true;
+    }();
+    (void)checked;
   }
 
-  void WriteProfile(const ProfileResult &result)
+  void EndSession()
   {
-    if (m_ProfileCount++ > 0)
-      m_OutputStream << ",";
+    std::lock_guard<std::mutex> lock(m_SessionMutex);
+    if (!m_Active.load(std::memory_order_acquire)) return;
 
-    std::string name = result.Name;
+    ProfileSwitches<>::enabled.store(0, std::memory_order_release);
+    m_Active.store(false, std::memory_order_release);
+    {
+      std::lock_guard<std::mutex> drain_lock(m_DrainMutex);
+      m_StopDrain = true;
+    }
+    m_DrainWake.notify_one();
+    m_DrainThread.join();
+
+    // Catch anything pushed after the drain thread's last pass
+    DrainAll();
+
+    std::string name = m_SessionName;
     std::replace(name.begin(), name.end(), '"', '\'');
+    m_OutputStream << "],\"displayTimeUnit\":\"ns\",\"otherData\":{"
+                   << "\"session\":\"" << name << "\","
+                   << "\"droppedEvents\":" << m_DroppedCount
+                   << "}}";
+    m_OutputStream.close();
+  }
 
-    m_OutputStream << "{";
-    m_OutputStream << "\"cat\":\"function\",";
-    m_OutputStream << "\"dur\":" << (result.End - result.Start) << ',';
-    m_OutputStream << "\"name\":\"" << name << "\",";
-    m_OutputStream << "\"ph\":\"X\",";
-    m_OutputStream << "\"pid\":0,";
-    m_OutputStream << "\"tid\":" << result.ThreadID << ",";
-    m_OutputStream << "\"ts\":" << result.Start;
-    m_OutputStream << "}";
+  bool Active() const { return m_Active.load(std::memory_order_relaxed); }
 
-    m_OutputStream.flush();
+  // Record a finished scope from the calling thread
+  void WriteProfile(const ProfileResult& result)
+  {
+    if (!Active()) return;
+    ThreadBuffer().Push(result);
   }
 
-  void WriteHeader()
+  static Instrumentor& Get()
   {
-    m_OutputStream << "{\"otherData\": {},\"traceEvents\":[";
-    m_OutputStream.flush();
+    static Instrumentor instance;
+    return instance;
   }
 
-  void WriteFooter()
+  private:
+  std::atomic<bool> m_Active;
+  std::mutex        m_SessionMutex; // Serialises Begin/EndSession
+  std::string       m_SessionName;
+  int64_t           m_SessionStart;
+  std::ofstream     m_OutputStream;
+  uint64_t          m_ProfileCount;
+  uint64_t          m_DroppedCount;
+
+  // Buffers of every thread that has recorded a scope. Only locked when a
+  // thread records its first scope and by the drain thread.
+  std::mutex                    m_BufferMutex;
+  std::vector<ProfileBufferPtr> m_Buffers;
+  uint32_t                      m_NextThreadID;
+
+  std::thread             m_DrainThread;
+  std::mutex              m_DrainMutex;
+  std::condition_variable m_DrainWake;
+  bool                    m_StopDrain;
+
+  // Keeps a thread's buffer registered for as long as the thread lives
+  struct BufferOwner {
+    ProfileBufferPtr Buffer;
+    ~BufferOwner()
+    {
+      if (Buffer) Buffer->Retire();
+    }
+  };
+
+  ThreadProfileBuffer& ThreadBuffer()
   {
-    m_OutputStream << "]}";
-    m_OutputStream.flush();
+    static thread_local BufferOwner owner;
+    if (!owner.Buffer) {
+      std::lock_guard<std::mutex> lock(m_BufferMutex);
+      owner.Buffer = std::make_shared<ThreadProfileBuffer>(m_NextThreadID++);
+      m_Buffers.push_back(owner.Buffer);
+    }
+    return *owner.Buffer;
   }
 
-  static Instrumentor &Get()
+  void DrainLoop()
   {
-    static Instrumentor instance;
-    return instance;
+    std::unique_lock<std::mutex> lock(m_DrainMutex);
+    while (!m_StopDrain) {
+      m_DrainWake.wait_for(lock, std::chrono::milliseconds(5));
+      DrainAll();
+    }
   }
-};
 
-class InstrumentationTimer
-{
-public:
-  InstrumentationTimer(const char *name)
-      : m_Name(name), m_Stopped(false)
+  // Write out everything buffered and forget buffers of threads that are gone
+  void DrainAll()
   {
-    m_StartTimepoint = std::chrono::high_resolution_clock::now();
+    auto write_event = [this](const ProfileResult& result, const uint32_t thread_id) {
+      WriteEvent(result, thread_id);
+    };
+
+    std::lock_guard<std::mutex> lock(m_BufferMutex);
+    for (auto buffer_it = m_Buffers.begin(); buffer_it != m_Buffers.end();) {
+      ThreadProfileBuffer& buffer = **buffer_it;
+      // Check before draining so no event pushed after the check is lost
+      const bool retired = buffer.Retired();
+      buffer.Drain(write_event);
+      m_DroppedCount += buffer.TakeDropped();
+      buffer_it = retired ? m_Buffers.erase(buffer_it) : buffer_it + 1;
+    }
   }
 
-  ~InstrumentationTimer()
+  void DiscardBuffered()
   {
+    auto ignore_event = [](const ProfileResult&, const uint32_t) {};
 
-    if (!m_Stopped)
-      Stop();
+    std::lock_guard<std::mutex> lock(m_BufferMutex);
+    for (auto& buffer : m_Buffers) {
+      buffer->Drain(ignore_event);
+      buffer->TakeDropped();
+    }
   }
 
-  void Stop()
+  // Chrome traces use microseconds, fractional values keep the nanoseconds
+  void WriteEvent(const ProfileResult& result, const uint32_t thread_id)
   {
-    auto endTimepoint = std::chrono::high_resolution_clock::now();
+    // Scopes opened before the session started are left out
+    const int64_t start = result.Start - m_SessionStart;
+    if (start < 0) return;
+
+    if (m_ProfileCount++ > 0) m_OutputStream << ",";
 
-    long long start = std::chrono::time_point_cast<std::chrono::microseconds>(m_StartTimepoint).time_since_epoch().count();
-    long long end = std::chrono::time_point_cast<std::chrono::microseconds>(endTimepoint).time_since_epoch().count();
+    std::string name = result.Name;
+    std::replace(name.begin(), name.end(), '"', '\'');
 
-    uint32_t threadID = std::hash<std::thread::id>{}(std::this_thread::get_id());
-    Instrumentor::Get().WriteProfile({m_Name, start, end, threadID});
+    m_OutputStream << "{\"cat\":\"" << profile_category_name(result.Category) << "\","
+                   << "\"dur\":" << result.Duration / 1000 << '.' << Fraction(result.Duration) << ','
+                   << "\"name\":\"" << name << "\","
+                   << "\"ph\":\"X\","
+                   << "\"pid\":0,"
+                   << "\"tid\":" << thread_id << ","
+                   << "\"ts\":" << start / 1000 << '.' << Fraction(start)
+                   << "}";
+  }
 
-    m_Stopped = true;
+  // Zero padded sub-microsecond digits of a nanosecond count
+  static std::string Fraction(const int64_t& ns)
+  {
+    const int64_t frac = ns % 1000;
+    return std::string(frac < 100 ? (frac < 10 ? "00" : "0") : "") + std::to_string(frac);
+  }
+};
+
+// Times the scope it lives in. Does nothing beyond checking its category's
+// switch unless that category is being recorded.
+class InstrumentationTimer {
+  public:
+  InstrumentationTimer(const char* name, const ProfileCategory category = ProfileCategory::model)
+      : m_Name(name)
+      , m_Category(category)
+      , m_Recording(false)
+      , m_Start(0)
+  {
+#if SBMR_COUNT_ALLOCATIONS
+    m_PrevPhase        = allocation_phase();
+    allocation_phase() = int(category);
+#endif
+    if (profile_category_enabled(category) && profile_take_sample(category)) {
+      m_Recording = true;
+      m_Start     = profile_now_ns();
+    }
+  }
+
+  ~InstrumentationTimer()
+  {
+    if (m_Recording) Stop();
+#if SBMR_COUNT_ALLOCATIONS
+    allocation_phase() = m_PrevPhase;
+#endif
+  }
+
+  void Stop()
+  {
+    Instrumentor::Get().WriteProfile({m_Name, m_Category, m_Start, profile_now_ns() - m_Start});
+    m_Recording = false;
   }
 
-private:
-  const char *m_Name;
-  std::chrono::time_point<std::chrono::high_resolution_clock> m_StartTimepoint;
-  bool m_Stopped;
+  private:
+  const char*     m_Name;
+  ProfileCategory m_Category;
+  bool            m_Recording;
+  int64_t         m_Start;
+#if SBMR_COUNT_ALLOCATIONS
+  int m_PrevPhase;
+#endif
 };
 
-// Enable profiling. This is set via the compile step but if it is needed to be
-// done manually this code is left in for that purpose.
-// #define PROFILING 1
-#if PROFILING
-#define PROFILE_SCOPE(name) InstrumentationTimer timer##__LINE__(name)
-#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+// Scopes are compiled in unless NO_PROFILING is defined. The category is one
+// of the ProfileCategory names, e.g. PROFILE_FUNCTION(proposal).
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#if NO_PROFILING
+#define PROFILE_SCOPE(name, category)
+#define PROFILE_FUNCTION(category)
 #else
-#define PROFILE_SCOPE(name)
-#define PROFILE_FUNCTION()
-#endif
\ No newline at end of file
+#define PROFILE_SCOPE(name, category) InstrumentationTimer PROFILE_CONCAT(timer, __LINE__)(name, ProfileCategory::category)
+#define PROFILE_FUNCTION(category) PROFILE_SCOPE(__FUNCTION__, category)
+#endif
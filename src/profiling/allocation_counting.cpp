@@ -0,0 +1,36 @@
+// Replacement global operator new/delete that count allocations against the
+// current profiling category (see Instrument.h). Only does anything when built
+// with SBMR_COUNT_ALLOCATIONS defined, and only meant to be linked into
+// standalone test and benchmark binaries, never the R package.
+
+#include "Instrument.h"
+
+#if SBMR_COUNT_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+
+void* operator new(std::size_t size)
+{
+  record_allocation(size);
+  void* ptr = std::malloc(size ? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+#endif
@@ -1,24 +1,36 @@
-// This script serves as a portal into debugging. I use it by pasting in any
-// tests that are failing and then stepping through to see what's going on.
+// Driver for profiling runs. Build with run_profiling.sh and open the
+// resulting profiling/results.json in chrome://tracing.
 
-#include <iostream>
-// #include "../helpers.h"
 #include "../SBM.h"
 #include "../cpp_tests/network_builders.cpp"
 #include "Instrument.h"
 
+#include <iostream>
 
+int main(int argc, char** argv)
+{
+  Instrumentor::Get().BeginSession("Profile", "profiling/results.json", argc > 1 ? argv[1] : "all");
 
-int main(int argc, char **argv)
-{ 
+  // Setup simulated SBM model
+  SBM my_SBM = build_bipartite_simulated();
 
-  Instrumentor::Get().BeginSession("Profile");
+  auto results = my_SBM.collapse_blocks(0, 30, 1, 5, 2, 0.1, false);
 
-  // Setup simple SBM model
-  SBM my_SBM = build_simulated_SBM();
+  Instrumentor::Get().EndSession();
 
-  auto results = my_SBM.collapse_blocks(0, 30);
+  // Where the memory sits once fitting is done
+  for (const auto& entry : my_SBM.memory_report()) {
+    std::cout << entry.structure << "\t" << entry.level << "\t" << entry.count << "\t"
+              << entry.bytes << std::endl;
+  }
+
+  // Heap requests made by each phase of the fit
+  if (allocation_counting_enabled()) {
+    for (const auto& count : allocation_counts()) {
+      std::cout << "allocations\t" << count.category << "\t" << count.allocations << "\t"
+                << count.bytes << std::endl;
+    }
+  }
 
-  Instrumentor::Get().EndSession();
   return 0;
 }
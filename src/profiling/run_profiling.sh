@@ -1,14 +1,15 @@
 OPTIMIZATION_LEVEL=-O2
 
-# Compile everything and tell compiler to enable profiling
-g++ -std=c++11 ${OPTIMIZATION_LEVEL} profiling/profile.cpp \
-    -DPROFILING=1 \
-    Node.cpp Network.cpp SBM.cpp helpers.cpp Sampler.cpp \
-    profiling/Instrument.h 
+# Compile everything. Profiling scopes are always compiled in and the driver
+# switches them on. Allocations are counted per profiling category.
+g++ -std=c++11 ${OPTIMIZATION_LEVEL} -pthread profiling/profile.cpp \
+    -DNO_RCPP=1 -DSBMR_COUNT_ALLOCATIONS=1 \
+    profiling/allocation_counting.cpp \
+    Node.cpp Block_Consensus.cpp SBM.cpp Sampler.cpp Batch_Fit.cpp Network_Sim.cpp
 
-# Run profiled code
-./a.out
+# Run profiled code. Pass a category list (see Instrument.h) to narrow down
+# what gets recorded, e.g. ./profiling/run_profiling.sh "proposal:10,merge"
+./a.out "$@"
 
 # Remove binaries
 rm ./a.out
-
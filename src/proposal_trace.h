@@ -0,0 +1,291 @@
+#ifndef __PROPOSAL_TRACE_INCLUDED__
+#define __PROPOSAL_TRACE_INCLUDED__
+// Records every move proposal made while fitting a model to a compact binary
+// file, as a much cheaper alternative to printing them with verbose = TRUE.
+// Rows are gathered into blocks of fixed width columns on the fitting thread
+// and handed to a background thread to be written, so the fitting thread never
+// formats text or waits on the disk unless it gets two blocks ahead.
+//
+// The file is an 8 byte "SBMTRACE" marker and a 32 bit version followed by
+// sections, each starting with a one byte kind:
+//   1  ids:  32 bit count, then that many ids as a 32 bit length and bytes.
+//            Ids are numbered from 0 across the whole file in the order given.
+//   2  rows: 32 bit count n, then the columns sweep, node, current_block and
+//            proposed_block (n 32 bit ints each, as id numbers apart from
+//            sweep), entropy_delta and prob_of_accept (n 64 bit doubles each),
+//            and move_accepted (n bytes).
+//   0  end of the trace.
+// Ids always come before the first rows that use them, so a trace cut short
+// can still be read up to its last full section. Numbers are in the machine's
+// byte order. binary_sections.h has the pieces shared with move_log.h.
+
+#include "binary_sections.h"
+#include "output_table.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class Proposal_Trace {
+  public:
+  // Rows gathered before a block is handed to the writer
+  static constexpr std::size_t block_rows = 1 << 16;
+
+  explicit Proposal_Trace(const std::string& path)
+      : file(path, std::ios::binary)
+  {
+    if (!file) {
+      RANGE_ERROR("Could not open " + path + " to write proposal trace to.");
+    }
+    file.write("SBMTRACE", 8);
+    write_section_value<std::uint32_t>(file, 1);
+    writer = std::thread(&Proposal_Trace::write_loop, this);
+  }
+
+  ~Proposal_Trace()
+  {
+    if (writer.joinable()) {
+      finish();
+    }
+  }
+
+  Proposal_Trace(const Proposal_Trace&) = delete;
+  Proposal_Trace& operator=(const Proposal_Trace&) = delete;
+
+  // Add a proposal to the trace. The trace can't take any more once closed.
+  void record(const int&         sweep,
+              const std::string& node,
+              const std::string& current_block,
+              const std::string& proposed_block,
+              const double&      entropy_delta,
+              const double&      prob_of_accept,
+              const bool&        accepted)
+  {
+    if (closed) {
+      LOGIC_ERROR("Proposal trace has already been closed.");
+    }
+
+    current.sweep.push_back(sweep);
+    current.node.push_back(id_number(node));
+    current.current_block.push_back(id_number(current_block));
+    current.proposed_block.push_back(id_number(proposed_block));
+    current.entropy_delta.push_back(entropy_delta);
+    current.prob_of_accept.push_back(prob_of_accept);
+    current.accepted.push_back(accepted);
+    num_rows++;
+
+    if (current.size() == block_rows) {
+      hand_off();
+    }
+  }
+
+  std::uint64_t size() const { return num_rows; }
+
+  // Write out everything recorded and close the file. Closing again does
+  // nothing more.
+  void close()
+  {
+    if (closed) return;
+    finish();
+    if (write_failed) {
+      RANGE_ERROR("Failed writing proposal trace.");
+    }
+  }
+
+  private:
+  struct Trace_Block {
+    std::vector<std::string>  new_ids;
+    std::vector<std::int32_t> sweep;
+    std::vector<std::int32_t> node;
+    std::vector<std::int32_t> current_block;
+    std::vector<std::int32_t> proposed_block;
+    std::vector<double>       entropy_delta;
+    std::vector<double>       prob_of_accept;
+    std::vector<std::uint8_t> accepted;
+
+    std::size_t size() const { return sweep.size(); }
+  };
+
+  std::ofstream                        file;
+  std::unordered_map<std::string, int> id_numbers;
+  Trace_Block                          current;
+  std::uint64_t                        num_rows = 0;
+  bool                                 closed   = false;
+
+  // Shared with the writer thread
+  std::mutex              lock;
+  std::condition_variable block_ready;
+  std::condition_variable block_taken;
+  std::deque<Trace_Block> pending;
+  bool                    closing      = false;
+  bool                    write_failed = false;
+  std::thread             writer;
+
+  int id_number(const std::string& id)
+  {
+    const auto inserted = id_numbers.emplace(id, id_numbers.size());
+    if (inserted.second) {
+      current.new_ids.push_back(id);
+    }
+    return inserted.first->second;
+  }
+
+  void hand_off()
+  {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      block_taken.wait(guard, [this] { return pending.size() < 2; });
+      pending.push_back(std::move(current));
+    }
+    block_ready.notify_one();
+    current = Trace_Block();
+  }
+
+  void finish()
+  {
+    closed = true;
+    if (current.size() > 0 || !current.new_ids.empty()) {
+      hand_off();
+    }
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      closing = true;
+    }
+    block_ready.notify_one();
+    writer.join();
+
+    write_section_value<std::uint8_t>(file, 0);
+    file.close();
+    write_failed = write_failed || !file;
+  }
+
+  void write_loop()
+  {
+    while (true) {
+      Trace_Block block;
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        block_ready.wait(guard, [this] { return closing || !pending.empty(); });
+        if (pending.empty()) {
+          return;
+        }
+        block = std::move(pending.front());
+        pending.pop_front();
+      }
+      block_taken.notify_one();
+      write_block(block);
+    }
+  }
+
+  void write_block(const Trace_Block& block)
+  {
+    if (!block.new_ids.empty()) {
+      write_id_section(file, block.new_ids);
+    }
+
+    if (block.size() > 0) {
+      write_section_value<std::uint8_t>(file, 2);
+      write_section_value<std::uint32_t>(file, block.size());
+      write_section_column(file, block.sweep);
+      write_section_column(file, block.node);
+      write_section_column(file, block.current_block);
+      write_section_column(file, block.proposed_block);
+      write_section_column(file, block.entropy_delta);
+      write_section_column(file, block.prob_of_accept);
+      write_section_column(file, block.accepted);
+    }
+
+    if (!end_sections(file)) {
+      std::lock_guard<std::mutex> guard(lock);
+      write_failed = true;
+    }
+  }
+};
+
+// Load a trace written by Proposal_Trace into a table with a row per proposal.
+// Ids are given in full. A trace that was cut short is read up to its last
+// complete section.
+inline Output_Table read_proposal_trace(const std::string& path)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    RANGE_ERROR("Could not open proposal trace " + path + ".");
+  }
+
+  char          marker[8];
+  std::uint32_t version = 0;
+  file.read(marker, 8);
+  if (!file || std::string(marker, 8) != "SBMTRACE") {
+    LOGIC_ERROR(path + " is not a proposal trace.");
+  }
+  if (!read_section_value(file, version) || version != 1) {
+    LOGIC_ERROR("Unsupported proposal trace version in " + path + ".");
+  }
+
+  std::vector<std::string> ids;
+  std::vector<int>         sweep, node, current_block, proposed_block, accepted;
+  std::vector<double>      entropy_delta, prob_of_accept;
+
+  std::uint8_t  kind = 0;
+  std::uint32_t n    = 0;
+  while (read_section_value(file, kind) && kind != 0 && read_section_value(file, n)) {
+    if (kind == 1) {
+      if (!read_id_section(file, n, ids)) break;
+    }
+    else if (kind == 2) {
+      const std::size_t rows_before = sweep.size();
+
+      read_section_column<std::int32_t>(file, n, sweep);
+      read_section_column<std::int32_t>(file, n, node);
+      read_section_column<std::int32_t>(file, n, current_block);
+      read_section_column<std::int32_t>(file, n, proposed_block);
+      read_section_column<double>(file, n, entropy_delta);
+      read_section_column<double>(file, n, prob_of_accept);
+      read_section_column<std::uint8_t>(file, n, accepted);
+
+      if (!file) {
+        // Drop the partly read section
+        for (auto* column : { &sweep, &node, &current_block, &proposed_block, &accepted }) {
+          column->resize(rows_before);
+        }
+        entropy_delta.resize(rows_before);
+        prob_of_accept.resize(rows_before);
+        break;
+      }
+    }
+    else {
+      LOGIC_ERROR("Corrupt section in proposal trace " + path + ".");
+    }
+  }
+
+  // Swap id numbers back for the ids themselves
+  const auto id_column = [&ids, &path](const std::vector<int>& numbers) -> std::vector<std::string> {
+    std::vector<std::string> column;
+    column.reserve(numbers.size());
+    for (const int& number : numbers) {
+      if (number < 0 || number >= int(ids.size())) {
+        LOGIC_ERROR("Proposal trace " + path + " refers to an id it doesn't contain.");
+      }
+      column.push_back(ids[number]);
+    }
+    return column;
+  };
+
+  Output_Table table;
+  table.add_column("sweep_num", sweep)
+      .add_column("node", id_column(node))
+      .add_column("current_block", id_column(current_block))
+      .add_column("proposed_block", id_column(proposed_block))
+      .add_column("entropy_delta", entropy_delta)
+      .add_column("prob_of_accept", prob_of_accept)
+      .add_column("move_accepted", accepted);
+  return table;
+}
+
+#endif
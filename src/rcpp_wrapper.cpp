@@ -1,3 +1,5 @@
+#include "Batch_Fit.h"
+#include "Fit_Job.h"
 #include "SBM.h"
 
 
@@ -9,8 +11,16 @@ namespace Rcpp {
   template <> SEXP wrap(const NodePtr&);
   template <> SEXP wrap(const BlockEdgeCounts&);
   template <> SEXP wrap(const MCMC_Sweeps&);
+  template <> SEXP wrap(const Sweep_Chunk&);
   template <> SEXP wrap(const CollapseResults&);
   template <> SEXP wrap(const NodeEdgeMap&);
+  template <> SEXP wrap(const BlockAssignments&);
+  template <> SEXP wrap(const NetworkFits&);
+  template <> SEXP wrap(const Engine_Stats&);
+  template <> SEXP wrap(const Memory_Report&);
+  template <> SEXP wrap(const Sim_Network&);
+  template <> SEXP wrap(const Output_Table&);
+  template <> SEXP wrap(const Job_Progress&);
 }
 
 using namespace Rcpp;
@@ -112,6 +122,28 @@ SEXP wrap(const MCMC_Sweeps& results)
                                           : "NA");
 }
 
+// Node indices are shifted to start at 1 so they can index R vectors directly
+template <>
+SEXP wrap(const Sweep_Chunk& chunk)
+{
+  std::vector<int> move_node;
+  move_node.reserve(chunk.move_node.size());
+  for (const int& node_index : chunk.move_node) {
+    move_node.push_back(node_index + 1);
+  }
+
+  return List::create(
+      _["sweeps"] = DataFrame::create(
+          _["sweep"]            = chunk.sweep,
+          _["entropy_delta"]    = chunk.entropy_delta,
+          _["num_nodes_moved"]  = chunk.num_nodes_moved,
+          _["stringsAsFactors"] = false),
+      _["moves"] = DataFrame::create(
+          _["sweep"]            = chunk.move_sweep,
+          _["node"]             = move_node,
+          _["stringsAsFactors"] = false));
+}
+
 template <>
 SEXP wrap(const CollapseResults& collapse_results)
 {
@@ -151,8 +183,298 @@ SEXP wrap(const NodeEdgeMap& node_connections)
                            _["stringsAsFactors"] = false);
 };
 
+template <>
+SEXP wrap(const BlockAssignments& assignments)
+{
+  const int n_nodes = assignments.size();
+
+  std::vector<std::string> id;
+  std::vector<std::string> block;
+  std::vector<double>      entropy_delta;
+  std::vector<double>      prob;
+  id.reserve(n_nodes);
+  block.reserve(n_nodes);
+  entropy_delta.reserve(n_nodes);
+  prob.reserve(n_nodes);
+
+  for (const auto& assignment : assignments) {
+    id.push_back(assignment.id);
+    block.push_back(assignment.best_block);
+    entropy_delta.push_back(assignment.entropy_delta);
+    prob.push_back(assignment.prob);
+  }
+
+  return DataFrame::create(_["id"]               = id,
+                           _["block"]            = block,
+                           _["entropy_delta"]    = entropy_delta,
+                           _["prob"]             = prob,
+                           _["stringsAsFactors"] = false);
+}
+
+// Batch fits come back as one row per network plus one row per node so
+// thousands of networks only cost two dataframes
+template <>
+SEXP wrap(const NetworkFits& fits)
+{
+  const int n_graphs = fits.size();
+  int       n_nodes  = 0;
+  for (const auto& fit : fits) {
+    n_nodes += fit.num_nodes;
+  }
+
+  std::vector<std::string> graph;
+  std::vector<int>         num_nodes;
+  std::vector<int>         num_edges;
+  std::vector<int>         num_blocks;
+  std::vector<double>      entropy;
+  graph.reserve(n_graphs);
+  num_nodes.reserve(n_graphs);
+  num_edges.reserve(n_graphs);
+  num_blocks.reserve(n_graphs);
+  entropy.reserve(n_graphs);
+
+  std::vector<std::string> node_graph;
+  std::vector<std::string> node_id;
+  std::vector<std::string> block;
+  node_graph.reserve(n_nodes);
+  node_id.reserve(n_nodes);
+  block.reserve(n_nodes);
+
+  for (const auto& fit : fits) {
+    graph.push_back(fit.graph);
+    num_nodes.push_back(fit.num_nodes);
+    num_edges.push_back(fit.num_edges);
+    num_blocks.push_back(fit.num_blocks);
+    entropy.push_back(fit.entropy);
+
+    node_graph.insert(node_graph.end(), fit.num_nodes, fit.graph);
+    node_id.insert(node_id.end(), fit.node_ids.begin(), fit.node_ids.end());
+    block.insert(block.end(), fit.blocks.begin(), fit.blocks.end());
+  }
+
+  return List::create(
+      _["graphs"] = DataFrame::create(_["graph"]            = graph,
+                                      _["num_nodes"]        = num_nodes,
+                                      _["num_edges"]        = num_edges,
+                                      _["num_blocks"]       = num_blocks,
+                                      _["entropy"]          = entropy,
+                                      _["stringsAsFactors"] = false),
+      _["blocks"] = DataFrame::create(_["graph"]            = node_graph,
+                                      _["id"]               = node_id,
+                                      _["block"]            = block,
+                                      _["stringsAsFactors"] = false));
+}
+
+// Counters come back as a named list of numbers. Doubles hold the nanosecond
+// timings without overflowing R's 32 bit integers.
+template <>
+SEXP wrap(const Engine_Stats& stats)
+{
+  List stats_list;
+  stats.for_each([&](const char* name, const int64_t& value) {
+    stats_list[name] = double(value);
+  });
+  return stats_list;
+}
+
+// One row per structure and level. Bytes as doubles so large models don't
+// overflow R's 32 bit integers.
+template <>
+SEXP wrap(const Memory_Report& report)
+{
+  const int n_entries = report.size();
+
+  std::vector<std::string> structure;
+  std::vector<int>         level;
+  std::vector<double>      count;
+  std::vector<double>      bytes;
+  structure.reserve(n_entries);
+  level.reserve(n_entries);
+  count.reserve(n_entries);
+  bytes.reserve(n_entries);
+
+  for (const auto& entry : report) {
+    structure.push_back(entry.structure);
+    level.push_back(entry.level);
+    count.push_back(entry.count);
+    bytes.push_back(entry.bytes);
+  }
+
+  return DataFrame::create(_["structure"]        = structure,
+                           _["level"]            = level,
+                           _["count"]            = count,
+                           _["bytes"]            = bytes,
+                           _["stringsAsFactors"] = false);
+}
+
+// Simulated networks come back as a node and an edge dataframe ready for
+// new_sbm_network(). Blocks are numbered from 1 like R indices.
+template <>
+SEXP wrap(const Sim_Network& network)
+{
+  const int num_edges = network.num_edges();
+
+  std::vector<int> blocks;
+  blocks.reserve(network.num_nodes());
+  for (const int& block : network.node_blocks) {
+    blocks.push_back(block + 1);
+  }
+
+  std::vector<std::string> from;
+  std::vector<std::string> to;
+  from.reserve(num_edges);
+  to.reserve(num_edges);
+  for (int i = 0; i < num_edges; i++) {
+    from.push_back(network.node_ids[network.edges_from[i]]);
+    to.push_back(network.node_ids[network.edges_to[i]]);
+  }
+
+  return List::create(
+      _["nodes"] = DataFrame::create(_["id"]               = network.node_ids,
+                                     _["type"]             = network.node_types,
+                                     _["block"]            = blocks,
+                                     _["stringsAsFactors"] = false),
+      _["edges"] = DataFrame::create(_["from"]             = from,
+                                     _["to"]               = to,
+                                     _["stringsAsFactors"] = false));
+}
+
+// Every column of the table becomes a column of the dataframe
+template <>
+SEXP wrap(const Output_Table& table)
+{
+  List columns;
+  for (const auto& column : table.columns) {
+    if (column.type == Column_Type::integer) {
+      columns.push_back(column.integers, column.name);
+    }
+    else if (column.type == Column_Type::number) {
+      columns.push_back(column.numbers, column.name);
+    }
+    else {
+      columns.push_back(column.texts, column.name);
+    }
+  }
+
+  // Marked as a dataframe directly so text columns are never made factors
+  columns.attr("row.names") = IntegerVector::create(NA_INTEGER, -int(table.num_rows()));
+  columns.attr("class")     = "data.frame";
+  return columns;
+}
+
+
+template <>
+SEXP wrap(const Job_Progress& progress)
+{
+  const char* status = progress.status == Job_Status::running ? "running"
+      : progress.status == Job_Status::finished              ? "finished"
+      : progress.status == Job_Status::cancelled             ? "cancelled"
+                                                              : "failed";
+
+  return List::create(
+      _["status"]     = status,
+      _["steps_done"] = progress.steps_done,
+      _["num_steps"]  = progress.num_steps,
+      _["num_blocks"] = progress.num_blocks,
+      _["seconds"]    = progress.seconds,
+      _["trace"]      = progress.trace,
+      _["error"]      = progress.error);
+}
+
 } // End RCPP namespace
 
+// =============================================================================
+// Background fit jobs. R refers to jobs by an integer id. Jobs stay registered
+// until their results are collected or they're discarded.
+// =============================================================================
+std::map<int, std::shared_ptr<Fit_Job>> fit_jobs;
+int                                     last_job_id = 0;
+
+int register_job(const std::shared_ptr<Fit_Job>& job)
+{
+  fit_jobs[++last_job_id] = job;
+  return last_job_id;
+}
+
+std::shared_ptr<Fit_Job> find_job(const int& job_id)
+{
+  const auto job_loc = fit_jobs.find(job_id);
+  if (job_loc == fit_jobs.end()) {
+    LOGIC_ERROR("No fit job with id " + std::to_string(job_id) + ". It may have been collected already.");
+  }
+  return job_loc->second;
+}
+
+// Jobs get their own seed from the model's sampler so results are
+// reproducible for a seeded model
+int start_sweep_job(SBM*          model,
+                    const int     level,
+                    const int     num_sweeps,
+                    const double  eps,
+                    const bool    variable_num_blocks,
+                    const bool    track_pairs)
+{
+  return register_job(Fit_Job::start_sweeps(*model,
+                                            level,
+                                            num_sweeps,
+                                            eps,
+                                            variable_num_blocks,
+                                            track_pairs,
+                                            model->sampler.generator()));
+}
+
+int start_collapse_run_job(SBM*                    model,
+                           const int               node_level,
+                           const int               num_mcmc_steps,
+                           const int               num_checks_per_block,
+                           const double            sigma,
+                           const double            eps,
+                           const std::vector<int>& block_nums)
+{
+  return register_job(Fit_Job::start_collapse_run(*model,
+                                                  node_level,
+                                                  num_mcmc_steps,
+                                                  num_checks_per_block,
+                                                  sigma,
+                                                  eps,
+                                                  block_nums,
+                                                  model->sampler.generator()));
+}
+
+Job_Progress fit_job_progress(const int job_id, const int first_step)
+{
+  return find_job(job_id)->progress(first_step);
+}
+
+void cancel_fit_job(const int job_id)
+{
+  find_job(job_id)->cancel();
+}
+
+// Dropping the last hold on a job cancels it and waits for its thread
+void discard_fit_job(const int job_id)
+{
+  find_job(job_id); // Unknown ids get the same error as everywhere else
+  fit_jobs.erase(job_id);
+}
+
+// Collecting a job's results waits for it and then lets it go
+List collect_sweep_job(const int job_id)
+{
+  const std::shared_ptr<Fit_Job> job = find_job(job_id);
+  fit_jobs.erase(job_id);
+  return List::create(_["results"] = job->sweep_results(),
+                      _["state"]   = job->final_state());
+}
+
+List collect_collapse_run_job(const int job_id)
+{
+  const std::shared_ptr<Fit_Job> job = find_job(job_id);
+  fit_jobs.erase(job_id);
+  return List::create(_["results"] = job->collapse_results(),
+                      _["state"]   = job->final_state());
+}
+
 RCPP_MODULE(SBM)
 {
   class_<SBM>("SBM")
@@ -184,16 +506,126 @@ RCPP_MODULE(SBM)
       .method("set_state",
               &SBM ::set_state,
               "Takes model state export as given by SBM$get_state() and returns model to specified state. This is useful for resetting model before running various algorithms such as agglomerative merging.")
+      .method("simulate_from_blocks",
+              &SBM ::simulate_from_blocks,
+              "Draws a new network from the model's blocks at a level, keeping every node's block, id, and type. Node degrees set how likely each node is to be picked as an edge end within its block. Takes the level (int), random seed (int), and if every pair of blocks should keep its current number of edges (TRUE) or draw a Poisson number with that mean (FALSE). Returns a list with a dataframe of nodes and a dataframe of edges.")
+      .method("set_degree_corrected",
+              &SBM ::set_degree_corrected,
+              "Chooses the edge model used to score partitions. TRUE (the default) uses the degree-corrected SBM and FALSE the non-degree-corrected SBM.")
+      .method("memory_report",
+              &SBM ::memory_report,
+              "Returns a dataframe of the estimated bytes used by each of the model's structures. Node objects, their edge lists, their children, and the level index are given per level. The network's edge list, connected component links, type lookup tables, the size a get_state() export would take, and what the results of the last MCMC sweep run held (sweep_results, and pair_consensus for tracked node pairs) are given with level -1.")
+      .method("get_stats",
+              &SBM ::get_stats,
+              "Returns a named list of counters of the work done fitting the model: node move proposals made, accepted, rejected, and unchanged, random-block and neighbor-block proposals, blocks created and removed, merge candidates scored, and nanoseconds spent proposing, evaluating, applying, and cleaning up after moves.")
+      .method("reset_stats",
+              &SBM ::reset_stats,
+              "Sets all the counters returned by get_stats() back to zero.")
+      .method("write_stats",
+              &SBM ::write_stats,
+              "Writes the counters returned by get_stats() to a file as a JSON object. Takes the output path. The file is replaced in a single step so readers never see a partial write.")
+      .method("start_profiling",
+              &SBM ::start_profiling,
+              "Starts recording timings of the engine's internals to a Chrome trace file (view in chrome://tracing). Takes the output path and a comma separated list of categories to record out of model, proposal, merge, entropy, state_io, and consensus (or all). Follow a category with :N to only record every Nth of its scopes, e.g. 'proposal:100,merge'. Profiling is shared by all models in the session and can also be started by setting the SBMR_PROFILE environment variable to a category list before loading any models.")
+      .method("stop_profiling",
+              &SBM ::stop_profiling,
+              "Stops recording timings and finishes writing the trace file.")
+      .method("start_proposal_trace",
+              &SBM ::start_proposal_trace,
+              "Starts recording every move proposal made by sweeps and merges to a compact binary file written by a background thread, a much faster alternative to verbose output. Takes the output path. Read the file back with read_proposal_trace().")
+      .method("stop_proposal_trace",
+              &SBM ::stop_proposal_trace,
+              "Finishes writing the proposal trace file and returns the number of proposals recorded.")
+      .method("start_move_log",
+              &SBM ::start_move_log,
+              "Starts logging every move accepted by sweeps to a compact binary file, beginning with the current state. Takes the output path. Rebuild the state at any sweep with replay_move_log(). Collapses and local, nested or component sweeps throw while a log is open.")
+      .method("stop_move_log",
+              &SBM ::stop_move_log,
+              "Finishes writing the move log file and returns the number of moves logged.")
       .method("get_entropy",
               &SBM ::get_entropy,
-              "Computes the (degree-corrected) entropy for the network at the specified level (int).")
+              "Computes the entropy for the network at the specified level (int) under the model's edge model (degree-corrected by default).")
+      .method("get_nested_entropy",
+              &SBM ::get_nested_entropy,
+              "Computes the nested entropy of the whole block hierarchy: the sum of the entropies of every level below the top level.")
+      .method("assign_new_nodes",
+              &SBM ::assign_new_nodes,
+              "Scores every block of the right type for a batch of new nodes given their edges to existing nodes without changing the model. Takes new node ids and types, the from (new node) and to (existing node) ids of their edges, the level of the nodes, and the number of threads to use. Returns a dataframe with the best block and its probability for each new node.")
+      .method("start_sweep_job",
+              &start_sweep_job,
+              "Starts mcmc_sweep on a background thread against a private copy of the model and returns a job id straight away. Takes the level (int), number of sweeps (int), eps, if new blocks can be created and empty blocks removed (boolean), and if node pairs sharing a block should be counted (boolean). Follow it with fit_job_progress() and get its results with collect_sweep_job().")
+      .method("start_collapse_run_job",
+              &start_collapse_run_job,
+              "Starts collapse_run on a background thread against a private copy of the model and returns a job id straight away. Takes the same arguments as collapse_run. Follow it with fit_job_progress() and get its results with collect_collapse_run_job().")
       .method("mcmc_sweep",
               &SBM ::mcmc_sweep,
               "Runs a single MCMC sweep across all nodes at specified level. Each node is given a chance to move blocks or stay in current block and all nodes are processed in random order. Takes the level that the sweep should take place on (int) and if new blocks blocks can be proposed and empty blocks removed (boolean).")
+      .method("mcmc_sweep_chunk",
+              &SBM ::mcmc_sweep_chunk,
+              "Runs MCMC sweeps like mcmc_sweep but returns only compact per sweep results: a dataframe of the sweep number, entropy change, and number of nodes moved of every sweep and a dataframe of the sweep number and node index (into get_sweep_node_ids()) of every move. Takes the level (int), number of sweeps (int), eps, if new blocks can be created and empty blocks removed (boolean), and the number to give the first sweep (int). Used to stream long runs in chunks: a chunk numbered on from the last carries on its node order, so the chunks make the same moves as one long run.")
+      .method("get_sweep_node_ids",
+              &SBM ::get_sweep_node_ids,
+              "Returns the ids of a level's nodes in the order mcmc_sweep_chunk indexes them by.")
+      .method("mcmc_sweep_checkpointed",
+              &SBM ::mcmc_sweep_checkpointed,
+              "Runs mcmc_sweep while a background thread saves the chain to a checkpoint file every so many sweeps or seconds and when it ends. Takes the same arguments as mcmc_sweep (minus verbose) followed by the checkpoint path, sweeps between checkpoints (int), and seconds between checkpoints (0 turns either off).")
+      .method("resume_sweeps",
+              &SBM ::resume_sweeps,
+              "Carries on a chain of sweeps from a checkpoint written by mcmc_sweep_checkpointed, making the same moves it would have gone on to make. The model must hold the same network. Takes the checkpoint path, sweeps between checkpoints (int), and seconds between checkpoints. Returns results like mcmc_sweep covering the whole chain, with nodes_moved only for the sweeps run since resuming.")
+      .method("mcmc_sweep_local",
+              &SBM ::mcmc_sweep_local,
+              "Runs MCMC sweeps over only the nodes within a hop radius of a set of seed nodes, adding the neighbors of any node that moves to the swept set. Takes the seed node ids, hop radius (int), node level (int), number of sweeps (int), eps, and if new blocks can be created and empty blocks removed (boolean).")
+      .method("mcmc_sweep_components",
+              &SBM ::mcmc_sweep_components,
+              "Runs MCMC sweeps over the data nodes of every connected component independently, largest first and spread across threads, then moves the nodes to their components' new blocks. No block can span components. Takes the number of sweeps (int), eps, if new blocks can be created and empty blocks removed (boolean), and number of threads (int). Sweep results are summed over components.")
+      .method("mcmc_sweep_nested",
+              &SBM ::mcmc_sweep_nested,
+              "Runs MCMC sweeps over every level of the block hierarchy at once, from the data nodes up, with moves scored by the change in nested entropy. Takes the number of sweeps (int) and eps.")
       .method("collapse_blocks",
               &SBM ::collapse_blocks,
               "Performs agglomerative merging on network, starting with each block has a single node down to one block per node type. Arguments are level to perform merge at (int) and number of MCMC steps to peform between each collapsing to equilibriate block. Returns list with entropy and model state at each merge.")
+      .method("collapse_components",
+              &SBM ::collapse_components,
+              "Performs agglomerative merging independently on every connected component of the network, largest first and spread across threads, then combines them into a single model state. Takes the number of MCMC steps between merges (int), desired number of blocks per component (int), merge proposals per block (int), sigma, eps, and number of threads (int).")
+      .method("collapse_hierarchy",
+              &SBM ::collapse_hierarchy,
+              "Builds a full block hierarchy by collapsing nodes into blocks, then those blocks into super-blocks, and so on until one block per type is left. Each level is collapsed to 1/block_ratio of its size with its components fit in parallel. Takes the number of MCMC steps between merges (int), block ratio, merge proposals per block (int), sigma, eps, and number of threads (int). Returns the collapse results of each level.")
       .method("collapse_run",
               &SBM ::collapse_run,
-              "Performs a sequence of block collapse steps on network. Targets a range of final blocks numbers and collapses to them and returns final result form each collapse.");
+              "Performs a sequence of block collapse steps on network. Targets a range of final blocks numbers and collapses to them and returns final result form each collapse. Each result's entropy is scored from scratch and the model is left in the result with the lowest.");
+
+  function("fit_network_batch",
+           &fit_network_batch,
+           "Fits many small networks in one call. Takes the graph id, from id, and to id of every edge, the graph id, id, and type of any explicitly typed nodes, the type for all other nodes, desired number of blocks, MCMC sweeps between merges (int), MCMC sweeps after collapsing (int), merge proposals per block (int), sigma, eps, random seed (int), and number of threads (int). Returns a list with a dataframe of per network results and a dataframe of the block of every node.");
+
+  function("fit_job_progress",
+           &fit_job_progress,
+           "Returns the progress of a background fit job as a list with its status (running, finished, cancelled, or failed), steps done and asked for, blocks left, seconds run, the trace of entropy changes (sweeps) or entropies (collapse targets) from a given step on, and any error. Takes the job id and the first step of the trace to return (int, from 0).");
+
+  function("cancel_fit_job",
+           &cancel_fit_job,
+           "Asks a background fit job to stop at its next sweep or merge step. Takes the job id.");
+
+  function("discard_fit_job",
+           &discard_fit_job,
+           "Stops a background fit job, waits for its current sweep or merge step to finish, and forgets it without collecting its results. Takes the job id.");
+
+  function("collect_sweep_job",
+           &collect_sweep_job,
+           "Waits for a background sweep job to stop and returns a list of its sweep results, as given by mcmc_sweep, and the model state it ended in. The job is forgotten afterwards.");
+
+  function("collect_collapse_run_job",
+           &collect_collapse_run_job,
+           "Waits for a background collapse run job to stop and returns a list of its collapse results, as given by collapse_run, and the model state it ended in. The job is forgotten afterwards.");
+
+  function("read_proposal_trace_file",
+           &read_proposal_trace,
+           "Reads a proposal trace file written after start_proposal_trace() into a dataframe with the sweep number, node, current block, proposed block, entropy change, acceptance probability, and if the move was accepted of every proposal.");
+  function("replay_move_log",
+           &replay_move_log,
+           "Rebuilds the state of a model after a given number of sweeps (int, negative for all) from a move log written after start_move_log(), by applying the logged moves to the starting state. Returns a dataframe like get_state() with empty blocks left out.");
+
+  function("simulate_block_network",
+           &simulate_block_network,
+           "Simulates a degree-corrected SBM network in time proportional to its number of edges. Takes the id, type, block (int, from 0), and weight of every node, the two blocks (int) and expected number of edges of every pair of blocks that share edges, if edge counts should be exactly the expected ones rather than Poisson draws, if self edges are allowed, and a random seed (int). Returns a list with a dataframe of nodes and a dataframe of edges.");
 }